@@ -26,6 +26,7 @@ add_executable(
     ${DARWIN_SOURCES}
     samples/fanomaly/AnomalyTask.cpp samples/fanomaly/AnomalyTask.hpp
     samples/fanomaly/Generator.cpp samples/fanomaly/Generator.hpp
+    toolkit/Clustering.cpp toolkit/Clustering.hpp
 )
 
 target_link_libraries(
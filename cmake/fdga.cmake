@@ -33,6 +33,7 @@ add_executable(
     samples/fdga/DGATask.cpp samples/fdga/DGATask.hpp
     samples/fdga/Generator.cpp samples/fdga/Generator.hpp
     samples/fdga/TfLiteHelper.cpp samples/fdga/TfLiteHelper.hpp
+    toolkit/InferenceScheduler.cpp toolkit/InferenceScheduler.hpp
 )
 
 target_link_libraries(
@@ -42,5 +43,10 @@ target_link_libraries(
     ${FAUP_LIBRARIES}
 )
 
+# Allows the XNNPACK delegate to be enabled in the configuration of the filter
+if(TFLITE_ENABLE_XNNPACK)
+    target_compile_definitions(${DGA_NAME} PRIVATE DARWIN_TFLITE_XNNPACK)
+endif()
+
 target_include_directories(${DGA_NAME} PUBLIC ${FAUP_INCLUDE_DIRS})
 target_include_directories(${DGA_NAME} PUBLIC samples/fdga/)
\ No newline at end of file
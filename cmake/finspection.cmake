@@ -28,14 +28,17 @@ add_executable(
     samples/finspection/ContentInspectionTask.cpp samples/finspection/ContentInspectionTask.hpp
     samples/finspection/Generator.cpp samples/finspection/Generator.hpp
     samples/finspection/data_pool.cpp samples/finspection/data_pool.hpp
+    samples/finspection/dump_writer.cpp samples/finspection/dump_writer.hpp
     samples/finspection/file_utils.cpp samples/finspection/file_utils.hpp
     samples/finspection/hash_utils.cpp samples/finspection/hash_utils.hpp
     samples/finspection/rand_utils.cpp samples/finspection/rand_utils.hpp
     samples/finspection/flow.cpp samples/finspection/flow.hpp
+    samples/finspection/flow_dispatcher.cpp samples/finspection/flow_dispatcher.hpp
     samples/finspection/packets.cpp samples/finspection/packet-utils.hpp
     samples/finspection/extract_impcap.cpp samples/finspection/extract_impcap.hpp
     samples/finspection/stream_buffer.cpp samples/finspection/stream_buffer.hpp
     samples/finspection/tcp_sessions.cpp samples/finspection/tcp_sessions.hpp
+    samples/finspection/timer_wheel.cpp samples/finspection/timer_wheel.hpp
     samples/finspection/yara_utils.cpp samples/finspection/yara_utils.hpp
     samples/finspection/packet-utils.hpp
 )
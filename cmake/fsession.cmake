@@ -9,6 +9,7 @@ add_executable(
     ${DARWIN_SOURCES}
     samples/fsession/SessionTask.cpp samples/fsession/SessionTask.hpp
     samples/fsession/Generator.cpp samples/fsession/Generator.hpp
+    toolkit/RedisNearCache.cpp toolkit/RedisNearCache.hpp
 )
 
 target_link_libraries(
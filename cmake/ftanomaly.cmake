@@ -26,7 +26,10 @@ add_executable(
     ${DARWIN_SOURCES}
     samples/ftanomaly/TAnomalyTask.cpp samples/ftanomaly/TAnomalyTask.hpp
     samples/ftanomaly/TAnomalyThreadManager.cpp samples/ftanomaly/TAnomalyThreadManager.hpp
+    samples/ftanomaly/TAnomalyFeatureWindow.cpp samples/ftanomaly/TAnomalyFeatureWindow.hpp
+    samples/ftanomaly/TAnomalyLogParser.cpp samples/ftanomaly/TAnomalyLogParser.hpp
     samples/ftanomaly/Generator.cpp samples/ftanomaly/Generator.hpp
+    toolkit/Clustering.cpp toolkit/Clustering.hpp
     toolkit/ThreadManager.cpp toolkit/ThreadManager.hpp
 )
 
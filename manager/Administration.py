@@ -61,6 +61,13 @@ class Server:
                 else:
                     response['status'] = 'KO'
                     response['errors'] = errors
+            elif cmd['type'] == 'reload_models':
+                errors = services.reload_models(cmd.get('filters', []))
+                if not errors:
+                    response['status'] = 'OK'
+                else:
+                    response['status'] = 'KO'
+                    response['errors'] = errors
             elif cmd['type'] == 'monitor':
                 response = services.monitor_all(proc_stats=cmd.get('proc_stats', []))
 
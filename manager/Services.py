@@ -13,7 +13,7 @@ from threading import Lock
 from copy import deepcopy
 from subprocess import Popen, call, TimeoutExpired
 from os import kill, remove, access, F_OK
-from signal import SIGTERM, SIGUSR1, SIGKILL
+from signal import SIGTERM, SIGUSR1, SIGHUP, SIGKILL
 from pprint import pprint
 from JsonSocket import JsonSocket
 from HeartBeat import HeartBeat
@@ -126,6 +126,17 @@ class Services:
             pid = f.readline()
         kill(int(pid), SIGUSR1)
 
+    @staticmethod
+    def _reload_with_pid_file(file):
+        """
+        Send SIGHUP signal to a program having his PID in file.
+
+        :param file: The file containing the PID a a program.
+        """
+        with open(file) as f:
+            pid = f.readline()
+        kill(int(pid), SIGHUP)
+
     @staticmethod
     def _kill_with_pid_file(file):
         """
@@ -210,6 +221,29 @@ class Services:
         if not no_lock:
             self._lock.release()
 
+    def reload_models(self, names):
+        """
+        Make the filters load their models and token maps again, without restarting them.
+        The filters keep answering with their current models until the new ones are loaded.
+
+        :param names: A list containing the names of the filters to reload, all the filters if empty.
+        :return A empty list on success. A list containing error messages on failure.
+        """
+        errors = []
+        with self._lock:
+            for n in names or self._filters.keys():
+                filter = self._filters.get(n, None)
+                if not filter:
+                    errors.append({"filter": n, "error": "Filter not existing"})
+                    continue
+                try:
+                    Services._reload_with_pid_file(filter['pid_file'])
+                    logger.info("Reload: models of filter {} reloading".format(n))
+                except Exception as e:
+                    logger.error("Cannot reload the models of filter {}: {}".format(n, e))
+                    errors.append({"filter": n, "error": str(e)})
+        return errors
+
     @staticmethod
     def stop(name, pid_file, socket_link=None):
         """
@@ -7,6 +7,7 @@
 
 #include <string>
 #include <fstream>
+#include <system_error>
 
 #include "../../toolkit/lru_cache.hpp"
 #include "base/Logger.hpp"
@@ -28,6 +29,61 @@ bool AGenerator::Configure(std::string const& configFile, const std::size_t cach
     return true;
 }
 
+void AGenerator::Reload() {
+    DARWIN_LOGGER;
+    std::lock_guard<std::mutex> lock(_reload_mutex);
+
+    if (_reloading) {
+        DARWIN_LOG_WARNING("AGenerator:: A reload is already running, ignoring the new one");
+        return;
+    }
+    // the previous reload is over
+    if (_reload_thread.joinable()) _reload_thread.join();
+
+    _reloading = true;
+    try {
+        _reload_thread = std::thread(&AGenerator::ReloadMain, this);
+    } catch (const std::system_error &e) {
+        _reloading = false;
+        DARWIN_LOG_ERROR("AGenerator:: Could not start the reload thread: " + std::string(e.what()));
+    }
+}
+
+void AGenerator::WaitReload() {
+    std::lock_guard<std::mutex> lock(_reload_mutex);
+
+    if (_reload_thread.joinable()) _reload_thread.join();
+}
+
+void AGenerator::ReloadMain() {
+    DARWIN_LOGGER;
+    bool reloaded = false;
+
+    DARWIN_LOG_INFO("AGenerator:: Reloading models...");
+    try {
+        reloaded = this->ReloadModels();
+    } catch (const std::exception &e) {
+        DARWIN_LOG_ERROR("AGenerator:: Error while reloading models: " + std::string(e.what()));
+    }
+
+    if (reloaded) {
+        if (_cache) {
+            std::unique_lock<std::mutex> lck{_cache_mutex};
+            _cache->clear();
+        }
+        DARWIN_LOG_INFO("AGenerator:: Models reloaded");
+    } else {
+        DARWIN_LOG_WARNING("AGenerator:: Models not reloaded, keeping the current ones");
+    }
+    _reloading = false;
+}
+
+bool AGenerator::ReloadModels() {
+    DARWIN_LOGGER;
+    DARWIN_LOG_INFO("AGenerator:: This filter has no model to reload");
+    return false;
+}
+
 bool AGenerator::ConfigureNetworkObject(boost::asio::io_context &context __attribute__((unused))) {
     return true;
 }
@@ -7,10 +7,13 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include "Session.hpp"
 #include "../toolkit/rapidjson/document.h"
@@ -48,6 +51,14 @@ protected:
     /// \return true if everything went right, false otherwise.
     virtual bool ConfigureAlerting(const std::string& tags) = 0;
 
+    /// Load the models of the filter again, from the files given in the configuration,
+    /// and swap them with the current ones once loaded.
+    /// Called by Reload in a background thread, the sessions keep running meanwhile.
+    /// Filters without models keep this default, which reloads nothing.
+    ///
+    /// \return true if the models were swapped, false if the current ones are kept.
+    virtual bool ReloadModels();
+
 // Final methods and abstract attributes
 public:
     /// Configure the generator from file and create cache.
@@ -59,6 +70,15 @@ public:
     Configure(std::string const& configFile,
               const std::size_t cache_size) final;
 
+    /// Reload the models of the filter in a background thread, then clear the cache
+    /// as its results were given by the previous models.
+    /// A reload requested while another one is running is ignored.
+    virtual void Reload() final;
+
+    /// Wait for the end of the running reload, if any.
+    /// Must be called before the generator is destroyed.
+    virtual void WaitReload() final;
+
 private:
     /// Open and read the configuration file.
     /// Try to load the json format of the configuration.
@@ -76,7 +96,15 @@ private:
     virtual bool ExtractCustomAlertingTags(const rapidjson::Document &configuration,
                                            std::string& tags);
 
+    /// Main function of the reload thread.
+    void ReloadMain();
+
 protected:
     std::shared_ptr<boost::compute::detail::lru_cache<xxh::hash64_t, unsigned int>> _cache; //!< The cache for already processed request
     std::mutex _cache_mutex;
+
+private:
+    std::mutex _reload_mutex; //!< Protects _reload_thread
+    std::thread _reload_thread;
+    std::atomic<bool> _reloading{false};
 };
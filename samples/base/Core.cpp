@@ -72,6 +72,8 @@ namespace darwin {
                 ret = 1;
                 raise(SIGTERM);
             }
+            // The generator must not be destroyed while reloading its models
+            gen.WaitReload();
             DARWIN_LOG_DEBUG("Core::run:: Joining monitoring thread...");
             if (t.joinable())
                 t.join();
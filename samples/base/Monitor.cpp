@@ -107,6 +107,7 @@ namespace darwin {
         message.append(std::to_string(STAT_PARSE_ERRORS));
         message.append(", \"matches\":");
         message.append(std::to_string(STAT_MATCHES));
+        message.append(darwin::stats::GetCustomStats());
         message.append("}");
 
         boost::asio::async_write(_connection, boost::asio::buffer(message),
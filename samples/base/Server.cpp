@@ -9,6 +9,7 @@
 #include <functional>
 #include <boost/bind.hpp>
 #include <boost/asio.hpp>
+#include "AlertManager.hpp"
 #include "Server.hpp"
 #include "Logger.hpp"
 #include "Stats.hpp"
@@ -21,7 +22,7 @@ namespace darwin {
                    std::size_t threshold,
                    Generator& generator)
             : _socket_path{socket_path}, _socket_next{next_filter_socket}, _output{output},
-              _io_context{}, _threshold{threshold}, _signals{_io_context},
+              _io_context{}, _threshold{threshold}, _signals{_io_context}, _reload_signals{_io_context, SIGHUP},
               _acceptor{_io_context,
                         boost::asio::local::stream_protocol::endpoint(
                                 socket_path)},
@@ -37,6 +38,9 @@ namespace darwin {
         // Start the waiting for a stopping signal
         AwaitStop();
 
+        // Start the waiting for a reload signal
+        AwaitReload();
+
         // Start accepting connections
         Accept();
     }
@@ -86,9 +90,34 @@ namespace darwin {
         SET_FILTER_STATUS(darwin::stats::FilterStatusEnum::stopping);
         DARWIN_LOG_DEBUG("Server::Handle:: Closing acceptor");
         _acceptor.close();
+        _reload_signals.cancel();
         _io_context.stop();
     }
 
+    void Server::AwaitReload() {
+        _reload_signals.async_wait(
+                boost::bind(&Server::HandleReload, this,
+                            boost::asio::placeholders::error,
+                            boost::asio::placeholders::signal_number));
+    }
+
+    void Server::HandleReload(boost::system::error_code const& error, int sig __attribute__((unused))) {
+        DARWIN_LOGGER;
+
+        // cancelled when the server stops
+        if (error) return;
+
+        // SIGHUP used to only rotate the logs, it still does
+        DARWIN_LOG_INFO("Server::HandleReload:: Rotating logs...");
+        log.RotateLogs();
+        darwin::AlertManager::instance().Rotate();
+
+        DARWIN_LOG_INFO("Server::HandleReload:: Reload requested");
+        // the models are loaded by another thread, the sessions keep being served meanwhile
+        _generator.Reload();
+        AwaitReload();
+    }
+
     void Server::Accept() {
         _acceptor.async_accept(_new_connection,
                 boost::bind(&Server::HandleAccept, this,
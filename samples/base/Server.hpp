@@ -60,6 +60,14 @@ namespace darwin {
         /// \param sig The received signal.
         void HandleStop(boost::system::error_code const& error, int sig);
 
+        /// Start async waiting for the reload signal.
+        void AwaitReload();
+
+        /// Handler called when the reload signal is received, rotates the logs and starts reloading the models.
+        ///
+        /// \param sig The received signal.
+        void HandleReload(boost::system::error_code const& error, int sig);
+
         /// Start an async connection acceptation on _new_session's socket.
         void Accept();
 
@@ -73,6 +81,7 @@ namespace darwin {
         boost::asio::io_context _io_context; //!< The async io context.
         std::size_t _threshold; //!< Filter's threshold
         boost::asio::signal_set _signals; //!< Set of the stopping signals.
+        boost::asio::signal_set _reload_signals; //!< Set of the signals reloading the models.
         boost::asio::local::stream_protocol::acceptor _acceptor; //!< Acceptor for the incoming connections.
         boost::asio::local::stream_protocol::socket _new_connection; //!< Socket used to accept a new connection.
         Generator& _generator; //!< Generator used to create new Sessions.
@@ -5,6 +5,9 @@
 /// \license  GPLv3
 /// \brief    Copyright (c) 2018 Advens. All rights reserved.
 
+#include <mutex>
+#include <vector>
+
 #include "Stats.hpp"
 
 namespace darwin {
@@ -16,5 +19,25 @@ namespace darwin {
         std::atomic_uint_fast64_t received;
         std::atomic_uint_fast64_t parseError;
         std::atomic_uint_fast64_t matchCount;
+
+        namespace {
+            std::mutex customStatsMutex;
+            std::vector<std::pair<std::string, std::function<std::string()>>> customStats;
+        }
+
+        void AddCustomStats(const std::string &name, std::function<std::string()> getter) {
+            std::lock_guard<std::mutex> lock(customStatsMutex);
+            customStats.emplace_back(name, std::move(getter));
+        }
+
+        std::string GetCustomStats() {
+            std::string result;
+            std::lock_guard<std::mutex> lock(customStatsMutex);
+
+            for (const auto &stats : customStats) {
+                result += ", \"" + stats.first + "\": " + stats.second();
+            }
+            return result;
+        }
     }
 }
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <atomic>
+#include <functional>
 #include <string>
 
 namespace darwin {
@@ -20,6 +21,17 @@ namespace darwin {
         extern std::atomic_uint_fast64_t received;
         extern std::atomic_uint_fast64_t parseError;
         extern std::atomic_uint_fast64_t matchCount;
+
+        /// Registers filter specific statistics, added to the monitoring data
+        ///
+        /// \param name The key under which the statistics are reported
+        /// \param getter A function returning the statistics as a valid JSON value, called on each monitoring request
+        void AddCustomStats(const std::string &name, std::function<std::string()> getter);
+
+        /// Get all the registered filter specific statistics
+        ///
+        /// \return A string with a ', "name": value' part for each registered statistics, empty if there is none
+        std::string GetCustomStats();
     }
 }
 
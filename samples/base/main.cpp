@@ -21,6 +21,7 @@ void rotateLogsHandler(int signum __attribute__((unused))) {
 
 int main(int ac, char**av) {
     signal(SIGUSR1, rotateLogsHandler);
+    // Once the server runs, SIGHUP also reloads the models, see Server::HandleReload
     signal(SIGHUP, rotateLogsHandler);
 
     DARWIN_LOGGER;
@@ -11,6 +11,7 @@
 
 #include "../toolkit/rapidjson/document.h"
 #include "../../toolkit/lru_cache.hpp"
+#include "../../toolkit/Clustering.hpp"
 #include "AnomalyTask.hpp"
 #include "Logger.hpp"
 #include "Stats.hpp"
@@ -55,84 +56,72 @@ bool AnomalyTask::Detection(){
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("AnomalyTask::Detection:: Start detection ...");
     double epsilon = 100;
-    const size_t newDataDimension = 2, sizePoint = 5;
+    const size_t sizePoint = 5;
+    const std::size_t points = _matrix.n_cols;
 
-    arma::Mat<size_t> neighbors;
-    arma::Row<size_t> assignments;
-    arma::uvec index_anomalies, index_no_anomalies;
-    arma::mat anomalies, no_anomalies, distances, alerts;
+    std::vector<double> projected(2 * points);
+    std::vector<std::size_t> assignments, index_anomalies;
+    std::vector<double> distances;
 
-    mlpack::pca::PCA<> pcaa;
-    mlpack::dbscan::DBSCAN<> db(epsilon, sizePoint);
+    // reduce matrix' dimension from 5 to 2, _matrix keeps the features for the alerts
+    darwin::toolkit::clustering::Pca2D(_matrix.memptr(), _matrix.n_rows, points, projected.data());
+    darwin::toolkit::clustering::Dbscan2D(projected.data(), points, epsilon, sizePoint, assignments);
 
-    alerts = _matrix;
-
-    // reduce matrix' dimension from 5 to 2
-    pcaa.Apply(_matrix, newDataDimension);
-    db.Cluster(_matrix, assignments);
-
-    no_anomalies = _matrix;
-    anomalies    = _matrix;
-
-    index_anomalies = arma::find(assignments == SIZE_MAX); // index of noises find by the clustering in the _matrix
-    if (index_anomalies.is_empty()){
+    // index of noises find by the clustering in the _matrix
+    for (std::size_t i = 0; i < points; ++i) {
+        if (assignments[i] == darwin::toolkit::clustering::NOISE) index_anomalies.push_back(i);
+    }
+    if (index_anomalies.empty()){
         DARWIN_LOG_DEBUG("AnomalyTask::Detection:: No anomalies found");
         _certitudes.push_back(0);
         return false;
     }
-    no_anomalies.shed_cols(index_anomalies); // suppress noisy columns, keep only normals data
-    index_no_anomalies = arma::find(assignments != SIZE_MAX); // index noises find by the clustering in the _matrix
-    anomalies.shed_cols(index_no_anomalies); // suppress non noisy-columns, keep only abnormal data
 
     //calculate distance between an abnormal ip and the nearest normal cluster
-    mlpack::neighbor::NeighborSearch<mlpack::neighbor::NearestNeighborSort ,
-            mlpack::metric::EuclideanDistance> ns(no_anomalies);
-    ns.Search(anomalies, 1, neighbors, distances);
-
-    alerts.shed_cols(index_no_anomalies);
-    // add distance to alerts
-    alerts.insert_rows(DISTANCE, distances);
+    darwin::toolkit::clustering::NearestClusterDistances(projected.data(), points, assignments, index_anomalies, distances);
 
     STAT_MATCH_INC;
     _certitudes.push_back(100);
 
-    GenerateAlerts(_ips, index_anomalies, alerts);
+    GenerateAlerts(index_anomalies, distances);
     if(GetOutputType() == darwin::config::output_type::LOG){
-        GenerateLogs(_ips, index_anomalies, alerts);
+        GenerateLogs(index_anomalies, distances);
     }
     return true;
 }
 
-void AnomalyTask::GenerateAlerts(std::vector<std::string> ips, arma::uvec index_anomalies, arma::mat alerts){
-    for(unsigned int i=0; i<index_anomalies.n_rows; i++){
+void AnomalyTask::GenerateAlerts(const std::vector<std::size_t> &index_anomalies, const std::vector<double> &distances){
+    for(std::size_t i=0; i<index_anomalies.size(); i++){
+        std::size_t column = index_anomalies[i];
         std::string details;
-        details = R"({"ip": ")" + ips[index_anomalies(i)] + "\",";
-        details += R"("udp_nb_host": )" + std::to_string(alerts(UDP_NB_HOST, i)) + ",";
-        details += R"("udp_nb_port": )" + std::to_string(alerts(UDP_NB_PORT, i)) + ",";
-        details += R"("tcp_nb_host": )" + std::to_string(alerts(TCP_NB_HOST, i)) + ",";
-        details += R"("tcp_nb_port": )" + std::to_string(alerts(TCP_NB_PORT, i)) + ",";
-        details += R"("icmp_nb_host": )" + std::to_string(alerts(ICMP_NB_HOST, i)) + ",";
-        details += R"("distance": )" + std::to_string(alerts(DISTANCE, i));
+        details = R"({"ip": ")" + _ips[column] + "\",";
+        details += R"("udp_nb_host": )" + std::to_string(_matrix(UDP_NB_HOST, column)) + ",";
+        details += R"("udp_nb_port": )" + std::to_string(_matrix(UDP_NB_PORT, column)) + ",";
+        details += R"("tcp_nb_host": )" + std::to_string(_matrix(TCP_NB_HOST, column)) + ",";
+        details += R"("tcp_nb_port": )" + std::to_string(_matrix(TCP_NB_PORT, column)) + ",";
+        details += R"("icmp_nb_host": )" + std::to_string(_matrix(ICMP_NB_HOST, column)) + ",";
+        details += R"("distance": )" + std::to_string(distances[i]);
         details += "}";
-        DARWIN_ALERT_MANAGER.Alert(ips[index_anomalies(i)], 100, Evt_idToString(), details);
+        DARWIN_ALERT_MANAGER.Alert(_ips[column], 100, Evt_idToString(), details);
     }
 }
 
-void AnomalyTask::GenerateLogs(std::vector<std::string> ips, arma::uvec index_anomalies, arma::mat alerts){
+void AnomalyTask::GenerateLogs(const std::vector<std::size_t> &index_anomalies, const std::vector<double> &distances){
 
-    for(unsigned int i=0; i<index_anomalies.n_rows; i++){
+    for(std::size_t i=0; i<index_anomalies.size(); i++){
+        std::size_t column = index_anomalies[i];
         std::string alert_log;
         alert_log = R"({"evt_id": ")" + Evt_idToString();
         alert_log += R"(", "time": ")" + darwin::time_utils::GetTime();
         alert_log += R"(", "filter": ")" + GetFilterName();
         alert_log += R"(", "anomaly": {)";
-        alert_log += R"("ip": ")" + ips[index_anomalies(i)] + "\",";
-        alert_log += R"("udp_nb_host": )" + std::to_string(alerts(UDP_NB_HOST, i)) + ",";
-        alert_log += R"("udp_nb_port": )" + std::to_string(alerts(UDP_NB_PORT, i)) + ",";
-        alert_log += R"("tcp_nb_host": )" + std::to_string(alerts(TCP_NB_HOST, i)) + ",";
-        alert_log += R"("tcp_nb_port": )" + std::to_string(alerts(TCP_NB_PORT, i)) + ",";
-        alert_log += R"("icmp_nb_host": )" + std::to_string(alerts(ICMP_NB_HOST, i)) + ",";
-        alert_log += R"("distance": )" + std::to_string(alerts(DISTANCE, i));
+        alert_log += R"("ip": ")" + _ips[column] + "\",";
+        alert_log += R"("udp_nb_host": )" + std::to_string(_matrix(UDP_NB_HOST, column)) + ",";
+        alert_log += R"("udp_nb_port": )" + std::to_string(_matrix(UDP_NB_PORT, column)) + ",";
+        alert_log += R"("tcp_nb_host": )" + std::to_string(_matrix(TCP_NB_HOST, column)) + ",";
+        alert_log += R"("tcp_nb_port": )" + std::to_string(_matrix(TCP_NB_PORT, column)) + ",";
+        alert_log += R"("icmp_nb_host": )" + std::to_string(_matrix(ICMP_NB_HOST, column)) + ",";
+        alert_log += R"("distance": )" + std::to_string(distances[i]);
         alert_log += "}}";
         _logs += alert_log + '\n';
     }
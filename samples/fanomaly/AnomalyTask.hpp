@@ -9,9 +9,6 @@
 
 #include <string>
 #include <mlpack/core.hpp>
-#include <mlpack/methods/pca/pca.hpp>
-#include <mlpack/methods/dbscan/dbscan.hpp>
-#include <mlpack/methods/neighbor_search/neighbor_search.hpp>
 
 #include "protocol.h"
 #include "Session.hpp"
@@ -45,10 +42,14 @@ protected:
 
 private:
     /// Generate the logs from the anomalies found
-    void GenerateLogs(std::vector<std::string> ips, arma::uvec index_anomalies, arma::mat alerts);
+    /// \param index_anomalies the columns of the anomalies in _matrix
+    /// \param distances the distance of each anomaly to the nearest normal cluster
+    void GenerateLogs(const std::vector<std::size_t> &index_anomalies, const std::vector<double> &distances);
 
     /// Generate the alerts from the anomalies found
-    void GenerateAlerts(std::vector<std::string> ips, arma::uvec index_anomalies, arma::mat alerts);
+    /// \param index_anomalies the columns of the anomalies in _matrix
+    /// \param distances the distance of each anomaly to the nearest normal cluster
+    void GenerateAlerts(const std::vector<std::size_t> &index_anomalies, const std::vector<double> &distances);
 
     /// The anomaly detection function
     bool Detection();
@@ -63,7 +64,6 @@ private:
     static constexpr int TCP_NB_HOST  = 2;
     static constexpr int TCP_NB_PORT  = 3;
     static constexpr int ICMP_NB_HOST = 4;
-    static constexpr int DISTANCE     = 5;
 
     static constexpr int MIN_DATA     = 10;
 
@@ -16,7 +16,13 @@
 BufferThread::BufferThread(std::shared_ptr<AConnector> output) :
                 AThread(output->GetInterval()),
                 _connector(output),
-                _redis_lists(output->GetRedisLists()) {}
+                _redis_lists(output->GetRedisLists()) {
+    this->_connector->SetFlushNotifier([this]() { this->Notify(); });
+}
+
+BufferThread::~BufferThread() {
+    this->_connector->SetFlushNotifier(nullptr);
+}
 
 
 bool BufferThread::Main() {
@@ -36,12 +42,13 @@ bool BufferThread::Main() {
             DARWIN_LOG_ERROR("BufferThread::Main:: Error when querying Redis on list: " + redis_list + " for source: '" + redis_config.first + "'");
             continue;
         } else {
-            if (not _connector->SendToFilter(logs)) {
-                DARWIN_LOG_INFO("BufferThread::Main:: unable to send data to next filter, reinserting logs in redis ...");
-                this->_connector->REDISReinsertLogs(logs, redis_list);
-            } else {
-                DARWIN_LOG_DEBUG("BufferThread::Main:: Removed " + std::to_string(logs.size()) + " elements from redis");
+            std::size_t nb_logs = logs.size();
+            std::vector<std::string> failed_logs;
+            if (not _connector->SendToFilter(logs, failed_logs)) {
+                DARWIN_LOG_INFO("BufferThread::Main:: unable to send " + std::to_string(failed_logs.size()) + " logs to next filter, reinserting them in redis ...");
+                this->_connector->REDISReinsertLogs(failed_logs, redis_list);
             }
+            DARWIN_LOG_DEBUG("BufferThread::Main:: Removed " + std::to_string(nb_logs - failed_logs.size()) + " elements from redis");
         }
     }
 
@@ -22,17 +22,19 @@ class BufferThread : public AThread {
     
     public:
     ///\brief Unique constructor, needs an AConnector to setup BufferThread fields and to send interval to AThread
+    /// Registers itself on the connector to be notified as soon as a list has enough entries.
     ///
     ///\param output The connector needed to perform output Filter related actions.
     BufferThread(std::shared_ptr<AConnector> output);
 
-    ///\brief virtual default destructor
-    virtual ~BufferThread() override = default;
+    ///\brief virtual destructor, unregisters from the connector
+    virtual ~BufferThread() override;
 
     private:
-    ///\brief Entry point (called by AThread's ThreadMain function) every _interval seconds.
+    ///\brief Entry point (called by AThread's ThreadMain function) every _interval seconds,
+    /// or as soon as the connector notifies that a list reached the required number of logs.
     /// Must override AThread's Main function.
-    /// This function checks on Redis if there is enough logs on the associated _redis_list. (Given by Connector)
+    /// This function checks if there is enough logs on the associated _redis_list. (Given by Connector)
     /// If needed, it tries to pick the logs in REDIS.
     /// On success it sends them to the output Filter.
     /// On failure, it reinserts the logs into REDIS.
@@ -5,6 +5,7 @@
 /// \license  GPLv3
 /// \brief    Copyright (c) 2020 Advens. All rights reserved.
 
+#include <algorithm>
 #include <boost/bind.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
@@ -17,13 +18,17 @@
 #include "protocol.h"
 #include "BufferTask.hpp"
 
-AConnector::AConnector(boost::asio::io_context &context, darwin::outputType filter_type, std::string &filter_socket_path, unsigned int interval, std::vector<std::pair<std::string, std::string>> &redis_lists, unsigned int required_log_lines) :
+AConnector::AConnector(boost::asio::io_context &context __attribute__((unused)), darwin::outputType filter_type, std::string &filter_socket_path, unsigned int interval, std::vector<std::pair<std::string, std::string>> &redis_lists, unsigned int required_log_lines) :
                         _filter_type(std::move(filter_type)),
                         _filter_socket_path(std::move(filter_socket_path)),
-                        _filter_socket(context),
+                        _filter_socket(_io_service),
                         _interval(interval),
                         _redis_lists(redis_lists),
-                        _required_log_lines(required_log_lines) {}
+                        _required_log_lines(required_log_lines) {
+    for (const auto &redis_config : this->_redis_lists) {
+        this->_ready_entries[redis_config.second] = 0;
+    }
+}
 
 unsigned int AConnector::GetInterval() const {
     return this->_interval;
@@ -37,6 +42,26 @@ std::vector<std::pair<std::string, std::string>> AConnector::GetRedisLists() con
     return this->_redis_lists;
 }
 
+void AConnector::SetFlushNotifier(std::function<void()> notifier) {
+    std::lock_guard<std::mutex> lock(this->_flush_notifier_mutex);
+    this->_flush_notifier = std::move(notifier);
+}
+
+void AConnector::UpdateReadyEntries(const std::string &list_name, long long int count, bool notify) {
+    auto it = this->_ready_entries.find(list_name);
+    if (it == this->_ready_entries.end() or count == 0)
+        return;
+
+    long long int previous = it->second.fetch_add(count);
+
+    // Only notify when crossing the threshold, a failed sending will be retried on the next interval
+    if (notify and previous < this->_required_log_lines and previous + count >= this->_required_log_lines) {
+        std::lock_guard<std::mutex> lock(this->_flush_notifier_mutex);
+        if (this->_flush_notifier)
+            this->_flush_notifier();
+    }
+}
+
 bool AConnector::ParseData(std::string fieldname) {
     DARWIN_LOGGER;
     if (this->_input_line.find(fieldname) == this->_input_line.end()) {
@@ -81,6 +106,7 @@ bool AConnector::PrepareKeysInRedis(){
                 if(redis.Query(std::vector<std::string>{"DEL", redis_list}) != REDIS_REPLY_INTEGER) {
                     DARWIN_LOG_WARNING("SumConnector::PrepareKeysInRedis:: could not reset the key");
                 }
+                this->_ready_entries[redis_list] = 0;
             }
         }
     }
@@ -100,10 +126,12 @@ bool AConnector::REDISAddEntry(const std::string &entry, const std::string &list
     arguments.emplace_back(list_name);
     arguments.emplace_back(entry);
 
-    if(redis.Query(arguments, true) != REDIS_REPLY_INTEGER) {
+    long long int added;
+    if(redis.Query(arguments, added, true) != REDIS_REPLY_INTEGER) {
         DARWIN_LOG_ERROR("AConnector::REDISAddEntry:: Not the expected Redis response, impossible to add to " + list_name + " redis list.");
         return false;
     }
+    this->UpdateReadyEntries(list_name, added, true);
     return true;
 }
 
@@ -120,67 +148,61 @@ bool AConnector::REDISReinsertLogs(std::vector<std::string> &logs, const std::st
     for (const auto &log : logs)
         arguments.emplace_back(log);
 
-    if(redis.Query(arguments, true) != REDIS_REPLY_INTEGER) {
+    long long int added;
+    if(redis.Query(arguments, added, true) != REDIS_REPLY_INTEGER) {
         DARWIN_LOG_ERROR("AConnector::REDISReinsertLogs:: Not the expected Redis response, impossible to add to " + list_name + " redis list.");
         return false;
     }
+    this->UpdateReadyEntries(list_name, added, false);
 
     return true;
 }
 
 long long int AConnector::REDISListLen(const std::string &list_name) noexcept {
     DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("AConnector::REDISListLen:: Querying Redis for list size...");
-
-    long long int result;
-
-    darwin::toolkit::RedisManager& redis = darwin::toolkit::RedisManager::GetInstance();
 
-    if(redis.Query(std::vector<std::string>{"SCARD", list_name}, result, true) != REDIS_REPLY_INTEGER) {
-        DARWIN_LOG_ERROR("AConnector::REDISListLen:: Not the expected Redis response");
+    auto it = this->_ready_entries.find(list_name);
+    if (it == this->_ready_entries.end()) {
+        DARWIN_LOG_ERROR("AConnector::REDISListLen:: Unknown redis list " + list_name);
         return -1;
     }
-    return result;
+    // Might be transiently negative if an entry is popped before its addition was accounted
+    return std::max(it->second.load(), 0LL);
 }
 
 bool AConnector::REDISPopLogs(long long int len, std::vector<std::string> &logs, const std::string &list_name) noexcept {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("AConnector::REDISPopLogs:: Querying Redis for logs...");
 
-    std::any result;
-    std::vector<std::any> result_vector;
+    size_t popped = 0;
 
     darwin::toolkit::RedisManager& redis = darwin::toolkit::RedisManager::GetInstance();
 
-    if(redis.Query(std::vector<std::string>{"SPOP", list_name, std::to_string(len)}, result, true) != REDIS_REPLY_ARRAY) {
-        DARWIN_LOG_ERROR("AConnector::REDISPopLogs:: Not the expected Redis response");
-        return false;
-    }
+    // parse the popped logs in place, without intermediate copies
+    auto parse_logs = [&logs, &popped](const darwin::toolkit::RedisReplyView& reply) {
+        if(not reply.IsArray())
+            return;
+        logs.reserve(logs.size() + reply.Size());
+        for(const auto& element : reply) {
+            popped++;
+            if(element.IsString())
+                logs.emplace_back(element.String());
+        }
+    };
 
-    try {
-        result_vector = std::any_cast<std::vector<std::any>>(result);
-    }
-    catch (const std::bad_any_cast&) {
-        DARWIN_LOG_ERROR("AConnector:REDISPopLogs:: Impossible to cast redis response into a vector.");
+    if(redis.Query(std::vector<std::string>{"SPOP", list_name, std::to_string(len)}, parse_logs, true) != REDIS_REPLY_ARRAY) {
+        DARWIN_LOG_ERROR("AConnector::REDISPopLogs:: Not the expected Redis response");
         return false;
     }
 
-    DARWIN_LOG_DEBUG("AConnector::REDISPopLogs:: Got " + std::to_string(result_vector.size()) + " entries from Redis");
-
-    for(auto& object : result_vector) {
-        try {
-            logs.emplace_back(std::any_cast<std::string>(object));
-        }
-        catch(const std::bad_any_cast&) {
-            DARWIN_LOG_WARNING("AConnector::REDISPopLogs:: Impossible to cast one element of the redis response into a string, log ignored.");
-        }
-    }
+    DARWIN_LOG_DEBUG("AConnector::REDISPopLogs:: Got " + std::to_string(popped) + " entries from Redis");
+    this->UpdateReadyEntries(list_name, -static_cast<long long int>(popped), false);
 
     return true;
 }
 
 bool AConnector::FormatDataToSendToFilter(std::vector<std::string> &logs, std::string &res) {
-    res = "[[";
+    res += "[[";
 
     for (size_t i = 0; i < logs.size(); i++) {
         if (i != 0)
@@ -191,78 +213,159 @@ bool AConnector::FormatDataToSendToFilter(std::vector<std::string> &logs, std::s
     return true;
 }
 
-bool AConnector::SendToFilter(std::vector<std::string> &logs) {
+void AConnector::SetChunkSize(unsigned int chunk_size) {
+    this->_chunk_size = chunk_size;
+}
+
+bool AConnector::SendToFilter(std::vector<std::string> &logs, std::vector<std::string> &failed_logs) {
     DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("AConnector::SendToFilter:: Sending logs to connected filter");
+    DARWIN_LOG_DEBUG("AConnector::SendToFilter:: Sending " + std::to_string(logs.size()) + " logs to connected filter");
 
-    // Format data
-    std::string data;
-    if (not FormatDataToSendToFilter(logs, data))
-        return false;
+    std::size_t chunk_size = this->_chunk_size == 0 ? logs.size() : this->_chunk_size;
+    std::vector<std::string> chunk;
+
+    for (auto it = logs.begin(); it != logs.end(); ) {
+        auto chunk_end = it + std::min(chunk_size, static_cast<std::size_t>(logs.end() - it));
+        chunk.assign(std::make_move_iterator(it), std::make_move_iterator(chunk_end));
+        it = chunk_end;
+
+        if (not this->_filter_socket.is_open() and not this->ConnectToFilter()) {
+            // No need to try the remaining chunks, keep them for the next sending
+            failed_logs.insert(failed_logs.end(), std::make_move_iterator(chunk.begin()), std::make_move_iterator(chunk.end()));
+            failed_logs.insert(failed_logs.end(), std::make_move_iterator(it), std::make_move_iterator(logs.end()));
+            break;
+        }
+
+        if (not this->SendChunk(chunk)) {
+            failed_logs.insert(failed_logs.end(), std::make_move_iterator(chunk.begin()), std::make_move_iterator(chunk.end()));
+        }
+    }
+    logs.clear();
 
-    // Connect to socket
-    DARWIN_LOG_DEBUG("AConnector::SendToFilter:: Trying to connect to: " +
+    return failed_logs.empty();
+}
+
+bool AConnector::ConnectToFilter() {
+    DARWIN_LOGGER;
+    DARWIN_LOG_DEBUG("AConnector::ConnectToFilter:: Trying to connect to: " +
                      this->_filter_socket_path);
     try {
         this->_filter_socket.connect(
             boost::asio::local::stream_protocol::endpoint(
                         this->_filter_socket_path.c_str()));
     } catch (std::exception const& e) {
-        DARWIN_LOG_ERROR(std::string("AConnector::SendToFilter:: "
+        DARWIN_LOG_ERROR(std::string("AConnector::ConnectToFilter:: "
                                      "Unable to connect to output filter: ") +
                          e.what());
+        this->_filter_socket.close();
         return false;
     }
+    return true;
+}
 
-    // Prepare packet
-    DARWIN_LOG_DEBUG("AConnector::SendToFilter:: data to send: " + data + ", data size: " + std::to_string(data.size()));
-    /*
-     * Allocate the header +
-     * the size of the certitude -
-     * DEFAULT_CERTITUDE_LIST_SIZE certitude already in header size
-     */
-    std::size_t certitude_size = 1;
-    std::size_t packet_size = sizeof(darwin_filter_packet_t) + data.size();
-
-    DARWIN_LOG_DEBUG("AConnector::SendToFilter:: Computed packet size: " + std::to_string(packet_size));
-    darwin_filter_packet_t* packet;
-    packet = (darwin_filter_packet_t *)malloc(packet_size);
-    if (!packet) {
-        DARWIN_LOG_CRITICAL("AConnector:: SendToFilter:: Could not create a Darwin packet");
-        _filter_socket.close();
+bool AConnector::SendChunk(std::vector<std::string> &chunk) {
+    DARWIN_LOGGER;
+
+    // Keep room for the header, the body is formatted right after it
+    this->_send_buffer.assign(sizeof(darwin_filter_packet_t), '\0');
+    if (not FormatDataToSendToFilter(chunk, this->_send_buffer))
         return false;
-    }
+
+    std::size_t body_size = this->_send_buffer.size() - sizeof(darwin_filter_packet_t);
+    DARWIN_LOG_DEBUG("AConnector::SendChunk:: " + std::to_string(chunk.size()) + " logs, data size: " + std::to_string(body_size));
+
     /*
      * Initialisation of the structure for the padding bytes because of
      * missing __attribute__((packed)) in the protocol structure.
      */
-    memset(packet, 0, packet_size);
-    if(data.size() != 0) {
-        // TODO: set a proper pointer in protocol.h for the body
-        // Yes We Hack...
-        memcpy(&packet->certitude_list[certitude_size + 1], data.c_str(), data.size());
-    }
-    packet->type = DARWIN_PACKET_FILTER;
-    packet->response = DARWIN_RESPONSE_SEND_DARWIN;
-    packet->certitude_size = certitude_size;
-    packet->filter_code = GetFilterCode();
-    packet->body_size = data.size();
-    
+    darwin_filter_packet_t header;
+    memset(&header, 0, sizeof(header));
+    header.type = DARWIN_PACKET_FILTER;
+    // The output Filter still sends its results to the next filter, but also answers to us to acknowledge the chunk
+    header.response = DARWIN_RESPONSE_SEND_BOTH;
+    header.certitude_size = 1;
+    header.filter_code = GetFilterCode();
+    header.body_size = body_size;
+
     std::vector<char> uuid = darwin::uuid::GenUuid();
-    memcpy(packet->evt_id, uuid.data(), 16);
-    DARWIN_LOG_DEBUG("AConnector::SendToFilter:: Sending header + data");
-    boost::system::error_code ec;
-    boost::asio::write(this->_filter_socket,
-                        boost::asio::buffer(packet, packet_size), ec);
-    free(packet);
-    _filter_socket.close();
-    if (ec) {
-        DARWIN_LOG_ERROR("AConnector::SendToFilter:: 'Unable to write to output filter: " + ec.message());
+    memcpy(header.evt_id, uuid.data(), 16);
+    memcpy(&this->_send_buffer[0], &header, sizeof(header));
+
+    this->_ack_error.clear();
+    this->_acknowledged = false;
+    boost::asio::async_write(this->_filter_socket,
+                            boost::asio::buffer(this->_send_buffer),
+                            boost::bind(&AConnector::WriteChunkCallback, this,
+                                        boost::asio::placeholders::error,
+                                        boost::asio::placeholders::bytes_transferred));
+
+    // Bigger chunks take longer to be processed before being acknowledged
+    unsigned int ack_timeout = FILTER_ACK_TIMEOUT + chunk.size() / FILTER_ACK_LOGS_PER_SECOND;
+    this->_io_service.restart();
+    this->_io_service.run_for(std::chrono::seconds(ack_timeout));
+    if (not this->_io_service.stopped()) {
+        DARWIN_LOG_ERROR("AConnector::SendChunk:: No answer from output filter after " + std::to_string(ack_timeout) + "s");
+        // Cancels pending operations, their callbacks must run before reusing the buffers
+        this->_filter_socket.close();
+        this->_io_service.run();
+    } else if (this->_ack_error) {
+        DARWIN_LOG_ERROR("AConnector::SendChunk:: Unable to send data to output filter: " + this->_ack_error.message());
+        this->_filter_socket.close();
+    }
+
+    if (not this->_acknowledged)
+        return false;
+
+    static const std::string error_prefix = "{\"error\"";
+    if (this->_ack_header.certitude_size == 0 and this->_ack_body.size() >= error_prefix.size()
+        and std::equal(error_prefix.begin(), error_prefix.end(), this->_ack_body.begin())) {
+        DARWIN_LOG_WARNING("AConnector::SendChunk:: Output filter refused the chunk: " + std::string(this->_ack_body.begin(), this->_ack_body.end()));
         return false;
     }
+
     return true;
 }
 
+void AConnector::WriteChunkCallback(const boost::system::error_code& e, std::size_t size __attribute__((unused))) {
+    if (e) {
+        this->_ack_error = e;
+        return;
+    }
+
+    boost::asio::async_read(this->_filter_socket,
+                            boost::asio::buffer(&this->_ack_header, sizeof(this->_ack_header)),
+                            boost::bind(&AConnector::ReadAckHeaderCallback, this,
+                                        boost::asio::placeholders::error,
+                                        boost::asio::placeholders::bytes_transferred));
+}
+
+void AConnector::ReadAckHeaderCallback(const boost::system::error_code& e, std::size_t size __attribute__((unused))) {
+    if (e) {
+        this->_ack_error = e;
+        return;
+    }
+
+    std::size_t ack_body_size = this->_ack_header.body_size;
+    if (this->_ack_header.certitude_size > DEFAULT_CERTITUDE_LIST_SIZE)
+        ack_body_size += (this->_ack_header.certitude_size - DEFAULT_CERTITUDE_LIST_SIZE) * sizeof(unsigned int);
+
+    this->_ack_body.resize(ack_body_size);
+    boost::asio::async_read(this->_filter_socket,
+                            boost::asio::buffer(this->_ack_body),
+                            boost::bind(&AConnector::ReadAckBodyCallback, this,
+                                        boost::asio::placeholders::error,
+                                        boost::asio::placeholders::bytes_transferred));
+}
+
+void AConnector::ReadAckBodyCallback(const boost::system::error_code& e, std::size_t size __attribute__((unused))) {
+    if (e) {
+        this->_ack_error = e;
+        return;
+    }
+
+    this->_acknowledged = true;
+}
+
 long AConnector::GetFilterCode() noexcept {
     return DARWIN_FILTER_BUFFER;
 }
@@ -7,13 +7,23 @@
 
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <mutex>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <boost/asio.hpp>
 
 #include "Logger.hpp"
 #include "enums.hpp"
+#include "protocol.h"
+
+// Minimum time to wait for the output Filter to acknowledge a chunk
+static constexpr unsigned int FILTER_ACK_TIMEOUT = 30;
+// Additional second allowed to the output Filter for every FILTER_ACK_LOGS_PER_SECOND logs in the chunk
+static constexpr unsigned int FILTER_ACK_LOGS_PER_SECOND = 1000;
 
 class AConnector {
     /// This abstract class is made to be inherited by subclasses named f<FilterName>Connector
@@ -61,6 +71,12 @@ class AConnector {
     ///\return this->_redis_lists
     std::vector<std::pair<std::string, std::string>> GetRedisLists() const;
 
+    ///\brief Set the function called when one of the Redis lists reaches _required_log_lines entries.
+    /// Used by the BufferThread to be woken up as soon as there is enough data to send, instead of waiting for _interval.
+    ///
+    ///\param notifier The function to call, an empty function disables notifications.
+    void SetFlushNotifier(std::function<void()> notifier);
+
     ///\brief test every Redis Key in _redis_lists to see if they can be used in REdis
     /// if keys exist and are of the correct type, they are deleted to be reset
     /// if a key is not the correct type, it is assumed it's already used for another application and filter will fail
@@ -87,9 +103,11 @@ class AConnector {
     /// \return true on success, false otherwise.
     virtual bool REDISPopLogs(long long int len, std::vector<std::string> &logs, const std::string &list_name) noexcept;
 
-    ///\brief Query Redis to get number of elements in _redis_list.
+    ///\brief Get the number of elements ready to be sent in list_name.
+    /// The count is tracked locally from the replies of REDISAddEntry, REDISPopLogs and REDISReinsertLogs,
+    /// so Redis is not queried.
     ///
-    /// \return The number of elements in _redis_list. Or -1 in case of error
+    /// \return The number of elements in list_name. Or -1 in case of error
     virtual long long int REDISListLen(const std::string &list_name) noexcept;
 
     ///\brief Reinserts logs into the _redis_list
@@ -106,12 +124,21 @@ class AConnector {
     ///\return true on success, false otherwise.
     bool ParseData(std::string fieldname);
 
-    ///\brief Sets the connection with the output Filter and sends logs to it.
+    ///\brief Sets the number of logs sent to the output Filter in a single packet.
     ///
-    ///\param logs The logs lines to be sent.
+    ///\param chunk_size The maximum number of logs per packet, 0 (the default) to send all logs in one packet.
+    ///                  Only set it for output Filters analysing each log independently.
+    void SetChunkSize(unsigned int chunk_size);
+
+    ///\brief Sends logs to the output Filter, by chunks of _chunk_size logs.
+    /// The connection with the output Filter is kept open between calls and reopened if needed.
+    /// Each chunk is acknowledged by the output Filter before sending the next one.
     ///
-    ///\return true on success, false otherwise.
-    bool SendToFilter(std::vector<std::string> &logs);
+    ///\param logs The logs lines to be sent, they are moved from the vector.
+    ///\param failed_logs Filled with the logs from the chunks that were not acknowledged or were refused.
+    ///
+    ///\return true if every chunk was delivered, false otherwise.
+    bool SendToFilter(std::vector<std::string> &logs, std::vector<std::string> &failed_logs);
 
     public: // Functions that needs to be implemented by children
     ///\brief This function sends data to the REDIS storage. It must be overrode as each filter doesn't need the same data.
@@ -129,12 +156,35 @@ class AConnector {
     ///\return the Buffer filter code
     long GetFilterCode() noexcept;
 
+    ///\brief Opens the connection with the output Filter.
+    ///
+    ///\return true on success, false otherwise.
+    bool ConnectToFilter();
+
+    ///\brief Formats a chunk of logs directly in _send_buffer, sends it and waits for the output Filter's answer.
+    /// The connection is closed on any network error or if no answer is received in time,
+    /// which is FILTER_ACK_TIMEOUT plus a second every FILTER_ACK_LOGS_PER_SECOND logs.
+    ///
+    ///\param chunk The logs to send
+    ///
+    ///\return true if the chunk was acknowledged, false if it was refused or not acknowledged.
+    bool SendChunk(std::vector<std::string> &chunk);
+
+    ///\brief Callback of the chunk writing, starts reading the answer's header.
+    void WriteChunkCallback(const boost::system::error_code& e, std::size_t size);
+
+    ///\brief Callback of the answer's header reading, starts reading the rest of the answer.
+    void ReadAckHeaderCallback(const boost::system::error_code& e, std::size_t size);
+
+    ///\brief Callback of the answer's certitudes and body reading.
+    void ReadAckBodyCallback(const boost::system::error_code& e, std::size_t size);
+
     protected:
     ///\brief this virtual function "jsonifies" the vector of strings into a single string.
     /// By default it performs no other actions on the data but CAN be overrode if needed. (e.g fAnomalyConnector)
     ///
     ///\param logs The logs to jsonify
-    ///\param format The string to fill with the result
+    ///\param format The string to append the result to (it already holds the packet header)
     ///
     ///\return True on success (formatting successful), False otherwise.
     virtual bool FormatDataToSendToFilter(std::vector<std::string> &logs, std::string &formatted);
@@ -144,6 +194,14 @@ class AConnector {
     ///\return The source of the current input line
     std::string GetSource();
 
+    ///\brief Updates the local count of entries ready in list_name.
+    /// Calls _flush_notifier when the count crosses _required_log_lines, if notify is true.
+    ///
+    ///\param list_name The Redis list concerned
+    ///\param count The number of entries added (positive) or removed (negative)
+    ///\param notify Whether crossing the threshold should wake the BufferThread up
+    void UpdateReadyEntries(const std::string &list_name, long long int count, bool notify);
+
     // Used to link with the correct task
     darwin::outputType _filter_type;
 
@@ -153,9 +211,25 @@ class AConnector {
     // Socket filepath on which to write data every _interval seconds if there is more than _required_log_lines of data in Redis
     std::string _filter_socket_path;
 
-    // The output Filter's socket
+    // The output Filter's socket, kept open between two sendings
     boost::asio::local::stream_protocol::socket _filter_socket; //!< Filter's socket.
 
+    // The maximum number of logs sent in a single packet (0 means no limit)
+    unsigned int _chunk_size = 0;
+
+    // Holds the packet header followed by the formatted chunk, reused between chunks
+    std::string _send_buffer;
+
+    // The header answered by the output Filter for the last chunk
+    darwin_filter_packet_t _ack_header;
+
+    // The certitudes and body answered by the output Filter for the last chunk
+    std::vector<char> _ack_body;
+
+    // Set by the callbacks when sending a chunk
+    boost::system::error_code _ack_error;
+    bool _acknowledged = false;
+
     // The interval between two checks on the number of elements in REDIS. (default 300s = 5min)
     unsigned int _interval = 300;
 
@@ -170,4 +244,14 @@ class AConnector {
 
     // The number of log lines in REDIS needed to send to the output Filter
     unsigned int _required_log_lines;
+
+    // The number of entries currently stored in each of the _redis_lists, indexed by list name
+    // Built in the constructor and never modified afterwards, only the counters are
+    std::unordered_map<std::string, std::atomic<long long int>> _ready_entries;
+
+    // Called when a list reaches _required_log_lines entries
+    std::function<void()> _flush_notifier;
+
+    // Protects _flush_notifier
+    std::mutex _flush_notifier_mutex;
 };
\ No newline at end of file
@@ -172,10 +172,9 @@ long long int SumConnector::REDISListLen(const std::string &sum_name) noexcept {
 
 
 bool SumConnector::FormatDataToSendToFilter(std::vector<std::string> &logs, std::string &res) {
-    res.clear();
-    if(logs.size() == 1) {
-        res = "[[" + logs[0] + ",\"" + darwin::time_utils::GetTime() + "\"" + "]]";
-    }
+    if(logs.size() != 1)
+        return false;
 
-    return not res.empty();
+    res += "[[" + logs[0] + ",\"" + darwin::time_utils::GetTime() + "\"" + "]]";
+    return true;
 }
\ No newline at end of file
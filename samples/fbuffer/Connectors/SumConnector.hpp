@@ -82,7 +82,7 @@ protected:
     ///\brief Overrode to generate a simple list (instead of double list, useless here)
     ///
     ///\param count The sum to jsonify
-    ///\param format The string to fill with the result
+    ///\param format The string to append the result to
     ///
     ///\return True on success (formatting successful), False otherwise.
     virtual bool FormatDataToSendToFilter(std::vector<std::string> &logs, std::string &formatted);
@@ -21,21 +21,21 @@ bool fAnomalyConnector::FormatDataToSendToFilter(std::vector<std::string> &logs,
         return false;
     }
 
-    std::string subres;
-
-    res = "[[[";
+    res += "[[[";
     int i = 0;
 
     for (const auto &item : data) {
-        subres = "\"" + item.first + "\""; // Double quotes around ip.
+        if (i != 0)
+            res += "], [";
+
+        res += "\"";
+        res += item.first; // Double quotes around ip.
+        res += "\"";
 
         for (int j : item.second) {
-            subres += ", " + std::to_string(j);
+            res += ", ";
+            res += std::to_string(j);
         }
-        
-        if (i != 0)
-            res += "], [";
-        res += subres;
         i++;
     }
     res += "]]]";
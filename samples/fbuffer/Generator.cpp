@@ -170,10 +170,13 @@ std::shared_ptr<AConnector> Generator::_CreateOutput(boost::asio::io_context &co
     }
     else {
         DARWIN_LOG_WARNING("Generator::_CreateOutput:: " + filter_type + " is not recognized as a valid filter.");
+        return nullptr;
     }
 
     if(not ret->PrepareKeysInRedis())
-        ret = nullptr;
+        return nullptr;
+
+    ret->SetChunkSize(output_config._chunk_size);
 
     return ret;
 }
@@ -214,11 +217,20 @@ bool Generator::LoadOutputs(const rapidjson::Value &array) {
                                 std::string(array[i]["filter_type"].GetString()) + "' ignored");
             continue;
         }
+        unsigned int chunk_size = 0;
+        if (array[i].HasMember("chunk_size")) {
+            if (not array[i]["chunk_size"].IsUint()) {
+                DARWIN_LOG_WARNING("Generator::LoadOuptuts:: 'chunk_size' field is not a positive integer. Output '" +
+                                    std::string(array[i]["filter_type"].GetString()) + "' ignored");
+                continue;
+            }
+            chunk_size = array[i]["chunk_size"].GetUint();
+        }
         std::string filter_type = array[i]["filter_type"].GetString();
         std::string filter_socket_path = array[i]["filter_socket_path"].GetString();
         unsigned int interval = array[i]["interval"].GetUint64();
         unsigned int required_log_lines = array[i]["required_log_lines"].GetUint64();
-        this->_output_configs.emplace_back(OutputConfig(filter_type, filter_socket_path, interval, redis_lists, required_log_lines));
+        this->_output_configs.emplace_back(OutputConfig(filter_type, filter_socket_path, interval, redis_lists, required_log_lines, chunk_size));
     }
     if (_output_configs.empty()) {
         DARWIN_LOG_CRITICAL("Generator::LoadOutputs:: No outputs available. The filter is about to Stop");
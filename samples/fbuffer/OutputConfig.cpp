@@ -11,9 +11,11 @@ OutputConfig::OutputConfig(std::string &filter_type,
                             std::string &filter_socket_path,
                             unsigned int interval,
                             std::vector<std::pair<std::string, std::string>> &redis_lists,
-                            unsigned int required_log_lines) :
+                            unsigned int required_log_lines,
+                            unsigned int chunk_size) :
                         _filter_type(filter_type),
                         _filter_socket_path(filter_socket_path),
                         _interval(interval),
                         _redis_lists(redis_lists),
-                        _required_log_lines(required_log_lines) {}
\ No newline at end of file
+                        _required_log_lines(required_log_lines),
+                        _chunk_size(chunk_size) {}
\ No newline at end of file
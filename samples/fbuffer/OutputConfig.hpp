@@ -25,11 +25,13 @@ class OutputConfig {
     ///\param interval To fill interval
     ///\param redis_lists To fill _redis_lists
     ///\param required_log_lines To fill _required_log_lines
+    ///\param chunk_size To fill _chunk_size
     OutputConfig(std::string &filter_type,
                 std::string &filter_socket_path,
                 unsigned int interval,
                 std::vector<std::pair<std::string, std::string>> &redis_lists,
-                unsigned int required_log_lines);
+                unsigned int required_log_lines,
+                unsigned int chunk_size);
 
     ///\brief unique default destructor
     ~OutputConfig() = default;
@@ -40,4 +42,5 @@ class OutputConfig {
     unsigned int _interval;
     std::vector<std::pair<std::string, std::string>> _redis_lists;
     unsigned int _required_log_lines;
+    unsigned int _chunk_size;
 };
\ No newline at end of file
@@ -70,6 +70,14 @@ bool Generator::LoadConfig(const rapidjson::Document &configuration) {
         _redis_expire = configuration["redis_expire"].GetUint();
     }
 
+    if (configuration.HasMember("redis_read_replicas")) {
+        if (!configuration["redis_read_replicas"].IsBool()) {
+            DARWIN_LOG_CRITICAL("ConnectionSupervision:: Generator:: 'redis_read_replicas' needs to be a boolean");
+            return false;
+        }
+        darwin::toolkit::RedisManager::GetInstance().SetReplicaReads(configuration["redis_read_replicas"].GetBool());
+    }
+
     return ConfigRedis(redis_socket_path, init_data_path);
 }
 
@@ -5,9 +5,7 @@
 /// \license  GPLv3
 /// \brief    Copyright (c) 2018 Advens. All rights reserved.
 
-#include <boost/algorithm/string.hpp>
-#include <boost/algorithm/string/split.hpp>
-#include <boost/tokenizer.hpp>
+#include <algorithm>
 #include <faup/decode.h>
 #include <faup/output.h>
 #include <string>
@@ -29,15 +27,17 @@ DGATask::DGATask(boost::asio::local::stream_protocol::socket& socket,
                  std::shared_ptr<boost::compute::detail::lru_cache<xxh::hash64_t, unsigned int>> cache,
                  std::mutex& cache_mutex,
                  DarwinTfLiteInterpreterFactory& interpreter_factory,
+                 std::shared_ptr<darwin::toolkit::InferenceScheduler> scheduler,
                  faup_options_t *faup_options,
-                 std::map<std::string, unsigned int> &token_map,
+                 const std::shared_ptr<const Model> &current_model,
                  const unsigned int max_tokens)
-        : Session{"dga", socket, manager, cache, cache_mutex}, _interpreter_factory{interpreter_factory}, _faup_options{faup_options}, _token_map{token_map}, _max_tokens{max_tokens} {
+        : Session{"dga", socket, manager, cache, cache_mutex}, _interpreter_factory{interpreter_factory}, _scheduler{std::move(scheduler)},
+          _faup_options{faup_options}, _current_model{current_model}, _max_tokens{max_tokens} {
     _is_cache = _cache != nullptr;
 }
 
 xxh::hash64_t DGATask::GenerateHash() {
-    return xxh::xxhash<64>(_domain);
+    return xxh::xxhash<64>(_domain, _model->generation);
 }
 
 long DGATask::GetFilterCode() noexcept {
@@ -50,18 +50,34 @@ void DGATask::operator()() {
 
     // Should not fail, as the Session body parser MUST check for validity !
     rapidjson::GenericArray<false, rapidjson::Value> array = _body.GetArray();
-    std::shared_ptr<tflite::Interpreter> interpreter = _interpreter_factory.GetInterpreter();
-    if(! interpreter) {
-        // Error in the configuration stage, cannot happen in the actual workflow, the program will kill itself, 
-        // see DarwinTfLiteInterpreterFactory::GetInterpreter for more information
-        DARWIN_LOG_ERROR("DGATask:: TFLite Interpreter is null, the filter cannot process data");
-        STAT_PARSE_ERROR_INC;
-        _certitudes.push_back(DARWIN_ERROR_RETURN);
-        return;
+    // The whole body uses the same model, even if the models are reloaded meanwhile
+    _model = std::atomic_load(&_current_model);
+    // With the scheduler, the model is run by its own threads
+    std::shared_ptr<tflite::Interpreter> interpreter;
+    if(! _scheduler) {
+        interpreter = _interpreter_factory.GetInterpreter(_model->flat_buffer);
+        if(! interpreter) {
+            // Error in the configuration stage, cannot happen in the actual workflow, the program will kill itself, 
+            // see DarwinTfLiteInterpreterFactory::GetInterpreter for more information
+            DARWIN_LOG_ERROR("DGATask:: TFLite Interpreter is null, the filter cannot process data");
+            STAT_PARSE_ERROR_INC;
+            _certitudes.push_back(DARWIN_ERROR_RETURN);
+            return;
+        }
     }
+
+    // Domains not found in the cache are classified all at once, after the whole body is parsed
+    std::vector<std::string> domains;
+    std::string registered_domains; // registered domains to classify, one after the other
+    std::vector<std::size_t> registered_domains_ends;
+    std::vector<std::string_view> to_predict;
+    std::vector<std::size_t> to_predict_indexes;
+    std::vector<xxh::hash64_t> to_predict_hashes;
+    std::vector<unsigned int> predictions;
+
+    SetStartingTime();
     for (rapidjson::Value &value : array) {
         STAT_INPUT_INC;
-        SetStartingTime();
         // We have a generic hash function, which takes no arguments as these can be of very different types depending
         // on the nature of the filter
         // So instead, we set an attribute corresponding to the current domain being processed, to compute the hash
@@ -69,173 +85,258 @@ void DGATask::operator()() {
 
         if(ParseLine(value)) {
             unsigned int certitude;
-            xxh::hash64_t hash;
+            xxh::hash64_t hash = 0;
 
             if (_is_cache) {
                 hash = GenerateHash();
 
                 if (GetCacheResult(hash, certitude)) {
-                    if (certitude >= _threshold and certitude < DARWIN_ERROR_RETURN){
-                        STAT_MATCH_INC;
-                        DARWIN_ALERT_MANAGER.Alert(_domain, certitude, Evt_idToString());
-                        if (is_log) {
-                            std::string alert_log = R"({"evt_id": ")" + Evt_idToString() + R"(", "time": ")" + darwin::time_utils::GetTime() +
-                                    R"(", "filter": ")" + GetFilterName() + "\", \"domain\": \""+ _domain + "\", \"dga_prob\": " + std::to_string(certitude) + "}";
-                            _logs += alert_log + '\n';
-                        }
-                    }
+                    domains.push_back(_domain);
                     _certitudes.push_back(certitude);
-                    DARWIN_LOG_DEBUG("DGATask:: processed entry in "
-                                    + std::to_string(GetDurationMs()) + "ms, certitude: " + std::to_string(certitude));
                     continue;
                 }
             }
 
-            certitude = Predict(interpreter);
-            if (certitude >= _threshold and certitude < DARWIN_ERROR_RETURN){
-                STAT_MATCH_INC;
-                DARWIN_ALERT_MANAGER.Alert(_domain, certitude, Evt_idToString());
-                if (is_log) {
-                    std::string alert_log = R"({"evt_id": ")" + Evt_idToString() + R"(", "time": ")" + darwin::time_utils::GetTime() +
-                                    R"(", "filter": ")" + GetFilterName() + "\", \"domain\": \""+ _domain + "\", \"dga_prob\": " + std::to_string(certitude) + "}";
-                    _logs += alert_log + '\n';
+            domains.push_back(_domain);
+            if (!ExtractRegisteredDomain(registered_domains)) {
+                _certitudes.push_back(DARWIN_ERROR_RETURN);
+                if (_is_cache) {
+                    SaveToCache(hash, DARWIN_ERROR_RETURN);
                 }
+                continue;
             }
-            _certitudes.push_back(certitude);
-            if (_is_cache) {
-                SaveToCache(hash, certitude);
-            }
-            DARWIN_LOG_DEBUG("DGATask:: processed entry in "
-                            + std::to_string(GetDurationMs()) + "ms, certitude: " + std::to_string(certitude));
+
+            registered_domains_ends.push_back(registered_domains.size());
+            to_predict_indexes.push_back(_certitudes.size());
+            to_predict_hashes.push_back(hash);
+            _certitudes.push_back(DARWIN_ERROR_RETURN);
         }
         else {
             STAT_PARSE_ERROR_INC;
+            domains.emplace_back();
             _certitudes.push_back(DARWIN_ERROR_RETURN);
         }
+    }
+
+    // Views are only taken once the buffer stopped growing
+    to_predict.reserve(registered_domains_ends.size());
+    for (std::size_t i = 0, start = 0; i < registered_domains_ends.size(); start = registered_domains_ends[i++]) {
+        to_predict.emplace_back(registered_domains.data() + start, registered_domains_ends[i] - start);
+    }
+
+    if (_scheduler) {
+        // Domains are classified along with the ones of the other sessions
+        _scheduler->Predict(_model, to_predict, predictions);
+    } else {
+        Predict(interpreter, _model->token_table, _max_tokens, to_predict, predictions);
+    }
+    for (std::size_t i = 0; i < predictions.size(); ++i) {
+        _certitudes[to_predict_indexes[i]] = predictions[i];
+        if (_is_cache) {
+            SaveToCache(to_predict_hashes[i], predictions[i]);
+        }
+    }
+
+    for (std::size_t i = 0; i < _certitudes.size(); ++i) {
+        unsigned int certitude = _certitudes[i];
 
+        if (certitude >= _threshold and certitude < DARWIN_ERROR_RETURN){
+            STAT_MATCH_INC;
+            DARWIN_ALERT_MANAGER.Alert(domains[i], certitude, Evt_idToString());
+            if (is_log) {
+                std::string alert_log = R"({"evt_id": ")" + Evt_idToString() + R"(", "time": ")" + darwin::time_utils::GetTime() +
+                                R"(", "filter": ")" + GetFilterName() + "\", \"domain\": \""+ domains[i] + "\", \"dga_prob\": " + std::to_string(certitude) + "}";
+                _logs += alert_log + '\n';
+            }
+        }
     }
+
+    DARWIN_LOG_DEBUG("DGATask:: processed " + std::to_string(_certitudes.size()) + " entries ("
+                     + std::to_string(to_predict.size()) + " classified) in " + std::to_string(GetDurationMs()) + "ms");
+
+    // An idle connection must not keep a reloaded model alive
+    _model = nullptr;
 }
 
 DGATask::~DGATask() = default;
 
+faup_handler_t *DGATask::GetFaupHandler() {
+    // faup handlers are not thread safe, each thread keeps its own until it exits
+    struct FaupHandler {
+        faup_handler_t *handler = nullptr;
+        ~FaupHandler() {
+            if (handler) faup_terminate(handler);
+        }
+    };
+    static thread_local FaupHandler faup_handler;
+
+    if (!faup_handler.handler) {
+        faup_handler.handler = faup_init(_faup_options);
+    }
+    return faup_handler.handler;
+}
+
 bool DGATask::ExtractRegisteredDomain(std::string &to_predict) {
     DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("ExtractRegisteredDomain:: Analyzing domain '" + _domain + "'");
 
     bool is_domain_valid = darwin::validator::IsDomainValid(_domain);
 
     if (!is_domain_valid) return false;
 
-    faup_handler_t* fh = faup_init(_faup_options);
-
-    try {
-        faup_decode(fh, _domain.c_str(), _domain.size());
-
-        std::string tld = _domain.substr(
-                faup_get_tld_pos(fh),
-                faup_get_tld_size(fh)
-        );
-
-        if (tld == "yu" || tld == "za") {
-            DARWIN_LOG_DEBUG("ExtractRegisteredDomain::TLD found is '" + tld + "', returning false");
-            faup_terminate(fh);
-            return false;
-        }
-
-        DARWIN_LOG_DEBUG("ExtractRegisteredDomain:: TLD found is '" + tld + "'");
-
-        std::string registered_domain = _domain.substr(
-                faup_get_domain_without_tld_pos(fh),
-                faup_get_domain_without_tld_size(fh)
-        );
+    faup_handler_t* fh = GetFaupHandler();
+    if (!fh) {
+        DARWIN_LOG_ERROR("ExtractRegisteredDomain:: Could not initialize faup");
+        return false;
+    }
 
-        DARWIN_LOG_DEBUG("ExtractRegisteredDomain:: Registered domain found is '" + registered_domain + "'");
+    faup_decode(fh, _domain.c_str(), _domain.size());
 
-        to_predict = registered_domain + "." + tld;
+    int tld_pos = faup_get_tld_pos(fh);
+    std::size_t tld_size = faup_get_tld_size(fh);
+    int registered_pos = faup_get_domain_without_tld_pos(fh);
+    std::size_t registered_size = faup_get_domain_without_tld_size(fh);
 
-    } catch (const std::out_of_range& exception) {
+    // faup returns a negative position when the part is not found
+    if (tld_pos < 0 || registered_pos < 0 ||
+        static_cast<std::size_t>(tld_pos) + tld_size > _domain.size() ||
+        static_cast<std::size_t>(registered_pos) + registered_size > _domain.size()) {
         DARWIN_LOG_INFO("ExtractRegisteredDomain:: domain appears to be invalid: '" + _domain + "'");
-        faup_terminate(fh);
         return false;
+    }
 
-    } catch (const std::exception& exception) {
-        DARWIN_LOG_ERROR("ExtractRegisteredDomain:: Unexpected error with domain '" + _domain + "': '" +
-                         exception.what() + "'");
-        faup_terminate(fh);
-        return false;
-    } catch (...) {
-        DARWIN_LOG_ERROR("ExtractRegisteredDomain:: Unknown error with domain '" + _domain + "'");
-        faup_terminate(fh);
+    if (_domain.compare(tld_pos, tld_size, "yu") == 0 || _domain.compare(tld_pos, tld_size, "za") == 0) {
         return false;
     }
-    faup_terminate(fh);
+
+    to_predict.append(_domain, registered_pos, registered_size);
+    to_predict.push_back('.');
+    to_predict.append(_domain, tld_pos, tld_size);
     return true;
 }
 
-void DGATask::DomainTokenizer(std::vector<std::size_t> &domain_tokens, const std::string &to_predict) {
-    DARWIN_LOGGER;
-    boost::tokenizer<boost::char_separator<char>> tokens(to_predict, _separator);
-    std::map<unsigned int, unsigned int> tmp_domain_tokens;
+void DGATask::DomainTokenizer(float *domain_tokens, const token_table_t &token_table, unsigned int max_tokens,
+                              std::string_view to_predict) {
     std::size_t size = 0;
 
-    for (const auto &c_character : to_predict) {
-        auto character = std::string(1, c_character);
-        auto it = _token_map.find(character);
+    for (unsigned char c_character : to_predict) {
+        if (token_table[c_character] != NO_TOKEN) ++size;
+    }
 
-        // token is not in our dictionary
-        if (it == _token_map.end()) {
-            DARWIN_LOG_DEBUG("DomainTokenizer:: No token has been found for the character '" + character + "'");
+    // Tokens are aligned on the right, keeping the last ones when the domain is too long
+    std::size_t skip = size > max_tokens ? size - max_tokens : 0;
+    std::size_t index = max_tokens - (size - skip);
+
+    std::fill(domain_tokens, domain_tokens + index, 0.0f);
+    for (unsigned char c_character : to_predict) {
+        unsigned int token = token_table[c_character];
+
+        // character is not in our dictionary
+        if (token == NO_TOKEN) continue;
+        if (skip) {
+            --skip;
             continue;
         }
-
-        tmp_domain_tokens[size++] = it->second;
+        domain_tokens[index++] = token;
     }
+}
 
-    std::size_t index = _max_tokens - size;
+bool DGATask::ReserveBatch(std::shared_ptr<tflite::Interpreter> interpreter, unsigned int max_tokens,
+                           std::size_t batch_size) {
+    // Set once the model refused a bigger batch, domains are then classified one at a time
+    static thread_local bool batch_unsupported = false;
+    DARWIN_LOGGER;
 
-    for (size = index; size < _max_tokens; ++size) {
-        domain_tokens[size] = tmp_domain_tokens[size - index];
-    }
-}
+    TfLiteTensor *input = interpreter->input_tensor(0);
+    std::size_t capacity = input->dims->size > 0 ? input->dims->data[0] : 0;
+    std::size_t wanted = 1;
 
-unsigned int DGATask::Predict(std::shared_ptr<tflite::Interpreter> interpreter) {
-    std::string to_predict;
+    if (batch_unsupported) batch_size = 1;
+    while (wanted < batch_size && wanted < MAX_BATCH_SIZE) wanted <<= 1;
 
-    if (!ExtractRegisteredDomain(to_predict)) {
-        return DARWIN_ERROR_RETURN;
+    // The interpreter is kept by the thread, so the tensors are only reallocated when the batch grows,
+    // or when it became much smaller than the current one
+    if (input->data.raw != nullptr && wanted <= capacity && wanted * 4 > capacity) return true;
+
+    TfLiteStatus status = interpreter->ResizeInputTensor(interpreter->inputs()[0], {static_cast<int>(wanted), static_cast<int>(max_tokens)});
+    if (status == TfLiteStatus::kTfLiteOk) {
+        status = interpreter->AllocateTensors();
     }
 
-    DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("Predict:: Classifying '" + to_predict + "'...");
+    if (status != TfLiteStatus::kTfLiteOk) {
+        if (wanted == 1) {
+            DARWIN_LOG_ERROR("DGATask::ReserveBatch:: Tflite Error while allocating tensors : " + std::to_string(static_cast<int>(status)));
+            return false;
+        }
+
+        DARWIN_LOG_WARNING("DGATask::ReserveBatch:: The model does not support batches of " + std::to_string(wanted) +
+                           " domains, classifying them one at a time");
+        batch_unsupported = true;
+        status = interpreter->ResizeInputTensor(interpreter->inputs()[0], {1, static_cast<int>(max_tokens)});
+        if (status == TfLiteStatus::kTfLiteOk) {
+            status = interpreter->AllocateTensors();
+        }
+        if (status != TfLiteStatus::kTfLiteOk) {
+            DARWIN_LOG_ERROR("DGATask::ReserveBatch:: Tflite Error while allocating tensors : " + std::to_string(static_cast<int>(status)));
+            return false;
+        }
+        return true;
+    }
 
-    std::vector<std::size_t> domain_tokens(_max_tokens, 0);
-    DomainTokenizer(domain_tokens, to_predict);
+    DARWIN_LOG_DEBUG("DGATask::ReserveBatch:: Input tensor resized for " + std::to_string(wanted) + " domains");
+    return true;
+}
 
-    TfLiteStatus status = interpreter->AllocateTensors();
+void DGATask::Predict(std::shared_ptr<tflite::Interpreter> interpreter, const token_table_t &token_table,
+                      unsigned int max_tokens, const std::vector<std::string_view> &to_predict,
+                      std::vector<unsigned int> &certitudes) {
+    DARWIN_LOGGER;
+    certitudes.assign(to_predict.size(), DARWIN_ERROR_RETURN);
 
-    if(status != TfLiteStatus::kTfLiteOk) {
-        DARWIN_LOG_ERROR("DGATask::Predict:: Tflite Error while allocating tensors : " + std::to_string(static_cast<int>(status)));
-        return DARWIN_ERROR_RETURN;
+    if (to_predict.empty()) {
+        return;
     }
 
-    float* input_tensor_mapped = interpreter->typed_input_tensor<float>(0);
-    size_t index = 0;
-    for (const auto &domain_token : domain_tokens) {
-        input_tensor_mapped[index++] = domain_token;
+    if (!interpreter) {
+        DARWIN_LOG_ERROR("DGATask::Predict:: TFLite Interpreter is null, the domains cannot be classified");
+        return;
     }
 
-    status = interpreter->Invoke();
-    if(status != TfLiteStatus::kTfLiteOk) {
-        DARWIN_LOG_ERROR("DGATask::Predict:: Tflite Error while predicting : " + std::to_string(static_cast<int>(status)));
-        return DARWIN_ERROR_RETURN;
+    if (!ReserveBatch(interpreter, max_tokens, to_predict.size())) {
+        return;
     }
-    
-    float* output_tensor = interpreter->typed_output_tensor<float>(0);
 
-    unsigned int certitude = round(output_tensor[0] * 100);
-    DARWIN_LOG_DEBUG("Predict:: DGA score obtained: " + std::to_string(certitude));
+    TfLiteTensor *input = interpreter->input_tensor(0);
+    std::size_t batch_size = input->dims->data[0];
 
-    return certitude;
+    for (std::size_t first = 0; first < to_predict.size(); first += batch_size) {
+        std::size_t count = std::min(batch_size, to_predict.size() - first);
+        float* input_tensor_mapped = interpreter->typed_input_tensor<float>(0);
+
+        for (std::size_t i = 0; i < count; ++i) {
+            DomainTokenizer(input_tensor_mapped + i * max_tokens, token_table, max_tokens, to_predict[first + i]);
+        }
+        // Rows left over from a bigger batch are cleared, their scores are ignored
+        std::fill(input_tensor_mapped + count * max_tokens, input_tensor_mapped + batch_size * max_tokens, 0.0f);
+
+        TfLiteStatus status = interpreter->Invoke();
+        if(status != TfLiteStatus::kTfLiteOk) {
+            DARWIN_LOG_ERROR("DGATask::Predict:: Tflite Error while predicting : " + std::to_string(static_cast<int>(status)));
+            return;
+        }
+
+        const TfLiteTensor *output = interpreter->output_tensor(0);
+        float* output_tensor = interpreter->typed_output_tensor<float>(0);
+        std::size_t output_size = 1;
+        for (int d = 0; d < output->dims->size; ++d) {
+            output_size *= output->dims->data[d];
+        }
+        // The score of a domain is the first value of its row
+        std::size_t stride = output_size / batch_size;
+
+        for (std::size_t i = 0; i < count; ++i) {
+            certitudes[first + i] = round(output_tensor[i * stride] * 100);
+        }
+    }
 }
 
 bool DGATask::ParseLine(rapidjson::Value &line) {
@@ -259,8 +360,7 @@ bool DGATask::ParseLine(rapidjson::Value &line) {
         return false;
     }
 
-    _domain = values[0].GetString();
-    DARWIN_LOG_DEBUG("DGATask:: ParseLine: Parsed element: " + _domain);
+    _domain.assign(values[0].GetString(), values[0].GetStringLength());
 
     return true;
 }
@@ -8,10 +8,12 @@
 #pragma once
 
 #include "tensorflow/lite/interpreter.h"
-#include <boost/token_functions.hpp>
+#include <array>
 #include <faup/faup.h>
-#include <map>
+#include <limits>
+#include <string_view>
 
+#include "../../toolkit/InferenceScheduler.hpp"
 #include "../../toolkit/lru_cache.hpp"
 #include "../../toolkit/xxhash.h"
 #include "../../toolkit/xxhash.hpp"
@@ -30,19 +32,43 @@
 
 class DGATask : public darwin::Session {
 public:
+    /// Token of each byte of a domain, NO_TOKEN for the bytes missing from the token map
+    typedef std::array<unsigned int, 256> token_table_t;
+    static constexpr unsigned int NO_TOKEN = std::numeric_limits<unsigned int>::max();
+
+    /// A model with the token table it was trained with, replaced as a whole when the models are reloaded
+    struct Model {
+        std::shared_ptr<tflite::FlatBufferModel> flat_buffer;
+        token_table_t token_table;
+        uint64_t generation = 0; // Seeds the cache keys, so that the results of the previous models are not reused
+    };
+
     explicit DGATask(boost::asio::local::stream_protocol::socket& socket,
                      darwin::Manager& manager,
                      std::shared_ptr<boost::compute::detail::lru_cache<xxh::hash64_t, unsigned int>> cache,
                      std::mutex& cache_mutex,
                      DarwinTfLiteInterpreterFactory& interpreter_factory,
+                     std::shared_ptr<darwin::toolkit::InferenceScheduler> scheduler,
                      faup_options_t *faup_options,
-                     std::map<std::string, unsigned int> &token_map, const unsigned int max_tokens = 50);
+                     const std::shared_ptr<const Model> &current_model, const unsigned int max_tokens = 50);
     ~DGATask() override;
 
 public:
     // You need to override the functor to compile and be executed by the thread
     void operator()() override;
 
+    /// Classify the registered domains, with one inference per batch.
+    /// Also called by the inference scheduler threads, with their own interpreter.
+    ///
+    /// \param interpreter The interpreter of the current thread.
+    /// \param token_table The token of each byte of the domains.
+    /// \param max_tokens The number of tokens given to the model for each domain.
+    /// \param to_predict The registered domains to classify.
+    /// \param certitudes Will contain the score of each domain, DARWIN_ERROR_RETURN on error.
+    static void Predict(std::shared_ptr<tflite::Interpreter> interpreter, const token_table_t &token_table,
+                        unsigned int max_tokens, const std::vector<std::string_view> &to_predict,
+                        std::vector<unsigned int> &certitudes);
+
 protected:
     /// Get the result from the cache
     xxh::hash64_t GenerateHash() override;
@@ -50,32 +76,45 @@ protected:
     long GetFilterCode() noexcept override;
 
 private:
+    /// Get the faup handler of the current thread, created on first use.
+    faup_handler_t *GetFaupHandler();
+
     /// Extract the registered domain with the TLD
     ///
-    /// \param to_predict Will contain the string extracted.
+    /// \param to_predict The string extracted is appended to it.
     /// \return true on success, false otherwise.
     bool ExtractRegisteredDomain(std::string &to_predict);
 
-    /// Classify the parsed request.
+    /// Make the input tensor of the interpreter hold a batch of domains.
     ///
+    /// \param interpreter The interpreter of the current thread.
+    /// \param max_tokens The number of tokens given to the model for each domain.
+    /// \param batch_size The number of domains to classify, the batch is rounded up to a power of 2.
     /// \return true on success, false otherwise.
-    unsigned int Predict(std::shared_ptr<tflite::Interpreter> interpreter);
+    static bool ReserveBatch(std::shared_ptr<tflite::Interpreter> interpreter, unsigned int max_tokens,
+                             std::size_t batch_size);
 
     /// Parse a line in the body.
     bool ParseLine(rapidjson::Value &line) final;
 
     /// Tokenize the DGA to be classified.
     ///
-    /// \param domain_tokens The DGA tokens to be used.
+    /// \param domain_tokens The input row receiving the max_tokens DGA tokens.
+    /// \param token_table The token of each byte of the domains.
+    /// \param max_tokens The number of tokens given to the model for each domain.
     /// \param to_predict The DGA to be predicted.
-    void DomainTokenizer(std::vector<std::size_t> &domain_tokens, const std::string &to_predict);
+    static void DomainTokenizer(float *domain_tokens, const token_table_t &token_table, unsigned int max_tokens,
+                                std::string_view to_predict);
 
 
 private:
-    boost::char_separator<char> _separator {" ());,:-~?!{}/[]"};
+    static constexpr std::size_t MAX_BATCH_SIZE = 1024; // Domains classified by a single inference
+
     DarwinTfLiteInterpreterFactory& _interpreter_factory;
+    std::shared_ptr<darwin::toolkit::InferenceScheduler> _scheduler; // nullptr if batching across sessions is disabled
     faup_options_t *_faup_options = nullptr;
-    std::map<std::string, unsigned int> _token_map; // The token map to help classifying domains
+    const std::shared_ptr<const Model> &_current_model; // Swapped atomically by the generator on reload
+    std::shared_ptr<const Model> _model; // The model used for the current body
     unsigned int _max_tokens = 75;
     std::string _domain; // The current domain to check
 };
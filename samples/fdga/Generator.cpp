@@ -15,6 +15,7 @@
 #include "DGATask.hpp"
 #include "Generator.hpp"
 #include "AlertManager.hpp"
+#include "Stats.hpp"
 
 bool Generator::ConfigureAlerting(const std::string& tags) {
     DARWIN_LOGGER;
@@ -35,9 +36,6 @@ bool Generator::LoadConfig(const rapidjson::Document &configuration) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("DGA:: Generator:: Loading classifier...");
 
-    std::string token_map_path;
-    std::string model_path;
-
     if (!configuration.HasMember("token_map_path")) {
         DARWIN_LOG_CRITICAL("DGA:: Generator:: Missing parameter: 'token_map_path'");
         return false;
@@ -48,7 +46,7 @@ bool Generator::LoadConfig(const rapidjson::Document &configuration) {
         return false;
     }
 
-    token_map_path = configuration["token_map_path"].GetString();
+    _token_map_path = configuration["token_map_path"].GetString();
 
     if (!configuration.HasMember("model_path")) {
         DARWIN_LOG_CRITICAL("DGA:: Generator:: Missing parameter: 'model_path'");
@@ -60,7 +58,7 @@ bool Generator::LoadConfig(const rapidjson::Document &configuration) {
         return false;
     }
 
-    model_path = configuration["model_path"].GetString();
+    _model_path = configuration["model_path"].GetString();
 
     if (!configuration.HasMember("max_tokens")) {
         DARWIN_LOG_CRITICAL("DGA:: Generator:: 'max_tokens' not provided. Setting default value: " +
@@ -76,11 +74,33 @@ bool Generator::LoadConfig(const rapidjson::Document &configuration) {
         _max_tokens = configuration["max_tokens"].GetUint();
     }
 
-    return LoadFaupOptions() && LoadTokenMap(token_map_path) && LoadModel(model_path);
+    return LoadFaupOptions() && LoadModels() && LoadInterpreterOptions(configuration) && LoadScheduler(configuration);
+}
+
+bool Generator::LoadModels() {
+    DARWIN_LOGGER;
+    auto model = std::make_shared<DGATask::Model>();
+
+    if (!LoadTokenMap(_token_map_path, model->token_table) || !LoadModel(_model_path, model->flat_buffer)) {
+        return false;
+    }
+
+    // Sessions already running keep the previous model, the new ones take this one
+    auto current = std::atomic_load(&_model);
+    model->generation = current ? current->generation + 1 : 0;
+    DARWIN_LOG_INFO("DGA:: Generator:: Model and token map loaded, generation " + std::to_string(model->generation));
+    std::atomic_store(&_model, std::shared_ptr<const DGATask::Model>(std::move(model)));
+    return true;
+}
+
+bool Generator::ReloadModels() {
+    // Interpreters are rebuilt by their threads the next time they run the model
+    return LoadModels();
 }
 
-bool Generator::LoadTokenMap(const std::string &token_map_path) {
+bool Generator::LoadTokenMap(const std::string &token_map_path, DGATask::token_table_t &token_table) {
     DARWIN_LOGGER;
+    std::map<std::string, unsigned int> token_map;
     std::string current_line;
     boost::char_separator<char> separator{","};
 
@@ -113,10 +133,8 @@ bool Generator::LoadTokenMap(const std::string &token_map_path) {
             return false;
         }
 
-        _token_map[*key] = (unsigned int)std::stoi(*value);
-
         try{
-            _token_map[*key] = (unsigned int)std::stoi(*value);
+            token_map[*key] = (unsigned int)std::stoi(*value);
         }catch(const std::invalid_argument& ia){
             std::string exc(ia.what());
             DARWIN_LOG_CRITICAL("DGA:: LoadTokenMap:: Value " + *value + " is invalid : " + exc);
@@ -130,22 +148,128 @@ bool Generator::LoadTokenMap(const std::string &token_map_path) {
 
     DARWIN_LOG_DEBUG("DGA:: LoadTokenMap:: Token map loaded");
 
+    BuildTokenTable(token_map, token_table);
     return true;
 }
 
-bool Generator::LoadModel(const std::string &model_path) {
+void Generator::BuildTokenTable(const std::map<std::string, unsigned int> &token_map, DGATask::token_table_t &token_table) {
+    DARWIN_LOGGER;
+
+    token_table.fill(DGATask::NO_TOKEN);
+    for (const auto &token : token_map) {
+        // domains are tokenized character by character, longer keys can't match
+        if (token.first.size() != 1) {
+            DARWIN_LOG_WARNING("DGA:: BuildTokenTable:: Ignoring token '" + token.first + "', only single characters are used");
+            continue;
+        }
+        token_table[static_cast<unsigned char>(token.first[0])] = token.second;
+    }
+}
+
+bool Generator::LoadModel(const std::string &model_path, std::shared_ptr<tflite::FlatBufferModel> &model) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("Generator:: LoadModel:: Loading model...");
 
-    _model = tflite::FlatBufferModel::BuildFromFile(model_path.c_str(), DarwinTfLiteErrorReporter::GetInstance());
+    model = tflite::FlatBufferModel::BuildFromFile(model_path.c_str(), DarwinTfLiteErrorReporter::GetInstance());
 
-    if (_model == nullptr) {
+    if (model == nullptr) {
         DARWIN_LOG_ERROR("Generator:: LoadModel:: Failed to load graph at " + model_path);
         return false;
     }
 
-    _interpreter_factory.SetModel(_model);
+    return true;
+}
+
+bool Generator::LoadInterpreterOptions(const rapidjson::Document &configuration) {
+    DARWIN_LOGGER;
+    unsigned int interpreter_threads = 0;
+    bool xnnpack = false;
 
+    if (configuration.HasMember("interpreter_threads")) {
+        if (!configuration["interpreter_threads"].IsUint()) {
+            DARWIN_LOG_CRITICAL("DGA:: Generator:: 'interpreter_threads' needs to be an unsigned integer");
+            return false;
+        }
+        interpreter_threads = configuration["interpreter_threads"].GetUint();
+    }
+
+    if (configuration.HasMember("xnnpack")) {
+        if (!configuration["xnnpack"].IsBool()) {
+            DARWIN_LOG_CRITICAL("DGA:: Generator:: 'xnnpack' needs to be a boolean");
+            return false;
+        }
+        xnnpack = configuration["xnnpack"].GetBool();
+    }
+
+#ifndef DARWIN_TFLITE_XNNPACK
+    if (xnnpack) {
+        DARWIN_LOG_WARNING("DGA:: Generator:: 'xnnpack' is enabled but darwin was built without XNNPACK, ignoring it");
+        xnnpack = false;
+    }
+#endif
+
+    DARWIN_LOG_INFO("DGA:: Generator:: interpreters use " + (interpreter_threads ? std::to_string(interpreter_threads) : std::string("the default number of"))
+                    + " threads" + (xnnpack ? " with the XNNPACK delegate" : ""));
+    _interpreter_factory.SetOptions(interpreter_threads, xnnpack);
+    return true;
+}
+
+bool Generator::LoadScheduler(const rapidjson::Document &configuration) {
+    DARWIN_LOGGER;
+    unsigned int batch_threads = 0;
+    unsigned int batch_max_size = darwin::toolkit::InferenceScheduler::DEFAULT_MAX_BATCH_SIZE;
+    unsigned int batch_max_delay = darwin::toolkit::InferenceScheduler::DEFAULT_MAX_DELAY;
+
+    if (configuration.HasMember("batch_threads")) {
+        if (!configuration["batch_threads"].IsUint()) {
+            DARWIN_LOG_CRITICAL("DGA:: Generator:: 'batch_threads' needs to be an unsigned integer");
+            return false;
+        }
+        batch_threads = configuration["batch_threads"].GetUint();
+    }
+
+    if (configuration.HasMember("batch_max_size")) {
+        if (!configuration["batch_max_size"].IsUint() || configuration["batch_max_size"].GetUint() == 0) {
+            DARWIN_LOG_CRITICAL("DGA:: Generator:: 'batch_max_size' needs to be a strictly positive integer");
+            return false;
+        }
+        batch_max_size = configuration["batch_max_size"].GetUint();
+    }
+
+    if (configuration.HasMember("batch_max_delay_us")) {
+        if (!configuration["batch_max_delay_us"].IsUint()) {
+            DARWIN_LOG_CRITICAL("DGA:: Generator:: 'batch_max_delay_us' needs to be an unsigned integer");
+            return false;
+        }
+        batch_max_delay = configuration["batch_max_delay_us"].GetUint();
+    }
+
+    if (batch_threads == 0) {
+        DARWIN_LOG_DEBUG("DGA:: Generator:: batching across sessions disabled");
+        return true;
+    }
+
+    DARWIN_LOG_INFO("DGA:: Generator:: batching across sessions enabled with " + std::to_string(batch_threads)
+                    + " threads, up to " + std::to_string(batch_max_size) + " domains or "
+                    + std::to_string(batch_max_delay) + "us");
+    _scheduler = std::make_shared<darwin::toolkit::InferenceScheduler>(
+        [this](const darwin::toolkit::InferenceScheduler::model_t &context, const std::vector<std::string_view> &inputs,
+               std::vector<unsigned int> &results) {
+            // the model of the sessions, so that a body is classified by a single model even during a reload
+            auto model = std::static_pointer_cast<const DGATask::Model>(context);
+            DGATask::Predict(_interpreter_factory.GetInterpreter(model->flat_buffer), model->token_table, _max_tokens, inputs, results);
+        },
+        batch_max_size, std::chrono::microseconds(batch_max_delay), DARWIN_ERROR_RETURN);
+    if (not _scheduler->Start(batch_threads)) {
+        DARWIN_LOG_CRITICAL("DGA:: Generator:: could not start the inference scheduler");
+        return false;
+    }
+
+    std::weak_ptr<darwin::toolkit::InferenceScheduler> scheduler = _scheduler;
+    darwin::stats::AddCustomStats("inference_batching", [scheduler]() {
+        auto batching = scheduler.lock();
+        return batching ? batching->GetStats() : std::string("{}");
+    });
     return true;
 }
 
@@ -166,7 +290,10 @@ darwin::session_ptr_t
 Generator::CreateTask(boost::asio::local::stream_protocol::socket& socket,
                       darwin::Manager& manager) noexcept {
     return std::static_pointer_cast<darwin::Session>(
-            std::make_shared<DGATask>(socket, manager, _cache, _cache_mutex, _interpreter_factory, _faup_options, _token_map, _max_tokens));
+            std::make_shared<DGATask>(socket, manager, _cache, _cache_mutex, _interpreter_factory, _scheduler, _faup_options, _model, _max_tokens));
 }
 
-Generator::~Generator() {}
+Generator::~Generator() {
+    // Sessions may still hold the scheduler, its threads must not outlive the model
+    if (_scheduler) _scheduler->Stop();
+}
@@ -11,10 +11,12 @@
 #include <map>
 #include <string>
 
+#include "../../toolkit/InferenceScheduler.hpp"
 #include "../toolkit/rapidjson/document.h"
 #include "Session.hpp"
 #include "AGenerator.hpp"
 #include "TfLiteHelper.hpp"
+#include "DGATask.hpp"
 #include "tensorflow/lite/model.h"
 
 class Generator: public AGenerator {
@@ -33,14 +35,34 @@ private:
     virtual bool LoadConfig(const rapidjson::Document &configuration) override final;
     virtual bool ConfigureAlerting(const std::string& tags) override final;
     bool LoadFaupOptions();
-    bool LoadTokenMap(const std::string &token_map_path);
-    bool LoadModel(const std::string &model_path);
 
-    std::shared_ptr<tflite::FlatBufferModel> _model;
-    std::map<std::string, unsigned int> _token_map;
+    /// Load the token map and the model, then make them the current ones
+    bool LoadModels();
+
+    /// Load the token map and the model again from the files of the configuration
+    virtual bool ReloadModels() override final;
+
+    bool LoadTokenMap(const std::string &token_map_path, DGATask::token_table_t &token_table);
+    void BuildTokenTable(const std::map<std::string, unsigned int> &token_map, DGATask::token_table_t &token_table);
+    bool LoadModel(const std::string &model_path, std::shared_ptr<tflite::FlatBufferModel> &model);
+
+    /// Set the number of threads of each interpreter ('interpreter_threads') and the use of XNNPACK ('xnnpack').
+    /// Each thread running the model has its own interpreter: the scheduler threads if 'batch_threads'
+    /// is set, the worker threads otherwise.
+    bool LoadInterpreterOptions(const rapidjson::Document &configuration);
+
+    /// Start the threads classifying the domains of all the sessions together, if enabled by 'batch_threads'
+    bool LoadScheduler(const rapidjson::Document &configuration);
+
+    std::string _token_map_path;
+    std::string _model_path;
+    std::shared_ptr<const DGATask::Model> _model; // Only accessed through std::atomic_load and std::atomic_store
     unsigned int _max_tokens = 75;
     faup_options_t* _faup_options = nullptr;
 
     // Object that distributes the thread_local interpreters
     DarwinTfLiteInterpreterFactory _interpreter_factory;
+
+    // Uses the members above, so it must be destroyed first
+    std::shared_ptr<darwin::toolkit::InferenceScheduler> _scheduler = nullptr; // nullptr if disabled
 };
@@ -7,39 +7,76 @@
 
 #include "tensorflow/lite/kernels/register.h"
 #include "tensorflow/lite/interpreter_builder.h"
+#ifdef DARWIN_TFLITE_XNNPACK
+#include "tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h"
+#endif
 
 ///
-/// \brief acquire pointer to model to be used for prediction
+/// \brief set the options of the interpreters, must be called before the first call to GetInterpreter
 /// 
-/// \param model pointer to model to be used for prediction
+/// \param num_threads the number of threads used by each interpreter, 0 to let TF lite decide
+/// \param use_xnnpack whether the interpreters run the model with the XNNPACK delegate,
+///        ignored if darwin was not built with XNNPACK
 ///
-void DarwinTfLiteInterpreterFactory::SetModel(std::shared_ptr<tflite::FlatBufferModel> model){
-    this->_model = model;
+void DarwinTfLiteInterpreterFactory::SetOptions(unsigned int num_threads, bool use_xnnpack){
+    this->_numThreads = num_threads;
+    this->_useXnnpack = use_xnnpack;
 }
 
 ///
 /// \brief TF lite interpreters are *NOT* thread-safe, to ensure thread safety in darwin, 
-///        this function returns a pointer to a thread_local tflite::interpreter
-///        This method must be called AFTER Factory::SetModel
-///        In case of an error (model not set), it kills its process and returns a nullptr
+///        this function returns a pointer to a thread_local tflite::interpreter running the given model
+///        When the model changes, the interpreter of the thread is rebuilt, and the previous one released
+///        In case of an error (no model given), it kills its process and returns a nullptr
 /// 
-/// \return std::shared_ptr<tflite::Interpreter> pointer to a thread_local allocated interpreter, may be null if no model is set
+/// \param model pointer to model to be used for prediction, kept alive by the interpreter
+/// \return std::shared_ptr<tflite::Interpreter> pointer to a thread_local allocated interpreter, may be null if no model is given
 ///
-std::shared_ptr<tflite::Interpreter> DarwinTfLiteInterpreterFactory::GetInterpreter(){
+std::shared_ptr<tflite::Interpreter> DarwinTfLiteInterpreterFactory::GetInterpreter(const std::shared_ptr<tflite::FlatBufferModel> &model){
     static thread_local std::shared_ptr<tflite::Interpreter> interpreter;
-    if( ! interpreter){
-        if( ! _model) {
+    // the model is kept alive by the interpreter, its address can't be reused while the interpreter exists
+    static thread_local const tflite::FlatBufferModel *interpreter_model = nullptr;
+    if( ! interpreter || interpreter_model != model.get()){
+        if( ! model) {
             // this case is not possible with the actual workflow, we just make sure that it stays that way in the future
             DARWIN_LOGGER;
-            DARWIN_LOG_CRITICAL("DarwinTfLiteInterpreterFactory::GetInterpreter:: Trying to get a TFLite Interpreter before setting the model, exiting");
+            DARWIN_LOG_CRITICAL("DarwinTfLiteInterpreterFactory::GetInterpreter:: Trying to get a TFLite Interpreter without a model, exiting");
             kill(getpid(), SIGTERM);
             return nullptr;
         }
+        // the interpreter of the previous model is retired, sessions still using it keep their reference
+        interpreter.reset();
+        interpreter_model = model.get();
+        DARWIN_LOGGER;
         tflite::ops::builtin::BuiltinOpResolver resolver;
-        tflite::InterpreterBuilder i_builder(*_model, resolver);
+        tflite::InterpreterBuilder i_builder(*model, resolver);
         std::unique_ptr<tflite::Interpreter> interp_unique;
         i_builder(&interp_unique);
-        interpreter = std::move(interp_unique);
+        if( ! interp_unique) {
+            DARWIN_LOG_ERROR("DarwinTfLiteInterpreterFactory::GetInterpreter:: Could not build a TFLite Interpreter");
+            return nullptr;
+        }
+        if(_numThreads > 0) {
+            interp_unique->SetNumThreads(static_cast<int>(_numThreads));
+        }
+
+        // the delegate and the model must outlive the interpreter, they are released by the deleter of the interpreter
+        std::shared_ptr<TfLiteDelegate> delegate;
+#ifdef DARWIN_TFLITE_XNNPACK
+        if(_useXnnpack) {
+            TfLiteXNNPackDelegateOptions options = TfLiteXNNPackDelegateOptionsDefault();
+            if(_numThreads > 0) {
+                options.num_threads = static_cast<int>(_numThreads);
+            }
+            delegate.reset(TfLiteXNNPackDelegateCreate(&options), TfLiteXNNPackDelegateDelete);
+            if(interp_unique->ModifyGraphWithDelegate(delegate.get()) != kTfLiteOk) {
+                DARWIN_LOG_WARNING("DarwinTfLiteInterpreterFactory::GetInterpreter:: Could not apply the XNNPACK delegate, using the builtin kernels");
+            }
+        }
+#endif
+        interpreter = std::shared_ptr<tflite::Interpreter>(interp_unique.release(), [delegate, model](tflite::Interpreter *i) {
+            delete i;
+        });
     }
     return interpreter;
 };
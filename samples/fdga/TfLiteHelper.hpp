@@ -42,20 +42,24 @@ class DarwinTfLiteInterpreterFactory {
 
         ///
         /// \brief TF lite interpreters are *NOT* thread-safe, to ensure thread safety in darwin, 
-        ///        this function returns a pointer to a thread_local tflite::interpreter
-        ///        This method must be called AFTER Factory::SetModel
-        ///        In case of an error (model not set), it kills its process and returns a nullptr
+        ///        this function returns a pointer to a thread_local tflite::interpreter running the given model
+        ///        When the model changes, the interpreter of the thread is rebuilt, and the previous one released
+        ///        In case of an error (no model given), it kills its process and returns a nullptr
         /// 
-        /// \return std::shared_ptr<tflite::Interpreter> pointer to a thread_local allocated interpreter, may be null if no model is set
+        /// \param model pointer to model to be used for prediction, kept alive by the interpreter
+        /// \return std::shared_ptr<tflite::Interpreter> pointer to a thread_local allocated interpreter, may be null if no model is given
         ///
-        std::shared_ptr<tflite::Interpreter> GetInterpreter();
+        std::shared_ptr<tflite::Interpreter> GetInterpreter(const std::shared_ptr<tflite::FlatBufferModel> &model);
 
         ///
-        /// \brief acquire pointer to model to be used for prediction
+        /// \brief set the options of the interpreters, must be called before the first call to GetInterpreter
         /// 
-        /// \param model pointer to model to be used for prediction
+        /// \param num_threads the number of threads used by each interpreter, 0 to let TF lite decide
+        /// \param use_xnnpack whether the interpreters run the model with the XNNPACK delegate,
+        ///        ignored if darwin was not built with XNNPACK
         ///
-        void SetModel(std::shared_ptr<tflite::FlatBufferModel> model);
+        void SetOptions(unsigned int num_threads, bool use_xnnpack);
     private:
-        std::shared_ptr<tflite::FlatBufferModel> _model;
+        unsigned int _numThreads = 0;
+        bool _useXnnpack = false;
 };
\ No newline at end of file
@@ -30,83 +30,134 @@ long ContentInspectionTask::GetFilterCode() noexcept {
     return DARWIN_FILTER_CONTENT_INSPECTION;
 }
 
-void ContentInspectionTask::operator()() {
-    DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("ContentInspectionTask:: started task");
-    bool is_log = GetOutputType() == darwin::config::output_type::LOG;
-
-    for(Packet *pkt : _packetList) {
-        unsigned int certitude = 0;
-        int tcpStatus = 0;
-        SetStartingTime();
+void ContentInspectionTask::ProcessPacket(void *data) {
+    PacketJob *job = (PacketJob *)data;
+    Packet *pkt = job->pkt;
+    YaraCnf *yaraCnf = job->configurations->yaraCnf;
+    int tcpStatus = 0;
 
-        pkt->enterTime = std::time(NULL);
-        pkt->hash = calculatePacketFlowHash(pkt);
+    // flows can't be reclaimed while the packet references them
+    flowEpochEnter();
 
-        if(pkt->flags & PKT_HASH_READY && _configurations.yaraCnf->scanType == SCAN_STREAM) {
-            pkt->flow = getOrCreateFlowFromHash(pkt);
+    if(pkt->flags & PKT_HASH_READY && yaraCnf->scanType == SCAN_STREAM) {
+        pkt->flow = getOrCreateFlowFromHash(pkt);
 
-            if(pkt->flow && pkt->proto == IPPROTO_TCP) {
-                pthread_mutex_lock(&(pkt->flow->mFlow));
-                tcpStatus = handleTcpFromPacket(pkt);
-                pthread_mutex_unlock(&(pkt->flow->mFlow));
+        if(pkt->flow && pkt->proto == IPPROTO_TCP) {
+            pthread_mutex_lock(&(pkt->flow->mFlow));
+            tcpStatus = handleTcpFromPacket(pkt);
+            pthread_mutex_unlock(&(pkt->flow->mFlow));
 
-            }
         }
+    }
 
-        if(pkt->payloadLen) {
-            YaraResults results;
-
-            if(_configurations.yaraCnf->scanType == SCAN_STREAM &&
-               pkt->flow && pkt->proto == IPPROTO_TCP && tcpStatus != -1) {
-                StreamBuffer *sb;
-                pthread_mutex_lock(&(pkt->flow->mFlow));
-                TcpSession *session = (TcpSession *)pkt->flow->protoCtx;
+    if(pkt->payloadLen) {
+        if(yaraCnf->scanType == SCAN_STREAM &&
+           pkt->flow && pkt->proto == IPPROTO_TCP && tcpStatus != -1) {
+            StreamBuffer *sb = NULL;
+            pthread_mutex_lock(&(pkt->flow->mFlow));
+            /* flow may have expired and released its session since the packet was handled */
+            TcpSession *session = (TcpSession *)pkt->flow->protoCtx;
+            if(!pkt->flow->expired && session) {
                 if(getPacketFlowDirection(pkt->flow, pkt) == TO_SERVER) {
                     sb = session->cCon->streamBuffer;
                 }
                 else {
                     sb = session->sCon->streamBuffer;
                 }
+                /* taken before releasing the flow, so the buffer can't be reset during the scan */
                 pthread_mutex_lock(&(sb->mutex));
-                pthread_mutex_unlock(&(pkt->flow->mFlow));
+            }
+            pthread_mutex_unlock(&(pkt->flow->mFlow));
 
-                results = yaraScan(pkt->payload, pkt->payloadLen, sb);
+            if(sb) {
+                job->results = yaraScan(pkt->payload, pkt->payloadLen, sb);
                 pthread_mutex_unlock(&(sb->mutex));
             }
-            else if(_configurations.yaraCnf->scanType == SCAN_PACKET_ONLY ||
-                    tcpStatus == -1){
-                results = yaraScan(pkt->payload, pkt->payloadLen, NULL);
+            else {
+                job->results = yaraScan(pkt->payload, pkt->payloadLen, NULL);
             }
+        }
+        else if(yaraCnf->scanType == SCAN_PACKET_ONLY ||
+                tcpStatus == -1){
+            job->results = yaraScan(pkt->payload, pkt->payloadLen, NULL);
+        }
+    }
+
+    freePacket(pkt);
+    flowEpochExit();
+}
+
+void ContentInspectionTask::operator()() {
+    DARWIN_LOGGER;
+    DARWIN_LOG_DEBUG("ContentInspectionTask:: started task");
+    bool is_log = GetOutputType() == darwin::config::output_type::LOG;
+    FlowDispatcher *dispatcher = _configurations.dispatcher;
+    std::vector<PacketJob> jobs(_packetList.size());
+    DispatchBatch batch;
+    uint32_t dispatched = 0;
+
+    SetStartingTime();
+    for(std::size_t i = 0; i < _packetList.size(); i++) {
+        Packet *pkt = _packetList[i];
+        jobs[i].pkt = pkt;
+        jobs[i].configurations = &_configurations;
+
+        if(pkt == nullptr) continue;
+        pkt->enterTime = std::time(NULL);
+        pkt->hash = calculatePacketFlowHash(pkt);
+        dispatched++;
+    }
+
+    // packets of a flow always go to the same lane, so they are processed in order
+    if(dispatcher) {
+        dispatchBatchInit(&batch, dispatched);
+        for(PacketJob &job : jobs) {
+            if(job.pkt) dispatchItem(dispatcher, job.pkt->hash, &job, &batch);
+        }
+        dispatchBatchWait(&batch);
+    }
+    else {
+        for(PacketJob &job : jobs) {
+            if(job.pkt) ProcessPacket(&job);
+        }
+    }
+
+    for(PacketJob &job : jobs) {
+        unsigned int certitude = 0;
 
-            if(not results.rules.empty()) {
-
-                std::string ruleListJson = ContentInspectionTask::GetJsonListFromSet(results.rules);
-                std::string tagListJson = ContentInspectionTask::GetJsonListFromSet(results.tags);
-                std::string details = "{\"rules\": " + ruleListJson + "}";
-
-                certitude = 100;
-                if (certitude >= _threshold and certitude < DARWIN_ERROR_RETURN){
-                    STAT_MATCH_INC;
-                    DARWIN_ALERT_MANAGER.SetTags(tagListJson);
-                    DARWIN_ALERT_MANAGER.Alert("raw_data", certitude, Evt_idToString(), details);
-                    if (is_log) {
-                        std::string alert_log = R"({"evt_id": ")" + Evt_idToString() + R"(", "time": ")" + darwin::time_utils::GetTime() +
-                                R"(", "filter": ")" + GetFilterName() + R"(", "certitude": )" + std::to_string(certitude) +
-                                R"(, "rules": )" + ruleListJson + R"(, "tags": )" + tagListJson +
-                                "}";
-                        _logs += alert_log + "\n";
-                    }
+        if(job.pkt == nullptr) {
+            DARWIN_LOG_WARNING("ContentInspectionTask:: could not get packet, skipping entry");
+            _certitudes.push_back(DARWIN_ERROR_RETURN);
+            continue;
+        }
+
+        if(not job.results.rules.empty()) {
+
+            std::string ruleListJson = ContentInspectionTask::GetJsonListFromSet(job.results.rules);
+            std::string tagListJson = ContentInspectionTask::GetJsonListFromSet(job.results.tags);
+            std::string details = "{\"rules\": " + ruleListJson + "}";
+
+            certitude = 100;
+            if (certitude >= _threshold and certitude < DARWIN_ERROR_RETURN){
+                STAT_MATCH_INC;
+                DARWIN_ALERT_MANAGER.SetTags(tagListJson);
+                DARWIN_ALERT_MANAGER.Alert("raw_data", certitude, Evt_idToString(), details);
+                if (is_log) {
+                    std::string alert_log = R"({"evt_id": ")" + Evt_idToString() + R"(", "time": ")" + darwin::time_utils::GetTime() +
+                            R"(", "filter": ")" + GetFilterName() + R"(", "certitude": )" + std::to_string(certitude) +
+                            R"(, "rules": )" + ruleListJson + R"(, "tags": )" + tagListJson +
+                            "}";
+                    _logs += alert_log + "\n";
                 }
             }
         }
 
         _certitudes.push_back(certitude);
-        DARWIN_LOG_INFO("ContentInspectionTask:: processed entry in "
-                         + std::to_string(GetDurationMs()) + "ms, certitude: " + std::to_string(certitude));
-        freePacket(pkt);
+        DARWIN_LOG_DEBUG("ContentInspectionTask:: processed entry, certitude: " + std::to_string(certitude));
     }
 
+    DARWIN_LOG_INFO("ContentInspectionTask:: processed " + std::to_string(jobs.size()) + " entries in "
+                     + std::to_string(GetDurationMs()) + "ms");
     DARWIN_LOG_DEBUG("ContentInspectionTask:: task finished");
 }
 
@@ -117,43 +168,23 @@ bool ContentInspectionTask::ParseBody() {
 
     try {
         _logs.clear();
-        std::size_t packetMeta = 0, packetMetaEnd;
-        std::size_t packetData, packetDataEnd = 0;
-        std::size_t openingBracket;
+        // entries are ["{metadata}", "{data}"], the objects being unescaped they can't be parsed as a JSON body
+        const char *body = _raw_body.data(), *end = body + _raw_body.size();
+        std::size_t entry = 0;
 
-        do {
-            packetMeta = _raw_body.find("\"{", packetDataEnd + 1);
-            if(packetMeta == std::string::npos) {
-                break;
-            }
+        while((entry = _raw_body.find("\"{", entry)) != std::string::npos) {
+            Packet *pkt;
             STAT_INPUT_INC;
 
-            packetMetaEnd = _raw_body.find("}\",", packetMeta);
-            if(packetMetaEnd == std::string::npos) {
-                DARWIN_LOG_WARNING("ContentInspectionTask:: parse fail 1");
-                STAT_PARSE_ERROR_INC;
-                break;
-            }
-
-            packetData = _raw_body.find("\"{", packetMetaEnd);
-            if(packetData == std::string::npos) {
-                DARWIN_LOG_WARNING("ContentInspectionTask:: parse fail 2");
+            const char *entryEnd = parseImpcapEntry(body + entry, end, &pkt);
+            if(entryEnd == nullptr) {
+                DARWIN_LOG_WARNING("ContentInspectionTask:: ParseBody: could not parse entry at offset " + std::to_string(entry));
                 STAT_PARSE_ERROR_INC;
                 break;
             }
-
-            packetDataEnd = _raw_body.find("}\"", packetData);
-            if(packetDataEnd == std::string::npos) {
-                DARWIN_LOG_WARNING("ContentInspectionTask:: parse fail 3");
-                STAT_PARSE_ERROR_INC;
-                break;
-            }
-
-            _packetList.push_back(getImpcapData(
-                    _raw_body.substr(packetMeta + 1, packetMetaEnd - packetMeta),
-                    _raw_body.substr(packetData + 1, packetDataEnd - packetData)
-            ));
-        } while(true);
+            _packetList.push_back(pkt);
+            entry = entryEnd - body;
+        }
 
     } catch (...) {
         DARWIN_LOG_CRITICAL("ContentInspectionTask:: ParseBody: Unknown Error");
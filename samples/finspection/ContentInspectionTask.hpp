@@ -21,6 +21,7 @@
 #include "flow.hpp"
 #include "yara_utils.hpp"
 #include "extract_impcap.hpp"
+#include "flow_dispatcher.hpp"
 
 #define DARWIN_FILTER_CONTENT_INSPECTION 0x79617261
 #define DARWIN_FILTER_NAME "inspection"
@@ -31,8 +32,15 @@ typedef struct Configurations_t {
     StreamsCnf *streamsCnf;
     FlowCnf *flowCnf;
     YaraCnf *yaraCnf;
+    FlowDispatcher *dispatcher; // NULL if packets are processed by the task thread
 }Configurations;
 
+typedef struct PacketJob_t {
+    Packet *pkt;
+    Configurations *configurations;
+    YaraResults results;
+}PacketJob;
+
 // To create a usable task method you MUST inherit from darwin::thread::Task publicly.
 // The code bellow show all what's necessary to have a working task.
 // For more information about Tasks, please refer to the class definition.
@@ -51,6 +59,11 @@ public:
     // You need to override the functor to compile and be executed by the thread
     void operator()() override;
 
+    /// Handle the TCP session and YARA scan of a packet, then free it.
+    /// Called either by the task thread or by the lane owning the packet's flow.
+    /// \param data the PacketJob of the packet, holding the scan results once processed
+    static void ProcessPacket(void *data);
+
 protected:
     /// Return filter code
     long GetFilterCode() noexcept override;
@@ -19,10 +19,12 @@ Generator::Generator() {
     _configurations.flowCnf = (FlowCnf *)calloc(1, sizeof(FlowCnf));
     _configurations.streamsCnf = (StreamsCnf *)calloc(1, sizeof(StreamsCnf));
     _configurations.yaraCnf = (YaraCnf *)calloc(1, sizeof(YaraCnf));
+    _configurations.dispatcher = nullptr;
     flowInitConfig(_configurations.flowCnf);
     yaraInitConfig(_configurations.yaraCnf);
     streamInitConfig(_configurations.streamsCnf);
     initTCPPools();
+    initPacketPool();
 
     _memoryManager = initMemoryManager();
     startMemoryManager(_memoryManager);
@@ -55,6 +57,7 @@ bool Generator::LoadConfig(const rapidjson::Document &config) {
 	}
 
     char str[2048];
+    uint32_t lanes = DISPATCHER_DEFAULT_LANES;
     if(config.HasMember("maxConnections")) {
         if(config["maxConnections"].IsUint()) {
             _configurations.flowCnf->maxFlow = config["maxConnections"].GetUint();
@@ -65,6 +68,36 @@ bool Generator::LoadConfig(const rapidjson::Document &config) {
             DARWIN_LOG_ERROR("ContentInspection:: Generator:: 'maxConnections' parameter must be a number");
         }
     }
+    if(config.HasMember("flowIdleTimeout")) {
+        if(config["flowIdleTimeout"].IsUint() && config["flowIdleTimeout"].GetUint() > 0) {
+            _configurations.flowCnf->idleTimeout = config["flowIdleTimeout"].GetUint();
+            std::snprintf(str, 2048, "flowIdleTimeout set to %us", _configurations.flowCnf->idleTimeout);
+            DARWIN_LOG_DEBUG(str);
+        }
+        else {
+            DARWIN_LOG_ERROR("ContentInspection:: Generator:: 'flowIdleTimeout' parameter must be a strictly positive number");
+        }
+    }
+    if(config.HasMember("flowClosedTimeout")) {
+        if(config["flowClosedTimeout"].IsUint() && config["flowClosedTimeout"].GetUint() > 0) {
+            _configurations.flowCnf->closedTimeout = config["flowClosedTimeout"].GetUint();
+            std::snprintf(str, 2048, "flowClosedTimeout set to %us", _configurations.flowCnf->closedTimeout);
+            DARWIN_LOG_DEBUG(str);
+        }
+        else {
+            DARWIN_LOG_ERROR("ContentInspection:: Generator:: 'flowClosedTimeout' parameter must be a strictly positive number");
+        }
+    }
+    if(config.HasMember("tcpMaxQueuedBytes")) {
+        if(config["tcpMaxQueuedBytes"].IsUint()) {
+            _configurations.flowCnf->maxQueuedBytes = config["tcpMaxQueuedBytes"].GetUint();
+            std::snprintf(str, 2048, "tcpMaxQueuedBytes set to %u", _configurations.flowCnf->maxQueuedBytes);
+            DARWIN_LOG_DEBUG(str);
+        }
+        else {
+            DARWIN_LOG_ERROR("ContentInspection:: Generator:: 'tcpMaxQueuedBytes' parameter must be a number");
+        }
+    }
     if(config.HasMember("yaraRuleFile")) {
         if(config["yaraRuleFile"].IsString()) {
             _configurations.yaraCnf->ruleFilename = (char *)config["yaraRuleFile"].GetString();
@@ -113,6 +146,10 @@ bool Generator::LoadConfig(const rapidjson::Document &config) {
     }
     if(config.HasMember("yaraScanMaxSize")) {
         if(config["yaraScanMaxSize"].IsUint()) {
+            if(config["yaraScanMaxSize"].GetUint() == 0) {
+                DARWIN_LOG_ERROR("ContentInspection:: Generator:: 'yaraScanMaxSize' parameter must be strictly positive");
+                return false;
+            }
             _configurations.yaraCnf->scanMaxSize = config["yaraScanMaxSize"].GetUint();
             _configurations.streamsCnf->streamMaxBufferSize = config["yaraScanMaxSize"].GetUint();
 
@@ -123,9 +160,25 @@ bool Generator::LoadConfig(const rapidjson::Document &config) {
             DARWIN_LOG_ERROR("ContentInspection:: Generator:: 'yaraScanMaxSize' parameter must be a number");
         }
     }
+    if(config.HasMember("yaraStreamOverlap")) {
+        if(config["yaraStreamOverlap"].IsUint() && config["yaraStreamOverlap"].GetUint() < SCAN_OVERLAP_AUTO) {
+            _configurations.yaraCnf->streamOverlap = config["yaraStreamOverlap"].GetUint();
+
+            std::snprintf(str, 2048, "yaraStreamOverlap set to %u", _configurations.yaraCnf->streamOverlap);
+            DARWIN_LOG_DEBUG(str);
+        }
+        else if(config["yaraStreamOverlap"].IsString() && std::string(config["yaraStreamOverlap"].GetString()) == "auto") {
+            _configurations.yaraCnf->streamOverlap = SCAN_OVERLAP_AUTO;
+            DARWIN_LOG_DEBUG("ContentInspection:: Generator:: yaraStreamOverlap computed from the rules");
+        }
+        else {
+            DARWIN_LOG_ERROR("ContentInspection:: Generator:: 'yaraStreamOverlap' parameter must be a number or 'auto'");
+        }
+    }
     if(config.HasMember("streamStoreFolder")) {
         if(config["streamStoreFolder"].IsString()) {
-            _configurations.streamsCnf->streamStoreFolder = (char *)config["streamStoreFolder"].GetString();
+            // freed with the streams configuration
+            _configurations.streamsCnf->streamStoreFolder = strdup(config["streamStoreFolder"].GetString());
 
             std::snprintf(str, 2048, "streamStoreFolder is '%s'", _configurations.streamsCnf->streamStoreFolder);
             DARWIN_LOG_DEBUG(str);
@@ -134,6 +187,16 @@ bool Generator::LoadConfig(const rapidjson::Document &config) {
             DARWIN_LOG_ERROR("ContentInspection:: Generator:: 'yaraScanMaxSize' parameter must be a string");
         }
     }
+    if(config.HasMember("streamStoreMaxOpenFiles")) {
+        if(config["streamStoreMaxOpenFiles"].IsUint() && config["streamStoreMaxOpenFiles"].GetUint() > 0) {
+            _configurations.streamsCnf->streamStoreMaxOpenFiles = config["streamStoreMaxOpenFiles"].GetUint();
+            std::snprintf(str, 2048, "streamStoreMaxOpenFiles set to %u", _configurations.streamsCnf->streamStoreMaxOpenFiles);
+            DARWIN_LOG_DEBUG(str);
+        }
+        else {
+            DARWIN_LOG_ERROR("ContentInspection:: Generator:: 'streamStoreMaxOpenFiles' parameter must be a strictly positive number");
+        }
+    }
     if(config.HasMember("maxMemoryUsage")) {
         if(config["maxMemoryUsage"].IsUint()) {
             poolStorage->maxDataSize = config["maxMemoryUsage"].GetUint() * 1024 * 1024;
@@ -144,12 +207,28 @@ bool Generator::LoadConfig(const rapidjson::Document &config) {
             DARWIN_LOG_ERROR("ContentInspection:: Generator:: 'maxMemoryUsage' parameter must be a number");
         }
     }
+    if(config.HasMember("processingLanes")) {
+        if(config["processingLanes"].IsUint()) {
+            lanes = config["processingLanes"].GetUint();
+            std::snprintf(str, 2048, "processingLanes set to %u", lanes);
+            DARWIN_LOG_DEBUG(str);
+        }
+        else {
+            DARWIN_LOG_ERROR("ContentInspection:: Generator:: 'processingLanes' parameter must be a number");
+        }
+    }
 
     if(_configurations.streamsCnf->streamStoreFolder) {
         if(createFolder(_configurations.streamsCnf->streamStoreFolder) != 0) {
             DARWIN_LOG_ERROR("ContentInspection:: Generator:: could not create folder to dump files");
             return false;
         }
+
+        _configurations.streamsCnf->dumpWriter = startDumpWriter(_configurations.streamsCnf->streamStoreMaxOpenFiles);
+        if(!_configurations.streamsCnf->dumpWriter) {
+            DARWIN_LOG_ERROR("ContentInspection:: Generator:: could not start stream dump writer");
+            return false;
+        }
     }
 
     if(!_configurations.streamsCnf->streamStoreFolder && _configurations.yaraCnf->scanType == SCAN_NONE) {
@@ -164,6 +243,27 @@ bool Generator::LoadConfig(const rapidjson::Document &config) {
         return false;
     }
 
+    // without an explicit limit, flows are bounded by the memory budget, each holding 2 fixed-size stream buffers.
+    // Out-of-order TCP data is copied in the same budget, a quarter of it is left to the queued segments
+    if(not config.HasMember("maxConnections") and config.HasMember("maxMemoryUsage") and
+       _configurations.yaraCnf->scanType == SCAN_STREAM) {
+        uint64_t flowSize = sizeof(Flow) + sizeof(TcpSession) +
+                            2 * (sizeof(TcpConnection) + sizeof(StreamBuffer) + _configurations.streamsCnf->streamMaxBufferSize);
+        uint64_t maxFlow = (poolStorage->maxDataSize - poolStorage->maxDataSize / 4) / flowSize;
+
+        _configurations.flowCnf->maxFlow = maxFlow ? (uint32_t)maxFlow : 1;
+        std::snprintf(str, 2048, "maxConnections derived from maxMemoryUsage: %u", _configurations.flowCnf->maxFlow);
+        DARWIN_LOG_INFO(str);
+    }
+
+    if(lanes) {
+        _configurations.dispatcher = createFlowDispatcher(lanes, ContentInspectionTask::ProcessPacket);
+        if(!_configurations.dispatcher) {
+            DARWIN_LOG_WARNING("ContentInspection:: Generator:: could not start processing lanes, "
+                               "packets will be processed by the task threads");
+        }
+    }
+
     DARWIN_LOG_DEBUG("ContentInspection:: Generator:: Configured");
     return true;
 }
@@ -176,12 +276,19 @@ Generator::CreateTask(boost::asio::local::stream_protocol::socket& socket,
 }
 
 Generator::~Generator() {
+    // lanes may still hold flows and packets
+    deleteFlowDispatcher(_configurations.dispatcher);
+    // the memory manager expires flows and sessions, stop it before freeing them
+    stopMemoryManager(_memoryManager);
+    // queued TCP segments hold packets
     destroyTCPPools();
+    destroyPacketPool();
     yaraDeleteConfig(_configurations.yaraCnf);
     streamDeleteConfig(_configurations.streamsCnf);
     flowDeleteConfig(_configurations.flowCnf);
     deletePoolStorage(poolStorage);
-    stopMemoryManager(_memoryManager);
+    // threads exiting later must not give their magazines back
+    poolStorage = NULL;
     DARWIN_LOGGER;
     DARWIN_LOG_INFO("ContentInspection:: Generator:: generator successfully destroyed");
 }
\ No newline at end of file
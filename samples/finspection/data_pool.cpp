@@ -30,24 +30,53 @@
 
 PoolStorage *poolStorage;
 
+typedef struct PoolMagazine_ {
+    uint32_t poolId;
+    uint32_t count;
+    DataObject *objects[POOL_MAGAZINE_SIZE];
+} PoolMagazine;
+
+/* magazines of a thread, registered so the memory manager can give their objects back to the pools */
+struct ThreadMagazines {
+    PoolMagazine magazines[POOL_MAX_MAGAZINES];
+    pthread_mutex_t mutex; /* only contended when the memory manager flushes the magazines */
+
+    ThreadMagazines *prev;
+    ThreadMagazines *next;
+
+    ThreadMagazines();
+    ~ThreadMagazines();
+};
+
+static ThreadMagazines *threadMagazinesList = NULL;
+static pthread_mutex_t threadMagazinesMutex = PTHREAD_MUTEX_INITIALIZER;
+static thread_local ThreadMagazines threadMagazines;
+static uint32_t lastPoolId = 0;
+
+static inline PoolMagazine *getPoolMagazine(ThreadMagazines *thread, DataPool *pool) {
+    if(!pool->id || pool->id > POOL_MAX_MAGAZINES) return NULL;
+
+    PoolMagazine *magazine = &thread->magazines[pool->id - 1];
+    /* pool ids are never reused, the magazine can only belong to this pool or be unused yet */
+    if(magazine->poolId != pool->id) {
+        magazine->poolId = pool->id;
+        magazine->count = 0;
+    }
+    return magazine;
+}
+
 static inline DataObject *createDataObject(DataPool *pool) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("createDataObject");
 
-    DataObject *newDataObject = (DataObject *)malloc(sizeof(DataObject));
+    DataObject *newDataObject = (DataObject *)calloc(1, sizeof(DataObject));
     if (newDataObject) {
-        pthread_mutexattr_t attr;
-        pthread_mutexattr_init(&attr);
-        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-
         newDataObject->pObject = NULL;
         newDataObject->state = DataObject::INIT;
         newDataObject->stale = 1;
-        pthread_mutex_init(&(newDataObject->mutex), &attr);
         newDataObject->pool = pool;
         newDataObject->size = sizeof(DataObject);
 
-        pthread_mutexattr_destroy(&attr);
         return newDataObject;
     }
 
@@ -79,6 +108,7 @@ static inline void addPoolToStorage(DataPool *pool) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("addPoolToStorage");
 
+    pthread_mutex_lock(&(poolStorage->mutex));
     if (poolStorage->head) {
         pool->prev = poolStorage->head;
         poolStorage->head->next = pool;
@@ -87,67 +117,139 @@ static inline void addPoolToStorage(DataPool *pool) {
     pool->next = NULL;
     poolStorage->listSize++;
     if (!poolStorage->tail) poolStorage->tail = pool;
+    pthread_mutex_unlock(&(poolStorage->mutex));
 
     pool->poolStorage = poolStorage;
 
     return;
 }
 
-uint32_t deleteDataObjectFromPool(DataObject *object, DataPool *pool) {
+static inline void accountPoolSize(DataPool *pool, int diffSize) {
+    __atomic_add_fetch(&pool->totalAllocSize, diffSize, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pool->poolStorage->totalDataSize, diffSize, __ATOMIC_RELAXED);
+}
+
+/**
+ * Frees an available object
+ * WARNING: pool mutex must be held, and the object must have been removed from the free list
+ */
+static uint32_t deleteDataObjectFromPool(DataObject *object, DataPool *pool) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("deleteDataObjectFromPool");
     uint32_t dataFreed = 0;
 
     if (pool && object && object->state != DataObject::USED) {
-
-        pthread_mutex_lock(&(pool->mutex));
-
         if (object->next) object->next->prev = object->prev;
         if (object->prev) object->prev->next = object->next;
         if (pool->head == object) pool->head = object->prev;
         if (pool->tail == object) pool->tail = object->next;
         pool->listSize--;
-        pool->availableElems--;
-        pool->totalAllocSize -= object->size;
+        __atomic_sub_fetch(&pool->availableElems, 1, __ATOMIC_RELAXED);
         dataFreed = object->size;
-
-        pthread_mutex_lock(&(pool->poolStorage->mutex));
-        pool->poolStorage->totalDataSize -= object->size;
-        pthread_mutex_unlock(&(pool->poolStorage->mutex));
-
-        pthread_mutex_unlock(&(pool->mutex));
-
+        accountPoolSize(pool, -(int)object->size);
 
         pool->objectDestructor(object->pObject);
-        pthread_mutex_destroy(&(object->mutex));
         free(object);
     }
     return dataFreed;
 }
 
+/* moves the objects of the magazine beyond keep to the shared free list */
+static inline void flushPoolMagazine(DataPool *pool, PoolMagazine *magazine, uint32_t keep) {
+    pthread_mutex_lock(&(pool->mutex));
+    while(magazine->count > keep) {
+        DataObject *object = magazine->objects[--magazine->count];
+        object->nextFree = pool->freeList;
+        pool->freeList = object;
+        pool->freeListSize++;
+    }
+    pthread_mutex_unlock(&(pool->mutex));
+}
+
+/**
+ * Gives back all the objects kept by a thread to the shared free lists of the pools still alive,
+ * objects of destroyed pools were freed with them
+ * WARNING: poolStorage mutex must be held
+ */
+static void flushThreadMagazines(ThreadMagazines *thread) {
+    DataPool *pool;
+
+    pthread_mutex_lock(&(thread->mutex));
+    for(pool = poolStorage->tail; pool != NULL; pool = pool->next) {
+        PoolMagazine *magazine = getPoolMagazine(thread, pool);
+        if(magazine && magazine->count) flushPoolMagazine(pool, magazine, 0);
+    }
+    pthread_mutex_unlock(&(thread->mutex));
+}
+
+ThreadMagazines::ThreadMagazines() {
+    memset(magazines, 0, sizeof(magazines));
+    pthread_mutex_init(&mutex, NULL);
+
+    pthread_mutex_lock(&threadMagazinesMutex);
+    prev = NULL;
+    next = threadMagazinesList;
+    if(threadMagazinesList) threadMagazinesList->prev = this;
+    threadMagazinesList = this;
+    pthread_mutex_unlock(&threadMagazinesMutex);
+}
+
+/* called when the thread exits, so its objects are not stranded in its magazines */
+ThreadMagazines::~ThreadMagazines() {
+    PoolStorage *storage = poolStorage;
+
+    if(storage) pthread_mutex_lock(&(storage->mutex));
+
+    pthread_mutex_lock(&threadMagazinesMutex);
+    if(next) next->prev = prev;
+    if(prev) prev->next = next;
+    else threadMagazinesList = next;
+    pthread_mutex_unlock(&threadMagazinesMutex);
+
+    if(storage) {
+        flushThreadMagazines(this);
+        pthread_mutex_unlock(&(storage->mutex));
+    }
+    pthread_mutex_destroy(&mutex);
+}
+
 void setObjectAvailable(DataObject *object) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("setObjectAvailable");
-    pthread_mutex_lock(&(object->mutex));
-    object->state = DataObject::AVAILABLE;
-    object->pool->objectResetor(object->pObject);
-    object->pool->availableElems++;
-    pthread_mutex_unlock(&(object->mutex));
+    DataPool *pool = object->pool;
+
+    /* concurrent releases of the same object must not both get it back to the pool */
+    if(__atomic_exchange_n(&object->state, DataObject::AVAILABLE, __ATOMIC_ACQ_REL) == DataObject::AVAILABLE) {
+        DARWIN_LOG_WARNING("object of '" + std::string(pool->poolName) + "' released twice, ignoring");
+        return;
+    }
+
+    pool->objectResetor(object->pObject);
+    __atomic_add_fetch(&pool->availableElems, 1, __ATOMIC_RELAXED);
+
+    ThreadMagazines *thread = &threadMagazines;
+    pthread_mutex_lock(&(thread->mutex));
+    PoolMagazine *magazine = getPoolMagazine(thread, pool);
+    if(magazine) {
+        if(magazine->count == POOL_MAGAZINE_SIZE) {
+            flushPoolMagazine(pool, magazine, POOL_MAGAZINE_SIZE/2);
+        }
+        magazine->objects[magazine->count++] = object;
+    }
+    else {
+        pthread_mutex_lock(&(pool->mutex));
+        object->nextFree = pool->freeList;
+        pool->freeList = object;
+        pool->freeListSize++;
+        pthread_mutex_unlock(&(pool->mutex));
+    }
+    pthread_mutex_unlock(&(thread->mutex));
 }
 
 void updateDataObjectSize(DataObject *object, int diffSize) {
     if (object) {
-        pthread_mutex_lock(&(object->mutex));
         object->size += diffSize;
-        pthread_mutex_unlock(&(object->mutex));
-
-        pthread_mutex_lock(&(object->pool->mutex));
-        object->pool->totalAllocSize += diffSize;
-        pthread_mutex_unlock(&(object->pool->mutex));
-
-        pthread_mutex_lock(&(object->pool->poolStorage->mutex));
-        object->pool->poolStorage->totalDataSize += diffSize;
-        pthread_mutex_unlock(&(object->pool->poolStorage->mutex));
+        accountPoolSize(object->pool, diffSize);
     }
     return;
 }
@@ -156,70 +258,130 @@ DataObject *getOrCreateAvailableObject(DataPool *pool) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("getOrCreateAvailableObject");
 
-    pthread_mutex_lock(&(pool->mutex));
+    DataObject *object = NULL;
+    ThreadMagazines *thread = &threadMagazines;
+    pthread_mutex_lock(&(thread->mutex));
+    PoolMagazine *magazine = getPoolMagazine(thread, pool);
 
-    DataObject *object = pool->tail;
-    while (object) {
-        pthread_mutex_lock(&(object->mutex));
-        if (object->state == DataObject::AVAILABLE) {
-            pthread_mutex_unlock(&(object->mutex));
-            break;
+    if(!magazine || !magazine->count) {
+        pthread_mutex_lock(&(pool->mutex));
+        if(magazine) {
+            /* refill half of the magazine at once */
+            while(pool->freeList && magazine->count < POOL_MAGAZINE_SIZE/2) {
+                magazine->objects[magazine->count++] = pool->freeList;
+                pool->freeList = pool->freeList->nextFree;
+                pool->freeListSize--;
+            }
         }
-        pthread_mutex_unlock(&(object->mutex));
-        object = object->next;
+        else if(pool->freeList) {
+            object = pool->freeList;
+            pool->freeList = object->nextFree;
+            pool->freeListSize--;
+        }
+        pthread_mutex_unlock(&(pool->mutex));
+    }
+    if(magazine && magazine->count) {
+        object = magazine->objects[--magazine->count];
     }
+    pthread_mutex_unlock(&(thread->mutex));
 
-    if (!object) {
-        if (poolStorage->totalDataSize >= poolStorage->maxDataSize) {
+    if (object) {
+        __atomic_sub_fetch(&pool->availableElems, 1, __ATOMIC_RELAXED);
+    }
+    else {
+        if (!pool->unbounded &&
+            __atomic_load_n(&poolStorage->totalDataSize, __ATOMIC_RELAXED) >= poolStorage->maxDataSize) {
             DARWIN_LOG_WARNING("WARNING: max memory usage reached, cannot create new objects");
-            pthread_mutex_unlock(&(pool->mutex));
             return NULL;
         }
 
         object = createDataObject(pool);
+        if (!object) return NULL;
         uint64_t sizeAlloc = (uint64_t)pool->objectConstructor((void *) object);
 
         if (sizeAlloc > 0) {
             object->size += sizeAlloc;
             addObjectToPool(pool, object);
-            object->pool->totalAllocSize += object->size;
-            object->pool->poolStorage->totalDataSize += object->size;
-            pool->availableElems++;
+            accountPoolSize(pool, object->size);
         } else {
-            pthread_mutex_destroy(&(object->mutex));
             free(object);
-            pthread_mutex_unlock(&(pool->mutex));
             return NULL;
         }
     }
 
-    object->state = DataObject::USED;
+    object->nextFree = NULL;
+    __atomic_store_n(&object->state, DataObject::USED, __ATOMIC_RELEASE);
     object->stale = 0;
-    pool->availableElems--;
 
+    return object;
+}
+
+/**
+ * Gives back the objects kept by the calling thread to the shared free lists,
+ * for threads which mostly release objects (like the memory manager)
+ */
+void releaseThreadMagazines() {
+    pthread_mutex_lock(&(poolStorage->mutex));
+    flushThreadMagazines(&threadMagazines);
+    pthread_mutex_unlock(&(poolStorage->mutex));
+}
+
+/**
+ * Frees the available objects of the shared free list which were not used since last call,
+ * while keeping at least minAvailableElems
+ * @param pool
+ * @return the memory freed
+ */
+static uint32_t trimPool(DataPool *pool) {
+    DARWIN_LOGGER;
+    uint32_t memFreed = 0;
+    DataObject **scan, *object;
+
+    pthread_mutex_lock(&(pool->mutex));
+    scan = &pool->freeList;
+    while(*scan) {
+        object = *scan;
+        if(object->stale && __atomic_load_n(&pool->availableElems, __ATOMIC_RELAXED) > pool->minAvailableElems) {
+            *scan = object->nextFree;
+            pool->freeListSize--;
+            memFreed += deleteDataObjectFromPool(object, pool);
+            continue;
+        }
+        object->stale = 1;
+        scan = &object->nextFree;
+    }
     pthread_mutex_unlock(&(pool->mutex));
 
-    return object;
+    DARWIN_LOG_DEBUG("memory manager: " + std::to_string(pool->availableElems) + " free, "
+                     + std::to_string(pool->listSize) + " total in '" + std::string(pool->poolName) +
+                    ", for " + std::to_string(pool->totalAllocSize) + " total memory");
+    return memFreed;
 }
 
-DataPool *createPool(char *poolName, constructor_t objectConstructor,
+DataPool *createPool(const char *poolName, constructor_t objectConstructor,
                      destructor_t objectDestructor, resetor_t objectResetor,
                      uint32_t minAvailableElems) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("createPool");
 
-    DataPool *newPool = (DataPool *)malloc(sizeof(DataPool));
+    DataPool *newPool = (DataPool *)calloc(1, sizeof(DataPool));
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
     if (newPool) {
         strncpy(newPool->poolName, poolName, 50);
+        newPool->poolName[49] = '\0';
         pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
         if (pthread_mutex_init(&(newPool->mutex), &attr) != 0) {
             DARWIN_LOG_ERROR("ERROR: could not initialize mutex while creating new pool");
+            pthread_mutexattr_destroy(&attr);
+            free(newPool);
             return NULL;
         }
+        newPool->id = __atomic_add_fetch(&lastPoolId, 1, __ATOMIC_RELAXED);
         newPool->head = NULL;
         newPool->tail = NULL;
+        newPool->freeList = NULL;
+        newPool->freeListSize = 0;
         newPool->listSize = 0;
         newPool->objectConstructor = objectConstructor;
         newPool->objectDestructor = objectDestructor;
@@ -227,8 +389,11 @@ DataPool *createPool(char *poolName, constructor_t objectConstructor,
         newPool->totalAllocSize = sizeof(DataPool);
         newPool->minAvailableElems = minAvailableElems;
         newPool->availableElems = 0;
+        newPool->unbounded = 0;
     } else {
         DARWIN_LOG_ERROR("ERROR: could not create new pool");
+        pthread_mutexattr_destroy(&attr);
+        return NULL;
     }
     pthread_mutexattr_destroy(&attr);
 
@@ -236,17 +401,30 @@ DataPool *createPool(char *poolName, constructor_t objectConstructor,
     return newPool;
 }
 
+/**
+ * WARNING: no other thread must be using the pool anymore
+ */
 void destroyPool(DataPool *pool) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("destroyPool");
 
+    if (!pool) return;
+
+    pthread_mutex_lock(&(poolStorage->mutex));
+    if (pool->next) pool->next->prev = pool->prev;
+    if (pool->prev) pool->prev->next = pool->next;
+    if (poolStorage->head == pool) poolStorage->head = pool->prev;
+    if (poolStorage->tail == pool) poolStorage->tail = pool->next;
+    poolStorage->listSize--;
+    pthread_mutex_unlock(&(poolStorage->mutex));
+
     pthread_mutex_lock(&(pool->mutex));
 
+    /* objects left in magazines are freed here as well, the pool id is never reused */
     DataObject *object = pool->tail, *destroy;
     while (object != NULL) {
         destroy = object;
         object = object->next;
-        pthread_mutex_destroy(&(destroy->mutex));
         if (destroy->pObject) pool->objectDestructor(destroy->pObject);
         free(destroy);
     }
@@ -290,16 +468,80 @@ void deletePoolStorage(PoolStorage *poolStorage) {
 /* --- memory manager --- */
 /* ###################### */
 
+/**
+ * Called by the timer wheel when a flow reaches its expiration,
+ * frees the flow and its TCP session if no packet was seen since, reschedules it otherwise
+ */
+static void expireFlowTimer(WheelTimer *timer, time_t now, void *arg __attribute__((unused))) {
+    DARWIN_LOGGER;
+    Flow *flow = FLOW_FROM_TIMER(timer);
+    TcpSession *session;
+    time_t expire;
+
+    pthread_mutex_lock(&(flow->mFlow));
+    session = (TcpSession *)flow->protoCtx;
+    if(session &&
+       session->cCon->state > TCP_SESS_ESTABLISHED &&
+       session->sCon->state > TCP_SESS_ESTABLISHED) {
+        expire = __atomic_load_n(&flow->lastPacketTime, __ATOMIC_RELAXED) + globalFlowCnf->closedTimeout;
+    }
+    else {
+        expire = __atomic_load_n(&flow->lastPacketTime, __ATOMIC_RELAXED) + globalFlowCnf->idleTimeout;
+    }
+
+    if(expire > now) {
+        /* packets were received since the flow was scheduled */
+        timerWheelSchedule(globalFlowCnf->wheel, timer, expire);
+        pthread_mutex_unlock(&(flow->mFlow));
+        return;
+    }
+
+    DARWIN_LOG_DEBUG("memory manager: found expired flow, freeing");
+    flow->expired = 1;
+    /* may have been rescheduled concurrently by a closing session */
+    timerWheelCancel(globalFlowCnf->wheel, timer);
+    if(session) {
+        setObjectAvailable(session->object);
+    }
+    pthread_mutex_unlock(&(flow->mFlow));
+
+    removeFlow(flow);
+}
+
+static inline void cleanPools() {
+    DARWIN_LOGGER;
+    DARWIN_LOG_DEBUG("memory manager: launching cleanup");
+    DataPool *pool;
+    uint32_t totalMemFreed = 0;
+
+    pthread_mutex_lock(&(poolStorage->mutex));
+    /* objects kept by the other threads can only be freed once back in the shared free lists */
+    pthread_mutex_lock(&threadMagazinesMutex);
+    for(ThreadMagazines *thread = threadMagazinesList; thread != NULL; thread = thread->next) {
+        flushThreadMagazines(thread);
+    }
+    pthread_mutex_unlock(&threadMagazinesMutex);
+
+    for(pool = poolStorage->tail; pool != NULL; pool = pool->next) {
+        totalMemFreed += trimPool(pool);
+    }
+    pthread_mutex_unlock(&(poolStorage->mutex));
+
+    DARWIN_LOG_DEBUG("memory manager: cleanup finished, memory freed: " + std::to_string(totalMemFreed) + ","
+              " total memory used: " + std::to_string(poolStorage->totalDataSize));
+}
+
 void *memoryManagerDoWork(void *pData) {
     DARWIN_LOGGER;
     MemManagerParams *params = (MemManagerParams *)pData;
     DARWIN_LOG_INFO("memory manager: started");
 
     struct timespec waitTime;
+    uint32_t ticks = 0;
 
     while(1) {
         clock_gettime(CLOCK_REALTIME, &waitTime);
-        waitTime.tv_sec += 10;
+        waitTime.tv_sec += MEMORY_MANAGER_TICK;
 
         pthread_mutex_lock(&(params->mSignal));
         pthread_cond_timedwait(&(params->cSignal), &(params->mSignal), &waitTime);
@@ -310,76 +552,21 @@ void *memoryManagerDoWork(void *pData) {
             pthread_exit(0);
         }
 
-        DARWIN_LOG_DEBUG("memory manager: launching cleanup");
-        DataPool *pool;
-        uint32_t totalMemFreed = 0;
-        for(pool = poolStorage->tail; pool != NULL; pool = pool->next) {
-            pthread_mutex_lock(&(pool->mutex));
-            uint32_t freeAmount = 0, usedAmount = 0;
-            DataObject *object = pool->tail, *deleteElem;
-            while(object) {
-                deleteElem = object;
-                object = object->next;
-                pthread_mutex_lock(&(deleteElem->mutex));
-
-                if(deleteElem->state != DataObject::USED) freeAmount++;
-                else usedAmount++;
-
-                if(deleteElem->state != DataObject::USED && deleteElem->stale &&
-                pool->availableElems > pool->minAvailableElems) {
-                    totalMemFreed += deleteDataObjectFromPool(deleteElem, pool);
-                    DARWIN_LOG_DEBUG("memory manager: deleting object in '" + std::string(pool->poolName) +
-                                     "', new listSize: " + std::to_string(pool->listSize));
-                    continue;
-                }
-                else if(!deleteElem->stale){
-                    deleteElem->stale = 1;
-                }
-                pthread_mutex_unlock(&(deleteElem->mutex));
+        /* only expired flows are visited, whatever the number of live flows */
+        if(globalFlowCnf && globalFlowCnf->wheel) {
+            uint32_t expired = timerWheelAdvance(globalFlowCnf->wheel, time(NULL), expireFlowTimer, NULL);
+            if(expired) {
+                DARWIN_LOG_DEBUG("memory manager: " + std::to_string(expired) + " flow timers expired");
             }
-            pthread_mutex_unlock(&(pool->mutex));
-            DARWIN_LOG_DEBUG("memory manager: " + std::to_string(pool->availableElems) + " free, "
-                             + std::to_string(pool->listSize) + " total in '" + std::string(pool->poolName) +
-                            ", for " + std::to_string(pool->totalAllocSize) + " total memory");
         }
 
-        DARWIN_LOG_DEBUG("memory manager: cleanup finished, memory freed: " + std::to_string(totalMemFreed) + ","
-                  " total memory used: " + std::to_string(poolStorage->totalDataSize));
-
-        uint32_t ratio = (unsigned long int)((float)poolStorage->totalDataSize/(float)poolStorage->maxDataSize*100);
-
-        DARWIN_LOG_DEBUG("memory manager: starting TCP session cleanup");
-        DataObject *sessObject;
-        TcpSession *session;
-        Flow *flow;
-        time_t currentTime = time(NULL);
-
-        pthread_mutex_lock(&(sessPool->mutex));
-        for(sessObject = sessPool->tail; sessObject != NULL; sessObject = sessObject->next) {
-            if(sessObject->state == DataObject::AVAILABLE) continue;
-            session = (TcpSession*)sessObject->pObject;
-            if(session) {
-                flow = session->flow;
-                if(flow) {
-                    if(session->cCon->state > TCP_SESS_ESTABLISHED &&
-                       session->sCon->state > TCP_SESS_ESTABLISHED &&
-                       (currentTime - flow->lastPacketTime) > 10) {
-                        DARWIN_LOG_DEBUG("memory manager: found closed session, freeing");
-                        pthread_mutex_lock(&(flow->mFlow));
-                        setObjectAvailable(sessObject);
-                        pthread_mutex_unlock(&(flow->mFlow));
-                    }
-                    else if((currentTime - flow->lastPacketTime) > 300) {
-                        DARWIN_LOG_DEBUG("memory manager: found idle session, freeing");
-                        pthread_mutex_lock(&(flow->mFlow));
-                        setObjectAvailable(sessObject);
-                        pthread_mutex_unlock(&(flow->mFlow));
-                    }
-                }
-            }
+        /* objects of expired sessions are only released by this thread */
+        releaseThreadMagazines();
+
+        if(++ticks >= MEMORY_MANAGER_CLEANUP_TICKS) {
+            ticks = 0;
+            cleanPools();
         }
-        pthread_mutex_unlock(&(sessPool->mutex));
-        DARWIN_LOG_DEBUG("memory manager: finished TCP session cleanup");
 
         pthread_mutex_unlock(&(params->mSignal));
     }
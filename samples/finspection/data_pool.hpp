@@ -52,25 +52,39 @@ typedef struct DataObject_ {
 
     uint8_t stale;
 
-    pthread_mutex_t mutex;
-
+    /* list of all the objects of the pool */
     struct DataObject_ *prev;
     struct DataObject_ *next;
+    /* list of the available objects shared by all threads */
+    struct DataObject_ *nextFree;
 } DataObject;
 
 typedef void *(*constructor_t)(void *);
 typedef void (*destructor_t)(void *);
 typedef void (*resetor_t)(void *);
 
+/* Each thread keeps a magazine of available objects for every pool,
+ * objects are only exchanged with the shared free list by half magazines,
+ * so most allocations and releases only take the uncontended lock of the thread magazines.
+ * Objects released by another thread than the one which got them just end up in its magazine.
+ * Magazines are given back to the shared free lists when their thread exits,
+ * and by the memory manager before each cleanup, so their objects can be freed as well */
+#define POOL_MAGAZINE_SIZE  32
+#define POOL_MAX_MAGAZINES  16 /* pools created beyond that only use the shared free list */
+
 typedef struct DataPool_ {
     char poolName[50];
+    uint32_t id; /* index of the per-thread magazines, never reused */
 
     struct DataObject_ *head;
     struct DataObject_ *tail;
+    struct DataObject_ *freeList;
+    uint32_t freeListSize;
     uint32_t listSize;
-    uint32_t availableElems;
+    uint32_t availableElems; /* in magazines and free list */
     uint32_t minAvailableElems;
     uint32_t totalAllocSize;
+    uint8_t unbounded; /* objects are accounted, but never refused when maxDataSize is reached */
 
     constructor_t objectConstructor;
     destructor_t objectDestructor;
@@ -78,7 +92,7 @@ typedef struct DataPool_ {
 
     struct PoolStorage_ *poolStorage;
 
-    pthread_mutex_t mutex;
+    pthread_mutex_t mutex; /* protects the lists */
 
     struct DataPool_ *prev;
     struct DataPool_ *next;
@@ -97,11 +111,11 @@ typedef struct PoolStorage_ {
 #define DEFAULT_MAX_POOL_STORAGE_SIZE   1024
 extern PoolStorage *poolStorage;
 
-uint32_t deleteDataObjectFromPool(DataObject *, DataPool *);
 void setObjectAvailable(DataObject *);
 void updateDataObjectSize(DataObject *, int);
 DataObject *getOrCreateAvailableObject(DataPool *);
-DataPool *createPool(char *, constructor_t, destructor_t, resetor_t, uint32_t);
+void releaseThreadMagazines();
+DataPool *createPool(const char *, constructor_t, destructor_t, resetor_t, uint32_t);
 void destroyPool(DataPool *);
 PoolStorage *initPoolStorage();
 void deletePoolStorage(PoolStorage *);
@@ -111,6 +125,9 @@ void deletePoolStorage(PoolStorage *);
 /* --- memory manager --- */
 /* ###################### */
 
+#define MEMORY_MANAGER_TICK             1 /* seconds between 2 flow expiration checks */
+#define MEMORY_MANAGER_CLEANUP_TICKS    10 /* ticks between 2 pools cleanups */
+
 typedef struct MemManagerParams_ {
     pthread_t thread;
 
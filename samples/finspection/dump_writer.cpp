@@ -0,0 +1,389 @@
+/* dump_writer.c
+ *
+ * This file contains functions used to write stream dumps from a background thread:
+ * segments are copied in a queue by the packet processing threads, contiguous segments
+ * of a file are merged, and the writer thread writes them with positioned vectored writes,
+ * keeping a bounded number of files open
+ *
+ * File begun on 2026-10-18
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "dump_writer.hpp"
+#include "Logger.hpp"
+
+#define DUMP_MAX_IOVEC  64
+
+/* ########################## */
+/* --- open files (writer) --- */
+/* ########################## */
+
+static inline void lruUnlink(DumpWriter *writer, DumpFile *file) {
+    if(file->lruPrev) file->lruPrev->lruNext = file->lruNext;
+    else writer->lruHead = file->lruNext;
+    if(file->lruNext) file->lruNext->lruPrev = file->lruPrev;
+    else writer->lruTail = file->lruPrev;
+
+    file->lruPrev = NULL;
+    file->lruNext = NULL;
+}
+
+static inline void lruPushFront(DumpWriter *writer, DumpFile *file) {
+    file->lruPrev = NULL;
+    file->lruNext = writer->lruHead;
+    if(writer->lruHead) writer->lruHead->lruPrev = file;
+    else writer->lruTail = file;
+    writer->lruHead = file;
+}
+
+static inline void dumpFileCloseFd(DumpWriter *writer, DumpFile *file) {
+    if(file->fd >= 0) {
+        lruUnlink(writer, file);
+        close(file->fd);
+        file->fd = -1;
+        writer->openFiles--;
+    }
+}
+
+/**
+ * Makes sure the file is open, closing the least recently used one if too many are
+ * @return 0 if the file can be written, -1 otherwise
+ */
+static inline int dumpFileEnsureOpen(DumpWriter *writer, DumpFile *file) {
+    DARWIN_LOGGER;
+
+    if(file->fd >= 0) {
+        if(writer->lruHead != file) {
+            lruUnlink(writer, file);
+            lruPushFront(writer, file);
+        }
+        return 0;
+    }
+    if(file->openFailed) return -1;
+
+    if(writer->openFiles >= writer->maxOpenFiles && writer->lruTail) {
+        dumpFileCloseFd(writer, writer->lruTail);
+    }
+
+    /* never truncated, the file may have been closed by the LRU and opened again */
+    file->fd = open(file->path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if(file->fd < 0) {
+        DARWIN_LOG_ERROR("dump writer: could not open '" + std::string(file->path) + "': " + std::string(strerror(errno)));
+        file->openFailed = 1;
+        return -1;
+    }
+
+    writer->openFiles++;
+    lruPushFront(writer, file);
+    return 0;
+}
+
+static inline void dumpFileFree(DumpFile *file) {
+    free(file->path);
+    free(file);
+}
+
+/* ########################## */
+/* --- writer thread --- */
+/* ########################## */
+
+/* writes all the iovecs at offset, the holes before are left to the filesystem (read as zeros) */
+static inline void dumpWriteVector(DumpFile *file, struct iovec *iov, int iovCount, uint64_t offset) {
+    DARWIN_LOGGER;
+
+    while(iovCount) {
+        ssize_t written = pwritev(file->fd, iov, iovCount, (off_t)offset);
+        if(written < 0) {
+            if(errno == EINTR) continue;
+            DARWIN_LOG_ERROR("dump writer: could not write to '" + std::string(file->path) + "': " + std::string(strerror(errno)));
+            return;
+        }
+
+        offset += written;
+        while(iovCount && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovCount--;
+        }
+        if(iovCount) {
+            iov->iov_base = (uint8_t *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+/**
+ * Writes a batch of segments, runs of contiguous segments of the same file being written at once
+ * @return the number of bytes written
+ */
+static uint64_t dumpWriteBatch(DumpWriter *writer, DumpSegment *batch) {
+    struct iovec iov[DUMP_MAX_IOVEC];
+    uint64_t batchSize = 0;
+
+    while(batch) {
+        DumpSegment *segment = batch;
+        DumpFile *file = segment->file;
+
+        if(segment->close) {
+            batch = segment->next;
+            dumpFileCloseFd(writer, file);
+            dumpFileFree(file);
+            free(segment);
+            continue;
+        }
+
+        int iovCount = 0;
+        uint64_t offset = segment->offset, end = segment->offset;
+        while(batch && iovCount < DUMP_MAX_IOVEC && !batch->close &&
+              batch->file == file && batch->offset == end) {
+            iov[iovCount].iov_base = batch->data;
+            iov[iovCount].iov_len = batch->length;
+            iovCount++;
+            end += batch->length;
+            batch = batch->next;
+        }
+        batchSize += end - offset;
+
+        if(dumpFileEnsureOpen(writer, file) == 0) {
+            dumpWriteVector(file, iov, iovCount, offset);
+        }
+
+        while(segment != batch) {
+            DumpSegment *next = segment->next;
+            free(segment);
+            segment = next;
+        }
+    }
+
+    return batchSize;
+}
+
+static void *dumpWriterDoWork(void *pData) {
+    DARWIN_LOGGER;
+    DumpWriter *writer = (DumpWriter *)pData;
+    uint64_t reportedDrops = 0;
+    DARWIN_LOG_INFO("dump writer: started");
+
+    pthread_mutex_lock(&(writer->mQueue));
+    while(1) {
+        while(!writer->head && !writer->sigStop) {
+            pthread_cond_wait(&(writer->cQueue), &(writer->mQueue));
+        }
+        /* queued segments are always written before stopping */
+        if(!writer->head) break;
+
+        DumpSegment *batch = writer->head, *segment;
+        writer->head = NULL;
+        writer->tail = NULL;
+        /* segments taken can't be appended to anymore */
+        for(segment = batch; segment; segment = segment->next) {
+            if(segment->file->pending == segment) segment->file->pending = NULL;
+        }
+        uint64_t dropped = writer->droppedSize;
+        pthread_mutex_unlock(&(writer->mQueue));
+
+        if(dropped != reportedDrops) {
+            DARWIN_LOG_WARNING("dump writer: disk too slow, " + std::to_string(dropped - reportedDrops) + " bytes were dropped");
+            reportedDrops = dropped;
+        }
+        uint64_t written = dumpWriteBatch(writer, batch);
+
+        pthread_mutex_lock(&(writer->mQueue));
+        writer->pendingSize -= written;
+    }
+    pthread_mutex_unlock(&(writer->mQueue));
+
+    while(writer->lruHead) {
+        dumpFileCloseFd(writer, writer->lruHead);
+    }
+
+    DARWIN_LOG_INFO("dump writer: closing");
+    return NULL;
+}
+
+/* ########################## */
+/* --- writer API --- */
+/* ########################## */
+
+/**
+ * Creates the writer and starts its thread
+ * @param maxOpenFiles the maximum number of file descriptors kept open
+ * @return the writer, or NULL on error
+ */
+DumpWriter *startDumpWriter(uint32_t maxOpenFiles) {
+    DARWIN_LOGGER;
+    DumpWriter *writer = (DumpWriter *)calloc(1, sizeof(DumpWriter));
+
+    if(!writer) {
+        DARWIN_LOG_ERROR("could not claim memory for dump writer");
+        return NULL;
+    }
+
+    writer->maxOpenFiles = maxOpenFiles ? maxOpenFiles : 1;
+    pthread_mutex_init(&(writer->mQueue), NULL);
+    pthread_cond_init(&(writer->cQueue), NULL);
+
+    if(pthread_create(&(writer->thread), NULL, dumpWriterDoWork, (void *)writer) != 0) {
+        DARWIN_LOG_ERROR("could not start dump writer thread");
+        pthread_mutex_destroy(&(writer->mQueue));
+        pthread_cond_destroy(&(writer->cQueue));
+        free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+/**
+ * Writes the remaining segments, stops the thread and frees the writer
+ * WARNING: files still open are closed, but not freed
+ */
+void stopDumpWriter(DumpWriter *writer) {
+    if(writer) {
+        pthread_mutex_lock(&(writer->mQueue));
+        writer->sigStop = 1;
+        pthread_cond_signal(&(writer->cQueue));
+        pthread_mutex_unlock(&(writer->mQueue));
+
+        pthread_join(writer->thread, NULL);
+
+        pthread_mutex_destroy(&(writer->mQueue));
+        pthread_cond_destroy(&(writer->cQueue));
+        free(writer);
+    }
+    return;
+}
+
+/**
+ * Creates a dump file, opened by the writer on first write
+ * @return the file, to give back with dumpWriterClose(), or NULL on error
+ */
+DumpFile *dumpWriterOpen(DumpWriter *writer __attribute__((unused)), const char *directory, const char *filename) {
+    DumpFile *file = (DumpFile *)calloc(1, sizeof(DumpFile));
+    if(!file) return NULL;
+
+    size_t pathLength = strlen(directory) + 1 + strlen(filename) + 1;
+    file->path = (char *)malloc(pathLength);
+    if(!file->path) {
+        free(file);
+        return NULL;
+    }
+    /* directory may end with a '/' */
+    if(directory[0] && directory[strlen(directory) - 1] == '/') {
+        snprintf(file->path, pathLength, "%s%s", directory, filename);
+    }
+    else {
+        snprintf(file->path, pathLength, "%s/%s", directory, filename);
+    }
+    file->fd = -1;
+
+    return file;
+}
+
+static inline void dumpWriterQueue(DumpWriter *writer, DumpSegment *segment) {
+    uint8_t wasEmpty = (writer->head == NULL);
+
+    segment->next = NULL;
+    if(writer->tail) writer->tail->next = segment;
+    else writer->head = segment;
+    writer->tail = segment;
+
+    if(wasEmpty) pthread_cond_signal(&(writer->cQueue));
+}
+
+/**
+ * Queues data to be written at offset in the file, the data is copied
+ * WARNING: writes to a file must not be done concurrently
+ * @return 0 if the data was queued, -1 if it was dropped
+ */
+int dumpWriterWrite(DumpWriter *writer, DumpFile *file, uint32_t offset, const uint8_t *data, uint32_t length) {
+    DumpSegment *segment;
+
+    if(!length) return 0;
+
+    pthread_mutex_lock(&(writer->mQueue));
+    if(writer->pendingSize + length > DUMP_MAX_PENDING_SIZE) {
+        writer->droppedSize += length;
+        pthread_mutex_unlock(&(writer->mQueue));
+        return -1;
+    }
+
+    /* merged in the last segment of the file if it's contiguous and not taken yet */
+    segment = file->pending;
+    if(segment && segment->offset + segment->length == offset && segment->capacity - segment->length >= length) {
+        memcpy(segment->data + segment->length, data, length);
+        segment->length += length;
+        writer->pendingSize += length;
+        pthread_mutex_unlock(&(writer->mQueue));
+        return 0;
+    }
+    writer->pendingSize += length;
+    pthread_mutex_unlock(&(writer->mQueue));
+
+    uint32_t capacity = (length > DUMP_SEGMENT_SIZE) ? length : DUMP_SEGMENT_SIZE;
+    segment = (DumpSegment *)malloc(sizeof(DumpSegment) + capacity);
+
+    pthread_mutex_lock(&(writer->mQueue));
+    if(!segment) {
+        writer->pendingSize -= length;
+        writer->droppedSize += length;
+        pthread_mutex_unlock(&(writer->mQueue));
+        return -1;
+    }
+    segment->file = file;
+    segment->offset = offset;
+    segment->length = length;
+    segment->capacity = capacity;
+    segment->close = 0;
+    memcpy(segment->data, data, length);
+
+    dumpWriterQueue(writer, segment);
+    file->pending = segment;
+    pthread_mutex_unlock(&(writer->mQueue));
+
+    return 0;
+}
+
+/**
+ * Closes and frees the file once all the data queued for it is written,
+ * the file must not be used afterwards
+ */
+void dumpWriterClose(DumpWriter *writer, DumpFile *file) {
+    DARWIN_LOGGER;
+    DumpSegment *segment = (DumpSegment *)calloc(1, sizeof(DumpSegment));
+
+    if(!segment) {
+        /* the file is leaked rather than freed with segments still referencing it */
+        DARWIN_LOG_ERROR("dump writer: could not queue file closing");
+        return;
+    }
+    segment->file = file;
+    segment->close = 1;
+
+    pthread_mutex_lock(&(writer->mQueue));
+    dumpWriterQueue(writer, segment);
+    file->pending = NULL;
+    pthread_mutex_unlock(&(writer->mQueue));
+}
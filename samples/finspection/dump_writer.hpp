@@ -0,0 +1,91 @@
+/* dump_writer.h
+ *
+ * This file contains structures and prototypes of functions used
+ * to write stream dumps to disk from a background thread
+ *
+ * File begun on 2026-10-18
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DUMP_WRITER_H
+#define DUMP_WRITER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define DUMP_DEFAULT_MAX_OPEN_FILES     256
+#define DUMP_SEGMENT_SIZE               16384 /* minimum capacity of a queued segment, contiguous writes are merged in it */
+#define DUMP_MAX_PENDING_SIZE           (64 * 1024 * 1024) /* queued bytes above which new writes are dropped */
+
+/* A dump file, its descriptor is only opened (and closed) by the writer thread */
+typedef struct DumpFile_ {
+    char *path;
+    int fd;
+    uint8_t openFailed;
+
+    /* last segment queued for this file, while it's not taken by the writer */
+    struct DumpSegment_ *pending;
+
+    /* LRU of open files, only used by the writer thread */
+    struct DumpFile_ *lruPrev;
+    struct DumpFile_ *lruNext;
+} DumpFile;
+
+typedef struct DumpSegment_ {
+    DumpFile *file;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t capacity;
+    uint8_t close; /* closes and frees the file once previous segments are written */
+
+    struct DumpSegment_ *next;
+    uint8_t data[];
+} DumpSegment;
+
+typedef struct DumpWriter_ {
+    DumpSegment *head;
+    DumpSegment *tail;
+    uint64_t pendingSize;
+    uint64_t droppedSize;
+
+    uint32_t maxOpenFiles;
+    uint32_t openFiles;
+    DumpFile *lruHead;
+    DumpFile *lruTail;
+
+    uint8_t sigStop;
+    pthread_mutex_t mQueue;
+    pthread_cond_t cQueue;
+    pthread_t thread;
+} DumpWriter;
+
+DumpWriter *startDumpWriter(uint32_t);
+void stopDumpWriter(DumpWriter *);
+DumpFile *dumpWriterOpen(DumpWriter *, const char *, const char *);
+int dumpWriterWrite(DumpWriter *, DumpFile *, uint32_t, const uint8_t *, uint32_t);
+void dumpWriterClose(DumpWriter *, DumpFile *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* DUMP_WRITER_H */
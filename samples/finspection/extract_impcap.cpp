@@ -26,177 +26,358 @@
  * limitations under the License.
  */
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IMPCAP_HEX_SIMD
+#endif
+
+#include <charconv>
+#include <string_view>
+
 #include "extract_impcap.hpp"
 #include "Logger.hpp"
-#include "../toolkit/rapidjson/document.h"
 
-Packet *getImpcapData(std::string impcapMeta, std::string impcapData) {
-    DARWIN_LOGGER;
-    int localret;
-    uint32_t contentLength;
-    const char *content;
-    uint16_t ethType;
-    Packet *pkt = NULL;
-    rapidjson::Document docMeta, docData;
-
-    if(!impcapMeta.empty()) {
-        pkt = createPacket();
-        docMeta.Parse(impcapMeta.c_str());
-
-        if(docMeta.HasMember("ID") && docMeta["ID"].IsUint()) {
-            pkt->pktNumber = docMeta["ID"].GetUint();
-        }
+/* ######################## */
+/* --- impcap body parser --- */
+/* ######################## */
 
-        if(docMeta.HasMember("ETH_type") && docMeta["ETH_type"].IsUint()) {
-            ethType = docMeta["ETH_type"].GetUint();
-            if(ethType == ETHERTYPE_IPV4) {
-                pkt->ipv4h = getIpv4Header(docMeta);
-                pkt->proto = pkt->ipv4h->proto;
-            }
-            else if(ethType == ETHERTYPE_IPV6) {
-                pkt->ipv6h = getIpv6Header(docMeta);
-                pkt->proto = pkt->ipv6h->proto;
-            }
+static inline const char *impcapSkipSpaces(const char *cursor, const char *end) {
+    while(cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r')) cursor++;
+    return cursor;
+}
 
-            if(pkt->proto == IPPROTO_TCP) {
-                pkt->tcph = getTcpHeader(docMeta);
-            }
-        }
-        updatePacketFromHeaders(pkt);
+/* cursor must be on the opening quote, returns the closing quote or NULL */
+static inline const char *impcapSkipString(const char *cursor, const char *end) {
+    for(cursor++; cursor < end; cursor++) {
+        if(*cursor == '\\') cursor++;
+        else if(*cursor == '"') return cursor;
     }
+    return NULL;
+}
 
-    if(!impcapData.empty() && pkt) {
-        docData.Parse(impcapData.c_str());
-
-        if(docData.HasMember("length") && docData["length"].IsUint()) {
-            contentLength = docData["length"].GetUint();
-
-            if(docData.HasMember("content") && docData["content"].IsString()) {
-                content = docData["content"].GetString();
-                pkt->payload = ImpcapDataDecode(content, contentLength);
-                pkt->payloadLen = contentLength/2;
-            }
+/* cursor must be on the opening '{' or '[', returns the character after the matching closing one or NULL */
+static inline const char *impcapSkipNested(const char *cursor, const char *end) {
+    uint32_t depth = 0;
+
+    for(; cursor < end; cursor++) {
+        switch(*cursor) {
+            case '"':
+                cursor = impcapSkipString(cursor, end);
+                if(!cursor) return NULL;
+                break;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case '}':
+            case ']':
+                if(--depth == 0) return cursor + 1;
+                break;
         }
     }
-
-
-    return pkt;
+    return NULL;
 }
 
-uint8_t *ImpcapDataDecode(const char *hex, uint32_t length) {
-    uint8_t *retBuf = (uint8_t *)malloc(length/2*sizeof(uint8_t));
-    int i;
-
-    for(i = 0; i < length; ++i) {
-        if(i%2) {
-            retBuf[i/2] <<= 4;
-            if(hex[i] >= '0' && hex[i] <= '9') {
-                retBuf[i/2] += hex[i] - '0';
-            }
-            else if(hex[i] >= 'A' && hex[i] <= 'F') {
-                retBuf[i/2] += hex[i] - 'A' + 10;
-            }
+/**
+ * Walks a JSON object once, giving each field to the handler as views on the body
+ * @param cursor must be on the opening '{'
+ * @param end
+ * @param onField called with (key, value, isString) for each field, string values are given without quotes
+ * @return the character after the closing '}', or NULL on parse error
+ */
+template<typename FieldHandler>
+static const char *impcapParseObject(const char *cursor, const char *end, FieldHandler &&onField) {
+    if(cursor >= end || *cursor != '{') return NULL;
+
+    cursor = impcapSkipSpaces(cursor + 1, end);
+    if(cursor < end && *cursor == '}') return cursor + 1;
+
+    while(cursor < end) {
+        const char *keyEnd, *valueStart;
+        bool isString = false;
+
+        if(*cursor != '"') return NULL;
+        keyEnd = impcapSkipString(cursor, end);
+        if(!keyEnd) return NULL;
+        std::string_view key(cursor + 1, keyEnd - cursor - 1);
+
+        cursor = impcapSkipSpaces(keyEnd + 1, end);
+        if(cursor >= end || *cursor != ':') return NULL;
+        cursor = impcapSkipSpaces(cursor + 1, end);
+        if(cursor >= end) return NULL;
+
+        valueStart = cursor;
+        if(*cursor == '"') {
+            cursor = impcapSkipString(cursor, end);
+            if(!cursor) return NULL;
+            valueStart++;
+            isString = true;
+        }
+        else if(*cursor == '{' || *cursor == '[') {
+            cursor = impcapSkipNested(cursor, end);
+            if(!cursor) return NULL;
         }
         else {
-            if(hex[i] >= '0' && hex[i] <= '9') {
-                retBuf[i/2] = hex[i] - '0';
-            }
-            else if(hex[i] >= 'A' && hex[i] <= 'F') {
-                retBuf[i/2] = hex[i] - 'A' + 10;
-            }
+            while(cursor < end && *cursor != ',' && *cursor != '}' &&
+                  *cursor != ' ' && *cursor != '\t' && *cursor != '\n' && *cursor != '\r') cursor++;
         }
+        onField(key, std::string_view(valueStart, cursor - valueStart), isString);
+        if(isString) cursor++;
+
+        cursor = impcapSkipSpaces(cursor, end);
+        if(cursor >= end) return NULL;
+        if(*cursor == '}') return cursor + 1;
+        if(*cursor != ',') return NULL;
+        cursor = impcapSkipSpaces(cursor + 1, end);
     }
 
-    return retBuf;
+    return NULL;
 }
 
-TCPHdr *getTcpHeader(rapidjson::Document& doc) {
-    DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("getting tcp header");
-    TCPHdr *tcph = (TCPHdr *)calloc(1, sizeof(TCPHdr));
+static inline bool impcapGetUint64(std::string_view value, bool isString, uint64_t &result) {
+    if(isString || value.empty()) return false;
 
-    if (doc.HasMember("net_src_port") && doc["net_src_port"].IsUint()) {
-        tcph->sport = doc["net_src_port"].GetUint();
-
-    }
-
-    if (doc.HasMember("net_dst_port") && doc["net_dst_port"].IsUint()) {
-        tcph->dport = doc["net_dst_port"].GetUint();
-    }
+    auto [last, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+    return ec == std::errc() && last == value.data() + value.size();
+}
 
-    if (doc.HasMember("TCP_seq_number") && doc["TCP_seq_number"].IsUint64()) {
-        tcph->seq = doc["TCP_seq_number"].GetUint64();
-    }
+static inline bool impcapGetUint(std::string_view value, bool isString, uint32_t &result) {
+    uint64_t value64;
 
-    if (doc.HasMember("TCP_ack_number") && doc["TCP_ack_number"].GetUint64()) {
-        tcph->ack = doc["TCP_ack_number"].GetUint64();
-    }
-
-    if (doc.HasMember("net_flags") && doc["net_flags"].IsString()) {
-        tcph->flags = strndup(doc["net_flags"].GetString(), 10);
-    }
+    if(!impcapGetUint64(value, isString, value64) || value64 > UINT32_MAX) return false;
+    result = (uint32_t)value64;
+    return true;
+}
 
-    if (doc.HasMember("net_bytes_data") && doc["net_bytes_data"].IsUint()) {
-        tcph->TCPDataLength = doc["net_bytes_data"].GetUint();
-    }
+/* copies a string value, truncated to the size of the destination */
+static inline void impcapCopyString(char *dst, size_t dstSize, std::string_view value) {
+    size_t length = value.size() < dstSize - 1 ? value.size() : dstSize - 1;
 
-    DARWIN_LOG_DEBUG("finished getting tcp header");
-    return tcph;
+    memcpy(dst, value.data(), length);
+    dst[length] = '\0';
 }
 
-IPV6Hdr *getIpv6Header(rapidjson::Document& doc) {
+/**
+ * Parses an impcap entry: the metadata object then the data object, both enclosed in quotes
+ * ("{...}", "{...}"), and fills a packet from the pool with it
+ * @param cursor must be on the opening quote of the metadata
+ * @param end the end of the body
+ * @param pkt will hold the packet, or NULL if it could not be obtained from the pool
+ * @return the character after the entry, or NULL on parse error
+ */
+const char *parseImpcapEntry(const char *cursor, const char *end, Packet **pkt) {
     DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("getting IPV6 header");
-    IPV6Hdr *ipv6h = (IPV6Hdr *)malloc(sizeof(IPV6Hdr));
-    memset(ipv6h, 0, sizeof(IPV6Hdr));
-
-    if (doc.HasMember("net_dst_ip") && doc["net_dst_ip"].IsString()) {
-        ipv6h->dst = strndup(doc["net_dst_ip"].GetString(), 39);
+    uint32_t ethType = 0, pktNumber = 0, contentLength = 0;
+    uint8_t hasLength = 0;
+    std::string_view content;
+    IPV4Hdr ipv4h;
+    IPV6Hdr ipv6h;
+    TCPHdr tcph;
+
+    *pkt = NULL;
+    memset(&ipv4h, 0, sizeof(IPV4Hdr));
+    memset(&ipv6h, 0, sizeof(IPV6Hdr));
+    memset(&tcph, 0, sizeof(TCPHdr));
+
+    if(cursor >= end || *cursor != '"') return NULL;
+    /* IP fields are read for both versions, the right header is chosen from ETH_type afterwards */
+    cursor = impcapParseObject(cursor + 1, end, [&](std::string_view key, std::string_view value, bool isString) {
+        uint32_t number;
+
+        if(key == "ID") impcapGetUint(value, isString, pktNumber);
+        else if(key == "ETH_type") impcapGetUint(value, isString, ethType);
+        else if(key == "net_src_ip" && isString) {
+            impcapCopyString(ipv4h.src, sizeof(ipv4h.src), value);
+            impcapCopyString(ipv6h.src, sizeof(ipv6h.src), value);
+        }
+        else if(key == "net_dst_ip" && isString) {
+            impcapCopyString(ipv4h.dst, sizeof(ipv4h.dst), value);
+            impcapCopyString(ipv6h.dst, sizeof(ipv6h.dst), value);
+        }
+        else if(key == "IP_ihl" && impcapGetUint(value, isString, number)) ipv4h.hLen = number;
+        else if(key == "net_ttl" && impcapGetUint(value, isString, number)) {
+            ipv4h.ttl = number;
+            ipv6h.ttl = number;
+        }
+        else if(key == "IP_proto" && impcapGetUint(value, isString, number)) {
+            ipv4h.proto = number;
+            ipv6h.proto = number;
+        }
+        else if(key == "net_src_port" && impcapGetUint(value, isString, number)) tcph.sport = number;
+        else if(key == "net_dst_port" && impcapGetUint(value, isString, number)) tcph.dport = number;
+        else if(key == "TCP_seq_number") impcapGetUint(value, isString, tcph.seq);
+        else if(key == "TCP_ack_number") impcapGetUint(value, isString, tcph.ack);
+        else if(key == "net_flags" && isString) impcapCopyString(tcph.flags, sizeof(tcph.flags), value);
+        else if(key == "net_bytes_data") impcapGetUint(value, isString, tcph.TCPDataLength);
+    });
+    if(!cursor || cursor >= end || *cursor != '"') return NULL;
+
+    cursor = impcapSkipSpaces(cursor + 1, end);
+    if(cursor >= end || *cursor != ',') return NULL;
+    cursor = impcapSkipSpaces(cursor + 1, end);
+    if(cursor >= end || *cursor != '"') return NULL;
+
+    cursor = impcapParseObject(cursor + 1, end, [&](std::string_view key, std::string_view value, bool isString) {
+        if(key == "length") hasLength = impcapGetUint(value, isString, contentLength);
+        else if(key == "content" && isString) content = value;
+    });
+    if(!cursor || cursor >= end || *cursor != '"') return NULL;
+    cursor++;
+
+    *pkt = createPacket();
+    if(!*pkt) {
+        DARWIN_LOG_ERROR("could not get a new packet");
+        return cursor;
     }
 
-    if (doc.HasMember("net_src_ip") && doc["net_src_ip"].IsString()) {
-        ipv6h->src = strndup(doc["net_src_ip"].GetString(), 39);
-
+    (*pkt)->pktNumber = pktNumber;
+    if(ethType == ETHERTYPE_IPV4) {
+        (*pkt)->ipv4hData = ipv4h;
+        (*pkt)->ipv4h = &(*pkt)->ipv4hData;
+        (*pkt)->proto = ipv4h.proto;
     }
-
-    if (doc.HasMember("net_ttl") && doc["net_ttl"].IsUint()) {
-        ipv6h->ttl = doc["net_ttl"].GetUint();
+    else if(ethType == ETHERTYPE_IPV6) {
+        (*pkt)->ipv6hData = ipv6h;
+        (*pkt)->ipv6h = &(*pkt)->ipv6hData;
+        (*pkt)->proto = ipv6h.proto;
     }
+    if((*pkt)->proto == IPPROTO_TCP) {
+        (*pkt)->tcphData = tcph;
+        (*pkt)->tcph = &(*pkt)->tcphData;
+    }
+    updatePacketFromHeaders(*pkt);
 
-    if (doc.HasMember("IP_proto") && doc["IP_proto"].IsUint()) {
-        ipv6h->proto = doc["IP_proto"].GetUint();
+    if(hasLength && content.data()) {
+        if(content.size() < contentLength) {
+            DARWIN_LOG_WARNING("impcap content is shorter than its length, ignoring payload");
+        }
+        else if(packetReservePayload(*pkt, contentLength/2)) {
+            if(ImpcapDataDecode(content.data(), contentLength, (*pkt)->payload) == 0) {
+                (*pkt)->payloadLen = contentLength/2;
+            }
+            else {
+                DARWIN_LOG_WARNING("impcap content is not valid hex, ignoring payload");
+            }
+        }
     }
 
-    DARWIN_LOG_DEBUG("finished getting IPV6 header");
-    return ipv6h;
+    return cursor;
 }
 
-IPV4Hdr *getIpv4Header(rapidjson::Document& doc) {
-    DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("getting IPV4 header");
-    IPV4Hdr *ipv4h = (IPV4Hdr *)malloc(sizeof(IPV4Hdr));
-    memset(ipv4h, 0, sizeof(IPV4Hdr));
-
-    if (doc.HasMember("net_dst_ip") && doc["net_dst_ip"].IsString()) {
-        ipv4h->dst = strndup(doc["net_dst_ip"].GetString(), 15);
+/* value of each hex digit, 0xFF for invalid characters */
+static const uint8_t hexValues[256] = {
+#define HEX_INVALID_16 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+    HEX_INVALID_16, HEX_INVALID_16, HEX_INVALID_16,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 10, 11, 12, 13, 14, 15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    HEX_INVALID_16,
+    0xFF, 10, 11, 12, 13, 14, 15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    HEX_INVALID_16, HEX_INVALID_16, HEX_INVALID_16, HEX_INVALID_16, HEX_INVALID_16,
+    HEX_INVALID_16, HEX_INVALID_16, HEX_INVALID_16, HEX_INVALID_16
+#undef HEX_INVALID_16
+};
+
+typedef int (*hex_decode_fn_t)(const char *, uint32_t, uint8_t *);
+
+static int hexDecodeScalar(const char *hex, uint32_t length, uint8_t *retBuf) {
+    uint8_t invalid = 0;
+    uint32_t i;
+
+    for(i = 0; i < length; i += 2) {
+        uint8_t high = hexValues[(uint8_t)hex[i]];
+        uint8_t low = hexValues[(uint8_t)hex[i + 1]];
+        invalid |= (high | low) & 0xF0;
+        retBuf[i/2] = (uint8_t)((high << 4) | (low & 0x0F));
     }
 
-    if (doc.HasMember("net_src_ip") && doc["net_src_ip"].IsString()) {
-        ipv4h->src = strndup(doc["net_src_ip"].GetString(), 15);
-    }
+    return invalid ? -1 : 0;
+}
 
-    if (doc.HasMember("IP_ihl") && doc["IP_ihl"].IsUint()) {
-        ipv4h->hLen = doc["IP_ihl"].GetUint();
+#ifdef IMPCAP_HEX_SIMD
+/* The vectorised decoders convert every character to its nibble value:
+ *  - digits ('0'-'9') by subtracting '0'
+ *  - letters ('a'-'f' and 'A'-'F', after setting the lowercase bit) by subtracting 'a' - 10
+ * then merge each pair of nibbles with a multiply-add (high * 16 + low) and pack the results to bytes.
+ * Characters that are neither a digit nor a letter make the whole input invalid. */
+
+__attribute__((target("sse4.1")))
+static int hexDecodeSSE4(const char *hex, uint32_t length, uint8_t *retBuf) {
+    const __m128i zeroMinus1 = _mm_set1_epi8('0' - 1), ninePlus1 = _mm_set1_epi8('9' + 1);
+    const __m128i aMinus1 = _mm_set1_epi8('a' - 1), fPlus1 = _mm_set1_epi8('f' + 1);
+    const __m128i lowercase = _mm_set1_epi8(0x20);
+    const __m128i digitOffset = _mm_set1_epi8('0'), letterOffset = _mm_set1_epi8('a' - 10);
+    const __m128i nibbleWeights = _mm_set1_epi16(0x0110); /* high nibble * 16 + low nibble * 1 */
+    __m128i invalid = _mm_setzero_si128();
+    uint32_t i = 0;
+
+    for(; i + 16 <= length; i += 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i *)(hex + i));
+        __m128i folded = _mm_or_si128(chars, lowercase);
+
+        __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, zeroMinus1), _mm_cmplt_epi8(chars, ninePlus1));
+        __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(folded, aMinus1), _mm_cmplt_epi8(folded, fPlus1));
+        invalid = _mm_or_si128(invalid, _mm_andnot_si128(_mm_or_si128(isDigit, isLetter), _mm_set1_epi8(-1)));
+
+        __m128i nibbles = _mm_blendv_epi8(_mm_sub_epi8(folded, letterOffset), _mm_sub_epi8(chars, digitOffset), isDigit);
+        __m128i bytes = _mm_maddubs_epi16(nibbles, nibbleWeights);
+        _mm_storel_epi64((__m128i *)(retBuf + i/2), _mm_packus_epi16(bytes, bytes));
     }
 
-    if (doc.HasMember("net_ttl") && doc["net_ttl"].IsUint()) {
-        ipv4h->ttl = doc["net_ttl"].GetUint();
-    }
+    if(!_mm_testz_si128(invalid, invalid)) return -1;
+    return hexDecodeScalar(hex + i, length - i, retBuf + i/2);
+}
 
-    if (doc.HasMember("IP_proto") && doc["IP_proto"].IsUint()) {
-        ipv4h->proto = doc["IP_proto"].GetUint();
+__attribute__((target("avx2")))
+static int hexDecodeAVX2(const char *hex, uint32_t length, uint8_t *retBuf) {
+    const __m256i zeroMinus1 = _mm256_set1_epi8('0' - 1), ninePlus1 = _mm256_set1_epi8('9' + 1);
+    const __m256i aMinus1 = _mm256_set1_epi8('a' - 1), fPlus1 = _mm256_set1_epi8('f' + 1);
+    const __m256i lowercase = _mm256_set1_epi8(0x20);
+    const __m256i digitOffset = _mm256_set1_epi8('0'), letterOffset = _mm256_set1_epi8('a' - 10);
+    const __m256i nibbleWeights = _mm256_set1_epi16(0x0110);
+    __m256i invalid = _mm256_setzero_si256();
+    uint32_t i = 0;
+
+    for(; i + 32 <= length; i += 32) {
+        __m256i chars = _mm256_loadu_si256((const __m256i *)(hex + i));
+        __m256i folded = _mm256_or_si256(chars, lowercase);
+
+        __m256i isDigit = _mm256_and_si256(_mm256_cmpgt_epi8(chars, zeroMinus1), _mm256_cmpgt_epi8(ninePlus1, chars));
+        __m256i isLetter = _mm256_and_si256(_mm256_cmpgt_epi8(folded, aMinus1), _mm256_cmpgt_epi8(fPlus1, folded));
+        invalid = _mm256_or_si256(invalid, _mm256_andnot_si256(_mm256_or_si256(isDigit, isLetter), _mm256_set1_epi8(-1)));
+
+        __m256i nibbles = _mm256_blendv_epi8(_mm256_sub_epi8(folded, letterOffset), _mm256_sub_epi8(chars, digitOffset), isDigit);
+        __m256i bytes = _mm256_maddubs_epi16(nibbles, nibbleWeights);
+        /* packing works per 128 bits lane, gather both 64 bits results in the low lane */
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(bytes, bytes), 0x08);
+        _mm_storeu_si128((__m128i *)(retBuf + i/2), _mm256_castsi256_si128(packed));
     }
 
-    DARWIN_LOG_DEBUG("finished getting IPV4 header");
-    return ipv4h;
+    if(!_mm256_testz_si256(invalid, invalid)) return -1;
+    return hexDecodeSSE4(hex + i, length - i, retBuf + i/2);
+}
+#endif
+
+static hex_decode_fn_t selectHexDecoder() {
+#ifdef IMPCAP_HEX_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return hexDecodeAVX2;
+    if(__builtin_cpu_supports("sse4.1")) return hexDecodeSSE4;
+#endif
+    return hexDecodeScalar;
+}
+
+static const hex_decode_fn_t hexDecode = selectHexDecoder();
+
+/**
+ * Decodes the hex string (upper or lower case) into retBuf
+ * WARNING: retBuf must hold at least length/2 bytes
+ * @param hex
+ * @param length the number of hex characters, must be even
+ * @param retBuf
+ * @return 0 on success, -1 if the string is not valid hex (retBuf content is undefined then)
+ */
+int ImpcapDataDecode(const char *hex, uint32_t length, uint8_t *retBuf) {
+    if(length % 2) return -1;
+
+    return hexDecode(hex, length, retBuf);
 }
@@ -36,43 +36,14 @@
 #include <arpa/inet.h>
 #include "packets.hpp"
 
-#include "../toolkit/rapidjson/document.h"
-
 #define HTTP_PORT 80
 #define FTP_PORT 21
 #define FTP_PORT_DATA 20
 
-typedef struct TCPHdr_ {
-    uint16_t sport;
-    uint16_t dport;
-    uint32_t seq;
-    uint32_t ack;
-    uint32_t TCPDataLength;
-    const char *flags;
-} TCPHdr;
-
 #define ETHERTYPE_IPV4  0x0800
 #define ETHERTYPE_IPV6  0X86DD
 
-typedef struct IPV4Hdr_ {
-    const char *src;
-    const char *dst;
-    uint8_t hLen;
-    uint8_t ttl;
-    uint8_t proto;
-} IPV4Hdr;
-
-typedef struct IPV6Hdr_ {
-    const char *src;
-    const char *dst;
-    uint8_t ttl;
-    uint8_t proto;
-} IPV6Hdr;
-
-struct Packet_ *getImpcapData(std::string, std::string);
-uint8_t *ImpcapDataDecode(const char *, uint32_t);
-TCPHdr *getTcpHeader(rapidjson::Document&);
-IPV4Hdr *getIpv4Header(rapidjson::Document&);
-IPV6Hdr *getIpv6Header(rapidjson::Document&);
+const char *parseImpcapEntry(const char *, const char *, struct Packet_ **);
+int ImpcapDataDecode(const char *, uint32_t, uint8_t *);
 
 #endif /* EXTRACT_IMPCAP_H */
@@ -24,11 +24,141 @@
  * limitations under the License.
  */
 
+#include <sched.h>
+
 #include "flow.hpp"
 #include "Logger.hpp"
 
 FlowCnf *globalFlowCnf;
 
+/* ###################### */
+/* --- epoch handling --- */
+/* ###################### */
+
+typedef struct EpochSlot_ {
+    uint64_t epoch; /* global epoch seen when entering, 0 when outside of critical sections */
+    uint32_t nesting; /* only accessed by the owning thread */
+    struct EpochSlot_ *next;
+} EpochSlot;
+
+typedef struct RetiredObject_ {
+    void *object;
+    retire_fn_t retire;
+    uint64_t epoch;
+    struct RetiredObject_ *next;
+} RetiredObject;
+
+static uint64_t globalEpoch = 1;
+static EpochSlot *epochSlots = NULL;
+static RetiredObject *retiredList = NULL;
+static pthread_mutex_t mRetired = PTHREAD_MUTEX_INITIALIZER;
+
+static inline EpochSlot *getEpochSlot() {
+    static thread_local EpochSlot *slot = NULL;
+
+    if(!slot) {
+        /* slots are never freed, as threads register once for the lifetime of the filter */
+        slot = (EpochSlot *)calloc(1, sizeof(EpochSlot));
+        if(!slot) {
+            DARWIN_LOGGER;
+            DARWIN_LOG_CRITICAL("could not claim memory for new epoch slot");
+            return NULL;
+        }
+
+        EpochSlot *head = __atomic_load_n(&epochSlots, __ATOMIC_ACQUIRE);
+        do {
+            slot->next = head;
+        } while(!__atomic_compare_exchange_n(&epochSlots, &head, slot, 1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+    }
+
+    return slot;
+}
+
+void flowEpochEnter() {
+    EpochSlot *slot = getEpochSlot();
+
+    if(slot && slot->nesting++ == 0) {
+        __atomic_store_n(&slot->epoch, __atomic_load_n(&globalEpoch, __ATOMIC_ACQUIRE), __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
+void flowEpochExit() {
+    EpochSlot *slot = getEpochSlot();
+
+    if(slot && slot->nesting && --slot->nesting == 0) {
+        __atomic_store_n(&slot->epoch, 0, __ATOMIC_RELEASE);
+    }
+}
+
+void flowEpochRetire(void *object, retire_fn_t retire) {
+    RetiredObject *retired = (RetiredObject *)malloc(sizeof(RetiredObject));
+
+    if(!retired) {
+        DARWIN_LOGGER;
+        DARWIN_LOG_ERROR("could not claim memory to retire object, leaking it");
+        return;
+    }
+
+    retired->object = object;
+    retired->retire = retire;
+
+    pthread_mutex_lock(&mRetired);
+    retired->epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+    retired->next = retiredList;
+    retiredList = retired;
+    pthread_mutex_unlock(&mRetired);
+
+    flowEpochReclaim();
+}
+
+void flowEpochReclaim() {
+    uint64_t epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+    uint8_t canAdvance = 1;
+    EpochSlot *slot;
+    RetiredObject *reclaimable = NULL, **scan, *current;
+
+    /* the epoch can only advance once every thread in a critical section has seen the current one */
+    for(slot = __atomic_load_n(&epochSlots, __ATOMIC_ACQUIRE); slot != NULL; slot = slot->next) {
+        uint64_t slotEpoch = __atomic_load_n(&slot->epoch, __ATOMIC_SEQ_CST);
+        if(slotEpoch && slotEpoch != epoch) {
+            canAdvance = 0;
+            break;
+        }
+    }
+    if(canAdvance) {
+        __atomic_compare_exchange_n(&globalEpoch, &epoch, epoch + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+    epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+
+    /* objects retired 2 epochs ago cannot be referenced anymore */
+    pthread_mutex_lock(&mRetired);
+    scan = &retiredList;
+    while(*scan) {
+        current = *scan;
+        if(current->epoch + 2 <= epoch) {
+            *scan = current->next;
+            current->next = reclaimable;
+            reclaimable = current;
+        }
+        else {
+            scan = &current->next;
+        }
+    }
+    pthread_mutex_unlock(&mRetired);
+
+    while(reclaimable) {
+        current = reclaimable;
+        reclaimable = reclaimable->next;
+        current->retire(current->object);
+        free(current);
+    }
+}
+
+/* ##################### */
+/* --- flow handling --- */
+/* ##################### */
+
 static inline Flow *createNewFlow() {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("createNewFlow");
@@ -63,121 +193,237 @@ void deleteFlow(Flow *flow) {
     return;
 }
 
-static inline FlowList *initNewFlowList() {
+static void retireFlow(void *flow) {
+    deleteFlow((Flow *)flow);
+}
+
+/* ###################### */
+/* --- flow table --- */
+/* ###################### */
+
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    sched_yield();
+#endif
+}
+
+static inline FlowTable *createFlowTable(uint32_t size) {
     DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("initNewFlowList");
+    DARWIN_LOG_DEBUG("createFlowTable, size: " + std::to_string(size));
+    uint32_t realSize = 64;
 
-    FlowList *flowList = NULL;
+    while(realSize < size) realSize <<= 1;
 
-    flowList = (FlowList *)calloc(1, sizeof(FlowList));
-    if(flowList) {
-        pthread_mutexattr_t attr;
-        pthread_mutexattr_init(&attr);
-        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-        if(pthread_mutex_init(&(flowList->mFlowList), &attr) == 0) {
-            pthread_mutexattr_destroy(&attr);
-            return flowList;
+    FlowTable *table = (FlowTable *)calloc(1, sizeof(FlowTable));
+    if(!table) {
+        DARWIN_LOG_ERROR("could not claim memory for new flow table");
+        return NULL;
+    }
+
+    table->buckets = (FlowBucket *)aligned_alloc(sizeof(FlowBucket), (size_t)realSize * sizeof(FlowBucket));
+    if(!table->buckets) {
+        DARWIN_LOG_ERROR("could not claim memory for flow table buckets");
+        free(table);
+        return NULL;
+    }
+    memset(table->buckets, 0, (size_t)realSize * sizeof(FlowBucket));
+    table->size = realSize;
+    table->mask = realSize - 1;
+
+    return table;
+}
+
+static void deleteFlowTable(void *tableObject) {
+    FlowTable *table = (FlowTable *)tableObject;
+
+    if(table) {
+        free(table->buckets);
+        free(table);
+    }
+    return;
+}
+
+static inline void setBucketKeyFromPacket(FlowBucket *key, struct Packet_ *packet) {
+    key->flowHash = packet->hash;
+    COPY_ADDR(&packet->src, &key->src);
+    COPY_ADDR(&packet->dst, &key->dst);
+    key->sp = packet->sp;
+    key->dp = packet->dp;
+    key->proto = packet->proto;
+}
+
+/* Finds the flow matching key in table, without waiting for flows being inserted
+ * sawMoved is set if migrated slots were crossed, meaning the flow may be in the new table */
+static Flow *flowTableLookup(FlowTable *table, const FlowBucket *key, uint8_t *sawMoved) {
+    uint32_t idx = key->flowHash & table->mask;
+    uint32_t i;
+
+    for(i = 0; i < table->size; i++, idx = (idx + 1) & table->mask) {
+        FlowBucket *bucket = &(table->buckets[idx]);
+        Flow *flow = __atomic_load_n(&bucket->flow, __ATOMIC_ACQUIRE);
+
+        if(flow == FLOW_BUCKET_EMPTY) return NULL;
+        if(flow == FLOW_BUCKET_MOVED) {
+            *sawMoved = 1;
+            continue;
+        }
+        if(FLOW_BUCKET_IS_FLOW(flow) && bucket->flowHash == key->flowHash && CMP_FLOW(bucket, key)) {
+            return flow;
         }
-        pthread_mutexattr_destroy(&attr);
     }
 
     return NULL;
 }
 
-static inline void deleteFlowListElems(FlowList *flowList) {
-    if(flowList) {
-        pthread_mutex_lock(&(flowList->mFlowList));
-        Flow *flowDelete, *flow = flowList->head;
-        while(flow) {
-            flowDelete = flow;
-            flow = flow->nextFlow;
-            deleteFlow(flowDelete);
+/* Inserts newFlow for key in table, unless a flow already exists for it
+ * Concurrent inserters of the same key walk the same slots and claim the first empty one,
+ * the others wait for the claimed slot to be ready and find the key there.
+ * With newFlow == FLOW_BUCKET_MOVED, marks the end of the key's chain as migrated instead,
+ * so that no thread can insert the key in this (old) table anymore.
+ * Returns the flow found or inserted,
+ *  FLOW_BUCKET_MOVED if the table is being migrated (or the chain was sealed),
+ *  NULL if the table is full */
+static Flow *flowTableInsert(FlowTable *table, const FlowBucket *key, Flow *newFlow) {
+    uint32_t idx = key->flowHash & table->mask;
+    uint32_t i;
+
+    for(i = 0; i < table->size; i++, idx = (idx + 1) & table->mask) {
+        FlowBucket *bucket = &(table->buckets[idx]);
+        Flow *flow = __atomic_load_n(&bucket->flow, __ATOMIC_ACQUIRE);
+
+        while(1) {
+            if(flow == FLOW_BUCKET_EMPTY) {
+                Flow *claim = (newFlow == FLOW_BUCKET_MOVED) ? FLOW_BUCKET_MOVED : FLOW_BUCKET_RESERVED;
+                if(__atomic_compare_exchange_n(&bucket->flow, &flow, claim, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                    __atomic_fetch_add(&table->used, 1, __ATOMIC_RELAXED);
+                    if(newFlow == FLOW_BUCKET_MOVED) return FLOW_BUCKET_MOVED;
+
+                    bucket->flowHash = key->flowHash;
+                    COPY_ADDR(&key->src, &bucket->src);
+                    COPY_ADDR(&key->dst, &bucket->dst);
+                    bucket->sp = key->sp;
+                    bucket->dp = key->dp;
+                    bucket->proto = key->proto;
+                    __atomic_store_n(&bucket->flow, newFlow, __ATOMIC_RELEASE);
+                    return newFlow;
+                }
+                /* flow holds the new value of the slot */
+                continue;
+            }
+            if(flow == FLOW_BUCKET_RESERVED) {
+                cpuRelax();
+                flow = __atomic_load_n(&bucket->flow, __ATOMIC_ACQUIRE);
+                continue;
+            }
+            break;
         }
 
-        flowList->listSize = 0;
-        pthread_mutex_unlock(&(flowList->mFlowList));
+        if(flow == FLOW_BUCKET_MOVED) {
+            if(newFlow == FLOW_BUCKET_MOVED) continue;
+            return FLOW_BUCKET_MOVED;
+        }
+        if(FLOW_BUCKET_IS_FLOW(flow) && bucket->flowHash == key->flowHash && CMP_FLOW(bucket, key)) {
+            return flow;
+        }
     }
 
-    return;
+    return NULL;
 }
 
-static inline void deleteFlowList(FlowList *flowList) {
-    if(flowList) {
-        pthread_mutex_destroy(&(flowList->mFlowList));
-        free(flowList);
+/* Replaces flow by a tombstone in table
+ * Returns 1 if the flow was found and removed, 0 otherwise */
+static int flowTableRemove(FlowTable *table, FlowHash hash, Flow *flow) {
+    uint32_t idx = hash & table->mask;
+    uint32_t i;
+
+    for(i = 0; i < table->size; i++, idx = (idx + 1) & table->mask) {
+        FlowBucket *bucket = &(table->buckets[idx]);
+        Flow *current = __atomic_load_n(&bucket->flow, __ATOMIC_ACQUIRE);
+
+        if(current == FLOW_BUCKET_EMPTY) return 0;
+        if(current == flow) {
+            return __atomic_compare_exchange_n(&bucket->flow, &current, FLOW_BUCKET_DELETED, 0,
+                                               __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ? 1 : 0;
+        }
     }
-    return ;
+
+    return 0;
 }
 
-static inline int addFlowToList(Flow *flow, FlowList *flowList) {
+static void flowTableMigrateBucket(FlowTable *newTable, FlowBucket *bucket) {
     DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("addFlowToList");
+    Flow *flow = __atomic_load_n(&bucket->flow, __ATOMIC_ACQUIRE);
 
-    if(flow && flowList) {
-        pthread_mutex_lock(&flowList->mFlowList);
-        if(flowList->tail) {
-            flowList->tail->nextFlow = flow;
-            flowList->tail = flow;
+    while(flow != FLOW_BUCKET_MOVED) {
+        if(flow == FLOW_BUCKET_RESERVED) {
+            cpuRelax();
+            flow = __atomic_load_n(&bucket->flow, __ATOMIC_ACQUIRE);
+            continue;
+        }
 
-            flow->prevFlow = flowList->tail;
-            flow->nextFlow = NULL;
+        if(FLOW_BUCKET_IS_FLOW(flow)) {
+            Flow *migrated = flow;
+            if(flowTableInsert(newTable, bucket, migrated) != migrated) {
+                DARWIN_LOG_ERROR("could not migrate flow to new flow table");
+            }
+            if(__atomic_compare_exchange_n(&bucket->flow, &flow, FLOW_BUCKET_MOVED, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return;
+            }
+            /* the flow was removed in the meantime, remove the copy as well */
+            flowTableRemove(newTable, bucket->flowHash, migrated);
         }
-        else {
-            flowList->tail = flow;
-            flowList->head = flow;
+        else if(__atomic_compare_exchange_n(&bucket->flow, &flow, FLOW_BUCKET_MOVED, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return;
         }
-        flowList->listSize++;
-        pthread_mutex_unlock(&flowList->mFlowList);
-        return 1;
-    }
-    else {
-        return 0;
     }
-}
-
-static inline int removeFlowFromList(Flow *flow, FlowList *flowList) {
-    DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("removeFlowFromList");
 
-    if(flow && flowList) {
-        pthread_mutex_lock(&flowList->mFlowList);
+    return;
+}
 
-        if(flowList->head) {
-            Flow *flowSearch = flowList->head;
-            uint8_t found = 0;
+/* Migrates the next FLOW_MIGRATE_STEP buckets of oldTable, and releases it when all buckets are migrated */
+static void flowTableMigrate(FlowCnf *conf, FlowTable *oldTable, FlowTable *newTable) {
+    uint32_t start = __atomic_fetch_add(&oldTable->migrateNext, FLOW_MIGRATE_STEP, __ATOMIC_RELAXED);
+    uint32_t end, idx;
 
-            do {
-                found = (flow == flowSearch) ? 1 : 0;
-            }while(flowSearch->nextFlow && !found);
+    if(start >= oldTable->size) return;
+    end = MIN(start + FLOW_MIGRATE_STEP, oldTable->size);
 
-            if(found) {
-                if (flowSearch == flowList->head) {
-                    flowList->head = flowList->head->nextFlow;
-                }
-                if (flowSearch == flowList->tail) {
-                    flowList->tail = flowList->tail->prevFlow;
-                }
-                flowList->listSize--;
+    for(idx = start; idx < end; idx++) {
+        flowTableMigrateBucket(newTable, &(oldTable->buckets[idx]));
+    }
 
-                if (flowSearch->nextFlow) {
-                    flowSearch->nextFlow = flowSearch->prevFlow;
-                }
+    if(__atomic_add_fetch(&oldTable->migrateDone, end - start, __ATOMIC_ACQ_REL) == oldTable->size) {
+        DARWIN_LOGGER;
+        DARWIN_LOG_DEBUG("flow table migration finished");
 
-                if (flowSearch->prevFlow) {
-                    flowSearch->prevFlow = flowSearch->nextFlow;
-                }
+        pthread_mutex_lock(&(conf->mConf));
+        __atomic_store_n(&conf->oldTable, (FlowTable *)NULL, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&(conf->mConf));
 
-                flowSearch->nextFlow = NULL;
-                flowSearch->prevFlow = NULL;
+        flowEpochRetire(oldTable, deleteFlowTable);
+    }
+}
 
-                pthread_mutex_unlock(&flowList->mFlowList);
-                return 1;
-            }
+/* Replaces table by a new one, bigger if enough flows are alive, and starts migrating flows incrementally */
+static void flowTableStartResize(FlowCnf *conf, FlowTable *table) {
+    DARWIN_LOGGER;
+    uint32_t liveFlows = __atomic_load_n(&conf->flowCount, __ATOMIC_RELAXED);
+    /* when the table is mostly filled by tombstones, rebuilding it with the same size is enough */
+    uint32_t newSize = (liveFlows > table->size / 4) ? table->size << 1 : table->size;
+
+    pthread_mutex_lock(&(conf->mConf));
+    if(__atomic_load_n(&conf->table, __ATOMIC_ACQUIRE) == table && !__atomic_load_n(&conf->oldTable, __ATOMIC_ACQUIRE)) {
+        FlowTable *newTable = createFlowTable(newSize);
+        if(newTable) {
+            DARWIN_LOG_DEBUG("resizing flow table from " + std::to_string(table->size) + " to " + std::to_string(newTable->size));
+            /* readers load table before oldTable, so oldTable must be published first */
+            __atomic_store_n(&conf->oldTable, table, __ATOMIC_RELEASE);
+            __atomic_store_n(&conf->table, newTable, __ATOMIC_RELEASE);
         }
-        pthread_mutex_unlock(&flowList->mFlowList);
     }
-
-    return 0;
+    pthread_mutex_unlock(&(conf->mConf));
 }
 
 void flowInitConfig(FlowCnf *conf) {
@@ -187,6 +433,11 @@ void flowInitConfig(FlowCnf *conf) {
     conf->hash_rand = (uint32_t) getRandom();
     conf->hash_size = FLOW_DEFAULT_HASHSIZE;
     conf->maxFlow = FLOW_DEFAULT_MAXCONN;
+    conf->flowCount = 0;
+    conf->oldTable = NULL;
+    conf->idleTimeout = FLOW_DEFAULT_IDLE_TIMEOUT;
+    conf->closedTimeout = FLOW_DEFAULT_CLOSED_TIMEOUT;
+    conf->maxQueuedBytes = FLOW_DEFAULT_MAX_QUEUED_BYTES;
 
     pthread_mutex_init(&(conf->mConf), NULL);
 
@@ -194,10 +445,15 @@ void flowInitConfig(FlowCnf *conf) {
     DARWIN_LOG_DEBUG("global flow conf hash_size: " + std::to_string(conf->hash_size));
     DARWIN_LOG_DEBUG("global flow conf maxFlow: " + std::to_string(conf->maxFlow));
 
-    conf->flowHashLists = (FlowList **)calloc(conf->hash_size, sizeof(FlowList *));
-    conf->flowList = initNewFlowList();
-    if(!conf->flowList) {
-        DARWIN_LOG_ERROR("could not create new flowList for global flow configuration");
+    conf->table = createFlowTable(conf->hash_size);
+    if(!conf->table) {
+        DARWIN_LOG_ERROR("could not create flow table for global flow configuration");
+        return;
+    }
+
+    conf->wheel = createTimerWheel(time(NULL));
+    if(!conf->wheel) {
+        DARWIN_LOG_ERROR("could not create timer wheel for global flow configuration");
         return;
     }
 
@@ -207,16 +463,34 @@ void flowInitConfig(FlowCnf *conf) {
 
 void flowDeleteConfig(FlowCnf *conf) {
     if(conf) {
-        if(conf->flowList)  {
-            deleteFlowListElems(conf->flowList);
-            deleteFlowList(conf->flowList);
-        }
         uint32_t i;
-        for(i = 0; i < conf->hash_size; i++) {
-            deleteFlowList(conf->flowHashLists[i]);
+        if(conf->table) {
+            for(i = 0; i < conf->table->size; i++) {
+                Flow *flow = conf->table->buckets[i].flow;
+                if(FLOW_BUCKET_IS_FLOW(flow)) deleteFlow(flow);
+            }
+            deleteFlowTable(conf->table);
+        }
+        if(conf->oldTable) {
+            /* flows not migrated yet are only referenced by the old table */
+            for(i = 0; i < conf->oldTable->size; i++) {
+                Flow *flow = conf->oldTable->buckets[i].flow;
+                if(FLOW_BUCKET_IS_FLOW(flow)) deleteFlow(flow);
+            }
+            deleteFlowTable(conf->oldTable);
+        }
+
+        /* no thread can use retired objects anymore */
+        pthread_mutex_lock(&mRetired);
+        while(retiredList) {
+            RetiredObject *current = retiredList;
+            retiredList = retiredList->next;
+            current->retire(current->object);
+            free(current);
         }
-        free(conf->flowHashLists);
+        pthread_mutex_unlock(&mRetired);
 
+        deleteTimerWheel(conf->wheel);
         pthread_mutex_destroy(&(conf->mConf));
 
         free(conf);
@@ -246,69 +520,153 @@ Flow *createNewFlowFromPacket(struct Packet_ *packet) {
         flow->toDstPktCnt = 1;
         flow->toDstByteCnt = packet->payloadLen;
         flow->toSrcPktCnt = 0;
-        flow->toDstByteCnt = 0;
+        flow->toSrcByteCnt = 0;
         packet->flow = flow;
     }
 
     return flow;
 }
 
+/**
+ * WARNING: must be called between flowEpochEnter() and flowEpochExit(),
+ * the flow returned is only guaranteed to be valid until flowEpochExit()
+ * @param packet
+ * @return the flow of the packet, or NULL if it could not be created
+ */
 Flow *getOrCreateFlowFromHash(struct Packet_ *packet) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("getOrCreateFlowFromHash");
-    FlowList *flowList = NULL;
-    FlowHash hash = packet->hash;
-    Flow *flow;
+    FlowTable *table, *oldTable;
+    Flow *flow = NULL, *newFlow = NULL;
+    FlowBucket key;
+
+    setBucketKeyFromPacket(&key, packet);
+
+    while(1) {
+        uint8_t sawMoved = 0;
+        table = __atomic_load_n(&globalFlowCnf->table, __ATOMIC_ACQUIRE);
+        oldTable = __atomic_load_n(&globalFlowCnf->oldTable, __ATOMIC_ACQUIRE);
+        if(oldTable == table) oldTable = NULL;
+        if(oldTable) flowTableMigrate(globalFlowCnf, oldTable, table);
+
+        flow = flowTableLookup(table, &key, &sawMoved);
+        if(!flow && oldTable) {
+            flow = flowTableLookup(oldTable, &key, &sawMoved);
+            /* the flow may have been migrated while looking for it */
+            if(!flow && sawMoved) flow = flowTableLookup(table, &key, &sawMoved);
+        }
+        if(flow) break;
 
-    pthread_mutex_lock(&(globalFlowCnf->mConf));
-    flowList = globalFlowCnf->flowHashLists[hash % globalFlowCnf->hash_size];
+        if(!newFlow) {
+            if(__atomic_fetch_add(&globalFlowCnf->flowCount, 1, __ATOMIC_RELAXED) >= globalFlowCnf->maxFlow) {
+                __atomic_fetch_sub(&globalFlowCnf->flowCount, 1, __ATOMIC_RELAXED);
+                DARWIN_LOG_DEBUG("max number of flows reached, cannot open new Flow");
+                return NULL;
+            }
+            newFlow = createNewFlowFromPacket(packet);
+            if(!newFlow) {
+                __atomic_fetch_sub(&globalFlowCnf->flowCount, 1, __ATOMIC_RELAXED);
+                return NULL;
+            }
+        }
 
-    if(flowList == NULL) {
-        flowList = initNewFlowList();
-        globalFlowCnf->flowHashLists[hash % globalFlowCnf->hash_size] = flowList;
-    }
-    pthread_mutex_unlock(&(globalFlowCnf->mConf));
+        if(oldTable) {
+            /* prevent threads still using the old table from inserting the same flow there */
+            flow = flowTableInsert(oldTable, &key, FLOW_BUCKET_MOVED);
+            if(FLOW_BUCKET_IS_FLOW(flow)) break;
+        }
 
-    pthread_mutex_lock(&(flowList->mFlowList));
-    flow = flowList->head;
-    uint8_t found = 0;
-    while(flow && !found) {
-        if(CMP_FLOW(flow, packet))  found = 1;
-        else flow = flow->nextFlow;
+        DARWIN_LOG_DEBUG("creating new flow and adding it to table");
+        flow = flowTableInsert(table, &key, newFlow);
+        if(flow == FLOW_BUCKET_MOVED) {
+            /* table was replaced in the meantime */
+            continue;
+        }
+        if(!flow) {
+            DARWIN_LOG_ERROR("flow table is full, cannot open new Flow");
+        }
+        break;
     }
 
+    if(newFlow && flow != newFlow) {
+        /* flow already existed or could not be inserted */
+        deleteFlow(newFlow);
+        __atomic_fetch_sub(&globalFlowCnf->flowCount, 1, __ATOMIC_RELAXED);
+        packet->flow = flow;
+    }
 
-    if(!flow) {
-        pthread_mutex_lock(&(globalFlowCnf->flowList->mFlowList));
-        if(globalFlowCnf->flowList->listSize < globalFlowCnf->maxFlow) {
-            DARWIN_LOG_DEBUG("creating new flow and adding it to lists");
-            flow = createNewFlowFromPacket(packet);
-            addFlowToList(flow, flowList);
-            addFlowToList(flow, globalFlowCnf->flowList);
+    if(flow && flow == newFlow) {
+        if(globalFlowCnf->wheel) {
+            timerWheelSchedule(globalFlowCnf->wheel, &flow->timer, flow->lastPacketTime + globalFlowCnf->idleTimeout);
         }
-        else {
-            DARWIN_LOG_DEBUG("max number of flows reached, cannot open new Flow");
+        if(__atomic_load_n(&table->used, __ATOMIC_RELAXED) * 4 >= table->size * 3) {
+            flowTableStartResize(globalFlowCnf, table);
         }
-        pthread_mutex_unlock(&(globalFlowCnf->flowList->mFlowList));
-        pthread_mutex_unlock(&(flowList->mFlowList));
     }
-    else {
-        pthread_mutex_unlock(&(flowList->mFlowList));
+    else if(flow) {
         DARWIN_LOG_DEBUG("found existing flow");
+        /* updated without the flow lock, concurrently with other packets and the expiry timer */
         if(getPacketFlowDirection(flow, packet) == TO_SERVER) {
-            flow->toDstByteCnt++;
-            flow->toDstByteCnt += packet->payloadLen;
+            __atomic_add_fetch(&flow->toDstPktCnt, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&flow->toDstByteCnt, packet->payloadLen, __ATOMIC_RELAXED);
         }
         else {
-            flow->toSrcPktCnt++;
-            flow->toSrcByteCnt += packet->payloadLen;
+            __atomic_add_fetch(&flow->toSrcPktCnt, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&flow->toSrcByteCnt, packet->payloadLen, __ATOMIC_RELAXED);
         }
-        flow->lastPacketTime = packet->enterTime;
+        __atomic_store_n(&flow->lastPacketTime, packet->enterTime, __ATOMIC_RELAXED);
     }
 
     return flow;
 }
 
+/**
+ * Removes the flow from the flow table, it will be freed once no thread can still be using it
+ * WARNING: the caller is responsible for the protocol context of the flow
+ * @param flow
+ * @return 1 if the flow was removed, 0 if it wasn't in the table
+ */
+int removeFlow(Flow *flow) {
+    DARWIN_LOGGER;
+    DARWIN_LOG_DEBUG("removeFlow");
+    FlowTable *table = NULL, *oldTable;
+    int removed = 0;
+
+    if(!flow) return 0;
+
+    flowEpochEnter();
+    /* a resize may start while removing, check the tables until they are stable */
+    while(table != __atomic_load_n(&globalFlowCnf->table, __ATOMIC_ACQUIRE)) {
+        table = __atomic_load_n(&globalFlowCnf->table, __ATOMIC_ACQUIRE);
+        oldTable = __atomic_load_n(&globalFlowCnf->oldTable, __ATOMIC_ACQUIRE);
+
+        /* old table first: a flow still there prevents its migration from succeeding */
+        if(oldTable && oldTable != table) removed |= flowTableRemove(oldTable, flow->flowHash, flow);
+        removed |= flowTableRemove(table, flow->flowHash, flow);
+    }
+    flowEpochExit();
+
+    if(removed) {
+        __atomic_fetch_sub(&globalFlowCnf->flowCount, 1, __ATOMIC_RELAXED);
+        flowEpochRetire(flow, retireFlow);
+    }
+
+    return removed;
+}
+
+/**
+ * Brings the expiration of the flow forward, if it was scheduled later
+ * (the expiration is only pushed back lazily, once it is reached)
+ * WARNING: flow mutex must be held, and the flow must not be expired
+ * @param flow
+ * @param expire
+ */
+void flowScheduleExpiry(Flow *flow, time_t expire) {
+    if(flow && globalFlowCnf->wheel) {
+        timerWheelScheduleEarlier(globalFlowCnf->wheel, &flow->timer, expire);
+    }
+}
+
 void swapFlowDirection(Flow *flow) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("swapFlowDirection");
@@ -31,36 +31,74 @@
 #include "packet-utils.hpp"
 #include "packets.hpp"
 #include "rand_utils.hpp"
+#include "timer_wheel.hpp"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #include <pthread.h>
+#include <stddef.h>
 #include <time.h>
 
 #define TO_SERVER 0
 #define TO_CLIENT 1
 
-typedef struct FlowList_ {
-    uint32_t listSize;
-    struct Flow_ *head;
-    struct Flow_ *tail;
-    pthread_mutex_t mFlowList;
-} FlowList;
+/* Slot of the flow table, one cache line each
+ * The key is written once before the flow pointer is published (release),
+ * and never changes afterwards, so readers don't need any lock */
+typedef struct FlowBucket_ {
+    struct Flow_ *flow;
+#define FLOW_BUCKET_EMPTY       ((struct Flow_ *)0)
+#define FLOW_BUCKET_RESERVED    ((struct Flow_ *)1) /* claimed by an inserter, key not ready yet */
+#define FLOW_BUCKET_DELETED     ((struct Flow_ *)2) /* tombstone */
+#define FLOW_BUCKET_MOVED       ((struct Flow_ *)3) /* migrated to the new table during a resize */
+#define FLOW_BUCKET_IS_FLOW(f)  ((uintptr_t)(f) > 3)
+    uint32_t flowHash;
+    Address src, dst;
+    Port sp, dp;
+    uint8_t proto;
+} __attribute__((aligned(64))) FlowBucket;
+
+/* Open addressing (linear probing) table of flows */
+typedef struct FlowTable_ {
+    uint32_t size; /* always a power of 2 */
+    uint32_t mask;
+    uint32_t used; /* claimed slots, including tombstones */
+
+    /* incremental migration to the next table, when this one is being replaced */
+    uint32_t migrateNext;
+    uint32_t migrateDone;
+#define FLOW_MIGRATE_STEP       64
+
+    FlowBucket *buckets;
+} FlowTable;
 
 typedef struct FlowCnf_ {
     uint32_t hash_rand;
-    uint32_t hash_size;
-#define FLOW_DEFAULT_HASHSIZE   65536
+    uint32_t hash_size; /* initial size of the flow table, grows as needed */
+#define FLOW_DEFAULT_HASHSIZE   16384
 
     uint32_t maxFlow;
 #define FLOW_DEFAULT_MAXCONN    8192
 
-    FlowList **flowHashLists;
-    FlowList *flowList;
+    FlowTable *table;
+    FlowTable *oldTable; /* table being migrated, NULL if no resize is in progress */
+    uint32_t flowCount;
 
-    pthread_mutex_t mConf;
+    /* flows are expired after idleTimeout seconds without packets,
+     * or closedTimeout seconds if their TCP session is closed */
+    TimerWheel *wheel;
+    uint32_t idleTimeout;
+#define FLOW_DEFAULT_IDLE_TIMEOUT       300
+    uint32_t closedTimeout;
+#define FLOW_DEFAULT_CLOSED_TIMEOUT     10
+
+    /* out-of-order bytes kept per TCP connection before skipping the missing segments */
+    uint32_t maxQueuedBytes;
+#define FLOW_DEFAULT_MAX_QUEUED_BYTES   (1024 * 1024)
+
+    pthread_mutex_t mConf; /* only taken to start or finish a resize */
 } FlowCnf;
 
 extern FlowCnf *globalFlowCnf;
@@ -100,20 +138,24 @@ typedef struct Flow_ {
 
     void *protoCtx;
 
+    /* counters and lastPacketTime are accessed atomically, packets update them without mFlow */
     uint32_t toDstPktCnt;
     uint32_t toSrcPktCnt;
     uint64_t toDstByteCnt;
     uint64_t toSrcByteCnt;
 
-    struct Flow_ *prevFlow;
-    struct Flow_ *nextFlow;
-
     time_t initPacketTime;
     time_t lastPacketTime;
 
+    /* scheduled at creation, lazily rescheduled on expiration according to lastPacketTime */
+    WheelTimer timer;
+    uint8_t expired; /* set under mFlow when the flow is removed from the table */
+
     pthread_mutex_t mFlow;
 } Flow;
 
+#define FLOW_FROM_TIMER(t)  ((Flow *)((char *)(t) - offsetof(Flow, timer)))
+
 #define CMP_FLOW(f1,f2) \
     (((CMP_ADDR(&(f1)->src, &(f2)->src) && \
        CMP_ADDR(&(f1)->dst, &(f2)->dst) && \
@@ -128,11 +170,22 @@ void flowInitConfig(FlowCnf *);
 void flowDeleteConfig(FlowCnf *);
 Flow *createNewFlowFromPacket(struct Packet_ *);
 Flow *getOrCreateFlowFromHash(struct Packet_ *);
+int removeFlow(Flow *);
+void flowScheduleExpiry(Flow *, time_t);
 void swapFlowDirection(Flow *);
 int getFlowDirectionFromAddrs(Flow *, Address *, Address *);
 int getFlowDirectionFromPorts(Flow *, const Port, const Port);
 int getPacketFlowDirection(Flow *, struct Packet_ *);
 
+/* Epoch based reclamation of flows and tables:
+ * pointers obtained from the flow table are valid until flowEpochExit(),
+ * objects removed from the table are only freed once no thread can still use them */
+typedef void (*retire_fn_t)(void *);
+void flowEpochEnter();
+void flowEpochExit();
+void flowEpochRetire(void *, retire_fn_t);
+void flowEpochReclaim();
+
 #ifdef __cplusplus
 };
 #endif
@@ -0,0 +1,280 @@
+/* flow_dispatcher.c
+ *
+ * This file contains functions used to process packets in parallel:
+ * items are hashed by flow to a fixed set of lanes, each lane being served by its own thread,
+ * so that all packets of a flow are processed in order by the same thread
+ *
+ * File begun on 2026-10-18
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "flow_dispatcher.hpp"
+#include "Logger.hpp"
+
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/* ###################### */
+/* --- dispatch batch --- */
+/* ###################### */
+
+void dispatchBatchInit(DispatchBatch *batch, uint32_t count) {
+    batch->pending = count;
+    batch->done = (count == 0);
+    pthread_mutex_init(&(batch->mDone), NULL);
+    pthread_cond_init(&(batch->cDone), NULL);
+}
+
+/**
+ * Waits for every item of the batch to be processed, then releases the batch
+ */
+void dispatchBatchWait(DispatchBatch *batch) {
+    pthread_mutex_lock(&(batch->mDone));
+    while(!batch->done) {
+        pthread_cond_wait(&(batch->cDone), &(batch->mDone));
+    }
+    pthread_mutex_unlock(&(batch->mDone));
+
+    pthread_mutex_destroy(&(batch->mDone));
+    pthread_cond_destroy(&(batch->cDone));
+}
+
+static inline void dispatchBatchItemDone(DispatchBatch *batch) {
+    if(__atomic_sub_fetch(&batch->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        /* signalled with the lock held, the waiter can't release the batch before */
+        pthread_mutex_lock(&(batch->mDone));
+        batch->done = 1;
+        pthread_cond_signal(&(batch->cDone));
+        pthread_mutex_unlock(&(batch->mDone));
+    }
+}
+
+/* ##################### */
+/* --- dispatch lane --- */
+/* ##################### */
+
+/*
+ * Each slot carries a sequence number telling whether it can be written (sequence == position)
+ * or read (sequence == position + 1), producers claim positions with a CAS on enqueuePos
+ */
+static inline void laneEnqueue(DispatchLane *lane, void *item, DispatchBatch *batch) {
+    uint32_t pos = __atomic_load_n(&lane->enqueuePos, __ATOMIC_RELAXED);
+    DispatchSlot *slot;
+
+    while(1) {
+        slot = &lane->slots[pos & (DISPATCHER_QUEUE_SIZE - 1)];
+        int32_t diff = (int32_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - pos);
+
+        if(diff == 0) {
+            if(__atomic_compare_exchange_n(&lane->enqueuePos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if(diff < 0) {
+            /* lane is full, wait for its thread to catch up */
+            sched_yield();
+            pos = __atomic_load_n(&lane->enqueuePos, __ATOMIC_RELAXED);
+        }
+        else {
+            pos = __atomic_load_n(&lane->enqueuePos, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->item = item;
+    slot->batch = batch;
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    /* pairs with the fence of the lane thread before it goes to sleep */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&lane->sleeping, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&(lane->mSleep));
+        pthread_cond_signal(&(lane->cSleep));
+        pthread_mutex_unlock(&(lane->mSleep));
+    }
+}
+
+static inline int laneIsEmpty(DispatchLane *lane) {
+    uint32_t pos = lane->dequeuePos;
+    DispatchSlot *slot = &lane->slots[pos & (DISPATCHER_QUEUE_SIZE - 1)];
+
+    return __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos + 1;
+}
+
+/**
+ * WARNING: must only be called by the lane thread
+ * @return 1 if an item was dequeued, 0 if the lane is empty
+ */
+static inline int laneDequeue(DispatchLane *lane, void **item, DispatchBatch **batch) {
+    uint32_t pos = lane->dequeuePos;
+    DispatchSlot *slot = &lane->slots[pos & (DISPATCHER_QUEUE_SIZE - 1)];
+
+    if(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos + 1) return 0;
+
+    *item = slot->item;
+    *batch = slot->batch;
+    __atomic_store_n(&slot->sequence, pos + DISPATCHER_QUEUE_SIZE, __ATOMIC_RELEASE);
+    lane->dequeuePos = pos + 1;
+
+    return 1;
+}
+
+static void *laneDoWork(void *pData) {
+    DispatchLane *lane = (DispatchLane *)pData;
+    FlowDispatcher *dispatcher = lane->dispatcher;
+    DispatchBatch *batch;
+    void *item;
+    uint32_t spins = 0;
+
+    while(1) {
+        if(laneDequeue(lane, &item, &batch)) {
+            dispatcher->process(item);
+            dispatchBatchItemDone(batch);
+            spins = 0;
+            continue;
+        }
+
+        /* remaining items are always processed before stopping */
+        if(__atomic_load_n(&dispatcher->sigStop, __ATOMIC_ACQUIRE)) break;
+
+        if(++spins < DISPATCHER_SPIN_COUNT) {
+            cpuRelax();
+            continue;
+        }
+
+        pthread_mutex_lock(&(lane->mSleep));
+        __atomic_store_n(&lane->sleeping, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if(laneIsEmpty(lane) && !__atomic_load_n(&dispatcher->sigStop, __ATOMIC_ACQUIRE)) {
+            pthread_cond_wait(&(lane->cSleep), &(lane->mSleep));
+        }
+        __atomic_store_n(&lane->sleeping, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&(lane->mSleep));
+        spins = 0;
+    }
+
+    return NULL;
+}
+
+/* ######################### */
+/* --- flow dispatcher --- */
+/* ######################### */
+
+/**
+ * Creates the dispatcher and starts one thread per lane
+ * @param laneCount the number of lanes, capped to DISPATCHER_MAX_LANES
+ * @param process called by the lane threads for each item dispatched
+ * @return the dispatcher, or NULL if it could not be created
+ */
+FlowDispatcher *createFlowDispatcher(uint32_t laneCount, dispatch_fn_t process) {
+    DARWIN_LOGGER;
+    DARWIN_LOG_DEBUG("createFlowDispatcher");
+    uint32_t i, j;
+
+    if(!laneCount || !process) return NULL;
+    if(laneCount > DISPATCHER_MAX_LANES) laneCount = DISPATCHER_MAX_LANES;
+
+    FlowDispatcher *dispatcher = (FlowDispatcher *)calloc(1, sizeof(FlowDispatcher));
+    if(!dispatcher) {
+        DARWIN_LOG_ERROR("could not claim memory for flow dispatcher");
+        return NULL;
+    }
+
+    dispatcher->lanes = (DispatchLane *)aligned_alloc(alignof(DispatchLane), laneCount * sizeof(DispatchLane));
+    if(!dispatcher->lanes) {
+        DARWIN_LOG_ERROR("could not claim memory for flow dispatcher lanes");
+        free(dispatcher);
+        return NULL;
+    }
+    memset(dispatcher->lanes, 0, laneCount * sizeof(DispatchLane));
+    dispatcher->process = process;
+
+    for(i = 0; i < laneCount; i++) {
+        DispatchLane *lane = &dispatcher->lanes[i];
+
+        for(j = 0; j < DISPATCHER_QUEUE_SIZE; j++) {
+            lane->slots[j].sequence = j;
+        }
+        lane->dispatcher = dispatcher;
+        pthread_mutex_init(&(lane->mSleep), NULL);
+        pthread_cond_init(&(lane->cSleep), NULL);
+
+        if(pthread_create(&(lane->thread), NULL, laneDoWork, (void *)lane) != 0) {
+            DARWIN_LOG_ERROR("could not start flow dispatcher lane " + std::to_string(i));
+            pthread_mutex_destroy(&(lane->mSleep));
+            pthread_cond_destroy(&(lane->cSleep));
+            break;
+        }
+        dispatcher->laneCount++;
+    }
+
+    if(!dispatcher->laneCount) {
+        free(dispatcher->lanes);
+        free(dispatcher);
+        return NULL;
+    }
+
+    DARWIN_LOG_INFO("flow dispatcher started with " + std::to_string(dispatcher->laneCount) + " lanes");
+    return dispatcher;
+}
+
+/**
+ * Stops the lanes once they processed their remaining items, and frees the dispatcher
+ */
+void deleteFlowDispatcher(FlowDispatcher *dispatcher) {
+    uint32_t i;
+
+    if(!dispatcher) return;
+
+    __atomic_store_n(&dispatcher->sigStop, 1, __ATOMIC_RELEASE);
+    for(i = 0; i < dispatcher->laneCount; i++) {
+        DispatchLane *lane = &dispatcher->lanes[i];
+
+        pthread_mutex_lock(&(lane->mSleep));
+        pthread_cond_signal(&(lane->cSleep));
+        pthread_mutex_unlock(&(lane->mSleep));
+
+        pthread_join(lane->thread, NULL);
+        pthread_mutex_destroy(&(lane->mSleep));
+        pthread_cond_destroy(&(lane->cSleep));
+    }
+
+    free(dispatcher->lanes);
+    free(dispatcher);
+    return;
+}
+
+/**
+ * Queues the item on the lane owning the flow
+ * @param dispatcher
+ * @param flowHash the hash of the flow, the same for both directions
+ * @param item given to the process function
+ * @param batch the batch the item belongs to
+ */
+void dispatchItem(FlowDispatcher *dispatcher, uint32_t flowHash, void *item, DispatchBatch *batch) {
+    /* high bits of the hash, the low ones are used to index the flow table */
+    uint32_t laneIndex = (uint32_t)(((uint64_t)flowHash * dispatcher->laneCount) >> 32);
+
+    laneEnqueue(&dispatcher->lanes[laneIndex], item, batch);
+}
@@ -0,0 +1,91 @@
+/* flow_dispatcher.h
+ *
+ * This file contains structures and prototypes of functions used
+ * to process packets in parallel, each flow being owned by a single lane
+ *
+ * File begun on 2026-10-18
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLOW_DISPATCHER_H
+#define FLOW_DISPATCHER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define DISPATCHER_DEFAULT_LANES    0 /* no lane, packets are processed by the task threads */
+#define DISPATCHER_MAX_LANES        64
+#define DISPATCHER_QUEUE_SIZE       1024 /* items per lane, must be a power of 2 */
+#define DISPATCHER_SPIN_COUNT       512 /* empty polls before a lane goes to sleep */
+
+typedef void (*dispatch_fn_t)(void *);
+
+/* Set of items dispatched together, the caller waits for all of them to be processed */
+typedef struct DispatchBatch_ {
+    uint32_t pending;
+    uint8_t done;
+
+    pthread_mutex_t mDone;
+    pthread_cond_t cDone;
+} DispatchBatch;
+
+typedef struct DispatchSlot_ {
+    uint32_t sequence;
+    void *item;
+    DispatchBatch *batch;
+} DispatchSlot;
+
+/* Bounded multi-producer, single-consumer queue served by its own thread */
+typedef struct DispatchLane_ {
+    /* producers and consumer positions are kept on separate cache lines */
+    alignas(64) uint32_t enqueuePos;
+    alignas(64) uint32_t dequeuePos;
+    uint8_t sleeping;
+
+    DispatchSlot slots[DISPATCHER_QUEUE_SIZE];
+
+    pthread_mutex_t mSleep;
+    pthread_cond_t cSleep;
+    pthread_t thread;
+
+    struct FlowDispatcher_ *dispatcher;
+} DispatchLane;
+
+typedef struct FlowDispatcher_ {
+    uint32_t laneCount;
+    uint8_t sigStop;
+    dispatch_fn_t process;
+
+    DispatchLane *lanes;
+} FlowDispatcher;
+
+FlowDispatcher *createFlowDispatcher(uint32_t, dispatch_fn_t);
+void deleteFlowDispatcher(FlowDispatcher *);
+void dispatchBatchInit(DispatchBatch *, uint32_t);
+void dispatchBatchWait(DispatchBatch *);
+void dispatchItem(FlowDispatcher *, uint32_t, void *, DispatchBatch *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* FLOW_DISPATCHER_H */
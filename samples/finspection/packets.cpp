@@ -30,31 +30,97 @@
 #include "packets.hpp"
 #include "Logger.hpp"
 
-Packet *createPacket() {
+DataPool *packetPool;
+
+static inline void *packetCreate(void *object) {
+    DARWIN_LOGGER;
+    DARWIN_LOG_DEBUG("packetCreate");
+    DataObject *dObject = (DataObject *)object;
+
     Packet *pkt = (Packet *)calloc(1, sizeof(Packet));
+    if(pkt) {
+        pkt->object = dObject;
+        dObject->pObject = (void *)pkt;
+        return (void *)sizeof(Packet);
+    }
+
+    DARWIN_LOG_ERROR("could not create new Packet");
+    return (void *)0;
+}
+
+static inline void packetDelete(void *pktObject) {
+    if(pktObject) {
+        Packet *pkt = (Packet *)pktObject;
+        if(pkt->payload) free(pkt->payload);
+        free(pkt);
+    }
+}
+
+static inline void packetReset(void *pktObject) {
+    if(pktObject) {
+        Packet *pkt = (Packet *)pktObject;
+        DataObject *object = pkt->object;
+        uint8_t *payload = pkt->payload;
+        uint32_t payloadSize = pkt->payloadSize;
+
+        memset(pkt, 0, sizeof(Packet));
+        pkt->object = object;
+        pkt->payload = payload;
+        pkt->payloadSize = payloadSize;
+    }
+}
+
+int initPacketPool() {
+    DARWIN_LOGGER;
+    DARWIN_LOG_DEBUG("initPacketPool");
 
-    return pkt;
+    packetPool = createPool("packetPool", packetCreate, packetDelete, packetReset, 64);
+    if(!packetPool) return -1;
+    /* packets only live for the duration of a task (out-of-order TCP data is copied), they must not be refused */
+    packetPool->unbounded = 1;
+    return 0;
+}
+
+void destroyPacketPool() {
+    destroyPool(packetPool);
+    packetPool = NULL;
+}
+
+Packet *createPacket() {
+    DataObject *object = getOrCreateAvailableObject(packetPool);
+
+    if(object) return (Packet *)object->pObject;
+    return NULL;
 }
 
 void freePacket(Packet *pkt) {
     if(pkt) {
-        if(pkt->ipv4h) {
-            if(pkt->ipv4h->dst) free((void *)pkt->ipv4h->dst);
-            if(pkt->ipv4h->src) free((void *)pkt->ipv4h->src);
-            free((void *)pkt->ipv4h);
-        }
-        if(pkt->ipv6h){
-            if(pkt->ipv6h->dst) free((void *)pkt->ipv6h->dst);
-            if(pkt->ipv6h->src) free((void *)pkt->ipv6h->src);
-            free((void *)pkt->ipv6h);
-        }
-        if(pkt->tcph){
-            if(pkt->tcph->flags) free((void *)pkt->tcph->flags);
-            free((void *)pkt->tcph);
+        setObjectAvailable(pkt->object);
+    }
+}
+
+/**
+ * Ensures the payload buffer of the packet can hold size bytes,
+ * the buffer is kept when the packet is reused so it is only grown
+ * @param pkt
+ * @param size
+ * @return the payload buffer, or NULL if it could not be grown
+ */
+uint8_t *packetReservePayload(Packet *pkt, uint32_t size) {
+    DARWIN_LOGGER;
+
+    if(size > pkt->payloadSize) {
+        uint8_t *newBuffer = (uint8_t *)realloc(pkt->payload, size);
+        if(!newBuffer) {
+            DARWIN_LOG_ERROR("could not claim memory for packet payload");
+            return NULL;
         }
-        if(pkt->payload)    free(pkt->payload);
-        free(pkt);
+        updateDataObjectSize(pkt->object, (int)(size - pkt->payloadSize));
+        pkt->payload = newBuffer;
+        pkt->payloadSize = size;
     }
+
+    return pkt->payload;
 }
 
 void updatePacketFromHeaders(Packet *pkt) {
@@ -142,12 +208,12 @@ FlowHash calculatePacketFlowHash(Packet *pkt) {
 
     if(pkt) {
         if(pkt->flags & PKT_HASH_READY) {
-            pthread_mutex_lock(&(globalFlowCnf->mConf));
+            /* set once at init, no need to lock */
             uint32_t hash_rand = (uint32_t)globalFlowCnf->hash_rand;
-            pthread_mutex_unlock(&(globalFlowCnf->mConf));
 
             if(pkt->flags & PKT_IPV4_ADDR) {
-                FlowHashKey4 *fk = (FlowHashKey4 *)malloc(sizeof(FlowHashKey4));
+                uint32_t fkData[sizeof(FlowHashKey4) / sizeof(uint32_t)];
+                FlowHashKey4 *fk = (FlowHashKey4 *)fkData;
 
                 int ai = (pkt->src.addr_data32[0] > pkt->dst.addr_data32[0]);
                 fk->addrs[1-ai] = pkt->src.addr_data32[0];
@@ -160,11 +226,10 @@ FlowHash calculatePacketFlowHash(Packet *pkt) {
                 fk->proto = (uint32_t) pkt->proto;
 
                 hash = hashword(fk->u32, 4, hash_rand);
-
-                free(fk);
             }
             else if(pkt->flags & PKT_IPV6_ADDR) {
-                FlowHashKey6 *fk = (FlowHashKey6 *)malloc(sizeof(FlowHashKey6));
+                uint32_t fkData[sizeof(FlowHashKey6) / sizeof(uint32_t)];
+                FlowHashKey6 *fk = (FlowHashKey6 *)fkData;
 
                 if(ip6AddressCompare(pkt->src.addr_data32, pkt->dst.addr_data32)) {
                     fk->addrs[0] = pkt->src.addr_data32[0];
@@ -195,8 +260,6 @@ FlowHash calculatePacketFlowHash(Packet *pkt) {
                 fk->proto = (uint32_t) pkt->proto;
 
                 hash = hashword(fk->u32, 10, hash_rand);
-
-                free(fk);
             }
         }
         else {
@@ -34,6 +34,7 @@
 #include "extract_impcap.hpp"
 #include "flow.hpp"
 #include "hash_utils.hpp"
+#include "data_pool.hpp"
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,6 +43,33 @@ extern "C" {
 #include <stdlib.h>
 #include <stdint.h>
 #include <time.h>
+#include <arpa/inet.h>
+
+typedef struct TCPHdr_ {
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t seq;
+    uint32_t ack;
+    uint32_t TCPDataLength;
+    char flags[11];
+} TCPHdr;
+
+typedef struct IPV4Hdr_ {
+    char src[INET_ADDRSTRLEN];
+    char dst[INET_ADDRSTRLEN];
+    uint8_t hLen;
+    uint8_t ttl;
+    uint8_t proto;
+} IPV4Hdr;
+
+typedef struct IPV6Hdr_ {
+    char src[INET6_ADDRSTRLEN];
+    char dst[INET6_ADDRSTRLEN];
+    uint8_t ttl;
+    uint8_t proto;
+} IPV6Hdr;
+
+extern DataPool *packetPool;
 
 typedef struct Packet_ {
     Address src, dst;
@@ -59,20 +87,30 @@ typedef struct Packet_ {
 #define PKT_IPV4_ADDR   0x10
 #define PKT_IPV6_ADDR   0x20
 
+    /* point to the storage below when the headers are present, NULL otherwise */
     struct IPV6Hdr_ *ipv6h;
     struct IPV4Hdr_ *ipv4h;
     struct TCPHdr_ *tcph;
+    IPV6Hdr ipv6hData;
+    IPV4Hdr ipv4hData;
+    TCPHdr tcphData;
 
     uint8_t *payload;
     uint16_t payloadLen;
+    uint32_t payloadSize; /* size of the payload buffer, kept when the packet is reused */
 
     uint32_t pktNumber;
 
     time_t enterTime;
+
+    DataObject *object;
 } Packet;
 
+int initPacketPool();
+void destroyPacketPool();
 Packet *createPacket();
 void freePacket(Packet *);
+uint8_t *packetReservePayload(Packet *, uint32_t);
 void updatePacketFromHeaders(Packet *);
 FlowHash calculatePacketFlowHash(Packet *);
 
@@ -29,18 +29,30 @@
 
 StreamsCnf *streamsCnf;
 
-static inline int initBuffer(StreamBuffer *sb) {
+/**
+ * Allocates the buffer to the configured size, the first time data is added
+ * (the size is only known once the configuration is loaded, after the pool is created)
+ * WARNING: sb mutex must be held
+ */
+static inline int streamBufferReserve(StreamBuffer *sb) {
     DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("initBuffer");
+    uint32_t size = streamsCnf->streamMaxBufferSize;
 
-    sb->buffer = (uint8_t *)calloc(1, DEFAULT_BUFF_START_SIZE);
+    if(sb->buffer && sb->bufferSize == size) return 0;
 
-    if(sb->buffer) {
-        sb->bufferSize = DEFAULT_BUFF_START_SIZE;
-        return 0;
+    /* only reallocated if the configuration changed, no data must be kept */
+    uint8_t *buffer = (uint8_t *)realloc(sb->buffer, size);
+    if(!buffer) {
+        DARWIN_LOG_ERROR("could not allocate stream buffer");
+        return -1;
     }
 
-    return -1;
+    updateDataObjectSize(sb->object, (int)size - (int)sb->bufferSize);
+    sb->buffer = buffer;
+    sb->bufferSize = size;
+    sb->bufferFill = 0;
+    sb->bufferStart = 0;
+    return 0;
 }
 
 static inline void *streamBufferCreate(void *object) {
@@ -56,13 +68,9 @@ static inline void *streamBufferCreate(void *object) {
 
         sb->object = dObject;
         dObject->pObject = sb;
-        if(initBuffer(sb) == 0) {
-            pthread_mutex_init(&(sb->mutex), &attr);
-            pthread_mutexattr_destroy(&attr);
-            return (void *) (sizeof(StreamBuffer) + DEFAULT_BUFF_START_SIZE);
-        }
-
-        free(sb);
+        pthread_mutex_init(&(sb->mutex), &attr);
+        pthread_mutexattr_destroy(&attr);
+        return (void *)sizeof(StreamBuffer);
     }
 
     return (void *)0;
@@ -75,15 +83,15 @@ static inline void streamBufferDelete(void *sbObject) {
     if(sbObject) {
         StreamBuffer *sb = (StreamBuffer *)sbObject;
 
-        pthread_mutex_destroy(&(sb->mutex));
-
         if(sb->bufferDump) {
             streamBufferDumpToFile(sb);
-            deleteFileStruct(sb->bufferDump);
+            dumpWriterClose(streamsCnf->dumpWriter, sb->bufferDump);
         }
 
+        pthread_mutex_destroy(&(sb->mutex));
+
         if(sb->buffer) free(sb->buffer);
-        if(sb->ruleList) yaraDeleteRuleList(sb->ruleList);
+        if(sb->matchedRules) free(sb->matchedRules);
 
         free(sb);
     }
@@ -97,16 +105,20 @@ void streamBufferReset(void *sbObject) {
         StreamBuffer *sb = (StreamBuffer *)sbObject;
         pthread_mutex_lock(&(sb->mutex));
 
-        sb->bufferFill = 0;
-        sb->streamOffset = 0;
-        if(sb->ruleList) {
-            yaraDeleteRuleList(sb->ruleList);
-            sb->ruleList = NULL;
-        }
         if(sb->bufferDump) {
-            deleteFileStruct(sb->bufferDump);
+            /* the end of the stream is still in the buffer */
+            streamBufferDumpToFile(sb);
+            dumpWriterClose(streamsCnf->dumpWriter, sb->bufferDump);
             sb->bufferDump = NULL;
         }
+        sb->bufferFill = 0;
+        sb->bufferStart = 0;
+        sb->streamOffset = 0;
+        sb->scannedOffset = 0;
+        if(sb->matchedRules) {
+            free(sb->matchedRules);
+            sb->matchedRules = NULL;
+        }
 
         pthread_mutex_unlock(&(sb->mutex));
     }
@@ -118,6 +130,8 @@ void streamInitConfig(StreamsCnf *conf) {
     DARWIN_LOG_DEBUG("streamInitConfig");
     memset(conf, 0, sizeof(StreamsCnf));
 
+    conf->streamMaxBufferSize = STREAM_DEFAULT_BUFFER_SIZE;
+    conf->streamStoreMaxOpenFiles = DUMP_DEFAULT_MAX_OPEN_FILES;
     conf->sbPool = createPool("streamBufferPool", streamBufferCreate, streamBufferDelete, streamBufferReset, 20);
 
     streamsCnf = conf;
@@ -130,6 +144,8 @@ void streamDeleteConfig(StreamsCnf *conf) {
 
     if(conf->streamStoreFolder) free(conf->streamStoreFolder);
     destroyPool(conf->sbPool);
+    /* after the pool, remaining stream data is queued when buffers are deleted */
+    stopDumpWriter(conf->dumpWriter);
     free(conf);
 }
 
@@ -138,18 +154,31 @@ int linkStreamBufferToDumpFile(StreamBuffer *sb, char *filename) {
     DARWIN_LOG_DEBUG("linkStreamBufferToDumpFile");
 
     if(streamsCnf->streamStoreFolder) {
-        FILE *opened = openFile(streamsCnf->streamStoreFolder, filename);
-        if(!opened) return -1;
-
-        sb->bufferDump = createFileStruct();
+        if(!streamsCnf->dumpWriter) return -1;
 
-        strncpy(sb->bufferDump->filename, filename, 256);
-        strncpy(sb->bufferDump->directory, streamsCnf->streamStoreFolder, 2048);
-        sb->bufferDump->pFile = opened;
+        /* the file is only opened by the writer thread, on first write */
+        sb->bufferDump = dumpWriterOpen(streamsCnf->dumpWriter, streamsCnf->streamStoreFolder, filename);
+        if(!sb->bufferDump) return -1;
     }
     return 0;
 }
 
+/**
+ * Queues length bytes of the buffer, starting at index start, to be written to the dump file
+ * WARNING: sb mutex must be held
+ */
+static inline void streamBufferDumpRange(StreamBuffer *sb, uint32_t start, uint32_t length, uint32_t streamOffset) {
+    uint32_t firstPart = sb->bufferSize - start;
+
+    if(length <= firstPart) {
+        dumpWriterWrite(streamsCnf->dumpWriter, sb->bufferDump, streamOffset, sb->buffer + start, length);
+    }
+    else {
+        dumpWriterWrite(streamsCnf->dumpWriter, sb->bufferDump, streamOffset, sb->buffer + start, firstPart);
+        dumpWriterWrite(streamsCnf->dumpWriter, sb->bufferDump, streamOffset + firstPart, sb->buffer, length - firstPart);
+    }
+}
+
 uint32_t streamBufferDumpToFile(StreamBuffer *sb) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("streamBufferDumpToFile");
@@ -157,8 +186,8 @@ uint32_t streamBufferDumpToFile(StreamBuffer *sb) {
 
     pthread_mutex_lock(&(sb->mutex));
 
-    if(sb->bufferDump->pFile) {
-        addDataToFile((char *)(sb->buffer), sb->bufferFill, sb->streamOffset, sb->bufferDump);
+    if(sb->bufferDump && sb->bufferFill) {
+        streamBufferDumpRange(sb, sb->bufferStart, sb->bufferFill, sb->streamOffset);
         writeAmount += sb->bufferFill;
     }
 
@@ -167,96 +196,93 @@ uint32_t streamBufferDumpToFile(StreamBuffer *sb) {
     return writeAmount;
 }
 
-int streamBufferExtend(StreamBuffer *sb, uint32_t extLength) {
-    DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("streamBufferExtend: extLength=" + std::to_string(extLength));
-
-    if(sb) {
-        pthread_mutex_lock(&(sb->mutex));
-
-        sb->buffer = (uint8_t *)realloc(sb->buffer, sb->bufferSize + extLength);
-        if(sb->buffer) {
-            sb->bufferSize += extLength;
-            updateDataObjectSize(sb->object, (int)extLength);
-            pthread_mutex_unlock(&(sb->mutex));
-            return 0;
-        }
-        else {
-            pthread_mutex_unlock(&(sb->mutex));
-
-            updateDataObjectSize(sb->object, (int)-sb->bufferSize);
-            sb->bufferSize = 0;
-
-            DARWIN_LOG_DEBUG("error while extending stream buffer");
-        }
-    }
-    else {
-        return 0;
-    }
-
-    return -1;
-}
-
-static inline void streamBufferShift(StreamBuffer *sb, int amount) {
+/**
+ * Drops the oldest bytes of the buffer, writing them to the dump file if any
+ * WARNING: sb mutex must be held
+ */
+static inline void streamBufferShift(StreamBuffer *sb, uint32_t amount) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("streamBufferShift, amount=" + std::to_string(amount));
 
-    if(sb) {
-        pthread_mutex_lock(&(sb->mutex));
-
-        if(amount > sb->bufferSize) amount = sb->bufferSize;
-        if(sb->bufferDump) addDataToFile((char *)sb->buffer, amount, sb->streamOffset, sb->bufferDump);
-        memmove(sb->buffer, sb->buffer + amount, sb->bufferFill - amount);
-        sb->bufferFill -= amount;
-        sb->streamOffset += amount;
+    if(amount > sb->bufferFill) amount = sb->bufferFill;
+    if(!amount) return;
 
-        pthread_mutex_unlock(&(sb->mutex));
-    }
-    else {
-        DARWIN_LOG_DEBUG("streamBufferShift: ERROR trying to shift StreamBuffer, but object is NULL");
-    }
+    if(sb->bufferDump) streamBufferDumpRange(sb, sb->bufferStart, amount, sb->streamOffset);
+    sb->bufferStart = (sb->bufferStart + amount) % sb->bufferSize;
+    sb->bufferFill -= amount;
+    sb->streamOffset += amount;
     return;
 }
 
 /**
  * The data given at this point SHOULD BE the next immediate data for the stream
+ * the oldest data is dropped if the buffer is full, no memory is allocated after the first call
  * @param sb
  * @param dataLength
  * @param data
- * @return
+ * @return 0 on success, 1 on error
  */
 int streamBufferAddDataSegment(StreamBuffer *sb, uint32_t dataLength, uint8_t *data) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("streamBufferAddDataSegment, dataLength: " + std::to_string(dataLength));
 
-    if(sb) {
-        pthread_mutex_lock(&(sb->mutex));
+    if(!sb) return 1;
+    if(!dataLength) return 0;
 
-        if(dataLength > streamsCnf->streamMaxBufferSize) {
-            dataLength = streamsCnf->streamMaxBufferSize;
-        }
-        // extend buffer if not big enough
-        if(sb->bufferFill + dataLength > sb->bufferSize) {
-            uint32_t addition = sb->bufferFill + dataLength - sb->bufferSize;
-            if(sb->bufferSize + addition <= streamsCnf->streamMaxBufferSize) {
-                streamBufferExtend(sb, addition);
-            }
-            else if(sb->bufferSize < streamsCnf->streamMaxBufferSize) {
-                uint32_t extension = streamsCnf->streamMaxBufferSize - sb->bufferSize;
-                streamBufferExtend(sb, extension);
-                streamBufferShift(sb, addition - extension);
-            }
-            else {
-                streamBufferShift(sb, addition);
-            }
-        }
-        memcpy(sb->buffer + sb->bufferFill, data, dataLength);
-        sb->bufferFill += dataLength;
+    pthread_mutex_lock(&(sb->mutex));
 
+    if(streamBufferReserve(sb) || !sb->bufferSize) {
         pthread_mutex_unlock(&(sb->mutex));
+        return 1;
+    }
+
+    if(dataLength > sb->bufferSize) {
+        /* only the end of the segment fits, the beginning goes straight to the dump file */
+        uint32_t skipped = dataLength - sb->bufferSize;
 
-        return 0;
+        streamBufferShift(sb, sb->bufferFill);
+        sb->bufferStart = 0;
+        if(sb->bufferDump) dumpWriterWrite(streamsCnf->dumpWriter, sb->bufferDump, sb->streamOffset, data, skipped);
+        sb->streamOffset += skipped;
+        data += skipped;
+        dataLength = sb->bufferSize;
     }
+    else if(sb->bufferFill + dataLength > sb->bufferSize) {
+        streamBufferShift(sb, sb->bufferFill + dataLength - sb->bufferSize);
+    }
+
+    uint32_t end = (sb->bufferStart + sb->bufferFill) % sb->bufferSize;
+    uint32_t firstPart = sb->bufferSize - end;
+    if(dataLength <= firstPart) {
+        memcpy(sb->buffer + end, data, dataLength);
+    }
+    else {
+        memcpy(sb->buffer + end, data, firstPart);
+        memcpy(sb->buffer, data + firstPart, dataLength - firstPart);
+    }
+    sb->bufferFill += dataLength;
+
+    pthread_mutex_unlock(&(sb->mutex));
+
+    return 0;
+}
+
+/**
+ * Gives a contiguous view of a range of the stream
+ * WARNING: sb mutex must be held while the view is used
+ * @param sb
+ * @param streamOffset the stream offset of the first byte, must still be in the buffer
+ * @param length the length of the range, must still be in the buffer
+ * @param scratch at least length bytes, used if the range wraps around the end of the buffer
+ * @return a pointer to the range, either in the buffer or in scratch
+ */
+uint8_t *streamBufferGetView(StreamBuffer *sb, uint32_t streamOffset, uint32_t length, uint8_t *scratch) {
+    uint32_t start = (sb->bufferStart + (streamOffset - sb->streamOffset)) % sb->bufferSize;
+    uint32_t firstPart = sb->bufferSize - start;
+
+    if(length <= firstPart) return sb->buffer + start;
 
-    return 1;
+    memcpy(scratch, sb->buffer + start, firstPart);
+    memcpy(scratch + firstPart, sb->buffer, length - firstPart);
+    return scratch;
 }
@@ -29,6 +29,7 @@
 
 #include "file_utils.hpp"
 #include "data_pool.hpp"
+#include "dump_writer.hpp"
 
 #ifdef __cplusplus
 extern "C" {
@@ -39,41 +40,51 @@ extern "C" {
 #include <string.h>
 
 
-#define DEFAULT_BUFF_START_SIZE     4096
-#define BUFF_ADD_BLOCK_SIZE         4096
+#define STREAM_DEFAULT_BUFFER_SIZE  4096
 
 typedef struct StreamsCnf_ {
     char *streamStoreFolder;
     uint32_t streamMaxBufferSize;
+    uint32_t streamStoreMaxOpenFiles;
+
+    /* started if streamStoreFolder is set */
+    DumpWriter *dumpWriter;
 
     DataPool *sbPool;
 } StreamsCnf;
 
 extern StreamsCnf *streamsCnf;
 
+/* Circular buffer keeping the last streamMaxBufferSize bytes of a stream direction,
+ * the buffer is allocated on first data and kept when the object is reused */
 typedef struct StreamBuffer_ {
     uint8_t *buffer;
     uint32_t bufferSize;
     uint32_t bufferFill;
+    /* index of the oldest byte in the buffer */
+    uint32_t bufferStart;
+    /* stream offset of the oldest byte */
     uint32_t streamOffset;
+    /* stream offset up to which data was already scanned */
+    uint32_t scannedOffset;
 
-    struct YaraRuleList_ *ruleList;
+    /* bitset of the rules already matched on the stream, indexed by rule id */
+    uint64_t *matchedRules;
 
-    FileStruct *bufferDump;
+    DumpFile *bufferDump;
 
     pthread_mutex_t mutex;
 
     DataObject *object;
 } StreamBuffer;
 
-void yaraDeleteRuleList(struct YaraRuleList_ *);
 void streamBufferReset(void *);
 void streamInitConfig(StreamsCnf *);
 void streamDeleteConfig(StreamsCnf *);
 int linkStreamBufferToDumpFile(StreamBuffer *, char *);
 uint32_t streamBufferDumpToFile(StreamBuffer *);
-int streamBufferExtend(StreamBuffer *, uint32_t);
 int streamBufferAddDataSegment(StreamBuffer *, uint32_t, uint8_t *);
+uint8_t *streamBufferGetView(StreamBuffer *, uint32_t, uint32_t, uint8_t *);
 
 #ifdef __cplusplus
 };
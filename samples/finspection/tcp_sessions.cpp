@@ -42,10 +42,7 @@ static inline void *tcpQueueCreate(void *object) {
     if(queue) {
         queue->object = dObject;
         dObject->pObject = (void *)queue;
-        queue->data = (uint8_t *)calloc(1, DEFAULT_QUEUE_BUFFER_SIZE);
-        if(queue->data) queue->dataBufferSize = DEFAULT_QUEUE_BUFFER_SIZE;
-        else queue->dataBufferSize = 0;
-        return (void *)(sizeof(TcpQueue) + queue->dataBufferSize);
+        return (void *)sizeof(TcpQueue);
     }
     DARWIN_LOG_ERROR("tcp_sessions:: could not create new TcpQueue");
     return (void *)0;
@@ -57,7 +54,7 @@ static inline void tcpQueueDelete(void *queueObject) {
 
     if(queueObject) {
         TcpQueue *queue = (TcpQueue *)queueObject;
-        if(queue->data) free(queue->data);
+        if(queue->buffer) free(queue->buffer);
         free(queue);
     }
     return;
@@ -73,13 +70,27 @@ static inline void tcpQueueReset(void *queueObject) {
         queue->seq = 0;
         queue->ack = 0;
         queue->dataLength = 0;
-        queue->used = 0;
-        queue->prev = NULL;
-        queue->next = NULL;
+        queue->data = NULL;
+        queue->level = 0;
+        memset(queue->forward, 0, sizeof(queue->forward));
     }
     return;
 }
 
+static inline void tcpConnectionClearQueue(TcpConnection *conn) {
+    TcpQueue *queue = conn->queueHead[0], *current;
+
+    while(queue) {
+        current = queue;
+        queue = queue->forward[0];
+        setObjectAvailable(current->object);
+    }
+
+    memset(conn->queueHead, 0, sizeof(conn->queueHead));
+    conn->queueSize = 0;
+    conn->queuedBytes = 0;
+}
+
 static inline void *tcpConnectionCreate(void *object) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("tcp_sessions::tcpConnectionCreate");
@@ -113,12 +124,7 @@ static inline void tcpConnectionDelete(void *connObject) {
     if(connObject) {
         TcpConnection *conn = (TcpConnection *)connObject;
         setObjectAvailable(conn->streamBuffer->object);
-        TcpQueue *current, *queue = conn->queueTail;
-        while(queue) {
-            current = queue;
-            queue = queue->next;
-            setObjectAvailable(current->object);
-        }
+        tcpConnectionClearQueue(conn);
 
         free(conn);
     }
@@ -138,17 +144,7 @@ static inline void tcpConnectionReset(void *connObject) {
         conn->nextSeq = 0;
         conn->lastAck = 0;
 
-        TcpQueue *queue = conn->queueTail, *current;
-
-        while(queue) {
-            current = queue;
-            queue = queue->next;
-            setObjectAvailable(current->object);
-        }
-        conn->queueSize = 0;
-
-        conn->queueHead = NULL;
-        conn->queueTail = NULL;
+        tcpConnectionClearQueue(conn);
     }
     return;
 }
@@ -169,16 +165,8 @@ static inline void *tcpSessionCreate(void *object) {
         if(!srcConnObject || !dstConnObject) {
             DARWIN_LOG_WARNING("could not get new TcpConnection objects, aborting");
             free(tcpSession);
-            if(srcConnObject) {
-                pthread_mutex_lock(&(srcConnObject->mutex));
-                srcConnObject->state = DataObject::AVAILABLE;
-                pthread_mutex_unlock(&(srcConnObject->mutex));
-            }
-            if(dstConnObject) {
-                pthread_mutex_lock(&(dstConnObject->mutex));
-                dstConnObject->state = DataObject::AVAILABLE;
-                pthread_mutex_unlock(&(dstConnObject->mutex));
-            }
+            if(srcConnObject) setObjectAvailable(srcConnObject);
+            if(dstConnObject) setObjectAvailable(dstConnObject);
             return (void *)0;
         }
 
@@ -248,42 +236,46 @@ static inline void swapTcpConnections(TcpSession *tcpSession) {
     return;
 }
 
-static inline TcpQueue *packetEnqueue(Packet *pkt) {
-    DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("tcp_sessions::packetEnqueue");
+/* describes the TCP segment of the packet, its data still belongs to the packet */
+static inline void tcpSegmentFromPacket(TcpQueue *segment, Packet *pkt) {
+    strncpy(segment->tcp_flags, pkt->tcph->flags, 10);
+    segment->seq = pkt->tcph->seq;
+    segment->ack = pkt->tcph->ack;
+    segment->dataLength = pkt->tcph->TCPDataLength;
+    /* payload may have been truncated by the capture */
+    if(segment->dataLength > pkt->payloadLen) segment->dataLength = pkt->payloadLen;
+    segment->data = pkt->payload;
+    segment->buffer = NULL;
+    segment->bufferSize = 0;
+    segment->level = 0;
+    segment->object = NULL;
+}
 
-    DataObject *queueObject = getOrCreateAvailableObject(queuePool);
-    TcpQueue *queue;
-    if(queueObject) queue = (TcpQueue *)queueObject->pObject;
-    else {
-        DARWIN_LOG_WARNING("tcp_sessions::could not get new TcpQueue object, aborting");
-        return NULL;
-    }
+/* drops the beginning of the segment, up to seq */
+static inline void tcpSegmentTrimFront(TcpQueue *segment, uint32_t seq) {
+    uint32_t trim = seq - segment->seq;
 
-    DARWIN_LOG_DEBUG(std::string(pkt->tcph->flags));
-    strncpy(queue->tcp_flags, pkt->tcph->flags, 10);
-    queue->seq = pkt->tcph->seq;
-    queue->ack = pkt->tcph->ack;
-    queue->dataLength = pkt->tcph->TCPDataLength;
-    if(queue->dataLength) {
-        if(queue->dataLength > queue->dataBufferSize) {
-            DARWIN_LOG_DEBUG("tcp_sessions:: packetEnqueue:: resizing buffer");
-            uint8_t *newBuffer = (uint8_t *)realloc(queue->data, queue->dataLength);
-            if(newBuffer) {
-                queue->data = newBuffer;
-                updateDataObjectSize(queue->object, (int)(queue->dataLength - queue->dataBufferSize));
-                queue->dataBufferSize = queue->dataLength;
-            }
-            else {
-                DARWIN_LOG_ERROR("tcp_sessions::could not realloc buffer of TcpQueue, using old buffer");
-                queue->dataLength = queue->dataBufferSize;
-            }
-        }
-        DARWIN_LOG_DEBUG("tcp_sessions:: packetEnqueue:: copying data to buffer, number of bytes: " + std::to_string(queue->dataLength));
-        memcpy(queue->data, pkt->payload, queue->dataLength);
-    }
+    if(trim > segment->dataLength) trim = segment->dataLength;
+    segment->seq += trim;
+    segment->data += trim;
+    segment->dataLength -= trim;
+}
+
+/* the next sequence number is unknown until the connection is seen sending */
+static inline int tcpConnectionExpectsSeq(TcpConnection *connection) {
+    return connection->state > TCP_SESS_LISTEN && connection->nextSeq;
+}
+
+/**
+ * Removes the data of the segment the connection already received
+ * @return 1 if the whole segment was already received, 0 otherwise
+ */
+static inline int tcpSegmentTrimToNextSeq(TcpConnection *connection, TcpQueue *segment) {
+    if(!tcpConnectionExpectsSeq(connection) || SEQ_GEQ(segment->seq, connection->nextSeq)) return 0;
+    if(SEQ_LEQ(segment->seq + segment->dataLength, connection->nextSeq)) return 1;
 
-    return queue;
+    tcpSegmentTrimFront(segment, connection->nextSeq);
+    return 0;
 }
 
 int tcpSessionInitFromPacket(TcpSession *tcpSession, Packet *pkt) {
@@ -358,8 +350,6 @@ int tcpConnectionsUpdateFromQueueElem(TcpConnection *srcCon, TcpConnection *dstC
     DARWIN_LOG_DEBUG("tcp_sessions::tcpConnectionsUpdateFromQueueElem");
 
     if(queue && srcCon && dstCon) {
-        queue->used = 1;
-
         char flags[10];
         uint32_t tcpDataLength = queue->dataLength;
 
@@ -441,69 +431,159 @@ int tcpConnectionsUpdateFromQueueElem(TcpConnection *srcCon, TcpConnection *dstC
     return -1;
 }
 
-static inline void tcpConnectionInsertToQueue(TcpConnection *connection, TcpQueue *newElem) {
+/* ######################## */
+/* --- out-of-order queue --- */
+/* ######################## */
+
+static inline uint8_t tcpQueueRandomLevel() {
+    static thread_local uint32_t seed = 0;
+    uint8_t level = 1;
+    uint32_t r;
+
+    if(!seed) seed = (uint32_t)getRandom() | 1;
+    /* xorshift32 */
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    /* each level holds a quarter of the segments of the level below */
+    for(r = seed; level < TCP_QUEUE_MAX_LEVEL && (r & 3) == 0; r >>= 2) level++;
+    return level;
+}
+
+/*
+ * Fills update with the last segment placed before seq at each level (NULL for the head),
+ * segments without data go before the ones starting at the same sequence number
+ */
+static inline void tcpQueueFindPosition(TcpConnection *connection, uint32_t seq, uint32_t dataLength, TcpQueue **update) {
+    TcpQueue *current = NULL, *next;
+    int i;
+
+    for(i = TCP_QUEUE_MAX_LEVEL - 1; i >= 0; i--) {
+        while((next = (current ? current->forward[i] : connection->queueHead[i])) &&
+              (SEQ_LT(next->seq, seq) || (next->seq == seq && dataLength))) {
+            current = next;
+        }
+        update[i] = current;
+    }
+}
+
+/**
+ * Queues the segment until the data before it is received, the data overlapping
+ * the previous segment is trimmed and the rest is copied, as the packet only lives for the task
+ * @return 0 if the segment was queued, 1 if it was already queued, -1 on error
+ */
+static inline int tcpConnectionInsertToQueue(TcpConnection *connection, TcpQueue *segment) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("tcp_sessions::tcpConnectionInsertToQueue");
+    TcpQueue *update[TCP_QUEUE_MAX_LEVEL];
+    TcpQueue *prev;
+    uint8_t i;
+
+    tcpQueueFindPosition(connection, segment->seq, segment->dataLength, update);
+    prev = update[0];
+    if(prev && segment->dataLength && SEQ_GT(prev->seq + prev->dataLength, segment->seq)) {
+        uint32_t prevEnd = prev->seq + prev->dataLength;
+        if(SEQ_GEQ(prevEnd, segment->seq + segment->dataLength) &&
+           !HAS_TCP_FLAG(segment->tcp_flags, 'F') && !HAS_TCP_FLAG(segment->tcp_flags, 'R')) {
+            DARWIN_LOG_DEBUG("tcp_sessions::tcpConnectionInsertToQueue:: segment already queued");
+            return 1;
+        }
+        tcpSegmentTrimFront(segment, prevEnd);
+        tcpQueueFindPosition(connection, segment->seq, segment->dataLength, update);
+    }
 
-    if(connection && newElem) {
-        TcpQueue *scan;
-        for(scan = connection->queueHead; scan != NULL && newElem->seq < scan->seq; scan = scan->prev) {}
-        if(scan) {
-            newElem->next = scan->next;
-            newElem->prev = scan;
-            if(scan->next) scan->next->prev = newElem;
-            else connection->queueHead = newElem;
-            scan->next = newElem;
+    DataObject *queueObject = getOrCreateAvailableObject(queuePool);
+    if(!queueObject) {
+        DARWIN_LOG_WARNING("tcp_sessions::could not get new TcpQueue object, aborting");
+        return -1;
+    }
+    TcpQueue *queue = (TcpQueue *)queueObject->pObject;
+
+    if(segment->dataLength > queue->bufferSize) {
+        /* queued data is bounded by the memory usage, as the rest of the pools */
+        if(__atomic_load_n(&poolStorage->totalDataSize, __ATOMIC_RELAXED) + (segment->dataLength - queue->bufferSize)
+           > poolStorage->maxDataSize) {
+            DARWIN_LOG_WARNING("tcp_sessions::max memory usage reached, dropping out-of-order segment");
+            setObjectAvailable(queueObject);
+            return -1;
         }
-        else {
-            if(connection->queueTail) {
-                connection->queueTail->prev = newElem;
-                newElem->next = connection->queueTail;
-            }
-            connection->queueTail = newElem;
+        uint8_t *newBuffer = (uint8_t *)realloc(queue->buffer, segment->dataLength);
+        if(!newBuffer) {
+            DARWIN_LOG_ERROR("tcp_sessions::could not claim memory for out-of-order segment");
+            setObjectAvailable(queueObject);
+            return -1;
         }
-        if(!connection->queueHead) connection->queueHead = newElem;
-        connection->queueSize++;
-        DARWIN_LOG_DEBUG("tcp_sessions::tcpConnectionInsertToQueue:: new queue size is " + std::to_string(connection->queueSize));
+        updateDataObjectSize(queueObject, (int)(segment->dataLength - queue->bufferSize));
+        queue->buffer = newBuffer;
+        queue->bufferSize = segment->dataLength;
+    }
 
+    memcpy(queue->tcp_flags, segment->tcp_flags, 10);
+    queue->seq = segment->seq;
+    queue->ack = segment->ack;
+    queue->dataLength = segment->dataLength;
+    if(segment->dataLength) {
+        memcpy(queue->buffer, segment->data, segment->dataLength);
+        queue->data = queue->buffer;
     }
-    else {
-        DARWIN_LOG_ERROR("tcp_sessions::connection or newElem are NULL");
+
+    queue->level = tcpQueueRandomLevel();
+    for(i = 0; i < queue->level; i++) {
+        TcpQueue **forward = update[i] ? update[i]->forward : connection->queueHead;
+        queue->forward[i] = forward[i];
+        forward[i] = queue;
     }
 
-    return;
+    connection->queueSize++;
+    connection->queuedBytes += queue->dataLength;
+    DARWIN_LOG_DEBUG("tcp_sessions::tcpConnectionInsertToQueue:: new queue size is " + std::to_string(connection->queueSize));
+    return 0;
 }
 
-static inline TcpQueue *tcpConnectionGetNextInQueue(TcpConnection *connection) {
-    DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("tcp_sessions::tcpConnectionGetNextInQueue");
-
-    if(connection->state <= TCP_SESS_LISTEN) return connection->queueTail;
+/* the first segment is always at the head of all its levels */
+static inline TcpQueue *tcpQueuePopFirst(TcpConnection *connection) {
+    TcpQueue *first = connection->queueHead[0];
+    uint8_t i;
 
-    TcpQueue *scan = connection->queueHead;
-    while(scan != NULL) {
-        if(connection->nextSeq == scan->seq && !scan->used) return scan;
-        if(scan->seq < connection->nextSeq) return NULL;
-        scan = scan->prev;
+    if(first) {
+        for(i = 0; i < first->level; i++) {
+            connection->queueHead[i] = first->forward[i];
+        }
+        connection->queueSize--;
+        connection->queuedBytes -= first->dataLength;
     }
 
-    return NULL;
+    return first;
 }
 
-static inline int tcpQueueRemoveFromConnection(TcpConnection *connection, TcpQueue *queue) {
+/**
+ * Processes the queued segments that are no longer waiting for missing data
+ * @return 1 if the session is closed, 0 otherwise
+ */
+static inline int tcpConnectionProcessQueue(TcpConnection *srcCon, TcpConnection *dstCon) {
     DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("tcp_sessions::tcpQueueRemoveFromConnection");
+    DARWIN_LOG_DEBUG("tcp_sessions::tcpConnectionProcessQueue");
+    TcpQueue *queue;
+    int ret = 0;
 
-    if(queue) {
-        if(queue->prev) queue->prev->next = queue->next;
-        if(queue->next) queue->next->prev = queue->prev;
+    while(!ret && (queue = srcCon->queueHead[0])) {
+        if(tcpConnectionExpectsSeq(srcCon) && SEQ_GT(queue->seq, srcCon->nextSeq)) {
+            if(srcCon->queuedBytes <= globalFlowCnf->maxQueuedBytes) break;
 
-        if(connection->queueHead == queue) connection->queueHead = queue->prev;
-        if(connection->queueTail == queue) connection->queueTail = queue->next;
-        connection->queueSize--;
-        return 0;
+            /* too much data is waiting for missing segments, consider them lost */
+            DARWIN_LOG_DEBUG("tcp_sessions::tcpConnectionProcessQueue:: queue is full, skipping missing data");
+            srcCon->nextSeq = queue->seq;
+        }
+
+        tcpQueuePopFirst(srcCon);
+        if(!tcpSegmentTrimToNextSeq(srcCon, queue)) {
+            ret = tcpConnectionsUpdateFromQueueElem(srcCon, dstCon, queue);
+        }
+        setObjectAvailable(queue->object);
     }
-    return 1;
+
+    return ret;
 }
 
 TcpConnection *getTcpSrcConnectionFromPacket(TcpSession *session, Packet *pkt) {
@@ -522,6 +602,14 @@ TcpConnection *getTcpDstConnectionFromPacket(TcpSession *session, Packet *pkt) {
     return NULL;
 }
 
+/* closed sessions don't need to wait for the idle timeout to be freed */
+static inline void tcpSessionCheckClosed(TcpSession *session) {
+    if(session->cCon->state > TCP_SESS_ESTABLISHED &&
+       session->sCon->state > TCP_SESS_ESTABLISHED) {
+        flowScheduleExpiry(session->flow, __atomic_load_n(&session->flow->lastPacketTime, __ATOMIC_RELAXED) + globalFlowCnf->closedTimeout);
+    }
+}
+
 int handleTcpFromPacket(Packet *pkt) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("tcp_sessions::handleTcpFromPacket");
@@ -530,6 +618,9 @@ int handleTcpFromPacket(Packet *pkt) {
 
     if(pkt) {
         if(pkt->proto == IPPROTO_TCP) {
+            /* flow was expired while the packet was processed */
+            if(pkt->flow->expired) return -1;
+
             TcpSession *session = (TcpSession *)pkt->flow->protoCtx;
 
             if(!session) {
@@ -541,39 +632,36 @@ int handleTcpFromPacket(Packet *pkt) {
                 session = (TcpSession *)sessionObject->pObject;
 
                 tcpSessionInitFromPacket(session, pkt);
-                TcpQueue *tcpQueue = packetEnqueue(pkt);
-                if(!tcpQueue) {
-                    DARWIN_LOG_WARNING("tcp_sessions::couldn't enqueue packet, dropping session handling");
-                    return -1;
-                }
-                tcpConnectionInsertToQueue(session->cCon, tcpQueue);
-                tcpQueue->used = 1;
                 pkt->flow->protoCtx = (void *)session;
             }
             else
             {
                 TcpConnection *srcCon, *dstCon;
-                TcpQueue *tcpQueue = packetEnqueue(pkt);
-                if(!tcpQueue) {
-                    DARWIN_LOG_WARNING("tcp_sessions::couldn't enqueue packet, dropping session handling");
-                    return -1;
-                }
+                TcpQueue segment;
+
                 srcCon = getTcpSrcConnectionFromPacket(session, pkt);
                 dstCon = getTcpDstConnectionFromPacket(session, pkt);
+                if(!srcCon || !dstCon) {
+                    DARWIN_LOG_WARNING("tcp_sessions::packet doesn't belong to the session, dropping session handling");
+                    return -1;
+                }
 
-                tcpConnectionInsertToQueue(srcCon, tcpQueue);
-                tcpQueue = tcpConnectionGetNextInQueue(srcCon);
-                if(tcpQueue) {
-                    do {
-                        ret = tcpConnectionsUpdateFromQueueElem(srcCon, dstCon, tcpQueue);
-                        tcpQueueRemoveFromConnection(srcCon, tcpQueue);
-
-                        setObjectAvailable(tcpQueue->object);
-
-                        if(ret) return 1;
+                tcpSegmentFromPacket(&segment, pkt);
+                if(!tcpSegmentTrimToNextSeq(srcCon, &segment)) {
+                    if(!tcpConnectionExpectsSeq(srcCon) || segment.seq == srcCon->nextSeq) {
+                        /* in order, no need to keep it */
+                        ret = tcpConnectionsUpdateFromQueueElem(srcCon, dstCon, &segment);
+                    }
+                    else if(tcpConnectionInsertToQueue(srcCon, &segment) < 0) {
+                        DARWIN_LOG_WARNING("tcp_sessions::couldn't enqueue packet, dropping session handling");
+                        return -1;
+                    }
 
-                        tcpQueue = tcpConnectionGetNextInQueue(srcCon);
-                    }while(tcpQueue);
+                    if(!ret) ret = tcpConnectionProcessQueue(srcCon, dstCon);
+                    if(ret) {
+                        tcpSessionCheckClosed(session);
+                        return 1;
+                    }
                 }
 
                 if(streamsCnf->streamStoreFolder &&
@@ -600,6 +688,8 @@ int handleTcpFromPacket(Packet *pkt) {
                         DARWIN_LOG_WARNING("tcp_sessions::could not link file to stream");
                     }
                 }
+
+                tcpSessionCheckClosed(session);
             }
 
             return 0;
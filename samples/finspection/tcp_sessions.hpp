@@ -54,17 +54,28 @@ extern DataPool *queuePool;
 extern DataPool *connPool;
 extern DataPool *sessPool;
 
+/* sequence numbers comparisons, valid across wrap-arounds */
+#define SEQ_LT(a, b)    ((int32_t)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b)   ((int32_t)((a) - (b)) <= 0)
+#define SEQ_GT(a, b)    ((int32_t)((a) - (b)) > 0)
+#define SEQ_GEQ(a, b)   ((int32_t)((a) - (b)) >= 0)
+
+#define TCP_QUEUE_MAX_LEVEL 8 /* levels of the skip list, enough for 4^8 queued segments */
+
+/* TCP segment waiting for the missing data before it */
 typedef struct TcpQueue_ {
     char tcp_flags[10];
     uint32_t seq;
     uint32_t ack;
     uint32_t dataLength;
-#define DEFAULT_QUEUE_BUFFER_SIZE   1500
+    /* slice of the payload of the packet, or of buffer once the segment is queued */
     uint8_t *data;
-    uint32_t dataBufferSize;
-    uint8_t used;
-    struct TcpQueue_ *prev;
-    struct TcpQueue_ *next;
+    /* copy of the data of a queued segment, accounted in the memory usage and kept when the object is reused */
+    uint8_t *buffer;
+    uint32_t bufferSize;
+
+    uint8_t level;
+    struct TcpQueue_ *forward[TCP_QUEUE_MAX_LEVEL];
 
     DataObject *object;
 } TcpQueue;
@@ -91,9 +102,10 @@ typedef struct TcpConnection_ {
     uint32_t nextSeq;
     uint32_t lastAck;
     StreamBuffer *streamBuffer;
-    TcpQueue *queueHead;
-    TcpQueue *queueTail;
+    /* out-of-order segments, in a skip list sorted by sequence number */
+    TcpQueue *queueHead[TCP_QUEUE_MAX_LEVEL];
     uint32_t queueSize;
+    uint32_t queuedBytes;
 
     DataObject *object;
 } TcpConnection;
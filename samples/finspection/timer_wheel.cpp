@@ -0,0 +1,242 @@
+/* timer_wheel.c
+ *
+ * This file contains functions used for the hierarchical timing wheel.
+ *
+ * File begun on 2026-10-18
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include "timer_wheel.hpp"
+#include "Logger.hpp"
+
+static inline void timerListInit(WheelTimer *head) {
+    head->prev = head;
+    head->next = head;
+}
+
+static inline int timerListEmpty(WheelTimer *head) {
+    return head->next == head;
+}
+
+static inline void timerListAppend(WheelTimer *head, WheelTimer *timer) {
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static inline void timerListUnlink(WheelTimer *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+}
+
+/* moves all timers of src at the end of dst */
+static inline void timerListSplice(WheelTimer *dst, WheelTimer *src) {
+    if(timerListEmpty(src)) return;
+
+    src->next->prev = dst->prev;
+    dst->prev->next = src->next;
+    src->prev->next = dst;
+    dst->prev = src->prev;
+    timerListInit(src);
+}
+
+/**
+ * Places the timer in the slot matching its expiration
+ * WARNING: wheel mutex must be held
+ */
+static inline void timerWheelPlace(TimerWheel *wheel, WheelTimer *timer) {
+    time_t expire = timer->expire, delta;
+    int level;
+
+    /* late timers are fired on next advance */
+    if(expire < wheel->now) expire = wheel->now;
+    delta = expire - wheel->now;
+    /* too far away, will be placed again when its slot is cascaded */
+    if(delta >= WHEEL_MAX_DELTA) {
+        expire = wheel->now + WHEEL_MAX_DELTA - 1;
+        delta = WHEEL_MAX_DELTA - 1;
+    }
+
+    for(level = 0; level < WHEEL_LEVELS - 1; level++) {
+        if(delta < ((time_t)1 << (WHEEL_SLOT_BITS * (level + 1)))) break;
+    }
+
+    timerListAppend(&wheel->slots[level][(expire >> (WHEEL_SLOT_BITS * level)) & WHEEL_SLOT_MASK], timer);
+}
+
+/**
+ * Places again the timers of a higher level slot, once its time range is reached
+ * WARNING: wheel mutex must be held
+ */
+static inline void timerWheelCascade(TimerWheel *wheel, int level) {
+    WheelTimer pending;
+    WheelTimer *slot = &wheel->slots[level][(wheel->now >> (WHEEL_SLOT_BITS * level)) & WHEEL_SLOT_MASK];
+
+    /* detach the list first, timers may be placed back in the same slot */
+    timerListInit(&pending);
+    timerListSplice(&pending, slot);
+
+    while(!timerListEmpty(&pending)) {
+        WheelTimer *timer = pending.next;
+        timerListUnlink(timer);
+        timerWheelPlace(wheel, timer);
+    }
+}
+
+TimerWheel *createTimerWheel(time_t now) {
+    DARWIN_LOGGER;
+    DARWIN_LOG_DEBUG("createTimerWheel");
+    int level, slot;
+
+    TimerWheel *wheel = (TimerWheel *)calloc(1, sizeof(TimerWheel));
+    if(!wheel) {
+        DARWIN_LOG_ERROR("could not claim memory for new timer wheel");
+        return NULL;
+    }
+
+    for(level = 0; level < WHEEL_LEVELS; level++) {
+        for(slot = 0; slot < WHEEL_SLOTS; slot++) {
+            timerListInit(&wheel->slots[level][slot]);
+        }
+    }
+    wheel->now = now;
+    wheel->count = 0;
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&wheel->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    return wheel;
+}
+
+/**
+ * WARNING: timers are owned by their objects, they are not freed
+ */
+void deleteTimerWheel(TimerWheel *wheel) {
+    if(wheel) {
+        pthread_mutex_destroy(&wheel->mutex);
+        free(wheel);
+    }
+    return;
+}
+
+/**
+ * Schedules (or reschedules) the timer to fire at expire
+ * @param wheel
+ * @param timer
+ * @param expire
+ */
+void timerWheelSchedule(TimerWheel *wheel, WheelTimer *timer, time_t expire) {
+    pthread_mutex_lock(&wheel->mutex);
+    if(timer->scheduled) {
+        timerListUnlink(timer);
+    }
+    else {
+        timer->scheduled = 1;
+        wheel->count++;
+    }
+    timer->expire = expire;
+    timerWheelPlace(wheel, timer);
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+/**
+ * Schedules the timer to fire at expire, unless it is already scheduled before
+ * @param wheel
+ * @param timer
+ * @param expire
+ */
+void timerWheelScheduleEarlier(TimerWheel *wheel, WheelTimer *timer, time_t expire) {
+    pthread_mutex_lock(&wheel->mutex);
+    if(!timer->scheduled || expire < timer->expire) {
+        timerWheelSchedule(wheel, timer, expire);
+    }
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+void timerWheelCancel(TimerWheel *wheel, WheelTimer *timer) {
+    pthread_mutex_lock(&wheel->mutex);
+    if(timer->scheduled) {
+        timerListUnlink(timer);
+        timer->scheduled = 0;
+        wheel->count--;
+    }
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+/**
+ * Fires every timer expiring until target (included)
+ * the cost only depends on the number of seconds elapsed and of timers fired,
+ * not on the number of timers scheduled
+ * @param wheel
+ * @param target the current time
+ * @param expireCallback called for each expired timer, without the wheel lock
+ * @param arg given to the callback
+ * @return the number of timers fired
+ */
+uint32_t timerWheelAdvance(TimerWheel *wheel, time_t target, timer_expire_fn_t expireCallback, void *arg) {
+    WheelTimer expired;
+    uint32_t fired = 0;
+    int level;
+
+    timerListInit(&expired);
+
+    pthread_mutex_lock(&wheel->mutex);
+    while(wheel->now <= target) {
+        if(!wheel->count) {
+            /* nothing to cascade or fire */
+            wheel->now = target + 1;
+            break;
+        }
+
+        /* higher levels first, so that their timers get a chance to be placed in lower slots */
+        for(level = WHEEL_LEVELS - 1; level > 0; level--) {
+            if((wheel->now & (((time_t)1 << (WHEEL_SLOT_BITS * level)) - 1)) == 0) {
+                timerWheelCascade(wheel, level);
+            }
+        }
+
+        timerListSplice(&expired, &wheel->slots[0][wheel->now & WHEEL_SLOT_MASK]);
+        wheel->now++;
+    }
+
+    /* expired timers stay linked (and scheduled) in the local list until fired,
+     * so that they can still be rescheduled or cancelled concurrently */
+    while(!timerListEmpty(&expired)) {
+        WheelTimer *timer = expired.next;
+        timerListUnlink(timer);
+        timer->scheduled = 0;
+        wheel->count--;
+        pthread_mutex_unlock(&wheel->mutex);
+
+        expireCallback(timer, target, arg);
+        fired++;
+
+        pthread_mutex_lock(&wheel->mutex);
+    }
+    pthread_mutex_unlock(&wheel->mutex);
+
+    return fired;
+}
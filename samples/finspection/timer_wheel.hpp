@@ -0,0 +1,77 @@
+/* timer_wheel.h
+ *
+ * This file contains structures and prototypes of functions used
+ * for the hierarchical timing wheel, used to expire objects in O(1).
+ *
+ * File begun on 2026-10-18
+ *
+ * This file is part of rsyslog.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+/* 3 levels of 64 slots with a 1 second resolution: timers up to ~72 hours are
+ * placed directly, further ones are cascaded again until they are close enough */
+#define WHEEL_SLOT_BITS     6
+#define WHEEL_SLOTS         (1 << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK     (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS        3
+#define WHEEL_MAX_DELTA     ((time_t)1 << (WHEEL_SLOT_BITS * WHEEL_LEVELS))
+
+/* Timer to embed in the object to expire */
+typedef struct WheelTimer_ {
+    time_t expire;
+    uint8_t scheduled;
+
+    struct WheelTimer_ *prev;
+    struct WheelTimer_ *next;
+} WheelTimer;
+
+typedef struct TimerWheel_ {
+    time_t now; /* next second to process, every timer expiring before was fired */
+    uint32_t count;
+
+    /* list heads, timers are linked circularly */
+    WheelTimer slots[WHEEL_LEVELS][WHEEL_SLOTS];
+
+    pthread_mutex_t mutex;
+} TimerWheel;
+
+/* Called without the wheel lock held, the callback may schedule or cancel the timer again */
+typedef void (*timer_expire_fn_t)(WheelTimer *, time_t, void *);
+
+TimerWheel *createTimerWheel(time_t);
+void deleteTimerWheel(TimerWheel *);
+void timerWheelSchedule(TimerWheel *, WheelTimer *, time_t);
+void timerWheelScheduleEarlier(TimerWheel *, WheelTimer *, time_t);
+void timerWheelCancel(TimerWheel *, WheelTimer *);
+uint32_t timerWheelAdvance(TimerWheel *, time_t, timer_expire_fn_t, void *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* TIMER_WHEEL_H */
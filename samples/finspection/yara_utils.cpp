@@ -62,20 +62,38 @@ void yaraAddRuleToList(YaraRuleList *list, YR_RULE *rule) {
     return;
 }
 
-int yaraIsRuleInList(YaraRuleList *list, YR_RULE *rule) {
+/* returns the index of the rule in the compiled rules, or -1 if it doesn't belong to them */
+static inline int64_t yaraGetRuleId(YR_RULE *rule) {
+    if(!globalYaraCnf->firstRule || rule < globalYaraCnf->firstRule) return -1;
+
+    int64_t id = rule - globalYaraCnf->firstRule;
+    return (id < globalYaraCnf->ruleCount) ? id : -1;
+}
+
+/**
+ * Marks the rule as matched in the bitset, allocating it if necessary
+ * @return 1 if the rule was already marked, 0 otherwise
+ */
+static inline int yaraTestAndSetRule(uint64_t **matchedRules, YR_RULE *rule) {
     DARWIN_LOGGER;
-    if(list && rule) {
-        uint32_t i;
-        for(i = 0; i < list->fill; i++) {
-            if(strcmp(list->list[i]->identifier, rule->identifier) == 0) {
-                return 1;
-            }
-        }
+    int64_t id = yaraGetRuleId(rule);
+
+    if(id < 0) {
+        DARWIN_LOG_WARNING("matching rule doesn't belong to compiled rules");
         return 0;
     }
-    else {
-        DARWIN_LOG_WARNING("could not search rule in list, list or rule is NULL");
+
+    if(!*matchedRules) {
+        *matchedRules = (uint64_t *)calloc((globalYaraCnf->ruleCount + 63) / 64, sizeof(uint64_t));
+        if(!*matchedRules) {
+            DARWIN_LOG_ERROR("could not allocate matched rules bitset");
+            return 0;
+        }
     }
+
+    uint64_t mask = (uint64_t)1 << (id % 64);
+    if((*matchedRules)[id / 64] & mask) return 1;
+    (*matchedRules)[id / 64] |= mask;
     return 0;
 }
 
@@ -99,6 +117,7 @@ int yaraInitConfig(YaraCnf *conf) {
 
     conf->scanMaxSize = SCAN_SIZE_DEFAULT;
     conf->scanType = SCAN_TYPE_DEFAULT;
+    conf->streamOverlap = SCAN_OVERLAP_WINDOW;
 
     conf->status |= YARA_CNF_INIT;
     conf->ruleFilename = NULL;
@@ -156,6 +175,32 @@ int yaraCompileRules() {
             DARWIN_LOG_ERROR("could not compile rules->insufficient memory");
             return -1;
         }
+
+        YR_RULE *rule;
+        YR_STRING *string;
+        uint32_t longestString = 0;
+        globalYaraCnf->firstRule = NULL;
+        globalYaraCnf->ruleCount = 0;
+        yr_rules_foreach(globalYaraCnf->rules, rule) {
+            if(!globalYaraCnf->firstRule) globalYaraCnf->firstRule = rule;
+            globalYaraCnf->ruleCount++;
+
+            yr_rule_strings_foreach(rule, string) {
+                if(string->length > 0 && (uint32_t)string->length > longestString) longestString = string->length;
+            }
+        }
+        /* a match can't span more than the longest string, as long as rules have a single fixed length string */
+        if(globalYaraCnf->streamOverlap == SCAN_OVERLAP_AUTO) {
+            globalYaraCnf->streamOverlap = longestString ? longestString - 1 : 0;
+        }
+        if(globalYaraCnf->streamOverlap == SCAN_OVERLAP_WINDOW) {
+            DARWIN_LOG_INFO("compiled " + std::to_string(globalYaraCnf->ruleCount) + " rules, streams are scanned on their last "
+                            + std::to_string(globalYaraCnf->scanMaxSize) + " bytes");
+        }
+        else {
+            DARWIN_LOG_INFO("compiled " + std::to_string(globalYaraCnf->ruleCount) + " rules, stream overlap is "
+                            + std::to_string(globalYaraCnf->streamOverlap) + " bytes");
+        }
         globalYaraCnf->status |= YARA_CNF_RULES_COMPILED;
         return 0;
     }
@@ -216,73 +261,134 @@ static inline int yaraScanStreamElem(YaraStreamElem *elem, int fastMode, int tim
     }
 }
 
-YaraResults yaraScan(uint8_t *buffer, uint32_t buffLen, StreamBuffer *sb) {
+/* adds the rules matched during the scan to the results */
+static inline void yaraCollectResults(YaraStreamElem *elem, YaraResults &results) {
     DARWIN_LOGGER;
-    YaraStreamElem *elem = (YaraStreamElem *)calloc(1, sizeof(YaraStreamElem));
-    elem->ruleList = yaraCreateRuleList();
+    const char *yaraRuleTag;
+    uint32_t i;
+
+    if(!elem->ruleList->fill) return;
+    DARWIN_LOG_INFO("number of elements found in scan: " + std::to_string(elem->ruleList->fill));
+
+    for(i = 0; i < elem->ruleList->fill; i++) {
+        YR_RULE *rule = elem->ruleList->list[i];
+
+        results.rules.insert(rule->identifier);
+        yr_rule_tags_foreach(rule, yaraRuleTag)
+        {
+            results.tags.insert(yaraRuleTag);
+        }
+    }
+    elem->ruleList->fill = 0;
+}
 
+/**
+ * Scans a packet payload, or the data added to a stream since its last scan
+ * For streams, the new data is scanned along with the data already scanned in the last scanMaxSize bytes,
+ * or only the last streamOverlap bytes if set, and each rule is only reported the first time it matches on the stream
+ * @param buffer the payload to scan, if sb is NULL
+ * @param buffLen the length of the payload
+ * @param sb the stream to scan, or NULL to scan the payload
+ * @return the rules (and their tags) newly matched
+ */
+YaraResults yaraScan(uint8_t *buffer, uint32_t buffLen, StreamBuffer *sb) {
+    DARWIN_LOGGER;
+    /* the rule list is only used during the scan, each thread keeps its own */
+    static thread_local YaraRuleList *scanRuleList = NULL;
+    static thread_local uint8_t *scratch = NULL;
+    static thread_local uint32_t scratchSize = 0;
+    YaraStreamElem scanElem;
+    YaraStreamElem *elem = &scanElem;
     YaraResults results;
 
+    if(!scanRuleList) scanRuleList = yaraCreateRuleList();
+    if(!scanRuleList) {
+        DARWIN_LOG_ERROR("could not create rule list to scan");
+        return results;
+    }
+    memset(elem, 0, sizeof(YaraStreamElem));
+    scanRuleList->fill = 0;
+    elem->ruleList = scanRuleList;
+
     if(!sb) {
         DARWIN_LOG_DEBUG("initializing packet scan");
         if(buffer && buffLen) {
             elem->buffer = buffer;
             elem->length = (buffLen > globalYaraCnf->scanMaxSize) ? globalYaraCnf->scanMaxSize : buffLen;
             elem->status |= YSE_READY;
+
+            if(yaraScanStreamElem(elem, 0, 1)) {
+                DARWIN_LOG_ERROR("error while trying to launch scan");
+            }
+            else {
+                yaraCollectResults(elem, results);
+            }
         }
         else {
             DARWIN_LOG_ERROR("trying to launch packet scan without providing buffer and length");
         }
+        return results;
     }
-    else {
-        DARWIN_LOG_DEBUG("initializing stream scan");
-        pthread_mutex_lock(&(sb->mutex));
-        if(globalYaraCnf->scanMaxSize >= sb->bufferFill) {
-            elem->buffer = sb->buffer;
-            elem->length = sb->bufferFill;
+
+    DARWIN_LOG_DEBUG("initializing stream scan");
+    pthread_mutex_lock(&(sb->mutex));
+
+    uint32_t streamEnd = sb->streamOffset + sb->bufferFill;
+    uint32_t scanMaxSize = globalYaraCnf->scanMaxSize;
+    /* windows must move forward by at least half their size */
+    uint32_t overlap = globalYaraCnf->streamOverlap;
+    if(overlap > scanMaxSize / 2) overlap = scanMaxSize / 2;
+
+    if(sb->scannedOffset != streamEnd && scanMaxSize) {
+        uint32_t start = sb->scannedOffset, rewind, newData;
+
+        /* data shifted out of the buffer before being scanned is lost */
+        if((int32_t)(start - sb->streamOffset) < 0) start = sb->streamOffset;
+        rewind = start - sb->streamOffset;
+        newData = streamEnd - start;
+        if(globalYaraCnf->streamOverlap == SCAN_OVERLAP_WINDOW) {
+            /* the first window is a full one, as the last scanMaxSize bytes were scanned before */
+            uint32_t window = (newData < scanMaxSize) ? scanMaxSize - newData : 0;
+            start -= (rewind > window) ? window : rewind;
         }
         else {
-            elem->buffer = sb->buffer + sb->bufferFill - globalYaraCnf->scanMaxSize - 1;
-            elem->length = globalYaraCnf->scanMaxSize;
+            start -= (rewind > overlap) ? overlap : rewind;
         }
-        elem->status |= YSE_READY;
-    }
-
-    if(elem->length) {
-        if(yaraScanStreamElem(elem, 0, 1)) {
-            DARWIN_LOG_ERROR("error while trying to launch scan");
-        }
-        else if(elem->ruleList->fill) {
-            const char *yaraRuleTag;
-            uint32_t i;
-            DARWIN_LOG_DEBUG("found elems in scan");
-            DARWIN_LOG_INFO("number of elements found in scan: " + std::to_string(elem->ruleList->fill));
-
-            if(sb && !sb->ruleList) sb->ruleList = yaraCreateRuleList();
-
-            for(i = 0; i < elem->ruleList->fill; i++) {
-                YR_RULE *rule = elem->ruleList->list[i];
-
-                if(sb && yaraIsRuleInList(sb->ruleList, rule)) {
-                    continue;
-                }
-                else {
 
-                    if(sb)  yaraAddRuleToList(sb->ruleList, rule);
-                    results.rules.insert(rule->identifier);
+        elem->matchedRules = &(sb->matchedRules);
+        while(1) {
+            uint32_t length = streamEnd - start;
+            if(length > scanMaxSize) length = scanMaxSize;
 
-                    yr_rule_tags_foreach(rule, yaraRuleTag)
-                    {
-                        results.tags.insert(yaraRuleTag);
-                    }
+            if(length > scratchSize) {
+                uint8_t *newScratch = (uint8_t *)realloc(scratch, length);
+                if(!newScratch) {
+                    DARWIN_LOG_ERROR("could not allocate stream scan buffer");
+                    break;
                 }
+                scratch = newScratch;
+                scratchSize = length;
+            }
+            /* the window is only copied if it wraps around the end of the stream buffer */
+            elem->buffer = streamBufferGetView(sb, start, length, scratch);
+            elem->length = length;
+            elem->status = YSE_READY;
+            if(yaraScanStreamElem(elem, 0, 1)) {
+                DARWIN_LOG_ERROR("error while trying to launch scan");
+                break;
             }
+            yaraCollectResults(elem, results);
+
+            if(start + length == streamEnd) break;
+            /* length is scanMaxSize here, the window moves forward by at least one byte */
+            start += length - overlap;
         }
+        /* not scanned again on error, the next scan will only cover the overlap */
+        sb->scannedOffset = streamEnd;
     }
-    if(sb) pthread_mutex_unlock(&(sb->mutex));
 
-    yaraDeleteRuleList(elem->ruleList);
-    free(elem);
+    pthread_mutex_unlock(&(sb->mutex));
+
     return results;
 }
 
@@ -315,7 +421,10 @@ int yaraScanOrImportCallback(int message, void *messageData, void *userData) {
             rule = (YR_RULE *)messageData;
             if(elem) {
                 elem->status |= YSE_RULE_MATCHED;
-                if(!yaraIsRuleInList(elem->ruleList, rule))  yaraAddRuleToList(elem->ruleList, rule);
+                /* YARA reports each rule once per scan, only streams need to filter them */
+                if(!elem->matchedRules || !yaraTestAndSetRule(elem->matchedRules, rule)) {
+                    yaraAddRuleToList(elem->ruleList, rule);
+                }
             }
             DARWIN_LOG_INFO("yara rule match");
             break;
@@ -373,7 +482,10 @@ int yaraScanOrImportCallback(
             rule = (YR_RULE *)messageData;
             if(elem) {
                 elem->status |= YSE_RULE_MATCHED;
-                if(!yaraIsRuleInList(elem->ruleList, rule))  yaraAddRuleToList(elem->ruleList, rule);
+                /* YARA reports each rule once per scan, only streams need to filter them */
+                if(!elem->matchedRules || !yaraTestAndSetRule(elem->matchedRules, rule)) {
+                    yaraAddRuleToList(elem->ruleList, rule);
+                }
             }
             DARWIN_LOG_INFO("yara rule match");
             break;
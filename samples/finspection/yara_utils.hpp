@@ -59,8 +59,18 @@ typedef struct YaraCnf_ {
 
     uint32_t scanMaxSize;
 #define SCAN_SIZE_DEFAULT   4096
+    /* bytes of already scanned data scanned again with new stream data, for matches spanning several packets:
+     * by default, each scan covers the last scanMaxSize bytes of the stream, whatever was already scanned.
+     * With "auto", the overlap is computed from the longest string of the rules, which misses the rules
+     * whose strings are in different packets and the regexes or jumps matching more than their length */
+    uint32_t streamOverlap;
+#define SCAN_OVERLAP_WINDOW UINT32_MAX
+#define SCAN_OVERLAP_AUTO   (UINT32_MAX - 1)
     YR_COMPILER *compiler;
     YR_RULES *rules;
+    /* compiled rules are contiguous, their id is their index from the first one */
+    YR_RULE *firstRule;
+    uint32_t ruleCount;
 
     char *ruleFilename;
 } YaraCnf;
@@ -86,7 +96,10 @@ typedef struct YaraStreamElem_ {
 #define YSE_RULE_MATCHED 8
 #define YSE_RULE_NOMATCH 16
 
+    /* rules matching during the scan, not already in matchedRules */
     YaraRuleList *ruleList;
+    /* stream bitset of already matched rules, NULL for packet scans */
+    uint64_t **matchedRules;
 
     struct YaraStreamElem_ *next;
     struct YaraStreamElem_ *prev;
@@ -95,7 +108,6 @@ typedef struct YaraStreamElem_ {
 YaraRuleList *yaraCreateRuleList();
 void yaraDeleteRuleList(YaraRuleList *);
 void yaraAddRuleToList(YaraRuleList *, YR_RULE *);
-int yaraIsRuleInList(YaraRuleList *, YR_RULE *);
 int yaraInitConfig(YaraCnf *);
 int yaraDeleteConfig(YaraCnf *);
 int yaraAddRuleFile(FILE *, const char *, const char *);
@@ -11,6 +11,7 @@
 
 #include "../../toolkit/lru_cache.hpp"
 #include "base/Logger.hpp"
+#include "base/Stats.hpp"
 #include "Generator.hpp"
 #include "SessionTask.hpp"
 #include "AlertManager.hpp"
@@ -48,14 +49,81 @@ bool Generator::LoadConfig(const rapidjson::Document &configuration) {
 
     redis_socket_path = configuration["redis_socket_path"].GetString();
     darwin::toolkit::RedisManager& redis = darwin::toolkit::RedisManager::GetInstance();
+
+    if (configuration.HasMember("redis_read_replicas")) {
+        if (!configuration["redis_read_replicas"].IsBool()) {
+            DARWIN_LOG_CRITICAL("Session:: Generator:: 'redis_read_replicas' needs to be a boolean");
+            return false;
+        }
+        redis.SetReplicaReads(configuration["redis_read_replicas"].GetBool());
+    }
+
     // Done in AlertManager before arriving here, but will allow better transition from redis singleton
     redis.SetUnixConnection(redis_socket_path);
-    return redis.FindAndConnect();
+    if (not redis.FindAndConnect())
+        return false;
+
+    return LoadNearCache(configuration);
+}
+
+bool Generator::LoadNearCache(const rapidjson::Document &configuration) {
+    DARWIN_LOGGER;
+    unsigned int near_cache_size = 0;
+    unsigned int near_cache_ttl = darwin::toolkit::RedisNearCache::DEFAULT_TTL;
+    std::string near_cache_key_prefix;
+
+    if (configuration.HasMember("near_cache_size")) {
+        if (!configuration["near_cache_size"].IsUint()) {
+            DARWIN_LOG_CRITICAL("Session:: Generator:: 'near_cache_size' needs to be an unsigned integer");
+            return false;
+        }
+        near_cache_size = configuration["near_cache_size"].GetUint();
+    }
+
+    if (configuration.HasMember("near_cache_ttl")) {
+        if (!configuration["near_cache_ttl"].IsUint()) {
+            DARWIN_LOG_CRITICAL("Session:: Generator:: 'near_cache_ttl' needs to be an unsigned integer");
+            return false;
+        }
+        near_cache_ttl = configuration["near_cache_ttl"].GetUint();
+    }
+
+    if (configuration.HasMember("near_cache_key_prefix")) {
+        if (!configuration["near_cache_key_prefix"].IsString()) {
+            DARWIN_LOG_CRITICAL("Session:: Generator:: 'near_cache_key_prefix' needs to be a string");
+            return false;
+        }
+        near_cache_key_prefix = configuration["near_cache_key_prefix"].GetString();
+    }
+
+    if (near_cache_size == 0 or near_cache_ttl == 0) {
+        DARWIN_LOG_DEBUG("Session:: Generator:: near cache disabled");
+        return true;
+    }
+
+    DARWIN_LOG_INFO("Session:: Generator:: near cache enabled with " + std::to_string(near_cache_size)
+                    + " entries for " + std::to_string(near_cache_ttl) + "s");
+    if (near_cache_key_prefix.empty())
+        DARWIN_LOG_INFO("Session:: Generator:: no 'near_cache_key_prefix' given, the near cache will be notified "
+                        "of the modification of any key");
+    _near_cache = std::make_shared<darwin::toolkit::RedisNearCache>(near_cache_size, near_cache_ttl,
+                                                                    near_cache_key_prefix);
+    if (not _near_cache->Start()) {
+        DARWIN_LOG_CRITICAL("Session:: Generator:: could not start the near cache");
+        return false;
+    }
+
+    std::weak_ptr<darwin::toolkit::RedisNearCache> near_cache = _near_cache;
+    darwin::stats::AddCustomStats("near_cache", [near_cache]() {
+        auto cache = near_cache.lock();
+        return cache ? cache->GetStats() : std::string("{}");
+    });
+    return true;
 }
 
 darwin::session_ptr_t
 Generator::CreateTask(boost::asio::local::stream_protocol::socket& socket,
                       darwin::Manager& manager) noexcept {
     return std::static_pointer_cast<darwin::Session>(
-            std::make_shared<SessionTask>(socket, manager, _cache, _cache_mutex));
+            std::make_shared<SessionTask>(socket, manager, _cache, _cache_mutex, _near_cache));
 }
@@ -17,6 +17,7 @@ extern "C" {
 
 #include "Session.hpp"
 #include "../../toolkit/RedisManager.hpp"
+#include "../../toolkit/RedisNearCache.hpp"
 #include "../toolkit/rapidjson/document.h"
 #include "AGenerator.hpp"
 
@@ -33,4 +34,10 @@ public:
 private:
     virtual bool LoadConfig(const rapidjson::Document &configuration) override final;
     virtual bool ConfigureAlerting(const std::string& tags) override final;
+
+    /// Create the near cache of Redis lookups, if enabled by 'near_cache_size'
+    bool LoadNearCache(const rapidjson::Document &configuration);
+
+private:
+    std::shared_ptr<darwin::toolkit::RedisNearCache> _near_cache = nullptr; // nullptr if disabled
 };
\ No newline at end of file
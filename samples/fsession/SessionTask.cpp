@@ -29,8 +29,9 @@ extern "C" {
 SessionTask::SessionTask(boost::asio::local::stream_protocol::socket& socket,
                          darwin::Manager& manager,
                          std::shared_ptr<boost::compute::detail::lru_cache<xxh::hash64_t, unsigned int>> cache,
-                         std::mutex& cache_mutex)
-        : Session{"session", socket, manager, cache, cache_mutex}{
+                         std::mutex& cache_mutex,
+                         std::shared_ptr<darwin::toolkit::RedisNearCache> near_cache)
+        : Session{"session", socket, manager, cache, cache_mutex}, _near_cache{std::move(near_cache)}{
 }
 
 long SessionTask::GetFilterCode() noexcept {
@@ -106,12 +107,34 @@ unsigned int SessionTask::REDISLookup(const std::string &token, const std::vecto
     for (auto &repo_id : repo_ids) {
         std::string result;
         std::string key = token + "_" + repo_id;
+        bool exists = false;
+
+        if (_near_cache and _near_cache->Get(key, result, exists)) {
+            DARWIN_LOG_DEBUG("SessionTask::REDISLookup:: near cache hit for key " + key);
+            if (not exists or result != "1")
+                continue;
+            // the session is still in use, it must not expire in Redis
+            if (_expiration and _near_cache->RefreshDue(key, std::chrono::seconds(NEAR_CACHE_EXPIRE_REFRESH_INTERVAL)))
+                REDISResetExpire(token, repo_id);
+            return 1;
+        }
+
         std::vector<std::string> arguments;
         arguments.emplace_back("GET");
         arguments.emplace_back(key);
 
+        // taken before querying, so that an invalidation received meanwhile prevents caching the reply
+        uint64_t epoch = _near_cache ? _near_cache->GetEpoch(key) : 0;
         redis_reply = redis.Query(arguments, result, true);
 
+        // replicas may lag behind the master the invalidations come from
+        if (_near_cache and not redis.LastReplyFromReplica()) {
+            if (redis_reply == REDIS_REPLY_STRING)
+                _near_cache->Insert(key, result, epoch);
+            else if (redis_reply == REDIS_REPLY_NIL)
+                _near_cache->Insert(key, boost::none, epoch);
+        }
+
         if(redis_reply == REDIS_REPLY_STRING) {
             // key exists, but still needs to check value
             if (result != "1") {
@@ -22,6 +22,7 @@ extern "C" {
 #include "Session.hpp"
 #include "../../toolkit/lru_cache.hpp"
 #include "../../toolkit/RedisManager.hpp"
+#include "../../toolkit/RedisNearCache.hpp"
 
 
 #define DARWIN_FILTER_SESSION 0x73657373
@@ -29,6 +30,9 @@ extern "C" {
 #define DARWIN_ALERT_RULE_NAME "Session"
 #define DARWIN_ALERT_TAGS "[]"
 
+// Minimum seconds between two resets of the expiration of a key served from the near cache
+#define NEAR_CACHE_EXPIRE_REFRESH_INTERVAL 1
+
 // To create a usable task method you MUST inherit from darwin::thread::Task publicly.
 // The code bellow show all what's necessary to have a working task.
 // For more information about Tasks, please refer to the class definition.
@@ -38,7 +42,8 @@ public:
     explicit SessionTask(boost::asio::local::stream_protocol::socket& socket,
                          darwin::Manager& manager,
                          std::shared_ptr<boost::compute::detail::lru_cache<xxh::hash64_t, unsigned int>> cache,
-                         std::mutex& cache_mutex);
+                         std::mutex& cache_mutex,
+                         std::shared_ptr<darwin::toolkit::RedisNearCache> near_cache);
     ~SessionTask() override = default;
 
 
@@ -61,6 +66,9 @@ private:
     /// Read a session number (from Cookie or HTTP header) from the session and
     /// perform a redis lookup.
     ///
+    /// Results are taken from the near cache when enabled, the expiration of a key served from it being reset
+    /// at most every NEAR_CACHE_EXPIRE_REFRESH_INTERVAL seconds.
+    ///
     /// \return true on success, false otherwise.
     unsigned int REDISLookup(const std::string &token, const std::vector<std::string> &repo_ids) noexcept;
 
@@ -72,4 +80,5 @@ private:
     std::string _token; // The token to check
     std::vector<std::string> _repo_ids; // The associated repository IDs to check
     uint64_t _expiration = 0; // The expiration to set
+    std::shared_ptr<darwin::toolkit::RedisNearCache> _near_cache; // Local cache of lookups, nullptr if disabled
 };
@@ -80,6 +80,9 @@ bool Generator::LoadConfig(const rapidjson::Document &configuration) {
     */
     if(start_detection_thread) {
         _anomaly_thread_manager = std::make_shared<AnomalyThreadManager>(_redis_internal);
+        if(not LoadIncremental(configuration, detection_frequency)) {
+            return false;
+        }
         if(!_anomaly_thread_manager->Start(detection_frequency)) {
             DARWIN_LOG_CRITICAL("TAnomaly:: Generator:: Error when starting polling thread");
             return false;
@@ -92,6 +95,53 @@ bool Generator::LoadConfig(const rapidjson::Document &configuration) {
     return true;
 }
 
+bool Generator::LoadIncremental(const rapidjson::Document &configuration, unsigned int detection_frequency) {
+    DARWIN_LOGGER;
+    unsigned int max_tracked_ips = AnomalyThreadManager::DEFAULT_MAX_TRACKED_IPS;
+    unsigned int window_size = 2 * detection_frequency; // detection sees the logs of the last 2 periods at most
+    unsigned int reference_size = AnomalyThreadManager::DEFAULT_REFERENCE_SIZE;
+
+    if(not configuration.HasMember("incremental")) {
+        return true;
+    }
+    if(not configuration["incremental"].IsBool()) {
+        DARWIN_LOG_CRITICAL("TAnomaly:: Generator:: 'incremental' needs to be a boolean");
+        return false;
+    }
+    if(not configuration["incremental"].GetBool()) {
+        return true;
+    }
+
+    if(configuration.HasMember("max_tracked_ips")) {
+        if(not configuration["max_tracked_ips"].IsUint() or configuration["max_tracked_ips"].GetUint() == 0) {
+            DARWIN_LOG_CRITICAL("TAnomaly:: Generator:: 'max_tracked_ips' needs to be a strictly positive integer");
+            return false;
+        }
+        max_tracked_ips = configuration["max_tracked_ips"].GetUint();
+    }
+
+    if(configuration.HasMember("window_size")) {
+        if(not configuration["window_size"].IsUint() or configuration["window_size"].GetUint() == 0) {
+            DARWIN_LOG_CRITICAL("TAnomaly:: Generator:: 'window_size' needs to be a strictly positive integer");
+            return false;
+        }
+        window_size = configuration["window_size"].GetUint();
+    }
+
+    if(configuration.HasMember("reference_size")) {
+        if(not configuration["reference_size"].IsUint()) {
+            DARWIN_LOG_CRITICAL("TAnomaly:: Generator:: 'reference_size' needs to be an unsigned integer");
+            return false;
+        }
+        reference_size = configuration["reference_size"].GetUint();
+    }
+
+    DARWIN_LOG_INFO("TAnomaly:: Generator:: incremental detection enabled, tracking up to " + std::to_string(max_tracked_ips)
+                    + " IPs over " + std::to_string(window_size) + "s");
+    _anomaly_thread_manager->EnableIncremental(max_tracked_ips, window_size, reference_size);
+    return true;
+}
+
 darwin::session_ptr_t
 Generator::CreateTask(boost::asio::local::stream_protocol::socket& socket,
                       darwin::Manager& manager) noexcept {
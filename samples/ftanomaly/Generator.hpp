@@ -33,6 +33,9 @@ private:
     virtual bool LoadConfig(const rapidjson::Document &configuration) override final;
     virtual bool ConfigureAlerting(const std::string& tags) override final;
 
+    /// Switch the detection thread to the incremental mode, if enabled by 'incremental'
+    bool LoadIncremental(const rapidjson::Document &configuration, unsigned int detection_frequency);
+
     std::string _redis_internal = REDIS_INTERNAL_LIST;
     std::shared_ptr<AnomalyThreadManager> _anomaly_thread_manager;
 };
\ No newline at end of file
@@ -0,0 +1,127 @@
+/// \file     TAnomalyFeatureWindow.cpp
+/// \version  1.0
+/// \date     19/10/26
+/// \license  GPLv3
+/// \brief    Copyright (c) 2018 Advens. All rights reserved.
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "../../toolkit/xxhash.h"
+#include "../../toolkit/xxhash.hpp"
+#include "TAnomalyFeatureWindow.hpp"
+#include "TAnomalyThreadManager.hpp"
+
+AnomalyFeatureWindow::AnomalyFeatureWindow(std::size_t max_ips, std::chrono::seconds window)
+        : _maxIps{std::max<std::size_t>(max_ips, 1)}, _halfWindow{window / 2},
+          _lastSlide{std::chrono::steady_clock::now()} {}
+
+void AnomalyFeatureWindow::Add(const AnomalyLogLine &line) {
+    const IpKey &ip = line.ip_src;
+    int host_feature = AnomalyThreadManager::HostFeature(line.protocol);
+    int port_feature = AnomalyThreadManager::PortFeature(line.protocol);
+
+    if (host_feature < 0) return;
+
+    auto it = _features.find(ip);
+    if (it == _features.end()) {
+        if (_features.size() >= _maxIps) {
+            _features.erase(_lru.back());
+            _lru.pop_back();
+        }
+        _lru.push_front(ip);
+        it = _features.emplace(ip, Features{}).first;
+        it.value().lru = _lru.begin();
+    } else {
+        _lru.splice(_lru.begin(), _lru, it->second.lru);
+    }
+
+    Features &features = it.value();
+    features.current[host_feature].Add(xxh::xxhash<64>(&line.ip_dst, sizeof(line.ip_dst)));
+    if (port_feature >= 0) {
+        features.current[port_feature].Add(xxh::xxhash<64>(&line.port, sizeof(line.port)));
+    }
+
+    if (not features.changed) {
+        features.changed = true;
+        _changed.push_back(ip);
+    }
+}
+
+void AnomalyFeatureWindow::Slide(std::chrono::steady_clock::time_point now) {
+    if (now - _lastSlide < _halfWindow) return;
+    _lastSlide = now;
+
+    for (auto it = _features.begin(); it != _features.end();) {
+        Features &features = it.value();
+        bool seen = false;
+
+        for (std::size_t i = 0; i < FEATURES; ++i) {
+            seen = seen or not features.current[i].Empty();
+            features.previous[i] = features.current[i];
+            features.current[i].Clear();
+        }
+
+        if (seen) {
+            ++it;
+        } else {
+            _lru.erase(features.lru);
+            it = _features.erase(it);
+        }
+    }
+}
+
+void AnomalyFeatureWindow::FillColumn(arma::mat &matrix, std::size_t column, const Features &features) {
+    for (std::size_t i = 0; i < FEATURES; ++i) {
+        sketch_t sketch = features.current[i];
+
+        sketch.Merge(features.previous[i]);
+        matrix(i, column) = std::round(sketch.Estimate());
+    }
+}
+
+std::size_t AnomalyFeatureWindow::BuildMatrix(arma::mat &matrix, std::vector<std::string> &ips,
+                                              std::size_t max_reference) const {
+    std::vector<const Features *> columns;
+    std::unordered_set<const Features *> added;
+
+    ips.clear();
+    for (const IpKey &ip : _changed) {
+        auto it = _features.find(ip);
+        // evicted since its update, or evicted and updated again
+        if (it == _features.end() or not added.insert(&it->second).second) continue;
+
+        ips.push_back(ip.ToString());
+        columns.push_back(&it->second);
+    }
+    std::size_t changed = ips.size();
+
+    // unchanged IPs are sampled evenly
+    std::size_t unchanged = _features.size() - changed;
+    std::size_t reference = std::min(unchanged, max_reference);
+    std::size_t index = 0, taken = 0;
+
+    for (auto it = _features.begin(); it != _features.end() and taken < reference; ++it) {
+        if (it->second.changed) continue;
+        if ((index++ * reference) / unchanged == taken) {
+            ips.push_back(it->first.ToString());
+            columns.push_back(&it->second);
+            ++taken;
+        }
+    }
+
+    matrix.zeros(FEATURES, columns.size());
+    for (std::size_t i = 0; i < columns.size(); ++i) {
+        FillColumn(matrix, i, *columns[i]);
+    }
+    return changed;
+}
+
+void AnomalyFeatureWindow::ClearChanged() {
+    for (const IpKey &ip : _changed) {
+        auto it = _features.find(ip);
+
+        if (it != _features.end()) it.value().changed = false;
+    }
+    _changed.clear();
+}
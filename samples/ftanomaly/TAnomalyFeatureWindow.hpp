@@ -0,0 +1,79 @@
+/// \file     TAnomalyFeatureWindow.hpp
+/// \version  1.0
+/// \date     19/10/26
+/// \license  GPLv3
+/// \brief    Copyright (c) 2018 Advens. All rights reserved.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <list>
+#include <string>
+#include <vector>
+#include <mlpack/core.hpp>
+
+#include "tsl/hopscotch_map.h"
+#include "TAnomalyLogParser.hpp"
+#include "../../toolkit/HyperLogLog.hpp"
+
+/// Features of the source IPs over a sliding window, updated as the logs arrive.
+/// The distinct hosts and ports of each IP are estimated by HyperLogLog sketches, so an IP takes a fixed
+/// amount of memory whatever its traffic, and the number of IPs tracked is bounded: the least recently
+/// seen ones are evicted first.
+/// The window is made of two halves, the features cover the current half and the previous one.
+class AnomalyFeatureWindow {
+public:
+    // ~9% standard error, 128 bytes per sketch
+    static constexpr unsigned int SKETCH_PRECISION = 7;
+    // Same order as the rows of the detection matrix
+    static constexpr std::size_t FEATURES = 5;
+
+    /// \param max_ips the maximum number of source IPs tracked
+    /// \param window the duration covered by the features
+    AnomalyFeatureWindow(std::size_t max_ips, std::chrono::seconds window);
+    ~AnomalyFeatureWindow() = default;
+
+public:
+    /// Update the features of a source IP with a log line
+    void Add(const AnomalyLogLine &line);
+
+    /// Start a new half of the window if the current one is over, forgetting the IPs not seen for a whole window
+    void Slide(std::chrono::steady_clock::time_point now);
+
+    /// Build the detection matrix from the IPs updated since the last call to ClearChanged,
+    /// followed by a sample of the other IPs giving the clustering a reference of the normal behaviour
+    /// \param matrix receives the features, one column per IP
+    /// \param ips receives the IP of each column
+    /// \param max_reference the maximum number of IPs not updated added to the matrix
+    /// \return the number of updated IPs, which are the first columns of the matrix
+    std::size_t BuildMatrix(arma::mat &matrix, std::vector<std::string> &ips, std::size_t max_reference) const;
+
+    /// Mark all the IPs as analysed
+    void ClearChanged();
+
+    std::size_t Size() const { return _features.size(); }
+    std::size_t ChangedSize() const { return _changed.size(); }
+
+private:
+    typedef darwin::toolkit::HyperLogLog<SKETCH_PRECISION> sketch_t;
+
+    struct Features {
+        std::array<sketch_t, FEATURES> current;
+        std::array<sketch_t, FEATURES> previous;
+        bool changed = false;
+        std::list<IpKey>::iterator lru; // position in _lru
+    };
+
+    /// Fill a column of the matrix with the features of an IP
+    static void FillColumn(arma::mat &matrix, std::size_t column, const Features &features);
+
+private:
+    std::size_t _maxIps;
+    std::chrono::steady_clock::duration _halfWindow;
+    std::chrono::steady_clock::time_point _lastSlide;
+
+    tsl::hopscotch_map<IpKey, Features, IpKeyHash> _features;
+    std::list<IpKey> _lru; // most recently updated first
+    std::vector<IpKey> _changed; // IPs updated since the last analysis, may have been evicted since
+};
@@ -0,0 +1,119 @@
+/// \file     TAnomalyLogParser.cpp
+/// \version  1.0
+/// \date     19/10/26
+/// \license  GPLv3
+/// \brief    Copyright (c) 2018 Advens. All rights reserved.
+
+extern "C" {
+#include <arpa/inet.h>
+}
+
+#include <charconv>
+#include <cstring>
+
+#include "TAnomalyLogParser.hpp"
+
+namespace {
+    constexpr uint64_t IPV4_MAPPED_PREFIX = 0xFFFF00000000ULL;
+
+    bool ParseIpv4(std::string_view address, uint32_t &ip) {
+        const char *current = address.data();
+        const char *end = address.data() + address.size();
+
+        ip = 0;
+        for (int i = 0; i < 4; ++i) {
+            unsigned int byte = 0;
+
+            if (i > 0) {
+                if (current == end or *current != '.') return false;
+                ++current;
+            }
+            // no leading zero, as inet_pton
+            if (current != end and *current == '0' and current + 1 != end and current[1] >= '0' and current[1] <= '9') return false;
+
+            auto result = std::from_chars(current, end, byte);
+            if (result.ec != std::errc() or result.ptr - current > 3 or byte > 255) return false;
+            current = result.ptr;
+            ip = (ip << 8) | byte;
+        }
+        return current == end;
+    }
+
+    template<typename T>
+    bool ParseInteger(std::string_view value, T &result) {
+        auto parsed = std::from_chars(value.data(), value.data() + value.size(), result);
+
+        return parsed.ec == std::errc() and parsed.ptr == value.data() + value.size();
+    }
+}
+
+std::string IpKey::ToString() const {
+    char str[INET6_ADDRSTRLEN];
+
+    if (high == 0 and (low >> 32) == (IPV4_MAPPED_PREFIX >> 32)) {
+        in_addr addr;
+
+        addr.s_addr = htonl(static_cast<uint32_t>(low));
+        inet_ntop(AF_INET, &addr, str, INET_ADDRSTRLEN);
+    } else {
+        in6_addr addr;
+
+        for (int i = 0; i < 8; ++i) {
+            addr.s6_addr[i] = high >> (56 - 8 * i);
+            addr.s6_addr[8 + i] = low >> (56 - 8 * i);
+        }
+        inet_ntop(AF_INET6, &addr, str, INET6_ADDRSTRLEN);
+    }
+    return std::string(str);
+}
+
+bool ParseIpKey(std::string_view address, IpKey &key) {
+    uint32_t ipv4;
+
+    if (ParseIpv4(address, ipv4)) {
+        key.high = 0;
+        key.low = IPV4_MAPPED_PREFIX | ipv4;
+        return true;
+    }
+
+    // inet_pton needs a null terminated string
+    char str[INET6_ADDRSTRLEN];
+    in6_addr addr;
+
+    if (address.size() >= sizeof(str)) return false;
+    std::memcpy(str, address.data(), address.size());
+    str[address.size()] = '\0';
+    if (inet_pton(AF_INET6, str, &addr) != 1) return false;
+
+    key.high = 0;
+    key.low = 0;
+    for (int i = 0; i < 8; ++i) {
+        key.high = (key.high << 8) | addr.s6_addr[i];
+        key.low = (key.low << 8) | addr.s6_addr[8 + i];
+    }
+    return true;
+}
+
+bool ParseAnomalyLogLine(std::string_view line, AnomalyLogLine &parsed) {
+    std::string_view fields[4];
+    std::size_t start = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        std::size_t end = i < 3 ? line.find(';', start) : line.size();
+
+        if (end == std::string_view::npos) return false;
+        fields[i] = line.substr(start, end - start);
+        start = end + 1;
+    }
+    // more than 4 fields
+    if (fields[3].find(';') != std::string_view::npos) return false;
+
+    if (not ParseInteger(fields[3], parsed.protocol)) return false;
+    if (parsed.protocol != 1 and parsed.protocol != 6 and parsed.protocol != 17) return false;
+
+    // the port is ignored for ICMP
+    parsed.port = 0;
+    if (parsed.protocol != 1 and not ParseInteger(fields[2], parsed.port)) return false;
+
+    return ParseIpKey(fields[0], parsed.ip_src) and ParseIpKey(fields[1], parsed.ip_dst);
+}
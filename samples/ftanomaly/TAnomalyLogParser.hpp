@@ -0,0 +1,49 @@
+/// \file     TAnomalyLogParser.hpp
+/// \version  1.0
+/// \date     19/10/26
+/// \license  GPLv3
+/// \brief    Copyright (c) 2018 Advens. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/// An IPv4 or IPv6 address as a fixed size key, IPv4 addresses are stored IPv4-mapped (::ffff:a.b.c.d)
+struct IpKey {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    bool operator==(const IpKey &other) const {
+        return high == other.high and low == other.low;
+    }
+
+    /// \return the textual representation of the address
+    std::string ToString() const;
+};
+
+struct IpKeyHash {
+    std::size_t operator()(const IpKey &key) const noexcept {
+        // the low part holds the whole IPv4 addresses
+        return (key.low ^ (key.high * 0x9E3779B97F4A7C15ULL)) * 0xC2B2AE3D27D4EB4FULL;
+    }
+};
+
+/// A log line of the detection thread, see AnomalyTask::ParseLine for the stored format
+struct AnomalyLogLine {
+    IpKey ip_src;
+    IpKey ip_dst;
+    uint16_t port = 0; // 0 for ICMP
+    uint8_t protocol = 0; // ip protocol number: 1, 6 or 17
+};
+
+/// Parse a log line "ip_src;ip_dst;port;protocol" without copying it
+/// \param line the line to parse
+/// \param parsed receives the values of the line
+/// \return true on success, false if the line is invalid
+bool ParseAnomalyLogLine(std::string_view line, AnomalyLogLine &parsed);
+
+/// Parse an IPv4 or IPv6 address
+/// \return true on success, false if the address is invalid
+bool ParseIpKey(std::string_view address, IpKey &key);
@@ -9,6 +9,7 @@
 #include <thread>
 #include <vector>
 
+#include "../../toolkit/Clustering.hpp"
 #include "../../toolkit/RedisManager.hpp"
 #include "TAnomalyThreadManager.hpp"
 #include "Logger.hpp"
@@ -16,15 +17,25 @@
 #include "Time.hpp"
 #include "protocol.h"
 #include "AlertManager.hpp"
-#include "../../toolkit/StringUtils.hpp"
+#include "../../toolkit/xxhash.h"
+#include "../../toolkit/xxhash.hpp"
 
 AnomalyThreadManager::AnomalyThreadManager(std::string& redis_internal)
         :_redis_internal(redis_internal) {}
 
+void AnomalyThreadManager::EnableIncremental(std::size_t max_ips, unsigned int window, std::size_t reference_size) {
+    _window = std::make_unique<AnomalyFeatureWindow>(max_ips, std::chrono::seconds(window));
+    _reference_size = reference_size;
+}
+
 bool AnomalyThreadManager::Main(){
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("AnomalyThread::ThreadMain:: Begin");
 
+    if (_window) {
+        return MainIncremental();
+    }
+
     long long int len = 0;
     std::vector<std::string> logs;
 
@@ -50,183 +61,156 @@ bool AnomalyThreadManager::Main(){
     return true;
 }
 
-void AnomalyThreadManager::Detection(){
+bool AnomalyThreadManager::MainIncremental(){
     DARWIN_LOGGER;
-    DARWIN_LOG_DEBUG("AnomalyThread::Detection:: Start detection ...");
-    double epsilon = 100;
-    const size_t newDataDimension = 2, sizePoint = 5;
 
-    arma::Mat<size_t> neighbors;
-    arma::Row<size_t> assignments;
-    arma::uvec index_anomalies, index_no_anomalies;
-    arma::mat anomalies, no_anomalies, distances, alerts;
+    long long int len = REDISListLen();
+    std::vector<std::string> logs;
+    AnomalyLogLine line;
+
+    if (len<0 || (len>0 && !REDISPopLogs(len, logs))){
+        DARWIN_LOG_ERROR("AnomalyThread::MainIncremental:: Error when querying Redis");
+        return true;
+    }
+
+    _window->Slide(std::chrono::steady_clock::now());
+    for (const std::string &l : logs) {
+        if (not ParseAnomalyLogLine(l, line)) {
+            DARWIN_LOG_WARNING("AnomalyThread::MainIncremental:: Error when parsing a log line, line ignored");
+            continue;
+        }
+        _window->Add(line);
+    }
+    // lines are consumed by the window, they are not needed anymore
+    logs = std::vector<std::string>();
+
+    if (_window->ChangedSize() == 0) {
+        DARWIN_LOG_DEBUG("AnomalyThread::MainIncremental:: No new log since the last detection");
+        return true;
+    }
+
+    _candidates = _window->BuildMatrix(_matrix, _ips, _reference_size);
+    if (_matrix.n_cols<10){
+        // the updated IPs are analysed again with the next logs
+        DARWIN_LOG_DEBUG("AnomalyThread::MainIncremental:: Not enough IPs tracked, wait for more");
+        _matrix.reset();
+        return true;
+    }
 
-    mlpack::pca::PCA<> pcaa;
-    mlpack::dbscan::DBSCAN<> db(epsilon, sizePoint);
+    DARWIN_LOG_DEBUG("AnomalyThread::MainIncremental:: Analysing " + std::to_string(_candidates) + " updated IPs out of "
+                     + std::to_string(_window->Size()) + " tracked, with " + std::to_string(_matrix.n_cols - _candidates)
+                     + " reference IPs");
+    Detection();
+    _window->ClearChanged();
+    return true;
+}
 
-    alerts = _matrix;
+void AnomalyThreadManager::Detection(){
+    DARWIN_LOGGER;
+    DARWIN_LOG_DEBUG("AnomalyThread::Detection:: Start detection ...");
+    double epsilon = 100;
+    const size_t sizePoint = 5;
+    const std::size_t points = _matrix.n_cols;
 
-    // reduce matrix' dimension from 5 to 2
-    pcaa.Apply(_matrix, newDataDimension);
-    db.Cluster(_matrix, assignments);
+    std::vector<double> projected(2 * points);
+    std::vector<std::size_t> assignments, index_anomalies;
+    std::vector<double> distances;
 
-    no_anomalies = _matrix;
-    anomalies    = _matrix;
+    // reduce matrix' dimension from 5 to 2, _matrix keeps the features for the alerts
+    darwin::toolkit::clustering::Pca2D(_matrix.memptr(), _matrix.n_rows, points, projected.data());
+    darwin::toolkit::clustering::Dbscan2D(projected.data(), points, epsilon, sizePoint, assignments);
 
-    index_anomalies = arma::find(assignments == SIZE_MAX); // index of noises find by the clustering in the _matrix
-    if (index_anomalies.is_empty()){
+    // noises found by the clustering, reference columns were already analysed
+    for (std::size_t i = 0; i < _candidates and i < points; ++i) {
+        if (assignments[i] == darwin::toolkit::clustering::NOISE) index_anomalies.push_back(i);
+    }
+    if (index_anomalies.empty()){
         DARWIN_LOG_DEBUG("AnomalyThread::Detection:: No anomalies found");
+        _matrix.reset();
         return;
     }
-    no_anomalies.shed_cols(index_anomalies); // suppress noisy columns, keep only normals data
-    index_no_anomalies = arma::find(assignments != SIZE_MAX); // index noises find by the clustering in the _matrix
-    anomalies.shed_cols(index_no_anomalies); // suppress non noisy-columns, keep only abnormal data
 
     //calculate distance between an abnormal ip and the nearest normal cluster
-    mlpack::neighbor::NeighborSearch<mlpack::neighbor::NearestNeighborSort ,
-            mlpack::metric::EuclideanDistance> ns(no_anomalies);
-    ns.Search(anomalies, 1, neighbors, distances);
+    darwin::toolkit::clustering::NearestClusterDistances(projected.data(), points, assignments, index_anomalies, distances);
 
-    alerts.shed_cols(index_no_anomalies);
-    // add distance to alerts
-    alerts.insert_rows(DISTANCE, distances);
+    for(std::size_t i=0; i<index_anomalies.size(); i++){
+        std::size_t column = index_anomalies[i];
 
-    for(unsigned int i=0; i<index_anomalies.n_rows; i++){
         STAT_MATCH_INC;
-        std::string details(R"({"ip": ")" + _ips[index_anomalies(i)] + "\","
-                + R"("udp_nb_host": )" + std::to_string(alerts(UDP_NB_HOST, i)) + ","
-                + R"("udp_nb_port": )" + std::to_string(alerts(UDP_NB_PORT, i)) + ","
-                + R"("tcp_nb_host": )" + std::to_string(alerts(TCP_NB_HOST, i)) + ","
-                + R"("tcp_nb_port": )" + std::to_string(alerts(TCP_NB_PORT, i)) + ","
-                + R"("icmp_nb_host": )" + std::to_string(alerts(ICMP_NB_HOST, i)) + ","
-                + R"("distance": )" + std::to_string(alerts(DISTANCE, i))
+        std::string details(R"({"ip": ")" + _ips[column] + "\","
+                + R"("udp_nb_host": )" + std::to_string(_matrix(UDP_NB_HOST, column)) + ","
+                + R"("udp_nb_port": )" + std::to_string(_matrix(UDP_NB_PORT, column)) + ","
+                + R"("tcp_nb_host": )" + std::to_string(_matrix(TCP_NB_HOST, column)) + ","
+                + R"("tcp_nb_port": )" + std::to_string(_matrix(TCP_NB_PORT, column)) + ","
+                + R"("icmp_nb_host": )" + std::to_string(_matrix(ICMP_NB_HOST, column)) + ","
+                + R"("distance": )" + std::to_string(distances[i])
                 + "}");
-        DARWIN_ALERT_MANAGER.Alert(_ips[index_anomalies(i)], 100, "-", details);
+        DARWIN_ALERT_MANAGER.Alert(_ips[column], 100, "-", details);
     }
     _matrix.reset();
 }
 
-void AnomalyThreadManager::PreProcess(std::vector<std::string> logs) {
+void AnomalyThreadManager::PreProcess(const std::vector<std::string> &logs) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("AnomalyThread::PreProcess:: Starting the pre-process...");
 
-    size_t size, pos, i;
-    char delimiter = ';';
-    std::array<int, 5> values{};
-    std::string ip, ip_dst, port, protocol;
-    std::vector<std::string> vec;
-
-    // data to be pre-processed : {
-    //                                  ip1 : [net_src_ip4, udp_nb_host, udp_nb_port, tcp_nb_host, tcp_nb_port, icmp_nb_host],
-    //                                  ip2 : [net_src_ip4, udp_nb_host, udp_nb_port, tcp_nb_host, tcp_nb_port, icmp_nb_host],
-    //                                  ...
-    //                            }
-    tsl::hopscotch_map<std::string, std::array<int, 5>> data;
-    tsl::hopscotch_map<std::string, tsl::hopscotch_set<std::string>> cache_port;
-    tsl::hopscotch_map<std::string, tsl::hopscotch_set<std::string>> cache_ip;
+    AnomalyLogLine line;
+
+    // data to be pre-processed, the features of the i-th source ip are in data[i] :
+    //                              [udp_nb_host, udp_nb_port, tcp_nb_host, tcp_nb_port, icmp_nb_host]
+    tsl::hopscotch_map<IpKey, uint32_t, IpKeyHash> indexes;
+    std::vector<IpKey> ips;
+    std::vector<std::array<int, 5>> data;
+    // (source ip index, protocol, destination) already counted, see PreProcessLine
+    tsl::hopscotch_set<uint64_t> cache_ip;
+    tsl::hopscotch_set<uint64_t> cache_port;
 
     for (const std::string &l : logs) {
-        // line of log : ip_src;ip_dst;port;(udp|tcp) or  ip_src;ip_dst;0;icmp
-        // where udp, tcp and icmp are represented by the ip protocol number
-        try {
-            vec = darwin::strings::SplitString(l, delimiter);
-
-            if (vec.size() != 4) {
-                DARWIN_LOG_WARNING("fAnomalyConnector::PreProcess:: Error when parsing a log line (element missing), line ignored");
-                continue;
-            }
-            ip = vec[0];
-            ip_dst = vec[1];
-            port = vec[2];
-            protocol = vec[3];
-
-            if (ip.empty() or ip_dst.empty() or protocol.empty() or (protocol != "1" and port.empty())) {
-                DARWIN_LOG_WARNING("fAnomalyConnector::PreProcess:: Error when parsing a log line (element empty), line ignored");
-                continue;
-            }
-            PreProcessLine(ip, ip_dst, protocol, port, cache_port, cache_ip, data);
-
-        } catch (const std::out_of_range& e) {
-            std::string warning("fAnomalyConnector::PreProcess:: Error when parsing a log line , line ignored: ");
-            warning += e.what();
-            DARWIN_LOG_WARNING(warning);
+        if (not ParseAnomalyLogLine(l, line)) {
+            DARWIN_LOG_WARNING("AnomalyThread::PreProcess:: Error when parsing a log line, line ignored");
             continue;
         }
+
+        auto index = indexes.try_emplace(line.ip_src, ips.size());
+        if (index.second) {
+            ips.push_back(line.ip_src);
+            data.emplace_back();
+        }
+        PreProcessLine(line, index.first->second, cache_port, cache_ip, data[index.first->second]);
     }
-    size = data.size();
+
     // Set the size of the matrix and fill it w/ zeros
     // (see .hpp file to know this matrix's content)
-    _matrix.zeros(5, size);
-    i = 0;
-    for(auto it = data.begin(); it != data.end(); ++it) {
-        _ips.emplace_back(it->first);
-        values = it.value();
+    _matrix.zeros(5, data.size());
+    _ips.clear();
+    _ips.reserve(ips.size());
+    _candidates = data.size();
+    for(std::size_t i = 0; i < data.size(); i++) {
+        _ips.emplace_back(ips[i].ToString());
         for(unsigned int j = 0; j<5; j++){
-            _matrix(j, i) = values[j];
+            _matrix(j, i) = data[i][j];
         }
-        i++;
     }
 }
 
-void AnomalyThreadManager::PreProcessLine(const std::string& ip, const std::string &ip_dst, const std::string& protocol, const std::string& port,
-                                          tsl::hopscotch_map<std::string, tsl::hopscotch_set<std::string>> &cache_port,
-                                          tsl::hopscotch_map<std::string, tsl::hopscotch_set<std::string>> &cache_ip,
-                                          tsl::hopscotch_map<std::string, std::array<int, 5>>& data) {
-    tsl::hopscotch_set<std::string>* set_ip;
-    tsl::hopscotch_set<std::string>* set_port;
-
-    if(data.find(ip) != data.end()){
-
-        if (protocol == "1") {
-            set_ip = &cache_ip[ip + ":1"];
-            if (set_ip->find(ip_dst) == set_ip->end()) {
-                data[ip][ICMP_NB_HOST] += 1;
-                set_ip->emplace(ip_dst);
-            }
-
-        } else if (protocol == "17") {
-            set_ip = &cache_ip[ip + ":17"];
-            if (set_ip->find(ip_dst) == set_ip->end()) {
-                data[ip][UDP_NB_HOST] += 1;
-                set_ip->emplace(ip_dst);
-            }
-
-            set_port = &cache_port[ip + ":17"];
-            if(set_port->find(port) == set_port->end()) {
-                data[ip][UDP_NB_PORT] += 1;
-                set_port->emplace(port);
-            }
-
-        } else if (protocol == "6") {
-            set_ip = &cache_ip[ip + ":6"];
-            if (set_ip->find(ip_dst) == set_ip->end()) {
-                data[ip][TCP_NB_HOST] += 1;
-                set_ip->emplace(ip_dst);
-            }
-
-            set_port = &cache_port[ip + ":6"];
-            if(set_port->find(port) == set_port->end()) {
-                data[ip][TCP_NB_PORT] += 1;
-                set_port->emplace(port);
-            }
-        }
-        return;
-    }
+void AnomalyThreadManager::PreProcessLine(const AnomalyLogLine &line, uint32_t index,
+                                          tsl::hopscotch_set<uint64_t> &cache_port,
+                                          tsl::hopscotch_set<uint64_t> &cache_ip,
+                                          std::array<int, 5> &features) {
+    int host_feature = HostFeature(line.protocol);
+    int port_feature = PortFeature(line.protocol);
 
+    if (host_feature >= 0) {
+        // the source ip and the protocol seed the hash of the destination
+        uint64_t ip_key = xxh::xxhash<64>(&line.ip_dst, sizeof(line.ip_dst), (uint64_t(index) << 8) | line.protocol);
 
-    if (protocol == "1") {
-        data.insert({ip, {0,0,0,0,1}});
-        cache_ip[ip + ":1"].emplace(ip_dst);
+        if (cache_ip.insert(ip_key).second) features[host_feature] += 1;
+    }
 
-    } else if (protocol == "17") {
-        data.insert({ip, {1,1,0,0,0}});
-        cache_ip[ip + ":17"].emplace(ip_dst);
-        cache_port[ip + ":17"].emplace(port);
+    if (port_feature >= 0) {
+        uint64_t port_key = (uint64_t(index) << 24) | (uint64_t(line.protocol) << 16) | line.port;
 
-    } else if (protocol == "6") {
-        data.insert({ip, {0,0,1,1,0}});
-        cache_ip[ip + ":6"].emplace(ip_dst);
-        cache_port[ip + ":6"].emplace(port);
+        if (cache_port.insert(port_key).second) features[port_feature] += 1;
     }
 }
 
@@ -251,29 +235,28 @@ bool AnomalyThreadManager::REDISPopLogs(long long int len, std::vector<std::stri
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("AnomalyThread::REDISPopLogs:: Querying Redis for logs...");
 
-    std::any result;
-    std::vector<std::any> result_vector;
+    size_t popped = 0;
 
     darwin::toolkit::RedisManager& redis = darwin::toolkit::RedisManager::GetInstance();
 
-    if(redis.Query(std::vector<std::string>{"SPOP", _redis_internal, std::to_string(len)}, result, true) != REDIS_REPLY_ARRAY) {
+    // parse the popped logs in place, without intermediate copies
+    auto parse_logs = [&logs, &popped](const darwin::toolkit::RedisReplyView& reply) {
+        if(not reply.IsArray())
+            return;
+        logs.reserve(logs.size() + reply.Size());
+        for(const auto& element : reply) {
+            popped++;
+            if(element.IsString())
+                logs.emplace_back(element.String());
+        }
+    };
+
+    if(redis.Query(std::vector<std::string>{"SPOP", _redis_internal, std::to_string(len)}, parse_logs, true) != REDIS_REPLY_ARRAY) {
         DARWIN_LOG_ERROR("AnomalyThread::REDISPopLogs:: Not the expected Redis response");
         return false;
     }
 
-    try {
-        result_vector = std::any_cast<std::vector<std::any>>(result);
-    }
-    catch (const std::bad_any_cast&) {}
-
-    DARWIN_LOG_DEBUG("Got " + std::to_string(result_vector.size()) + " entries from Redis");
-
-    for(auto& object : result_vector) {
-        try {
-            logs.emplace_back(std::any_cast<std::string>(object));
-        }
-        catch(const std::bad_any_cast&) {}
-    }
+    DARWIN_LOG_DEBUG("Got " + std::to_string(popped) + " entries from Redis");
 
     return true;
 }
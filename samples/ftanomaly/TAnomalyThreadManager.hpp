@@ -11,12 +11,11 @@
 #include <string>
 #include <thread>
 #include <mlpack/core.hpp>
-#include <mlpack/methods/pca/pca.hpp>
-#include <mlpack/methods/dbscan/dbscan.hpp>
-#include <mlpack/methods/neighbor_search/neighbor_search.hpp>
 
 #include "tsl/hopscotch_map.h"
 #include "tsl/hopscotch_set.h"
+#include "TAnomalyFeatureWindow.hpp"
+#include "TAnomalyLogParser.hpp"
 #include "../../toolkit/ThreadManager.hpp"
 #include "../../toolkit/RedisManager.hpp"
 #include "../../toolkit/FileManager.hpp"
@@ -26,26 +25,61 @@ public:
     AnomalyThreadManager(std::string& redis_internal);
     ~AnomalyThreadManager() override = default;
 
-private:
+public:
     // Indices of values in matrix (see variable "_data" below)
     static constexpr int UDP_NB_HOST  = 0;
     static constexpr int UDP_NB_PORT  = 1;
     static constexpr int TCP_NB_HOST  = 2;
     static constexpr int TCP_NB_PORT  = 3;
     static constexpr int ICMP_NB_HOST = 4;
-    static constexpr int DISTANCE     = 5;
 
+    /// \return the row of the distinct hosts reached with a protocol, -1 if the protocol is not analysed
+    static int HostFeature(uint8_t protocol) {
+        switch (protocol) {
+            case 1: return ICMP_NB_HOST;
+            case 6: return TCP_NB_HOST;
+            case 17: return UDP_NB_HOST;
+            default: return -1;
+        }
+    }
+
+    /// \return the row of the distinct ports reached with a protocol, -1 if the protocol has no ports
+    static int PortFeature(uint8_t protocol) {
+        switch (protocol) {
+            case 6: return TCP_NB_PORT;
+            case 17: return UDP_NB_PORT;
+            default: return -1;
+        }
+    }
+
+    // default values of the incremental mode
+    static constexpr std::size_t DEFAULT_MAX_TRACKED_IPS = 50000;
+    static constexpr std::size_t DEFAULT_REFERENCE_SIZE = 10000;
+
+    /// Keep the features of the IPs in a sliding window updated at each wake-up, instead of rebuilding
+    /// them from the logs of the last period. Only the IPs updated since the previous wake-up are analysed.
+    /// Must be called before Start.
+    /// \param max_ips the maximum number of source IPs tracked, bounding the memory used
+    /// \param window the duration covered by the features, in seconds
+    /// \param reference_size the maximum number of IPs not updated added to the clustering as a reference
+    void EnableIncremental(std::size_t max_ips, unsigned int window, std::size_t reference_size);
+
+private:
     static constexpr int MIN_LOGS_LINES = 10;
 
     /// Main function
     bool Main() override;
 
+    /// Main function of the incremental mode
+    bool MainIncremental();
+
+
     /// The algorithm to detect anomalies in data
     void Detection();
 
     /// Pre-process data and stock it in a matrix,
     /// before the algorithm process
-    void PreProcess(std::vector<std::string> logs);
+    void PreProcess(const std::vector<std::string> &logs);
 
     /// Write the alerts/logs in Redis
     /// \return true on success, false otherwise.
@@ -53,10 +87,14 @@ private:
     bool WriteRedis(const std::string& log_line);
 
     /// Used by "PreProcess" to process a log's line
-    void PreProcessLine(const std::string& ip, const std::string &ip_dst, const std::string& protocol, const std::string& port,
-                        tsl::hopscotch_map<std::string, tsl::hopscotch_set<std::string>> &cache_data,
-                        tsl::hopscotch_map<std::string, tsl::hopscotch_set<std::string>> &cache_ip,
-                        tsl::hopscotch_map<std::string, std::array<int, 5>>& data);
+    /// \param index the index of the source ip
+    /// \param cache_port the (source ip, protocol, port) already counted
+    /// \param cache_ip the (source ip, protocol, destination ip) already counted
+    /// \param features the features of the source ip
+    void PreProcessLine(const AnomalyLogLine &line, uint32_t index,
+                        tsl::hopscotch_set<uint64_t> &cache_port,
+                        tsl::hopscotch_set<uint64_t> &cache_ip,
+                        std::array<int, 5> &features);
 
     /// Query the Redis to get length of the list
     /// where we have our data
@@ -84,6 +122,11 @@ private:
     arma::mat _matrix = {};
     // ips linked to pre-processed data :   [  ip1,   ip2   ]
     std::vector<std::string> _ips;
+    // only the first _candidates columns of the matrix may raise alerts, the other ones are a reference
+    std::size_t _candidates = 0;
+
+    std::unique_ptr<AnomalyFeatureWindow> _window = nullptr; // nullptr if the incremental mode is disabled
+    std::size_t _reference_size = DEFAULT_REFERENCE_SIZE;
 
     const std::string _redis_internal;
 };
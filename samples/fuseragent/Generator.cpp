@@ -5,12 +5,14 @@
 /// \license  GPLv3
 /// \brief    Copyright (c) 2018 Advens. All rights reserved.
 
+#include <algorithm>
 #include <boost/tokenizer.hpp>
 #include <fstream>
 
 #include "../toolkit/lru_cache.hpp"
 #include "base/Logger.hpp"
 #include "Generator.hpp"
+#include "Stats.hpp"
 #include "tensorflow/core/framework/graph.pb.h"
 #include "UserAgentTask.hpp"
 
@@ -18,9 +20,6 @@ bool Generator::LoadConfig(const rapidjson::Document &configuration) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("UserAgent:: Generator:: Loading classifier...");
 
-    std::string token_map_path;
-    std::string model_path;
-
     if (!configuration.HasMember("token_map_path")) {
         DARWIN_LOG_CRITICAL("UserAgent:: Generator:: Missing parameter: 'token_map_path'");
         return false;
@@ -31,7 +30,7 @@ bool Generator::LoadConfig(const rapidjson::Document &configuration) {
         return false;
     }
 
-    token_map_path = configuration["token_map_path"].GetString();
+    _token_map_path = configuration["token_map_path"].GetString();
 
     if (!configuration.HasMember("model_path")) {
         DARWIN_LOG_CRITICAL("UserAgent:: Generator:: Missing parameter: 'model_path'");
@@ -43,7 +42,7 @@ bool Generator::LoadConfig(const rapidjson::Document &configuration) {
         return false;
     }
 
-    model_path = configuration["model_path"].GetString();
+    _model_path = configuration["model_path"].GetString();
 
     if (!configuration.HasMember("max_tokens")) {
         DARWIN_LOG_CRITICAL("UserAgent:: Generator:: 'max_tokens' not provided. Setting default value: " +
@@ -59,11 +58,63 @@ bool Generator::LoadConfig(const rapidjson::Document &configuration) {
         _max_tokens = configuration["max_tokens"].GetUint();
     }
 
-    return LoadTokenMap(token_map_path) && LoadModel(model_path);
+    if (configuration.HasMember("memo_size")) {
+        if (!configuration["memo_size"].IsUint()) {
+            DARWIN_LOG_CRITICAL("UserAgent:: Generator:: 'memo_size' needs to be an unsigned integer");
+            return false;
+        }
+
+        _memo_size = configuration["memo_size"].GetUint();
+    }
+
+    if (configuration.HasMember("intra_op_threads")) {
+        if (!configuration["intra_op_threads"].IsUint()) {
+            DARWIN_LOG_CRITICAL("UserAgent:: Generator:: 'intra_op_threads' needs to be an unsigned integer");
+            return false;
+        }
+
+        _intra_op_threads = configuration["intra_op_threads"].GetUint();
+    }
+
+    if (configuration.HasMember("inter_op_threads")) {
+        if (!configuration["inter_op_threads"].IsUint()) {
+            DARWIN_LOG_CRITICAL("UserAgent:: Generator:: 'inter_op_threads' needs to be an unsigned integer");
+            return false;
+        }
+
+        _inter_op_threads = configuration["inter_op_threads"].GetUint();
+    }
+
+    // The classes are in the order of the outputs of the model
+    auto bad_bot = std::find(UserAgentTask::USER_AGENT_CLASSES.begin(), UserAgentTask::USER_AGENT_CLASSES.end(), "Bad bot");
+    _bad_bot_index = std::distance(UserAgentTask::USER_AGENT_CLASSES.begin(), bad_bot);
+
+    return LoadModels() && LoadScheduler(configuration);
+}
+
+bool Generator::LoadModels() {
+    DARWIN_LOGGER;
+    auto model = std::make_shared<UserAgentTask::Model>();
+
+    if (!LoadTokenMap(_token_map_path, model->token_map) || !LoadModel(_model_path, model->session)) {
+        return false;
+    }
+
+    // Sessions already running keep the previous model, the new ones take this one
+    auto current = std::atomic_load(&_model);
+    model->generation = current ? current->generation + 1 : 0;
+    DARWIN_LOG_INFO("UserAgent:: Generator:: Model and token map loaded, generation " + std::to_string(model->generation));
+    std::atomic_store(&_model, std::shared_ptr<const UserAgentTask::Model>(std::move(model)));
+    return true;
+}
+
+bool Generator::ReloadModels() {
+    return LoadModels();
 }
 
-bool Generator::LoadTokenMap(const std::string &token_map_path) {
+bool Generator::LoadTokenMap(const std::string &token_map_path, UserAgentTokenMap &token_map) {
     DARWIN_LOGGER;
+    std::map<std::string, unsigned int> dictionary;
     std::string current_line;
     boost::char_separator<char> separator{","};
 
@@ -80,17 +131,17 @@ bool Generator::LoadTokenMap(const std::string &token_map_path) {
 
     while (!token_map_stream.eof() && std::getline(token_map_stream, current_line)) {
         boost::tokenizer<boost::char_separator<char>> tokens(current_line, separator);
-        _token_map[*tokens.begin()] = (unsigned int)std::stoi(*(++tokens.begin()));
+        dictionary[*tokens.begin()] = (unsigned int)std::stoi(*(++tokens.begin()));
     }
 
     token_map_stream.close();
 
     DARWIN_LOG_DEBUG("UserAgent:: LoadTokenMap:: Token map loaded");
 
-    return true;
+    return token_map.Compile(dictionary, UserAgentTask::TOKEN_SEPARATORS, _max_tokens, _memo_size);
 }
 
-bool Generator::LoadModel(const std::string &model_path) {
+bool Generator::LoadModel(const std::string &model_path, std::shared_ptr<tensorflow::Session> &session) {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("Generator:: LoadModel:: Loading model...");
     tensorflow::GraphDef graph_def;
@@ -101,8 +152,23 @@ bool Generator::LoadModel(const std::string &model_path) {
         return false;
     }
 
-    _session.reset(tensorflow::NewSession(tensorflow::SessionOptions()));
-    tensorflow::Status session_create_status = _session->Create(graph_def);
+    // 0 lets tensorflow choose the number of threads
+    tensorflow::SessionOptions options;
+    options.config.set_intra_op_parallelism_threads(_intra_op_threads);
+    options.config.set_inter_op_parallelism_threads(_inter_op_threads);
+    DARWIN_LOG_INFO("Generator:: LoadModel:: session using " + std::to_string(_intra_op_threads) + " intra-op and "
+                    + std::to_string(_inter_op_threads) + " inter-op threads (0: tensorflow's default)");
+
+    // A reloaded session is closed by the last task or scheduler thread using it
+    session.reset(tensorflow::NewSession(options), [](tensorflow::Session *s) {
+        tensorflow::Status status = s->Close();
+        if (not status.ok()) {
+            DARWIN_LOGGER;
+            DARWIN_LOG_ERROR("UserAgent:: Generator:: Unable to close Tensorflow Session");
+        }
+        delete s;
+    });
+    tensorflow::Status session_create_status = session->Create(graph_def);
 
     if (!session_create_status.ok()) {
         DARWIN_LOG_ERROR("Generator:: LoadModel:: Failed to create a new session. Status: " + session_create_status.ToString());
@@ -112,17 +178,73 @@ bool Generator::LoadModel(const std::string &model_path) {
     return true;
 }
 
+bool Generator::LoadScheduler(const rapidjson::Document &configuration) {
+    DARWIN_LOGGER;
+    unsigned int batch_threads = 0;
+    unsigned int batch_max_size = darwin::toolkit::InferenceScheduler::DEFAULT_MAX_BATCH_SIZE;
+    unsigned int batch_max_delay = darwin::toolkit::InferenceScheduler::DEFAULT_MAX_DELAY;
+
+    if (configuration.HasMember("batch_threads")) {
+        if (!configuration["batch_threads"].IsUint()) {
+            DARWIN_LOG_CRITICAL("UserAgent:: Generator:: 'batch_threads' needs to be an unsigned integer");
+            return false;
+        }
+        batch_threads = configuration["batch_threads"].GetUint();
+    }
+
+    if (configuration.HasMember("batch_max_size")) {
+        if (!configuration["batch_max_size"].IsUint() || configuration["batch_max_size"].GetUint() == 0) {
+            DARWIN_LOG_CRITICAL("UserAgent:: Generator:: 'batch_max_size' needs to be a strictly positive integer");
+            return false;
+        }
+        batch_max_size = configuration["batch_max_size"].GetUint();
+    }
+
+    if (configuration.HasMember("batch_max_delay_us")) {
+        if (!configuration["batch_max_delay_us"].IsUint()) {
+            DARWIN_LOG_CRITICAL("UserAgent:: Generator:: 'batch_max_delay_us' needs to be an unsigned integer");
+            return false;
+        }
+        batch_max_delay = configuration["batch_max_delay_us"].GetUint();
+    }
+
+    if (batch_threads == 0) {
+        DARWIN_LOG_DEBUG("UserAgent:: Generator:: batching across sessions disabled");
+        return true;
+    }
+
+    DARWIN_LOG_INFO("UserAgent:: Generator:: batching across sessions enabled with " + std::to_string(batch_threads)
+                    + " threads, up to " + std::to_string(batch_max_size) + " user agents or "
+                    + std::to_string(batch_max_delay) + "us");
+    _scheduler = std::make_shared<darwin::toolkit::InferenceScheduler>(
+        [this](const darwin::toolkit::InferenceScheduler::model_t &context, const std::vector<std::string_view> &inputs,
+               std::vector<unsigned int> &results) {
+            // the model of the sessions, so that a body is classified by a single model even during a reload
+            auto model = std::static_pointer_cast<const UserAgentTask::Model>(context);
+            UserAgentTask::Predict(*model->session, model->token_map, _bad_bot_index, inputs, results);
+        },
+        batch_max_size, std::chrono::microseconds(batch_max_delay), DARWIN_ERROR_RETURN);
+    if (not _scheduler->Start(batch_threads)) {
+        DARWIN_LOG_CRITICAL("UserAgent:: Generator:: could not start the inference scheduler");
+        return false;
+    }
+
+    std::weak_ptr<darwin::toolkit::InferenceScheduler> scheduler = _scheduler;
+    darwin::stats::AddCustomStats("inference_batching", [scheduler]() {
+        auto batching = scheduler.lock();
+        return batching ? batching->GetStats() : std::string("{}");
+    });
+    return true;
+}
+
 darwin::session_ptr_t
 Generator::CreateTask(boost::asio::local::stream_protocol::socket& socket,
                       darwin::Manager& manager) noexcept {
     return std::static_pointer_cast<darwin::Session>(
-            std::make_shared<UserAgentTask>(socket, manager, _cache, _cache_mutex, _session, _token_map, _max_tokens));
+            std::make_shared<UserAgentTask>(socket, manager, _cache, _cache_mutex, _scheduler, _model, _bad_bot_index));
 }
 
 Generator::~Generator() {
-    tensorflow::Status s = _session->Close();
-    if (not s.ok()) {
-        DARWIN_LOGGER;
-        DARWIN_LOG_ERROR("UserAgent:: Generator:: Unable to close Tensorflow Session");
-    }
+    // Sessions may still hold the scheduler, its threads must not outlive the tensorflow session
+    if (_scheduler) _scheduler->Stop();
 };
@@ -10,9 +10,12 @@
 #include <map>
 #include <string>
 
+#include "../../toolkit/InferenceScheduler.hpp"
 #include "../toolkit/rapidjson/document.h"
 #include "Session.hpp"
 #include "AGenerator.hpp"
+#include "TokenMap.hpp"
+#include "UserAgentTask.hpp"
 #include "tensorflow/core/public/session.h"
 
 class Generator: public AGenerator {
@@ -22,6 +25,7 @@ public:
 
 public:
     static constexpr int DEFAULT_MAX_TOKENS = 50;
+    static constexpr unsigned int DEFAULT_MEMO_SIZE = 1024;
 
     virtual darwin::session_ptr_t
     CreateTask(boost::asio::local::stream_protocol::socket& socket,
@@ -29,13 +33,32 @@ public:
 
 private:
     virtual bool LoadConfig(const rapidjson::Document &configuration) override final;
-    bool LoadTokenMap(const std::string &token_map_path);
-    bool LoadModel(const std::string &model_path);
+
+    /// Load the token map and the model, then make them the current ones
+    bool LoadModels();
+
+    /// Load the token map and the model again from the files of the configuration
+    virtual bool ReloadModels() override final;
+
+    bool LoadTokenMap(const std::string &token_map_path, UserAgentTokenMap &token_map);
+    /// Create a session running the model, with the threads of the configuration ('intra_op_threads', 'inter_op_threads')
+    bool LoadModel(const std::string &model_path, std::shared_ptr<tensorflow::Session> &session);
+
+    /// Start the threads classifying the user agents of all the sessions together, if enabled by 'batch_threads'
+    bool LoadScheduler(const rapidjson::Document &configuration);
 
     // The doc is quite hard to find so here is a link to the version currently used on BSD
     // (see vulture-libtensorflow)
     // https://github.com/tensorflow/tensorflow/blob/r1.13/tensorflow/core/public/session.h
-    std::shared_ptr<tensorflow::Session> _session;
-    std::map<std::string, unsigned int> _token_map;
+    std::string _token_map_path;
+    std::string _model_path;
+    std::shared_ptr<const UserAgentTask::Model> _model; // Only accessed through std::atomic_load and std::atomic_store
+    std::size_t _memo_size = DEFAULT_MEMO_SIZE;
+    unsigned int _intra_op_threads = 0; // 0 for tensorflow's default
+    unsigned int _inter_op_threads = 0; // 0 for tensorflow's default
     unsigned int _max_tokens = 50;
+    std::size_t _bad_bot_index = 0; // The column of the "Bad bot" class in the output of the model
+
+    // Uses the members above, so it must be destroyed first
+    std::shared_ptr<darwin::toolkit::InferenceScheduler> _scheduler = nullptr; // nullptr if disabled
 };
@@ -0,0 +1,172 @@
+/// \file     TokenMap.cpp
+/// \version  1.0
+/// \date     19/10/26
+/// \license  GPLv3
+/// \brief    Copyright (c) 2018 Advens. All rights reserved.
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "../../toolkit/lru_cache.hpp"
+#include "../../toolkit/xxhash.h"
+#include "../../toolkit/xxhash.hpp"
+#include "Logger.hpp"
+#include "TokenMap.hpp"
+
+namespace {
+    // Tokens of the last user agents tokenized by the thread
+    struct TokenMemo {
+        uint64_t generation = 0;
+        std::unique_ptr<boost::compute::detail::lru_cache<xxh::hash64_t, std::vector<unsigned int>>> cache;
+        std::vector<unsigned int> buffer;
+    };
+
+    std::atomic<uint64_t> next_generation{1};
+}
+
+bool UserAgentTokenMap::Compile(const std::map<std::string, unsigned int> &token_map, std::string_view separators,
+                                unsigned int max_tokens, std::size_t memo_size) {
+    DARWIN_LOGGER;
+
+    auto unknown = token_map.find("UNK");
+    if (unknown == token_map.end()) {
+        DARWIN_LOG_CRITICAL("UserAgentTokenMap:: Compile:: Invalid dictionary file: 'UNK' token not found");
+        return false;
+    }
+    _unknown = unknown->second;
+    _maxTokens = max_tokens;
+    _memoSize = memo_size;
+
+    _separators.fill(false);
+    for (unsigned char separator : separators) {
+        _separators[separator] = true;
+    }
+
+    // The trie is built with sorted children, then flattened in arrays
+    std::vector<std::map<unsigned char, uint32_t>> children(1);
+    _nodeTokens.assign(1, _unknown);
+
+    for (const auto &token : token_map) {
+        uint32_t node = ROOT;
+        bool splittable = token.first.empty();
+
+        for (unsigned char c : token.first) {
+            if (_separators[c]) {
+                splittable = true;
+                break;
+            }
+
+            auto child = children[node].find(c);
+            if (child == children[node].end()) {
+                child = children[node].emplace(c, children.size()).first;
+                children.emplace_back();
+                _nodeTokens.push_back(_unknown);
+            }
+            node = child->second;
+        }
+
+        // user agents are split on the separators, such words can't match
+        if (splittable) {
+            DARWIN_LOG_WARNING("UserAgentTokenMap:: Compile:: Ignoring token '" + token.first + "', it contains a separator");
+            continue;
+        }
+        _nodeTokens[node] = token.second;
+    }
+
+    _firstEdge.clear();
+    _edgeBytes.clear();
+    _edgeTargets.clear();
+    for (const auto &node_children : children) {
+        _firstEdge.push_back(_edgeBytes.size());
+        for (const auto &child : node_children) {
+            _edgeBytes.push_back(child.first);
+            _edgeTargets.push_back(child.second);
+        }
+    }
+    _firstEdge.push_back(_edgeBytes.size());
+
+    _rootChildren.fill(NO_NODE);
+    for (const auto &child : children[ROOT]) {
+        _rootChildren[child.first] = child.second;
+    }
+
+    _generation = next_generation++;
+    DARWIN_LOG_DEBUG("UserAgentTokenMap:: Compile:: " + std::to_string(token_map.size()) + " tokens compiled into "
+                     + std::to_string(children.size()) + " nodes");
+    return true;
+}
+
+void UserAgentTokenMap::Split(std::string_view user_agent, std::vector<unsigned int> &tokens) const {
+    uint32_t node = NO_NODE;
+    bool in_word = false;
+
+    for (unsigned char c : user_agent) {
+        if (_separators[c]) {
+            if (in_word) {
+                tokens.push_back(node == NO_NODE ? _unknown : _nodeTokens[node]);
+                in_word = false;
+            }
+            continue;
+        }
+
+        if (not in_word) {
+            in_word = true;
+            node = _rootChildren[c];
+            continue;
+        }
+
+        // once the word left the trie, it's unknown whatever its remaining bytes
+        if (node == NO_NODE) continue;
+
+        auto first = _edgeBytes.begin() + _firstEdge[node];
+        auto last = _edgeBytes.begin() + _firstEdge[node + 1];
+        auto edge = std::lower_bound(first, last, c);
+
+        node = (edge != last and *edge == c) ? _edgeTargets[edge - _edgeBytes.begin()] : NO_NODE;
+    }
+
+    if (in_word) {
+        tokens.push_back(node == NO_NODE ? _unknown : _nodeTokens[node]);
+    }
+}
+
+void UserAgentTokenMap::WriteRow(const unsigned int *tokens, std::size_t size, float *ua_tokens) const {
+    std::size_t kept = std::min<std::size_t>(size, _maxTokens);
+    std::size_t index = _maxTokens - kept;
+
+    std::fill(ua_tokens, ua_tokens + index, 0.0f);
+    std::copy(tokens + size - kept, tokens + size, ua_tokens + index);
+}
+
+void UserAgentTokenMap::Tokenize(std::string_view user_agent, float *ua_tokens) const {
+    static thread_local TokenMemo memo;
+
+    if (_memoSize == 0) {
+        memo.buffer.clear();
+        Split(user_agent, memo.buffer);
+        WriteRow(memo.buffer.data(), memo.buffer.size(), ua_tokens);
+        return;
+    }
+
+    // the memo is dropped when the dictionary changes
+    if (memo.generation != _generation or not memo.cache) {
+        memo.cache = std::make_unique<boost::compute::detail::lru_cache<xxh::hash64_t, std::vector<unsigned int>>>(_memoSize);
+        memo.generation = _generation;
+    }
+
+    xxh::hash64_t hash = xxh::xxhash<64>(user_agent.data(), user_agent.size());
+    auto tokens = memo.cache->get(hash);
+
+    if (not tokens) {
+        memo.buffer.clear();
+        Split(user_agent, memo.buffer);
+
+        // only the tokens given to the model are remembered
+        std::size_t kept = std::min<std::size_t>(memo.buffer.size(), _maxTokens);
+        tokens.emplace(memo.buffer.end() - kept, memo.buffer.end());
+        memo.cache->insert(hash, *tokens);
+    }
+
+    WriteRow(tokens->data(), tokens->size(), ua_tokens);
+}
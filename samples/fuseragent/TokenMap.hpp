@@ -0,0 +1,82 @@
+/// \file     TokenMap.hpp
+/// \version  1.0
+/// \date     19/10/26
+/// \license  GPLv3
+/// \brief    Copyright (c) 2018 Advens. All rights reserved.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+///
+/// \brief Token dictionary of the user agents, compiled into a trie to tokenize
+///        a user agent in a single pass over its bytes
+///
+/// Each thread also remembers the tokens of the last user agents it tokenized,
+/// as the same user agents are seen again and again.
+///
+class UserAgentTokenMap {
+    public:
+        UserAgentTokenMap() = default;
+        ~UserAgentTokenMap() = default;
+
+        //No copy, the memos of the threads are bound to the instance
+        UserAgentTokenMap(const UserAgentTokenMap&) = delete;
+        UserAgentTokenMap& operator=(const UserAgentTokenMap&) = delete;
+
+    public:
+        ///
+        /// \brief Compile the token dictionary
+        ///
+        /// \param token_map the token of each word, must contain the "UNK" token given to unknown words
+        /// \param separators the bytes splitting the user agents into words
+        /// \param max_tokens the number of tokens given to the model for each user agent
+        /// \param memo_size the number of user agents remembered by each thread, 0 to disable
+        /// \return true on success, false otherwise
+        ///
+        bool Compile(const std::map<std::string, unsigned int> &token_map, std::string_view separators,
+                     unsigned int max_tokens, std::size_t memo_size);
+
+        ///
+        /// \brief Tokenize a user agent into an input row of the model
+        ///
+        /// Tokens are aligned on the right, keeping the last ones when the user agent is too long.
+        ///
+        /// \param user_agent the user agent to tokenize
+        /// \param ua_tokens the input row receiving the max_tokens tokens
+        ///
+        void Tokenize(std::string_view user_agent, float *ua_tokens) const;
+
+        unsigned int GetMaxTokens() const { return _maxTokens; }
+
+    private:
+        /// Append the token of each word of the user agent to tokens
+        void Split(std::string_view user_agent, std::vector<unsigned int> &tokens) const;
+
+        /// Write the last max_tokens tokens on the right of the row, padded with zeros
+        void WriteRow(const unsigned int *tokens, std::size_t size, float *ua_tokens) const;
+
+    private:
+        static constexpr uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+        static constexpr uint32_t ROOT = 0;
+
+        // Nodes of the trie, the children of node i are the edges [_firstEdge[i], _firstEdge[i + 1]),
+        // sorted by byte. The children of the root are also indexed by byte in _rootChildren.
+        std::vector<uint32_t> _firstEdge;
+        std::vector<unsigned char> _edgeBytes;
+        std::vector<uint32_t> _edgeTargets;
+        std::vector<unsigned int> _nodeTokens; // token of the word ending on the node, _unknown if none
+        std::array<uint32_t, 256> _rootChildren;
+
+        std::array<bool, 256> _separators{};
+        unsigned int _unknown = 0;
+        unsigned int _maxTokens = 0;
+        std::size_t _memoSize = 0;
+        uint64_t _generation = 0; // identifies the compiled dictionary in the memos of the threads
+};
@@ -5,7 +5,7 @@
 /// \license  GPLv3
 /// \brief    Copyright (c) 2018 Advens. All rights reserved.
 
-#include <boost/tokenizer.hpp>
+#include <algorithm>
 #include <cmath>
 #include <protocol.h>
 #include <string.h>
@@ -26,16 +26,17 @@ UserAgentTask::UserAgentTask(boost::asio::local::stream_protocol::socket& socket
                              darwin::Manager& manager,
                              std::shared_ptr<boost::compute::detail::lru_cache<xxh::hash64_t, unsigned int>> cache,
                              std::mutex& cache_mutex,
-                             std::shared_ptr<tensorflow::Session> &session,
-                             std::map<std::string, unsigned int> &token_map,
-                             const unsigned int max_tokens)
-        : Session{"user_agent", socket, manager, cache, cache_mutex}, _session{session}, _max_tokens{max_tokens}, _token_map{token_map} {
+                             std::shared_ptr<darwin::toolkit::InferenceScheduler> scheduler,
+                             const std::shared_ptr<const Model> &current_model,
+                             const std::size_t bad_bot_index)
+        : Session{"user_agent", socket, manager, cache, cache_mutex}, _bad_bot_index{bad_bot_index},
+          _scheduler{std::move(scheduler)}, _current_model{current_model} {
     _is_cache = _cache != nullptr;
 }
 
 
 xxh::hash64_t UserAgentTask::GenerateHash() {
-    return xxh::xxhash<64>(_current_user_agent);
+    return xxh::xxhash<64>(_current_user_agent, _model->generation);
 }
 
 long UserAgentTask::GetFilterCode() noexcept {
@@ -46,135 +47,126 @@ void UserAgentTask::operator()() {
     DARWIN_LOGGER;
     bool is_log = GetOutputType() == darwin::config::output_type::LOG;
 
+    // User agents not found in the cache are classified all at once
+    std::vector<std::string_view> to_predict;
+    std::vector<std::size_t> to_predict_indexes;
+    std::vector<xxh::hash64_t> to_predict_hashes;
+    std::vector<unsigned int> predictions;
+
+    // The whole body is classified by the same model, even if it is reloaded meanwhile
+    _model = std::atomic_load(&_current_model);
+    SetStartingTime();
     for (const std::string &user_agent : _user_agents) {
-        SetStartingTime();
         // We have a generic hash function, which takes no arguments as these can be of very different types depending
         // on the nature of the filter
         // So instead, we set an attribute corresponding to the current user agent being processed, to compute the hash
         // accordingly
         _current_user_agent = user_agent;
         unsigned int certitude;
-        xxh::hash64_t hash;
+        xxh::hash64_t hash = 0;
 
         if (_is_cache) {
             hash = GenerateHash();
 
             if (GetCacheResult(hash, certitude)) {
-                if (is_log && (certitude>=_threshold)){
-                    _logs += R"({"evt_id": ")" + Evt_idToString() + R"(", "time": ")" + darwin::time_utils::GetTime() +
-                            R"(", "filter": ")" + GetFilterName() + "\", \"user_agent\": \"" + user_agent + "\", \"ua_classification\": " + std::to_string(certitude) + "}\n";
-                }
                 _certitudes.push_back(certitude);
-                DARWIN_LOG_DEBUG("UserAgentTask:: processed entry in "
-                                 + std::to_string(GetDurationMs()) + "ms, certitude: " + std::to_string(certitude));
                 continue;
             }
         }
 
-        certitude = Predict(user_agent);
-        if (is_log && (certitude>=_threshold)){
-            _logs += R"({"evt_id": ")" + Evt_idToString() + R"(", "time": ")" + darwin::time_utils::GetTime() +
-                            R"(", "filter": ")" + GetFilterName() + "\", \"user_agent\": \"" + user_agent + "\", \"ua_classification\": " + std::to_string(certitude) + "}\n";
-        }
-        _certitudes.push_back(certitude);
+        to_predict.push_back(user_agent);
+        to_predict_indexes.push_back(_certitudes.size());
+        to_predict_hashes.push_back(hash);
+        _certitudes.push_back(DARWIN_ERROR_RETURN);
+    }
 
+    if (_scheduler) {
+        // User agents are classified along with the ones of the other sessions
+        _scheduler->Predict(_model, to_predict, predictions);
+    } else {
+        Predict(*_model->session, _model->token_map, _bad_bot_index, to_predict, predictions);
+    }
+
+    for (std::size_t i = 0; i < predictions.size(); ++i) {
+        _certitudes[to_predict_indexes[i]] = predictions[i];
         if (_is_cache) {
-            SaveToCache(hash, certitude);
+            SaveToCache(to_predict_hashes[i], predictions[i]);
         }
-        DARWIN_LOG_DEBUG("UserAgentTask:: processed entry in "
-                         + std::to_string(GetDurationMs()) + "ms, certitude: " + std::to_string(certitude));
     }
 
-    _user_agents = std::vector<std::string>();
-}
+    for (std::size_t i = 0; i < _certitudes.size(); ++i) {
+        unsigned int certitude = _certitudes[i];
 
-UserAgentTask::~UserAgentTask() = default;
-
-void UserAgentTask::UserAgentTokenizer(const std::string &user_agent, std::vector<std::size_t> &ua_tokens) {
-    DARWIN_LOGGER;
-    boost::tokenizer<boost::char_separator<char>> tokens(user_agent, _separator);
-    std::map<unsigned int, unsigned int> tmp_ua_tokens;
-    std::size_t size = 0;
-
-    for (const auto& token : tokens) {
-        auto it = _token_map.find(token);
-
-        // token is not in our dictionary
-        if (it == _token_map.end()) {
-            it = _token_map.find("UNK");
-
-            // "UNK" token is not in the dictionary: this should NEVER happen!
-            if (it == _token_map.end()) {
-                DARWIN_LOG_ERROR("UserAgentTokenizer:: Error: Invalid dictionary file: 'UNK' token not found!");
-                continue;
-            }
+        if (is_log && (certitude>=_threshold)){
+            _logs += R"({"evt_id": ")" + Evt_idToString() + R"(", "time": ")" + darwin::time_utils::GetTime() +
+                            R"(", "filter": ")" + GetFilterName() + "\", \"user_agent\": \"" + _user_agents[i] + "\", \"ua_classification\": " + std::to_string(certitude) + "}\n";
         }
-
-        tmp_ua_tokens[size++] = it->second;
     }
 
-    std::size_t index = _max_tokens - size;
+    DARWIN_LOG_DEBUG("UserAgentTask:: processed " + std::to_string(_certitudes.size()) + " entries ("
+                     + std::to_string(to_predict.size()) + " classified) in " + std::to_string(GetDurationMs()) + "ms");
 
-    for (size = index; size < _max_tokens; ++size) {
-        ua_tokens[size] = tmp_ua_tokens[size - index];
-    }
+    _user_agents = std::vector<std::string>();
+    // An idle connection must not keep a reloaded model alive
+    _model = nullptr;
 }
 
-unsigned int UserAgentTask::Predict(const std::string &user_agent) {
-    DARWIN_LOGGER;
-
-    std::vector<std::size_t> ua_tokens(_max_tokens, 0);
-    UserAgentTokenizer(user_agent, ua_tokens);
+UserAgentTask::~UserAgentTask() = default;
 
-    tensorflow::Tensor input_tensor(tensorflow::DT_FLOAT, tensorflow::TensorShape({1, _max_tokens}));
-    auto input_tensor_mapped = input_tensor.tensor<float, 2>();
-    std::size_t index = 0;
+void UserAgentTask::Predict(tensorflow::Session &session, const UserAgentTokenMap &token_map, std::size_t bad_bot_index,
+                            const std::vector<std::string_view> &user_agents, std::vector<unsigned int> &certitudes) {
+    DARWIN_LOGGER;
+    unsigned int max_tokens = token_map.GetMaxTokens();
+    certitudes.assign(user_agents.size(), DARWIN_ERROR_RETURN);
 
-    for (const auto &ua_token : ua_tokens) {
-        input_tensor_mapped(index++) = ua_token;
+    if (user_agents.empty()) {
+        return;
     }
 
-    std::vector<tensorflow::Tensor> output_tensors;
+    for (std::size_t first = 0; first < user_agents.size(); first += MAX_BATCH_SIZE) {
+        std::size_t count = std::min(MAX_BATCH_SIZE, user_agents.size() - first);
 
-    try {
-        tensorflow::Status run_status = _session->Run({{"embedding_4_input", input_tensor}},
-                                                    {"output_node0"},
-                                                    {},
-                                                    &output_tensors);
-
-        if (!run_status.ok()) {
-            DARWIN_LOG_ERROR("Predict:: Error: Running model failed: " + run_status.ToString());
-            return DARWIN_ERROR_RETURN;
-        }
-    }
-    catch(const std::exception& e)
-    {
-        DARWIN_LOG_ERROR("Predict:: Error: Running model exception: " + std::string(e.what()));
-        return DARWIN_ERROR_RETURN;
-    }
+        tensorflow::Tensor input_tensor(tensorflow::DT_FLOAT,
+                                        tensorflow::TensorShape({static_cast<int64_t>(count), max_tokens}));
+        // Tokens are written directly in the buffer of the tensor, one row per user agent
+        float *input_tensor_mapped = input_tensor.flat<float>().data();
 
+        for (std::size_t i = 0; i < count; ++i) {
+            token_map.Tokenize(user_agents[first + i], input_tensor_mapped + i * max_tokens);
+        }
 
-    std::map<std::string, float> result;
-    index = 0;
+        std::vector<tensorflow::Tensor> output_tensors;
 
-    for (const auto &ua_type : USER_AGENT_CLASSES) {
-        result[ua_type] = output_tensors[0].tensor<float, 2>()(index++);
-    }
+        try {
+            tensorflow::Status run_status = session.Run({{"embedding_4_input", input_tensor}},
+                                                        {"output_node0"},
+                                                        {},
+                                                        &output_tensors);
 
-    DARWIN_LOG_DEBUG("Predict:: Results:");
-
-    unsigned int certitude = 0;
+            if (!run_status.ok()) {
+                DARWIN_LOG_ERROR("UserAgentTask::Predict:: Error: Running model failed: " + run_status.ToString());
+                return;
+            }
+        }
+        catch(const std::exception& e)
+        {
+            DARWIN_LOG_ERROR("UserAgentTask::Predict:: Error: Running model exception: " + std::string(e.what()));
+            return;
+        }
 
-    for (auto it = result.begin(); it != result.end(); ++it) {
-        DARWIN_LOG_DEBUG("Predict:: '" + it->first + "': " + std::to_string(it->second));
+        // One row of class scores per user agent
+        const tensorflow::Tensor &output = output_tensors[0];
+        if (output.dims() != 2 || static_cast<std::size_t>(output.dim_size(0)) != count ||
+            static_cast<std::size_t>(output.dim_size(1)) <= bad_bot_index) {
+            DARWIN_LOG_ERROR("UserAgentTask::Predict:: Error: Unexpected output shape of the model");
+            return;
+        }
 
-        if (it->first == "Bad bot") {
-            certitude = (unsigned int)round((double)it->second * 100);
-            break;
+        auto scores = output_tensors[0].matrix<float>();
+        for (std::size_t i = 0; i < count; ++i) {
+            certitudes[first + i] = (unsigned int)round((double)scores(i, bad_bot_index) * 100);
         }
     }
-
-    return certitude;
 }
 
 bool UserAgentTask::ParseBody() {
@@ -7,14 +7,15 @@
 
 #pragma once
 
-#include <boost/token_functions.hpp>
-#include <map>
+#include <string_view>
 
+#include "../../toolkit/InferenceScheduler.hpp"
 #include "../../toolkit/lru_cache.hpp"
 #include "../../toolkit/xxhash.h"
 #include "../../toolkit/xxhash.hpp"
 #include "protocol.h"
 #include "Session.hpp"
+#include "TokenMap.hpp"
 #include "tensorflow/core/public/session.h"
 
 #define DARWIN_FILTER_USER_AGENT 0x75736572
@@ -25,18 +26,37 @@
 
 class UserAgentTask : public darwin::Session {
 public:
+    /// A tensorflow session with the token map it was trained with, replaced as a whole when the models are reloaded
+    struct Model {
+        std::shared_ptr<tensorflow::Session> session; // Closed when the last user releases the model
+        UserAgentTokenMap token_map;
+        uint64_t generation = 0; // Seeds the cache keys, so that the results of the previous models are not reused
+    };
+
     explicit UserAgentTask(boost::asio::local::stream_protocol::socket& socket,
                            darwin::Manager& manager,
                            std::shared_ptr<boost::compute::detail::lru_cache<xxh::hash64_t, unsigned int>> cache,
                            std::mutex& cache_mutex,
-                           std::shared_ptr<tensorflow::Session> &session,
-                           std::map<std::string, unsigned int> &token_map, const unsigned int max_tokens = 50);
+                           std::shared_ptr<darwin::toolkit::InferenceScheduler> scheduler,
+                           const std::shared_ptr<const Model> &current_model, const std::size_t bad_bot_index = 4);
     ~UserAgentTask() override;
 
 public:
     // You need to override the functor to compile and be executed by the thread
     void operator()() override;
     static const std::vector<std::string> USER_AGENT_CLASSES;
+    static constexpr const char *TOKEN_SEPARATORS = " ());,:-~?!{}/[]"; // Bytes splitting the user agents into words
+
+    /// Classify user agents, with one run of the model per batch.
+    /// Also called by the inference scheduler threads.
+    ///
+    /// \param session The tensorflow session to use.
+    /// \param token_map The token map to help classifying user agents.
+    /// \param bad_bot_index The column of the "Bad bot" class in the output of the model.
+    /// \param user_agents The user agents to classify.
+    /// \param certitudes Will contain the score of each user agent, DARWIN_ERROR_RETURN on error.
+    static void Predict(tensorflow::Session &session, const UserAgentTokenMap &token_map, std::size_t bad_bot_index,
+                        const std::vector<std::string_view> &user_agents, std::vector<unsigned int> &certitudes);
 
 protected:
     /// Get the result from the cache
@@ -45,26 +65,18 @@ protected:
     long GetFilterCode() noexcept override;
 
 private:
-    /// Classify the parsed request.
-    ///
-    /// \return true on success, false otherwise.
-    unsigned int Predict(const std::string &user_agent);
-
     /// Parse the body received.
     ///
     /// \return true on success, false otherwise.
     bool ParseBody() override;
 
-    /// Tokenize the user agent to be classified.
-    ///
-    /// \param ua_tokens The user agent tokens to be used.
-    void UserAgentTokenizer(const std::string &user_agent, std::vector<std::size_t> &ua_tokens);
-
 private:
-    unsigned int _max_tokens = 50;
-    boost::char_separator<char> _separator {" ());,:-~?!{}/[]"};
-    std::shared_ptr<tensorflow::Session> _session = nullptr; // The tensorflow session to use
-    std::map<std::string, unsigned int> _token_map; // The token map to help classifying user agents
+    static constexpr std::size_t MAX_BATCH_SIZE = 1024; // User agents classified by a single run of the model
+
+    std::size_t _bad_bot_index = 4; // The column of the "Bad bot" class in the output of the model
+    std::shared_ptr<darwin::toolkit::InferenceScheduler> _scheduler; // nullptr if batching across sessions is disabled
+    const std::shared_ptr<const Model> &_current_model; // Swapped atomically by the generator on reload
+    std::shared_ptr<const Model> _model; // The model used for the current body
     std::string _current_user_agent; // The user agent to check
     std::vector<std::string> _user_agents;
 };
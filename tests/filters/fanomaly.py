@@ -1,10 +1,15 @@
 import logging
 import os
+import random
+import time
 
 from tools.filter import Filter
 from tools.output import print_result
 from darwin import DarwinApi
 
+SCALE_SIZES = [10000, 100000, 1000000]
+SCALE_ANOMALIES = 10
+
 class Anomaly(Filter):
     def __init__(self):
         super().__init__(filter_name="anomaly")
@@ -25,7 +30,8 @@ def run():
         one_set_data_test,
         multiple_set_data_test,
         negative_value_in_data_test,
-        badly_formatted_ip_test
+        badly_formatted_ip_test,
+        clustering_scale_test
     ]
 
     for i in tests:
@@ -356,3 +362,53 @@ def badly_formatted_ip_test():
             ],
         ],
         [101,101,101,101],4)
+
+
+def clustering_scale_test():
+    """
+    Sends synthetic sets of growing sizes, made of a dense cluster of normal hosts and a few scanners,
+    checks the anomalies are found and prints the time taken for each size
+    """
+    anomaly_filter = Anomaly()
+    # Debug logs would be most of the time spent
+    anomaly_filter.log_level = "ERROR"
+    anomaly_filter.configure()
+
+    if not anomaly_filter.start():
+        logging.error("Anomaly clustering_scale_test Test : filter did not start")
+        return False
+
+    darwin_api = DarwinApi(socket_path=anomaly_filter.socket,
+                           socket_type="unix",
+                           timeout=120)
+    generator = random.Random(42)
+    ret = True
+    for size in SCALE_SIZES:
+        data = [["10.{}.{}.{}".format(i >> 16 & 255, i >> 8 & 255, i & 255)]
+                + [generator.randint(0, 20) for _ in range(5)]
+                for i in range(size - SCALE_ANOMALIES)]
+        data += [["192.168.0.{}".format(i)] + [generator.randint(5000, 10000) for _ in range(5)]
+                 for i in range(SCALE_ANOMALIES)]
+
+        start = time.perf_counter()
+        results = darwin_api.bulk_call(
+            [data],
+            filter_code="ANOMALY",
+            response_type="back",
+        )
+        elapsed = time.perf_counter() - start
+
+        certitudes = results.get('certitude_list')
+        if certitudes != [100]:
+            ret = False
+            logging.error("Anomaly clustering_scale_test Test : Unexpected certitude of {} instead of [100] for {} points"
+                          .format(certitudes, size))
+        print("[{}: {:.2f}s] ".format(size, elapsed), end='', flush=True)
+
+    darwin_api.close()
+
+    anomaly_filter.clean_files()
+    if not anomaly_filter.stop():
+        ret = False
+
+    return ret
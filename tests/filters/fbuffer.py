@@ -2,7 +2,10 @@ import json
 import os
 import uuid
 import redis
+import socket
+import struct
 import logging
+import threading
 from time import sleep, time
 
 from tools.redis_utils import RedisServer
@@ -16,6 +19,8 @@ REDIS_SOCKET = "/tmp/redis.sock"
 FILTER_CODE = 0x62756672
 REDIS_ALERT_LIST = "darwin_buffer_test_alert"
 REDIS_ALERT_CHANNEL = "darwin.buffer.test.alert"
+# darwin_filter_packet_t: type, response, filter_code, body_size, evt_id, certitude_size, certitude_list[1] (+ padding)
+DARWIN_HEADER = struct.Struct("<iiqQ16sQI4x")
 
 class Buffer(Filter):
     def __init__(self):
@@ -101,6 +106,7 @@ def run():
         thread_working_test,
         fanomaly_connector_and_send_test,
         fsofa_connector_test,
+        refused_chunk_reinserted_test,
         sum_test_one_value,
         sum_test_multiple_values,
         sum_test_not_enough,
@@ -620,6 +626,140 @@ def fsofa_connector_test():
     )
 
 
+class RefusingOutputFilter(threading.Thread):
+    """
+    Fake output filter answering to the chunks sent by the Buffer,
+    the first one is refused with an error like Session::SendErrorResponse, the others are acknowledged.
+    """
+    def __init__(self, socket_path):
+        super().__init__(daemon=True)
+        self.socket_path = socket_path
+        self.chunks = list()
+        try:
+            os.unlink(socket_path)
+        except FileNotFoundError:
+            pass
+        self.server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.server.bind(socket_path)
+        self.server.listen(1)
+        self.server.settimeout(1)
+        self.running = True
+
+    def read(self, connection, size):
+        data = b''
+        while len(data) < size:
+            received = connection.recv(size - len(data))
+            if not received:
+                raise ConnectionError("connection closed by the Buffer")
+            data += received
+        return data
+
+    def answer(self, connection, evt_id, body, certitude_size):
+        header = DARWIN_HEADER.pack(0, 0, 0, len(body), evt_id, certitude_size, 0)
+        connection.sendall(header + body)
+
+    def run(self):
+        while self.running:
+            try:
+                connection, _ = self.server.accept()
+            except socket.timeout:
+                continue
+            with connection:
+                try:
+                    while self.running:
+                        _, _, _, body_size, evt_id, _, _ = DARWIN_HEADER.unpack(self.read(connection, DARWIN_HEADER.size))
+                        self.chunks.append(self.read(connection, body_size))
+                        if len(self.chunks) == 1:
+                            self.answer(connection, evt_id, b'{"error":"Refused by the test", "error_code":400}', 0)
+                        else:
+                            self.answer(connection, evt_id, b'', 1)
+                except ConnectionError:
+                    pass
+
+    def stop(self):
+        self.running = False
+        self.join()
+        self.server.close()
+        os.unlink(self.socket_path)
+
+def refused_chunk_reinserted_test():
+    ret = True
+
+    config_buffer = '{{' \
+                        '"redis_socket_path": "{redis_socket}",' \
+                        '"input_format": [' \
+                            '{{"name": "ip", "type": "string"}},' \
+                            '{{"name": "hostname", "type": "string"}},' \
+                            '{{"name": "os", "type": "string"}},' \
+                            '{{"name": "proto", "type": "string"}},' \
+                            '{{"name": "port", "type": "string"}}' \
+                        '],' \
+                        '"outputs": [' \
+                            '{{' \
+                                '"filter_type": "fsofa",' \
+                                '"filter_socket_path": "/tmp/buffer_sofa.sock",' \
+                                '"interval": 10,' \
+                                '"required_log_lines": 3,' \
+                                '"chunk_size": 2,' \
+                                '"redis_lists": [{{' \
+                                    '"source": "",' \
+                                    '"name": "darwin_buffer_sofa"' \
+                                '}}]' \
+                            '}}' \
+                        ']' \
+                    '}}'.format(redis_socket=REDIS_SOCKET)
+
+    # CONFIG
+    buffer_filter = Buffer()
+    buffer_filter.configure(config_buffer)
+
+    output_filter = RefusingOutputFilter("/tmp/buffer_sofa.sock")
+    output_filter.start()
+
+    # START FILTER
+    if not buffer_filter.valgrind_start():
+        output_filter.stop()
+        return False
+
+    # SEND TEST
+    darwin_api = DarwinApi(socket_path=buffer_filter.socket,
+                           socket_type="unix", )
+
+    darwin_api.bulk_call(
+        [
+            ["", "ip_1", "hostname", "os", "proto", "port"],
+            ["", "ip_2", "hostname", "os", "proto", "port"],
+            ["", "ip_3", "hostname", "os", "proto", "port"]
+        ],
+        response_type="back",
+    )
+
+    # We wait for the thread to activate
+    sleep(15)
+
+    # The 3 logs are sent in 2 chunks, only the logs of the refused one must be back in Redis
+    with buffer_filter.redis.connect() as redis_connection:
+        redis_data = redis_connection.smembers("darwin_buffer_sofa")
+
+    if len(output_filter.chunks) != 2:
+        logging.error("refused_chunk_reinserted_test: Expected 2 chunks sent but got {}".format(len(output_filter.chunks)))
+        ret = False
+    elif len(redis_data) != 2 or not all(log in output_filter.chunks[0] for log in redis_data):
+        logging.error("refused_chunk_reinserted_test: Expected the logs of the refused chunk {} in Redis but got {}".format(
+            output_filter.chunks[0], redis_data))
+        ret = False
+
+    # CLEAN
+    darwin_api.close()
+
+    if not buffer_filter.valgrind_stop():
+        ret = False
+
+    output_filter.stop()
+
+    return ret
+
+
 def sum_tests(test_name, values=[], required_log_lines=0, expected_alert=1, init_data=None, init_data_type="key", should_start=True):
     ret = True
     config_test =   '{{' \
@@ -2,6 +2,8 @@ import json
 import logging
 import os
 import math
+import time
+from signal import SIGHUP
 from darwin import DarwinApi, darwinexceptions
 
 from tools.filter import Filter
@@ -16,9 +18,13 @@ TOKEN_MAP_PATH = f"{TEST_FILTERS_FOLDER_PATH}/data/dga_tokens.csv"
 TMP_TOKEN_MAP_PATH = f"{TOKEN_MAP_PATH}.tmp"
 MAX_TOKENS = 80
 
+THROUGHPUT_BATCH_SIZES = [1, 32, 256, 1024]
+THROUGHPUT_MIN_DOMAINS = 2048
+
 class DGA(Filter):
-    def __init__(self, tokens=None):
+    def __init__(self, tokens=None, options=None):
         super().__init__(filter_name="dga")
+        self.options = options if options is not None else {}
         if tokens is None:
             self.token_map_path = TOKEN_MAP_PATH
         else:
@@ -26,12 +32,13 @@ class DGA(Filter):
             self.init_tokens(tokens)
 
     def configure(self):
-        content = '{{\n' \
-                  '"model_path": "{model_path}",\n' \
-                  '"token_map_path": "{token_map_path}",\n' \
-                  '"max_tokens": {max_tokens}\n' \
-                  '}}'.format(model_path=MODEL_PATH, token_map_path=self.token_map_path, max_tokens=MAX_TOKENS)
-        super(DGA, self).configure(content)
+        config = {
+            "model_path": MODEL_PATH,
+            "token_map_path": self.token_map_path,
+            "max_tokens": MAX_TOKENS,
+        }
+        config.update(self.options)
+        super(DGA, self).configure(json.dumps(config))
 
     def init_tokens(self, data):
         with open(self.token_map_path, mode='w') as file:
@@ -51,6 +58,10 @@ def run():
     tests = [
         passing_tests_bulk,
         passing_tests_singles,
+        batch_throughput_test,
+        interpreter_options_test,
+        reload_models_test,
+        reload_models_batch_test,
         good_format_tokens_test,
         bad_format_tokens_test,
     ]
@@ -135,6 +146,238 @@ def passing_tests_singles():
     return ret
 
 
+def batch_throughput_test():
+    """
+    Sends the test domains in requests of growing sizes,
+    checks certitudes don't depend on the batch and prints the domains/s for each size
+    """
+    dga_filter = DGA()
+    # Debug logs would be most of the time spent
+    dga_filter.log_level = "ERROR"
+    dga_filter.configure()
+
+    if not os.path.exists(PASSING_TESTS_DATA):
+        logging.error(f"batch_throughput_test Test : no data to test, file {PASSING_TESTS_DATA} does not exist")
+        return False
+
+    with open(PASSING_TESTS_DATA, 'r') as f:
+        data = json.load(f)
+
+    domains = list(data.keys())
+    expected_values = list(data.values())
+
+    if not dga_filter.start():
+        logging.error("DGA batch_throughput_test Test : filter did not start")
+        return False
+
+    darwin_api = DarwinApi(socket_path=dga_filter.socket,
+                           socket_type="unix",
+                           timeout=40)
+    ret = True
+    for batch_size in THROUGHPUT_BATCH_SIZES:
+        sent = 0
+        start = time.perf_counter()
+        while sent < max(batch_size, THROUGHPUT_MIN_DOMAINS):
+            indexes = [(sent + i) % len(domains) for i in range(batch_size)]
+            try:
+                results = darwin_api.bulk_call(
+                    [[domains[i]] for i in indexes],
+                    response_type="back"
+                )
+            except darwinexceptions.DarwinTimeoutError as e:
+                logging.error(f"DGA batch_throughput_test Test : Timeout error with batches of {batch_size}", exc_info=e)
+                darwin_api.close()
+                return False
+
+            certitudes = results.get('certitude_list', [])
+            if len(certitudes) != batch_size:
+                logging.error(f"DGA batch_throughput_test Test : Unexpected certitude size of {len(certitudes)} instead of {batch_size}")
+                darwin_api.close()
+                return False
+
+            for result, i in zip(certitudes, indexes):
+                expected_percent = expected_values[i]*100
+                if not math.isclose(result, expected_percent, rel_tol=0.01, abs_tol=1):
+                    ret = False
+                    logging.error(f"DGA batch_throughput_test Test : Unexpected certitude of {result} instead of {expected_percent} "
+                                  f"for {domains[i]} in a batch of {batch_size}")
+            sent += batch_size
+
+        elapsed = time.perf_counter() - start
+        print(f"[{batch_size}: {sent / elapsed:.0f} domains/s] ", end='', flush=True)
+
+    darwin_api.close()
+
+    if not dga_filter.stop():
+        ret = False
+
+    return ret
+
+
+def interpreter_options_test():
+    """
+    Runs the model with multi-threaded interpreters, XNNPACK and batching threads,
+    checks the certitudes don't depend on them
+    """
+    dga_filter = DGA(options={"interpreter_threads": 2, "xnnpack": True, "batch_threads": 2})
+    dga_filter.log_level = "ERROR"
+    dga_filter.configure()
+
+    if not os.path.exists(PASSING_TESTS_DATA):
+        logging.error(f"interpreter_options_test Test : no data to test, file {PASSING_TESTS_DATA} does not exist")
+        return False
+
+    with open(PASSING_TESTS_DATA, 'r') as f:
+        data = json.load(f)
+
+    if not dga_filter.start():
+        logging.error("DGA interpreter_options_test Test : filter did not start")
+        return False
+
+    darwin_api = DarwinApi(socket_path=dga_filter.socket,
+                           socket_type="unix",
+                           timeout=40)
+    ret = True
+    try:
+        results = darwin_api.bulk_call(
+            [[domain] for domain in data.keys()],
+            response_type="back"
+        )
+    except darwinexceptions.DarwinTimeoutError as e:
+        logging.error("DGA interpreter_options_test Test : Timeout error", exc_info=e)
+        darwin_api.close()
+        dga_filter.stop()
+        return False
+
+    certitudes = results.get('certitude_list', [])
+    expected_values = list(data.values())
+    if len(certitudes) != len(expected_values):
+        ret = False
+        logging.error(f"DGA interpreter_options_test Test : Unexpected certitude size of {len(certitudes)} instead of {len(expected_values)}")
+
+    for result, expected in zip(certitudes, expected_values):
+        expected_percent = expected*100
+        if not math.isclose(result, expected_percent, rel_tol=0.01, abs_tol=1):
+            ret = False
+            logging.error(f"DGA interpreter_options_test Test : Unexpected certitude of {result} instead of {expected_percent}")
+
+    darwin_api.close()
+
+    if not dga_filter.stop():
+        ret = False
+
+    return ret
+
+
+def wait_reload(dga_filter, expected_log, timeout=10):
+    """
+    Waits for the filter to log the end of a reload
+    """
+    end = time.time() + timeout
+    while time.time() < end:
+        if dga_filter.check_line_in_filter_log(expected_log, keep_init_pos=False):
+            return True
+        time.sleep(0.1)
+    return False
+
+def reload_models_batch_test():
+    """
+    Reloads the token map with the domains classified by the batching threads
+    """
+    return reload_models_test(options={"batch_threads": 2})
+
+def reload_models_test(options=None):
+    """
+    Reloads the token map on SIGHUP while the filter runs, with a cache:
+    the certitudes follow the token map loaded, and a failed reload keeps the current one
+    """
+    if not os.path.exists(PASSING_TESTS_DATA) or not os.path.exists(TOKEN_MAP_PATH):
+        logging.error("DGA reload_models_test Test : no data to test")
+        return False
+
+    with open(PASSING_TESTS_DATA, 'r') as f:
+        data = json.load(f)
+    with open(TOKEN_MAP_PATH, 'r') as f:
+        tokens = f.read().splitlines()
+
+    domains = [[domain] for domain in data.keys()]
+    expected_values = [expected * 100 for expected in data.values()]
+    # Every character gets the same token, the model can't tell the domains apart anymore
+    flat_tokens = ["{},1".format(token.split(',')[0]) for token in tokens]
+
+    dga_filter = DGA(tokens=tokens, options=options)
+    dga_filter.cache_size = 10000
+    dga_filter.configure()
+
+    if not dga_filter.start():
+        logging.error("DGA reload_models_test Test : filter did not start")
+        return False
+
+    darwin_api = DarwinApi(socket_path=dga_filter.socket,
+                           socket_type="unix",
+                           timeout=40)
+
+    def get_certitudes():
+        results = darwin_api.bulk_call(domains, response_type="back")
+        return results.get('certitude_list', [])
+
+    def certitudes_match(expected_certitudes=expected_values):
+        certitudes = get_certitudes()
+        return len(certitudes) == len(expected_certitudes) and all(
+            math.isclose(result, expected, rel_tol=0.01, abs_tol=1)
+            for result, expected in zip(certitudes, expected_certitudes))
+
+    ret = True
+    try:
+        # Fills the cache with the results of the first token map
+        if not certitudes_match():
+            ret = False
+            logging.error("DGA reload_models_test Test : Unexpected certitudes before the reload")
+
+        dga_filter.init_tokens(flat_tokens)
+        dga_filter.process.send_signal(SIGHUP)
+        if not wait_reload(dga_filter, "AGenerator:: Models reloaded"):
+            ret = False
+            logging.error("DGA reload_models_test Test : The models were not reloaded")
+        flat_certitudes = get_certitudes()
+        if certitudes_match():
+            ret = False
+            logging.error("DGA reload_models_test Test : Certitudes unchanged by the new token map")
+
+        # A token map which can't be loaded keeps the current one
+        os.remove(TMP_TOKEN_MAP_PATH)
+        dga_filter.process.send_signal(SIGHUP)
+        if not wait_reload(dga_filter, "AGenerator:: Models not reloaded"):
+            ret = False
+            logging.error("DGA reload_models_test Test : The failed reload was not reported")
+        elif not certitudes_match(flat_certitudes):
+            ret = False
+            logging.error("DGA reload_models_test Test : Certitudes changed by the failed reload")
+
+        dga_filter.init_tokens(tokens)
+        dga_filter.process.send_signal(SIGHUP)
+        if not wait_reload(dga_filter, "AGenerator:: Models reloaded"):
+            ret = False
+            logging.error("DGA reload_models_test Test : The models were not reloaded")
+        elif not certitudes_match():
+            ret = False
+            logging.error("DGA reload_models_test Test : Unexpected certitudes after reloading the first token map")
+    except darwinexceptions.DarwinTimeoutError as e:
+        logging.error("DGA reload_models_test Test : Timeout error", exc_info=e)
+        ret = False
+
+    darwin_api.close()
+
+    if not dga_filter.check_run():
+        ret = False
+        logging.error("DGA reload_models_test Test : filter stopped while reloading")
+
+    if not dga_filter.stop():
+        ret = False
+
+    return ret
+
+
 def good_format_tokens_test():
     ret = True
 
@@ -0,0 +1,201 @@
+import json
+import logging
+import os
+import socket
+import struct
+import threading
+import uuid
+from time import perf_counter
+
+from tools.filter import Filter
+from tools.output import print_result
+
+FILTER_CODE = 0x79617261
+RULE_FILE = "/tmp/inspection_rules.yara"
+RULE = 'rule inspection_marker { strings: $marker = "inspection_marker" condition: $marker }'
+# darwin_filter_packet_t: type, response, filter_code, body_size, evt_id, certitude_size, certitude_list[1] (+ padding)
+DARWIN_HEADER = struct.Struct("<iiqQ16sQI4x")
+CERTITUDES_OFFSET = 48
+DARWIN_ERROR_RETURN = 101
+
+NB_FLOWS = 4096
+PACKETS_PER_REQUEST = 512
+THREADS = [1, 2, 4, 8, 16, 32]
+
+
+class Inspection(Filter):
+    def __init__(self, nb_threads=1):
+        super().__init__(filter_name="content_inspection", nb_threads=nb_threads)
+
+    def configure(self, lanes):
+        with open(RULE_FILE, mode="w") as file:
+            file.write(RULE)
+
+        content = '{{\n' \
+                  '"yaraRuleFile": "{rule_file}",\n' \
+                  '"yaraScanType": "stream",\n' \
+                  '"maxConnections": {max_connections},\n' \
+                  '"processingLanes": {lanes}\n' \
+                  '}}'.format(rule_file=RULE_FILE, max_connections=NB_FLOWS * 2, lanes=lanes)
+        super().configure(content)
+
+    def clean_files(self):
+        super().clean_files()
+
+        try:
+            os.remove(RULE_FILE)
+        except:
+            pass
+
+
+def run():
+    tests = [
+        flow_table_scaling_test,
+    ]
+
+    for i in tests:
+        print_result("content_inspection: " + i.__name__, i)
+
+
+def impcap_entry(packet_id, flow, from_client, flags, seq, ack, payload=b''):
+    src_port, dst_port = (40000 + flow % 20000, 80) if from_client else (80, 40000 + flow % 20000)
+    src_ip = "10.{}.{}.{}".format((flow >> 16) & 0xFF, (flow >> 8) & 0xFF, flow & 0xFF)
+    ips = (src_ip, "192.168.0.1") if from_client else ("192.168.0.1", src_ip)
+
+    metadata = json.dumps({
+        "ID": packet_id,
+        "ETH_type": 2048,
+        "net_src_ip": ips[0],
+        "net_dst_ip": ips[1],
+        "IP_ihl": 5,
+        "net_ttl": 64,
+        "IP_proto": 6,
+        "net_src_port": src_port,
+        "net_dst_port": dst_port,
+        "TCP_seq_number": seq,
+        "TCP_ack_number": ack,
+        "net_flags": flags,
+        "net_bytes_data": len(payload)
+    })
+    data = json.dumps({"length": len(payload) * 2, "content": payload.hex()}) if payload else "{}"
+    # impcap objects are sent unescaped
+    return '["{}", "{}"]'.format(metadata, data)
+
+
+def flow_packets(flow):
+    """
+    Handshake then the marker split between 2 segments, only a stream scan can match the second one
+    """
+    client_seq, server_seq = 1000, 5000
+    first, second = b'GET /inspection_', b'marker HTTP/1.1\r\n\r\n'
+    return [
+        (True, "S", client_seq, 0, b''),
+        (False, "SA", server_seq, client_seq + 1, b''),
+        (True, "A", client_seq + 1, server_seq + 1, b''),
+        (True, "PA", client_seq + 1, server_seq + 1, first),
+        (True, "PA", client_seq + 1 + len(first), server_seq + 1, second),
+    ]
+
+
+def build_requests(flows):
+    """
+    Packets of the flows are interleaved, so each request mixes many flows while keeping the order inside a flow
+    """
+    entries = []
+    packets = {flow: flow_packets(flow) for flow in flows}
+    for index in range(len(flow_packets(0))):
+        for flow in flows:
+            from_client, flags, seq, ack, payload = packets[flow][index]
+            entries.append(impcap_entry(len(entries), flow, from_client, flags, seq, ack, payload))
+
+    return ['[' + ', '.join(entries[i:i + PACKETS_PER_REQUEST]) + ']'
+            for i in range(0, len(entries), PACKETS_PER_REQUEST)]
+
+
+def read_exactly(connection, size):
+    data = b''
+    while len(data) < size:
+        received = connection.recv(size - len(data))
+        if not received:
+            raise ConnectionError("connection closed by the filter")
+        data += received
+    return data
+
+
+def send_requests(socket_path, requests, results, index):
+    certitudes = []
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as connection:
+        connection.connect(socket_path)
+        for body in requests:
+            body = body.encode()
+            connection.sendall(DARWIN_HEADER.pack(0, 1, FILTER_CODE, len(body), uuid.uuid4().bytes, 0, 0) + body)
+
+            header = read_exactly(connection, DARWIN_HEADER.size)
+            _, _, _, body_size, _, certitude_size, _ = DARWIN_HEADER.unpack(header)
+            packet = header + read_exactly(connection, max(certitude_size - 1, 0) * 4 + body_size)
+            certitudes.extend(struct.unpack_from("<{}I".format(certitude_size), packet, CERTITUDES_OFFSET))
+    results[index] = certitudes
+
+
+def flow_table_scaling_test():
+    """
+    Sends the same flows with 1 to 32 processing threads, prints the packet rate for each,
+    and checks the results don't depend on the number of threads
+    """
+    ret = True
+    reference = None
+
+    for nb_threads in THREADS:
+        inspection_filter = Inspection(nb_threads=nb_threads)
+        inspection_filter.configure(lanes=nb_threads)
+
+        if not inspection_filter.valgrind_start():
+            logging.error("flow_table_scaling_test: filter did not start with {} threads".format(nb_threads))
+            return False
+
+        # one client per thread, each with its own flows so their packets stay in order
+        clients = [build_requests(range(client, NB_FLOWS, nb_threads)) for client in range(nb_threads)]
+        results = [None] * nb_threads
+        senders = [threading.Thread(target=send_requests, args=(inspection_filter.socket, requests, results, client))
+                   for client, requests in enumerate(clients)]
+
+        start = perf_counter()
+        for sender in senders:
+            sender.start()
+        for sender in senders:
+            sender.join()
+        elapsed = perf_counter() - start
+
+        if not inspection_filter.valgrind_stop():
+            ret = False
+
+        if any(result is None for result in results):
+            logging.error("flow_table_scaling_test: a client got no answer with {} threads".format(nb_threads))
+            return False
+
+        # the certitudes of a client only depend on its flows, compare them flow by flow
+        matches = {}
+        packets_per_flow = len(flow_packets(0))
+        for client, certitudes in enumerate(results):
+            flows = list(range(client, NB_FLOWS, nb_threads))
+            for index, certitude in enumerate(certitudes):
+                matches[(flows[index % len(flows)], index // len(flows))] = certitude
+
+        if len(matches) != NB_FLOWS * packets_per_flow:
+            logging.error("flow_table_scaling_test: expected {} certitudes but got {} with {} threads".format(
+                NB_FLOWS * packets_per_flow, len(matches), nb_threads))
+            ret = False
+        elif any(certitude == DARWIN_ERROR_RETURN for certitude in matches.values()):
+            logging.error("flow_table_scaling_test: some packets could not be processed with {} threads".format(nb_threads))
+            ret = False
+        elif reference is None:
+            reference = matches
+        elif matches != reference:
+            differences = sum(1 for key in reference if reference[key] != matches.get(key))
+            logging.error("flow_table_scaling_test: {} certitudes differ from a single thread with {} threads".format(
+                differences, nb_threads))
+            ret = False
+
+        print(f"[{nb_threads}: {NB_FLOWS * packets_per_flow / elapsed:.0f} packets/s] ", end='', flush=True)
+
+    return ret
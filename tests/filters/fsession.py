@@ -52,7 +52,11 @@ def run():
         no_timeout_no_refresh,
         timeout_but_no_change_to_ttl,
         set_new_ttl,
-        timeout_with_change_to_ttl
+        timeout_with_change_to_ttl,
+        near_cache_hit,
+        near_cache_invalidation,
+        near_cache_key_expiry,
+        near_cache_hit_resets_expiration
     ]
 
     for i in tests:
@@ -600,3 +604,136 @@ def timeout_with_change_to_ttl():
         return False
 
     return True
+
+
+
+NEAR_CACHE_TOKEN = "1234567890123456789012345678901234567890123456789012345678901234"
+
+def _near_cache_lookups(test_name, steps, populate):
+    """
+    Starts the filter with a near cache outliving the tests, then does each step: (action on redis, expected certitude)
+    """
+    session_filter = Session()
+    session_filter.configure('{{\n'
+                                '"redis_socket_path": "{redis_socket}",\n'
+                                '"near_cache_size": 100,\n'
+                                '"near_cache_ttl": 60\n'
+                             '}}'.format(redis_socket=REDIS_SOCKET))
+
+    redis = session_filter.redis.connect()
+    if not redis:
+        logging.error(f"{test_name}: could not get a valid connection to the temporary Redis")
+        return False
+
+    try:
+        # needed by servers without client tracking
+        redis.config_set("notify-keyspace-events", "K$gx")
+        populate(redis)
+    except Exception as e:
+        logging.error(f"{test_name}: could not populate the temporary Redis server: {e}")
+        return False
+
+    if not session_filter.valgrind_start():
+        logging.error(f"{test_name}: filter didn't start correctly")
+        return False
+
+    # let the near cache subscribe to the invalidations
+    sleep(2)
+
+    darwin_api = DarwinApi(socket_path=session_filter.socket,
+                           socket_type="unix")
+
+    ret = True
+    for index, (action, request, expected_certitude) in enumerate(steps):
+        if action:
+            action(redis)
+        results = darwin_api.bulk_call([request], response_type="back")
+        certitudes = results.get('certitude_list')
+        if certitudes != [expected_certitude]:
+            logging.error(f"{test_name}: step {index}: unexpected certitudes {certitudes} instead of [{expected_certitude}]")
+            ret = False
+            break
+
+    darwin_api.close()
+
+    if ret and not session_filter.check_line_in_filter_log(f"near cache hit for key {NEAR_CACHE_TOKEN}_1", keep_init_pos=False):
+        logging.error(f"{test_name}: the near cache was not used, please check logs")
+        ret = False
+
+    if not session_filter.valgrind_stop():
+        ret = False
+
+    return ret
+
+def near_cache_hit():
+    """
+    Second lookup is served from the near cache
+    """
+    return _near_cache_lookups("near_cache_hit",
+        [
+            (None, [NEAR_CACHE_TOKEN, "1"], 1),
+            (None, [NEAR_CACHE_TOKEN, "1"], 1),
+        ],
+        lambda redis: redis.set(f"{NEAR_CACHE_TOKEN}_1", "1"))
+
+def near_cache_invalidation():
+    """
+    A session revoked in Redis must not be served from the near cache anymore
+    """
+    def revoke(redis):
+        redis.delete(f"{NEAR_CACHE_TOKEN}_1")
+        sleep(1)
+
+    return _near_cache_lookups("near_cache_invalidation",
+        [
+            (None, [NEAR_CACHE_TOKEN, "1"], 1),
+            (None, [NEAR_CACHE_TOKEN, "1"], 1),
+            (revoke, [NEAR_CACHE_TOKEN, "1"], 0),
+        ],
+        lambda redis: redis.set(f"{NEAR_CACHE_TOKEN}_1", "1"))
+
+def near_cache_key_expiry():
+    """
+    A session expired in Redis must not be served from the near cache anymore
+    """
+    def populate(redis):
+        redis.set(f"{NEAR_CACHE_TOKEN}_1", "1")
+        redis.expire(f"{NEAR_CACHE_TOKEN}_1", 10)
+
+    return _near_cache_lookups("near_cache_key_expiry",
+        [
+            (None, [NEAR_CACHE_TOKEN, "1"], 1),
+            (None, [NEAR_CACHE_TOKEN, "1"], 1),
+            (lambda redis: sleep(10), [NEAR_CACHE_TOKEN, "1"], 0),
+        ],
+        populate)
+
+def near_cache_hit_resets_expiration():
+    """
+    A session served from the near cache still gets its expiration reset in Redis
+    """
+    ttls = []
+
+    def populate(redis):
+        redis.set(f"{NEAR_CACHE_TOKEN}_1", "1")
+        redis.hset(NEAR_CACHE_TOKEN, "1", "1")
+        redis.expire(NEAR_CACHE_TOKEN, 10)
+
+    def wait(redis):
+        sleep(3)
+        ttls.append(redis.ttl(NEAR_CACHE_TOKEN))
+
+    ret = _near_cache_lookups("near_cache_hit_resets_expiration",
+        [
+            (None, [NEAR_CACHE_TOKEN, "1", 10], 1),
+            (wait, [NEAR_CACHE_TOKEN, "1", 10], 1),
+            (wait, [NEAR_CACHE_TOKEN, "1", 10], 1),
+        ],
+        populate)
+
+    # each hit resets the TTL to 10, it never goes below 7 before it
+    if ret and min(ttls) < 6:
+        logging.error(f"near_cache_hit_resets_expiration: token's expiration was not reset by the cache hits, TTLs: {ttls}")
+        return False
+
+    return ret
@@ -9,6 +9,7 @@ import filters.fbuffer as fbuffer
 import filters.fvast as fvast
 import filters.fvaml as fvaml
 import filters.fsession as fsession
+import filters.finspection as finspection
 
 from tools.output import print_results
 
@@ -27,6 +28,7 @@ def run():
     fvast.run()
     fvaml.run()
     fsession.run()
+    finspection.run()
 
     print()
     print()
@@ -13,25 +13,37 @@
 AThread::AThread(int interval) : 
                 _interval(interval),
                 _thread(),
-                _is_stop(false) {}
+                _is_stop(false),
+                _notified(false) {}
 
 void AThread::ThreadMain() {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("AThread::ThreadMain:: Begin");
-    std::mutex mtx;
-    std::unique_lock<std::mutex> lck(mtx);
+    std::unique_lock<std::mutex> lck(this->_cv_mutex);
 
     while (!(this->_is_stop)) {
+        this->_notified = false;
+        lck.unlock();
         if (!this->Main()) {
             DARWIN_LOG_DEBUG("AThread::ThreadMain:: Error in main function, stopping the thread");
             _is_stop = true;
             break;
         }
+        lck.lock();
         // Wait for notification or until timeout
-        this->_cv.wait_for(lck, std::chrono::seconds(_interval));
+        this->_cv.wait_for(lck, std::chrono::seconds(_interval),
+                           [this]() { return this->_is_stop or this->_notified; });
     }
 }
 
+void AThread::Notify() {
+    {
+        std::lock_guard<std::mutex> lck(this->_cv_mutex);
+        this->_notified = true;
+    }
+    this->_cv.notify_all();
+}
+
 void AThread::InitiateThread() {
     this->_thread = std::thread(&AThread::ThreadMain, this);
 }
@@ -40,7 +52,10 @@ bool AThread::Stop() {
     DARWIN_LOGGER;
     DARWIN_LOG_DEBUG("AThread::Stop:: Stopping thread...");
 
-    this->_is_stop = true;
+    {
+        std::lock_guard<std::mutex> lck(this->_cv_mutex);
+        this->_is_stop = true;
+    }
     //Notify the thread
     this->_cv.notify_all();
     try {
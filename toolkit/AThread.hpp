@@ -8,6 +8,8 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 #include <thread>
 
@@ -17,7 +19,7 @@ class AThread {
     /// This abstract class is made to be inheritated by subclasses
     /// Its purpose is to handle everything needed to run a thread.
     /// It is likely to be called by AThreadManager or any subclass inheriting from it.
-    /// ThreadMain is calling Main every _interval seconds.
+    /// ThreadMain is calling Main every _interval seconds, or earlier when Notify is called.
     /// Main MUST be overrode by children.
     ///
     ///\class AThread
@@ -39,6 +41,10 @@ class AThread {
     ///\return true on success, false otherwise
     bool Stop();
 
+    ///\brief Wakes the thread up so that Main is called without waiting for the end of the current interval.
+    /// A notification received while Main is running is kept and triggers another call right after.
+    void Notify();
+
     ///\brief It is the entry point of the thread, it calls Main every _interval seconds and is called in the constructor.
     void ThreadMain();
 
@@ -62,4 +68,10 @@ class AThread {
 
     /// The condition variable for the thread
     std::condition_variable _cv;
+
+    /// The mutex protecting _cv and _notified
+    std::mutex _cv_mutex;
+
+    /// Set by Notify, reset by ThreadMain before calling Main
+    bool _notified;
 };
\ No newline at end of file
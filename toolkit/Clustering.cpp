@@ -0,0 +1,420 @@
+/// \file     Clustering.cpp
+/// \version  1.0
+/// \date     19/10/26
+/// \license  GPLv3
+/// \brief    Copyright (c) 2018 Advens. All rights reserved.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <system_error>
+#include <thread>
+
+#include "Clustering.hpp"
+#include "tsl/hopscotch_map.h"
+
+namespace darwin {
+
+    namespace toolkit {
+
+        namespace clustering {
+
+            namespace {
+
+                // Points per leaf of the k-d tree
+                constexpr std::size_t LEAF_SIZE = 8;
+                // Below this number of queries per thread, starting a thread costs more than it saves
+                constexpr std::size_t MIN_QUERIES_PER_THREAD = 1024;
+
+                /// Eigen decomposition of a small symmetric matrix by cyclic Jacobi rotations
+                /// \param matrix the n x n matrix, destroyed: its diagonal receives the eigenvalues
+                /// \param vectors receives the eigenvectors, as columns of a n x n matrix
+                void SymmetricEigen(std::vector<double> &matrix, std::size_t n, std::vector<double> &vectors) {
+                    auto a = [&matrix, n](std::size_t row, std::size_t col) -> double& { return matrix[col * n + row]; };
+                    auto v = [&vectors, n](std::size_t row, std::size_t col) -> double& { return vectors[col * n + row]; };
+
+                    vectors.assign(n * n, 0);
+                    for (std::size_t i = 0; i < n; ++i) v(i, i) = 1;
+
+                    for (int sweep = 0; sweep < 64; ++sweep) {
+                        double off = 0, diagonal = 0;
+                        for (std::size_t p = 0; p < n; ++p) {
+                            diagonal += a(p, p) * a(p, p);
+                            for (std::size_t q = p + 1; q < n; ++q) off += a(p, q) * a(p, q);
+                        }
+                        if (off <= diagonal * 1e-30) break;
+
+                        for (std::size_t p = 0; p < n; ++p) {
+                            for (std::size_t q = p + 1; q < n; ++q) {
+                                if (a(p, q) == 0) continue;
+
+                                double theta = (a(q, q) - a(p, p)) / (2 * a(p, q));
+                                double t = (theta >= 0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+                                double c = 1 / std::sqrt(t * t + 1), s = t * c;
+
+                                for (std::size_t k = 0; k < n; ++k) {
+                                    double kp = a(k, p), kq = a(k, q);
+                                    a(k, p) = c * kp - s * kq;
+                                    a(k, q) = s * kp + c * kq;
+                                }
+                                for (std::size_t k = 0; k < n; ++k) {
+                                    double pk = a(p, k), qk = a(q, k);
+                                    a(p, k) = c * pk - s * qk;
+                                    a(q, k) = s * pk + c * qk;
+                                }
+                                for (std::size_t k = 0; k < n; ++k) {
+                                    double kp = v(k, p), kq = v(k, q);
+                                    v(k, p) = c * kp - s * kq;
+                                    v(k, q) = s * kp + c * kq;
+                                }
+                            }
+                        }
+                    }
+                }
+
+                struct CellKey {
+                    int64_t x, y;
+
+                    bool operator==(const CellKey &other) const { return x == other.x and y == other.y; }
+                };
+
+                struct CellKeyHash {
+                    std::size_t operator()(const CellKey &key) const noexcept {
+                        return (static_cast<uint64_t>(key.x) * 0x9E3779B97F4A7C15ULL) ^ static_cast<uint64_t>(key.y);
+                    }
+                };
+
+                /// The distinct points, sorted by cell of side epsilon / sqrt(2)
+                struct Grid {
+                    struct Cell {
+                        CellKey key;
+                        std::size_t begin, end; // distinct points of the cell
+                        std::size_t weight; // number of points of the cell, duplicates included
+                    };
+
+                    std::vector<double> xs, ys; // distinct points
+                    std::vector<std::size_t> weights; // number of points equal to each distinct point
+                    std::vector<std::size_t> cellOf; // cell of each distinct point
+                    std::vector<std::size_t> distinctOf; // distinct point of each point
+                    std::vector<Cell> cells;
+                    tsl::hopscotch_map<CellKey, std::size_t, CellKeyHash> index;
+
+                    Grid(const double *points, std::size_t count, double side) {
+                        struct Entry {
+                            CellKey cell;
+                            double x, y;
+                            std::size_t point;
+                        };
+
+                        double min_x = points[0], min_y = points[1];
+                        for (std::size_t i = 1; i < count; ++i) {
+                            min_x = std::min(min_x, points[2 * i]);
+                            min_y = std::min(min_y, points[2 * i + 1]);
+                        }
+
+                        std::vector<Entry> entries(count);
+                        for (std::size_t i = 0; i < count; ++i) {
+                            double x = points[2 * i], y = points[2 * i + 1];
+                            entries[i] = {{static_cast<int64_t>((x - min_x) / side), static_cast<int64_t>((y - min_y) / side)},
+                                          x, y, i};
+                        }
+                        std::sort(entries.begin(), entries.end(), [](const Entry &l, const Entry &r) {
+                            if (l.cell.x != r.cell.x) return l.cell.x < r.cell.x;
+                            if (l.cell.y != r.cell.y) return l.cell.y < r.cell.y;
+                            if (l.x != r.x) return l.x < r.x;
+                            return l.y < r.y;
+                        });
+
+                        distinctOf.resize(count);
+                        for (std::size_t i = 0; i < count; ++i) {
+                            const Entry &entry = entries[i];
+                            bool new_cell = i == 0 or not (entry.cell == entries[i - 1].cell);
+
+                            if (new_cell) {
+                                if (not cells.empty()) cells.back().end = xs.size();
+                                index.emplace(entry.cell, cells.size());
+                                cells.push_back({entry.cell, xs.size(), xs.size(), 0});
+                            }
+                            if (new_cell or entry.x != xs.back() or entry.y != ys.back()) {
+                                xs.push_back(entry.x);
+                                ys.push_back(entry.y);
+                                weights.push_back(0);
+                                cellOf.push_back(cells.size() - 1);
+                            }
+                            ++weights.back();
+                            ++cells.back().weight;
+                            distinctOf[entry.point] = xs.size() - 1;
+                        }
+                        cells.back().end = xs.size();
+                    }
+
+                    /// Call f(cell) for the cells which may contain neighbours of the points of a cell, itself included,
+                    /// until f returns false
+                    template<typename F>
+                    void ForNeighbourCells(std::size_t cell, F f) const {
+                        const CellKey &key = cells[cell].key;
+
+                        for (int64_t dx = -2; dx <= 2; ++dx) {
+                            for (int64_t dy = -2; dy <= 2; ++dy) {
+                                auto it = index.find({key.x + dx, key.y + dy});
+
+                                if (it != index.end() and not f(it->second)) return;
+                            }
+                        }
+                    }
+
+                    double Distance2(std::size_t i, std::size_t j) const {
+                        double dx = xs[i] - xs[j], dy = ys[i] - ys[j];
+                        return dx * dx + dy * dy;
+                    }
+                };
+
+                std::size_t FindRoot(std::vector<std::size_t> &parents, std::size_t i) {
+                    while (parents[i] != i) {
+                        parents[i] = parents[parents[i]];
+                        i = parents[i];
+                    }
+                    return i;
+                }
+
+                /// Static k-d tree on points in 2 dimensions, stored as an implicit balanced tree:
+                /// the node of a range is its middle point, splitting the range on the x axis at even depths
+                class KdTree {
+                public:
+                    explicit KdTree(std::vector<std::array<double, 2>> points) : _points(std::move(points)) {
+                        this->Build(0, _points.size(), 0);
+                    }
+
+                    /// \return the squared distance between (x, y) and its nearest point
+                    double Nearest2(double x, double y) const {
+                        double best = INFINITY;
+                        this->Search(0, _points.size(), 0, {x, y}, best);
+                        return best;
+                    }
+
+                private:
+                    void Build(std::size_t begin, std::size_t end, int axis) {
+                        if (end - begin <= LEAF_SIZE) return;
+
+                        std::size_t middle = begin + (end - begin) / 2;
+                        std::nth_element(_points.begin() + begin, _points.begin() + middle, _points.begin() + end,
+                                         [axis](const std::array<double, 2> &l, const std::array<double, 2> &r) {
+                                             return l[axis] < r[axis];
+                                         });
+                        this->Build(begin, middle, 1 - axis);
+                        this->Build(middle + 1, end, 1 - axis);
+                    }
+
+                    void Search(std::size_t begin, std::size_t end, int axis, const std::array<double, 2> &query,
+                                double &best) const {
+                        if (end - begin <= LEAF_SIZE) {
+                            for (std::size_t i = begin; i < end; ++i) best = std::min(best, Distance2(_points[i], query));
+                            return;
+                        }
+
+                        std::size_t middle = begin + (end - begin) / 2;
+                        const std::array<double, 2> &node = _points[middle];
+                        double delta = query[axis] - node[axis];
+
+                        best = std::min(best, Distance2(node, query));
+                        if (delta < 0) {
+                            this->Search(begin, middle, 1 - axis, query, best);
+                            if (delta * delta < best) this->Search(middle + 1, end, 1 - axis, query, best);
+                        } else {
+                            this->Search(middle + 1, end, 1 - axis, query, best);
+                            if (delta * delta < best) this->Search(begin, middle, 1 - axis, query, best);
+                        }
+                    }
+
+                    static double Distance2(const std::array<double, 2> &l, const std::array<double, 2> &r) {
+                        double dx = l[0] - r[0], dy = l[1] - r[1];
+                        return dx * dx + dy * dy;
+                    }
+
+                private:
+                    std::vector<std::array<double, 2>> _points;
+                };
+            }
+
+            void Pca2D(const double *data, std::size_t dimensions, std::size_t count, double *projected) {
+                std::vector<double> mean(dimensions, 0), covariance(dimensions * dimensions, 0), vectors;
+
+                for (std::size_t i = 0; i < count; ++i) {
+                    for (std::size_t d = 0; d < dimensions; ++d) mean[d] += data[i * dimensions + d];
+                }
+                for (double &m : mean) m /= std::max<std::size_t>(count, 1);
+
+                std::vector<double> centered(dimensions);
+                for (std::size_t i = 0; i < count; ++i) {
+                    for (std::size_t d = 0; d < dimensions; ++d) centered[d] = data[i * dimensions + d] - mean[d];
+                    for (std::size_t r = 0; r < dimensions; ++r) {
+                        for (std::size_t c = r; c < dimensions; ++c) covariance[c * dimensions + r] += centered[r] * centered[c];
+                    }
+                }
+                for (std::size_t r = 0; r < dimensions; ++r) {
+                    for (std::size_t c = r + 1; c < dimensions; ++c) covariance[r * dimensions + c] = covariance[c * dimensions + r];
+                }
+
+                SymmetricEigen(covariance, dimensions, vectors);
+
+                // components by decreasing variance
+                std::vector<std::size_t> order(dimensions);
+                std::iota(order.begin(), order.end(), 0);
+                std::sort(order.begin(), order.end(), [&covariance, dimensions](std::size_t l, std::size_t r) {
+                    return covariance[l * dimensions + l] > covariance[r * dimensions + r];
+                });
+                const double *first = &vectors[order[0] * dimensions], *second = &vectors[order[1] * dimensions];
+
+                for (std::size_t i = 0; i < count; ++i) {
+                    double x = 0, y = 0;
+                    for (std::size_t d = 0; d < dimensions; ++d) {
+                        double value = data[i * dimensions + d] - mean[d];
+                        x += value * first[d];
+                        y += value * second[d];
+                    }
+                    projected[2 * i] = x;
+                    projected[2 * i + 1] = y;
+                }
+            }
+
+            std::size_t Dbscan2D(const double *points, std::size_t count, double epsilon, std::size_t min_points,
+                                 std::vector<std::size_t> &assignments) {
+                assignments.assign(count, NOISE);
+                if (count == 0) return 0;
+
+                const Grid grid(points, count, epsilon / std::sqrt(2.0));
+                const double epsilon2 = epsilon * epsilon;
+                const std::size_t distinct = grid.xs.size();
+                std::vector<char> core(distinct, 0), core_cell(grid.cells.size(), 0);
+
+                // the points of a cell are all neighbours, a dense cell is made of core points only
+                for (std::size_t c = 0; c < grid.cells.size(); ++c) {
+                    const Grid::Cell &cell = grid.cells[c];
+
+                    for (std::size_t p = cell.begin; p < cell.end; ++p) {
+                        std::size_t neighbours = cell.weight - 1;
+
+                        if (neighbours < min_points) {
+                            grid.ForNeighbourCells(c, [&](std::size_t other) {
+                                if (other == c) return true;
+                                for (std::size_t q = grid.cells[other].begin; q < grid.cells[other].end; ++q) {
+                                    if (grid.Distance2(p, q) <= epsilon2) neighbours += grid.weights[q];
+                                }
+                                return neighbours < min_points;
+                            });
+                        }
+                        core[p] = neighbours >= min_points;
+                        core_cell[c] |= core[p];
+                    }
+                }
+
+                // the core points of a cell are in the same cluster, cells are merged when two of their core points are neighbours
+                std::vector<std::size_t> parents(grid.cells.size());
+                std::iota(parents.begin(), parents.end(), 0);
+
+                for (std::size_t c = 0; c < grid.cells.size(); ++c) {
+                    if (not core_cell[c]) continue;
+
+                    grid.ForNeighbourCells(c, [&](std::size_t other) {
+                        if (other <= c or not core_cell[other] or FindRoot(parents, c) == FindRoot(parents, other)) return true;
+
+                        for (std::size_t p = grid.cells[c].begin; p < grid.cells[c].end; ++p) {
+                            if (not core[p]) continue;
+                            for (std::size_t q = grid.cells[other].begin; q < grid.cells[other].end; ++q) {
+                                if (core[q] and grid.Distance2(p, q) <= epsilon2) {
+                                    parents[FindRoot(parents, other)] = FindRoot(parents, c);
+                                    return true;
+                                }
+                            }
+                        }
+                        return true;
+                    });
+                }
+
+                // border points join the cluster of a core point within epsilon
+                std::vector<std::size_t> clusters(distinct, NOISE);
+                for (std::size_t p = 0; p < distinct; ++p) {
+                    std::size_t c = grid.cellOf[p];
+
+                    if (core[p]) {
+                        clusters[p] = FindRoot(parents, c);
+                    } else if (core_cell[c]) {
+                        clusters[p] = FindRoot(parents, c);
+                    } else {
+                        grid.ForNeighbourCells(c, [&](std::size_t other) {
+                            if (not core_cell[other]) return true;
+                            for (std::size_t q = grid.cells[other].begin; q < grid.cells[other].end; ++q) {
+                                if (core[q] and grid.Distance2(p, q) <= epsilon2) {
+                                    clusters[p] = FindRoot(parents, other);
+                                    return false;
+                                }
+                            }
+                            return true;
+                        });
+                    }
+                }
+
+                // clusters are numbered by order of first point
+                std::vector<std::size_t> numbers(grid.cells.size(), NOISE);
+                std::size_t next = 0;
+                for (std::size_t i = 0; i < count; ++i) {
+                    std::size_t root = clusters[grid.distinctOf[i]];
+
+                    if (root == NOISE) continue;
+                    if (numbers[root] == NOISE) numbers[root] = next++;
+                    assignments[i] = numbers[root];
+                }
+                return next;
+            }
+
+            void NearestClusterDistances(const double *points, std::size_t count,
+                                         const std::vector<std::size_t> &assignments,
+                                         const std::vector<std::size_t> &queries,
+                                         std::vector<double> &distances, unsigned int threads) {
+                std::vector<std::array<double, 2>> references;
+
+                distances.assign(queries.size(), -1);
+                for (std::size_t i = 0; i < count; ++i) {
+                    if (assignments[i] != NOISE) references.push_back({points[2 * i], points[2 * i + 1]});
+                }
+                if (references.empty() or queries.empty()) return;
+
+                // clusters are mostly made of duplicates
+                std::sort(references.begin(), references.end());
+                references.erase(std::unique(references.begin(), references.end()), references.end());
+
+                const KdTree tree(std::move(references));
+                auto search = [&](std::size_t begin, std::size_t end) {
+                    for (std::size_t i = begin; i < end; ++i) {
+                        std::size_t point = queries[i];
+                        distances[i] = std::sqrt(tree.Nearest2(points[2 * point], points[2 * point + 1]));
+                    }
+                };
+
+                if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+                std::size_t workers = std::min<std::size_t>(threads, queries.size() / MIN_QUERIES_PER_THREAD);
+                if (workers <= 1) {
+                    search(0, queries.size());
+                    return;
+                }
+
+                std::vector<std::thread> pool;
+                std::size_t chunk = (queries.size() + workers - 1) / workers;
+                std::size_t begin = chunk;
+                try {
+                    for (; begin < queries.size(); begin += chunk) {
+                        pool.emplace_back(search, begin, std::min(begin + chunk, queries.size()));
+                    }
+                } catch (const std::system_error &) {
+                    // no more threads available, the current thread searches the remaining queries
+                    search(begin, queries.size());
+                }
+                // the current thread takes the first chunk
+                search(0, chunk);
+                for (std::thread &thread : pool) thread.join();
+            }
+
+        }
+    }
+}
@@ -0,0 +1,59 @@
+/// \file     Clustering.hpp
+/// \version  1.0
+/// \date     19/10/26
+/// \license  GPLv3
+/// \brief    Copyright (c) 2018 Advens. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace darwin {
+
+    namespace toolkit {
+
+        /// Clustering of large sets of points in 2 dimensions.
+        /// The matrices are column-major, one column per point, as Armadillo stores them: the functions can be
+        /// given the memptr() of an arma::mat without copying it.
+        namespace clustering {
+
+            /// Assignment of the points which belong to no cluster
+            constexpr std::size_t NOISE = SIZE_MAX;
+
+            /// Project points on their 2 principal components, as an exact PCA of centered and unscaled data.
+            /// \param data the points, dimensions rows and count columns
+            /// \param dimensions the number of values of each point, at least 2
+            /// \param count the number of points
+            /// \param projected receives the 2 coordinates of each point, must hold 2 * count values
+            void Pca2D(const double *data, std::size_t dimensions, std::size_t count, double *projected);
+
+            /// DBSCAN on points in 2 dimensions, using a grid of cells of side epsilon / sqrt(2):
+            /// all the points of a cell are neighbours, and the neighbours of a point are in the 5x5 cells around it.
+            /// Identical points are grouped, so heavily duplicated data is clustered as fast as distinct points.
+            /// As in mlpack, a point is a core point when at least min_points other points are within epsilon.
+            /// \param points the points, 2 rows and count columns
+            /// \param count the number of points
+            /// \param epsilon the maximum distance between neighbours, must be positive
+            /// \param min_points the minimum number of neighbours of a core point
+            /// \param assignments receives the cluster of each point, or NOISE
+            /// \return the number of clusters
+            std::size_t Dbscan2D(const double *points, std::size_t count, double epsilon, std::size_t min_points,
+                                 std::vector<std::size_t> &assignments);
+
+            /// Compute the Euclidean distance from some points to the nearest point belonging to a cluster.
+            /// The points of the clusters are indexed in a k-d tree, which is then searched by several threads.
+            /// \param points the points, 2 rows and count columns
+            /// \param count the number of points
+            /// \param assignments the cluster of each point, or NOISE, as given by Dbscan2D
+            /// \param queries the indexes of the points to compute the distance of
+            /// \param distances receives the distance of each query, -1 when no point belongs to a cluster
+            /// \param threads the maximum number of threads used, 0 for the number of hardware threads
+            void NearestClusterDistances(const double *points, std::size_t count,
+                                         const std::vector<std::size_t> &assignments,
+                                         const std::vector<std::size_t> &queries,
+                                         std::vector<double> &distances, unsigned int threads = 0);
+
+        }
+    }
+}
@@ -0,0 +1,83 @@
+/// \file     HyperLogLog.hpp
+/// \version  1.0
+/// \date     19/10/26
+/// \license  GPLv3
+/// \brief    Copyright (c) 2018 Advens. All rights reserved.
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+namespace darwin {
+
+    namespace toolkit {
+
+        /// Estimates the number of distinct values added, in 2^PRECISION bytes.
+        /// The standard error is about 1.04 / sqrt(2^PRECISION), small cardinalities are
+        /// estimated by linear counting and stay close to the exact value.
+        ///
+        /// \tparam PRECISION the number of bits of the hashes used to select a register
+        template<unsigned int PRECISION>
+        class HyperLogLog {
+            static_assert(PRECISION >= 4 and PRECISION <= 16, "HyperLogLog precision must be between 4 and 16");
+
+        public:
+            static constexpr std::size_t REGISTERS = std::size_t(1) << PRECISION;
+
+        public:
+            /// Add a value to the sketch
+            /// \param hash a 64 bits hash of the value, uniformly distributed
+            void Add(uint64_t hash) {
+                std::size_t index = hash >> (64 - PRECISION);
+                // the guard bit bounds the rank when the remaining bits are all zeros
+                uint64_t remaining = (hash << PRECISION) | (uint64_t(1) << (PRECISION - 1));
+                uint8_t rank = __builtin_clzll(remaining) + 1;
+
+                if (rank > _registers[index]) _registers[index] = rank;
+            }
+
+            /// Add the values of another sketch to this one
+            void Merge(const HyperLogLog &other) {
+                for (std::size_t i = 0; i < REGISTERS; ++i) {
+                    if (other._registers[i] > _registers[i]) _registers[i] = other._registers[i];
+                }
+            }
+
+            /// \return the estimated number of distinct values added
+            double Estimate() const {
+                constexpr double m = REGISTERS;
+                constexpr double alpha = 0.7213 / (1.0 + 1.079 / m);
+                double sum = 0;
+                std::size_t zeros = 0;
+
+                for (uint8_t reg : _registers) {
+                    sum += std::ldexp(1.0, -reg);
+                    if (reg == 0) ++zeros;
+                }
+
+                double estimate = alpha * m * m / sum;
+                if (estimate <= 2.5 * m and zeros != 0) {
+                    estimate = m * std::log(m / zeros);
+                }
+                return estimate;
+            }
+
+            bool Empty() const {
+                for (uint8_t reg : _registers) {
+                    if (reg) return false;
+                }
+                return true;
+            }
+
+            void Clear() {
+                _registers.fill(0);
+            }
+
+        private:
+            std::array<uint8_t, REGISTERS> _registers{};
+        };
+
+    }
+}
@@ -0,0 +1,222 @@
+/// \file     InferenceScheduler.cpp
+/// \version  1.0
+/// \date     19/10/26
+/// \license  GPLv3
+/// \brief    Copyright (c) 2018 Advens. All rights reserved.
+
+#include <algorithm>
+
+#include "InferenceScheduler.hpp"
+#include "base/Logger.hpp"
+
+namespace darwin {
+
+    namespace toolkit {
+
+        InferenceScheduler::InferenceScheduler(predict_fn_t predict, std::size_t max_batch_size,
+                                               std::chrono::microseconds max_delay, unsigned int error_result)
+            : _predict(std::move(predict)), _maxBatchSize(std::max<std::size_t>(max_batch_size, 1)), _maxDelay(max_delay),
+              _errorResult(error_result) {}
+
+
+        InferenceScheduler::~InferenceScheduler() {
+            this->Stop();
+        }
+
+
+        bool InferenceScheduler::Start(std::size_t threads) {
+            DARWIN_LOGGER;
+            std::lock_guard<std::mutex> lock(this->_mutex);
+
+            if(not this->_threads.empty()) {
+                DARWIN_LOG_WARNING("InferenceScheduler::Start:: threads already started");
+                return false;
+            }
+
+            this->_stop = false;
+            try {
+                for(std::size_t i = 0; i < threads; ++i) {
+                    this->_threads.emplace_back(&InferenceScheduler::WorkerMain, this);
+                }
+            }
+            catch(const std::system_error &e) {
+                DARWIN_LOG_ERROR("InferenceScheduler::Start:: could not start thread: " + std::string(e.what()));
+                // the threads already started still serve the requests
+                this->_running = not this->_threads.empty();
+                return false;
+            }
+
+            this->_running = not this->_threads.empty();
+            return this->_running;
+        }
+
+
+        void InferenceScheduler::Stop() {
+            {
+                std::lock_guard<std::mutex> lock(this->_mutex);
+                this->_stop = true;
+            }
+            this->_workersCv.notify_all();
+
+            for(auto &thread : this->_threads) {
+                if(thread.joinable())
+                    thread.join();
+            }
+            this->_threads.clear();
+        }
+
+
+        void InferenceScheduler::Predict(const model_t &model, const std::vector<std::string_view> &inputs,
+                                         std::vector<unsigned int> &results) {
+            if(inputs.empty()) {
+                results.clear();
+                return;
+            }
+
+            Request request;
+            request.model = &model;
+            request.inputs = &inputs;
+            request.results = &results;
+            request.next = 0;
+            request.remaining = inputs.size();
+            results.assign(inputs.size(), this->_errorResult);
+
+            std::unique_lock<std::mutex> lock(this->_mutex);
+            if(not this->_running) {
+                lock.unlock();
+                this->_predict(model, inputs, results);
+                return;
+            }
+
+            request.submitted = std::chrono::steady_clock::now();
+            this->_pending.push_back(&request);
+            this->_pendingInputs += inputs.size();
+            this->_workersCv.notify_one();
+
+            request.done.wait(lock, [&request]() { return request.remaining == 0; });
+        }
+
+
+        std::string InferenceScheduler::GetStats() {
+            std::string batch_sizes;
+            uint_fast64_t requests = this->_requests;
+            std::size_t buckets = 1;
+
+            // buckets above the maximum batch size are always empty
+            while(buckets < BATCH_SIZE_BUCKETS and (std::size_t(1) << buckets) <= this->_maxBatchSize) ++buckets;
+            for(std::size_t i = 0; i < buckets; ++i) {
+                if(i) batch_sizes += ", ";
+                batch_sizes += "\"" + std::to_string(std::size_t(1) << i) + "\": " + std::to_string(this->_batchSizes[i]);
+            }
+
+            return "{\"batches\": " + std::to_string(this->_batches)
+                    + ", \"inputs\": " + std::to_string(this->_inputs)
+                    + ", \"batch_sizes\": {" + batch_sizes + "}"
+                    + ", \"queue_delay_us\": {\"avg\": " + std::to_string(requests ? this->_delaySum / requests : 0)
+                    + ", \"max\": " + std::to_string(this->_delayMax) + "}}";
+        }
+
+
+        void InferenceScheduler::WorkerMain() {
+            std::vector<std::string_view> batch;
+            std::vector<std::pair<Request *, std::size_t>> origins;
+            std::vector<unsigned int> results;
+            model_t model;
+            std::unique_lock<std::mutex> lock(this->_mutex);
+
+            while(true) {
+                // waits for enough inputs, or for the oldest one to reach its deadline
+                while(not this->_stop and this->_pendingInputs < this->_maxBatchSize) {
+                    if(this->_pending.empty()) {
+                        this->_workersCv.wait(lock);
+                        continue;
+                    }
+
+                    auto deadline = this->_pending.front()->submitted + this->_maxDelay;
+                    if(std::chrono::steady_clock::now() >= deadline) break;
+                    this->_workersCv.wait_until(lock, deadline);
+                }
+
+                // pending inputs are still classified when stopping
+                if(this->_pending.empty()) {
+                    if(this->_stop) {
+                        this->_running = false;
+                        return;
+                    }
+                    continue;
+                }
+
+                model = this->TakeBatch(batch, origins);
+                // what is left may already make another batch
+                if(not this->_pending.empty()) this->_workersCv.notify_one();
+                lock.unlock();
+
+                results.assign(batch.size(), this->_errorResult);
+                try {
+                    this->_predict(model, batch, results);
+                }
+                catch(const std::exception &e) {
+                    DARWIN_LOGGER;
+                    DARWIN_LOG_ERROR("InferenceScheduler::WorkerMain:: error while running the model: " + std::string(e.what()));
+                    results.assign(batch.size(), this->_errorResult);
+                }
+
+                std::size_t bucket = 0;
+                while(bucket + 1 < BATCH_SIZE_BUCKETS and (std::size_t(2) << bucket) <= batch.size()) ++bucket;
+                this->_batchSizes[bucket]++;
+                this->_batches++;
+                this->_inputs += batch.size();
+                // may be the last reference to a reloaded model, not released with the lock held
+                model.reset();
+
+                lock.lock();
+                for(std::size_t i = 0; i < origins.size(); ++i) {
+                    Request *request = origins[i].first;
+
+                    (*request->results)[origins[i].second] = results[i];
+                    if(--request->remaining == 0) request->done.notify_one();
+                }
+            }
+        }
+
+
+        InferenceScheduler::model_t InferenceScheduler::TakeBatch(std::vector<std::string_view> &batch,
+                                                                  std::vector<std::pair<Request *, std::size_t>> &origins) {
+            auto now = std::chrono::steady_clock::now();
+            // the requests stay valid until all their inputs have a result
+            model_t model = *this->_pending.front()->model;
+
+            batch.clear();
+            origins.clear();
+            while(not this->_pending.empty() and batch.size() < this->_maxBatchSize) {
+                Request *request = this->_pending.front();
+                // the requests of another model wait for the next batch, keeping the order of the requests
+                if(*request->model != model) break;
+                std::size_t count = std::min(request->inputs->size() - request->next, this->_maxBatchSize - batch.size());
+
+                if(request->next == 0) this->RecordDelay(now - request->submitted);
+
+                for(std::size_t i = request->next; i < request->next + count; ++i) {
+                    batch.push_back((*request->inputs)[i]);
+                    origins.emplace_back(request, i);
+                }
+                request->next += count;
+                this->_pendingInputs -= count;
+
+                if(request->next == request->inputs->size()) this->_pending.pop_front();
+            }
+            return model;
+        }
+
+
+        void InferenceScheduler::RecordDelay(std::chrono::steady_clock::duration delay) {
+            uint_fast64_t us = std::chrono::duration_cast<std::chrono::microseconds>(delay).count();
+            uint_fast64_t max = this->_delayMax;
+
+            this->_requests++;
+            this->_delaySum += us;
+            while(us > max and not this->_delayMax.compare_exchange_weak(max, us)) {}
+        }
+
+    }
+}
@@ -0,0 +1,123 @@
+/// \file     InferenceScheduler.hpp
+/// \version  1.0
+/// \date     19/10/26
+/// \license  GPLv3
+/// \brief    Copyright (c) 2018 Advens. All rights reserved.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace darwin {
+
+    namespace toolkit {
+
+        /// Groups the inputs of concurrent sessions into shared batches for a model.
+        /// Sessions submit their inputs and wait for the results, while dedicated threads run the model
+        /// as soon as max_batch_size inputs are pending, or when the oldest pending input waited for max_delay.
+        /// Inputs of a session are kept in order, but may be split between consecutive batches.
+        /// Each session gives the model its inputs must be classified with, a batch only holds inputs of the same model.
+        class InferenceScheduler {
+        public:
+            /// The model given by the sessions, passed back to the predict function as is
+            typedef std::shared_ptr<const void> model_t;
+
+            /// Classifies a batch with a model, results[i] must receive the certitude of inputs[i]
+            typedef std::function<void(const model_t &model, const std::vector<std::string_view> &inputs,
+                                       std::vector<unsigned int> &results)> predict_fn_t;
+
+            // default values
+            static constexpr std::size_t DEFAULT_MAX_BATCH_SIZE = 256;
+            static constexpr unsigned int DEFAULT_MAX_DELAY = 2000; // microseconds
+
+        public:
+            /// \param predict the function running the model, called by the scheduler threads
+            /// \param max_batch_size the maximum number of inputs given to a single call of predict
+            /// \param max_delay the maximum time an input waits for other ones before being classified
+            /// \param error_result the result given to the inputs when predict fails
+            InferenceScheduler(predict_fn_t predict, std::size_t max_batch_size, std::chrono::microseconds max_delay,
+                               unsigned int error_result);
+            ~InferenceScheduler();
+
+            InferenceScheduler(const InferenceScheduler&) = delete;
+            InferenceScheduler& operator=(const InferenceScheduler&) = delete;
+
+        public:
+            /// Starts the threads running the model
+            /// \param threads the number of threads, each one runs a batch at a time
+            /// \return true if all the threads were started, false otherwise
+            bool Start(std::size_t threads);
+
+            /// Classifies the pending inputs, then stops the threads
+            void Stop();
+
+            /// Classifies the inputs along with the ones of the other sessions, blocks until they are all done
+            /// If the scheduler is not running, the inputs are classified by the calling thread
+            /// \param model the model to classify the inputs with
+            /// \param inputs the inputs to classify, must stay valid until the call returns
+            /// \param results will receive the certitude of each input
+            void Predict(const model_t &model, const std::vector<std::string_view> &inputs, std::vector<unsigned int> &results);
+
+            /// Get the statistics of the scheduler
+            /// \return a JSON object with the number of batches and inputs, the distribution of the batch sizes
+            ///         and the time spent by sessions waiting for their inputs to be taken in a batch
+            std::string GetStats();
+
+        private:
+            struct Request {
+                const model_t *model;
+                const std::vector<std::string_view> *inputs;
+                std::vector<unsigned int> *results;
+                std::size_t next; // first input not taken by a batch yet
+                std::size_t remaining; // inputs without result yet
+                std::chrono::steady_clock::time_point submitted;
+                std::condition_variable done;
+            };
+
+            /// Main loop of the scheduler threads: waits for a batch to be ready, runs it and dispatches the results
+            void WorkerMain();
+
+            /// Takes the oldest pending inputs of the same model, up to _maxBatchSize, must be called with _mutex held
+            /// \return the model of the batch
+            model_t TakeBatch(std::vector<std::string_view> &batch, std::vector<std::pair<Request *, std::size_t>> &origins);
+
+            void RecordDelay(std::chrono::steady_clock::duration delay);
+
+        private:
+            // batch sizes are counted by powers of 2
+            static constexpr std::size_t BATCH_SIZE_BUCKETS = 16;
+
+            predict_fn_t _predict;
+            std::size_t _maxBatchSize;
+            std::chrono::microseconds _maxDelay;
+            unsigned int _errorResult;
+
+            std::vector<std::thread> _threads;
+            std::mutex _mutex; // protects the pending requests and the running state
+            std::condition_variable _workersCv;
+            std::deque<Request *> _pending;
+            std::size_t _pendingInputs = 0;
+            bool _running = false;
+            bool _stop = false;
+
+            std::atomic_uint_fast64_t _batches{0};
+            std::atomic_uint_fast64_t _inputs{0};
+            std::array<std::atomic_uint_fast64_t, BATCH_SIZE_BUCKETS> _batchSizes{};
+            std::atomic_uint_fast64_t _requests{0};
+            std::atomic_uint_fast64_t _delaySum{0}; // microseconds
+            std::atomic_uint_fast64_t _delayMax{0}; // microseconds
+        };
+
+    }
+}
@@ -17,8 +17,12 @@ namespace darwin {
         // ########################################
 
         RedisManager::~RedisManager() {
+            this->StopHealthCheckThread();
             for(auto& threadData : _threadSet) {
                 redisFree(threadData->_redisContext);
+                for(auto& replicaContext : threadData->_replicaContexts) {
+                    redisFree(replicaContext.second);
+                }
             }
         }
 
@@ -38,6 +42,44 @@ namespace darwin {
         }
 
 
+        void RedisManager::SetReplicaReads(const bool enable) {
+            DARWIN_LOGGER;
+
+            if(this->_replicaReads.exchange(enable) == enable)
+                return;
+
+            if(enable) {
+                DARWIN_LOG_INFO("RedisManager::SetReplicaReads:: read-only queries will be sent to replicas");
+                {
+                    std::lock_guard<std::mutex> lock(this->_healthCheckMut);
+                    this->_healthCheckStop = false;
+                }
+                this->_healthCheckThread = std::thread(&RedisManager::HealthCheckMain, this);
+            }
+            else {
+                DARWIN_LOG_INFO("RedisManager::SetReplicaReads:: all queries will be sent to master");
+                this->StopHealthCheckThread();
+            }
+        }
+
+
+        bool RedisManager::LastReplyFromReplica() {
+            return this->GetThreadInfo()->_lastReplyFromReplica;
+        }
+
+
+        bool RedisManager::IsReadOnlyCommand(const std::string& command) {
+            static const std::unordered_set<std::string> readOnlyCommands {
+                "GET", "MGET", "EXISTS", "TTL", "PTTL", "TYPE", "STRLEN",
+                "SCARD", "SISMEMBER", "SMEMBERS",
+                "LLEN", "LRANGE", "LINDEX",
+                "HGET", "HMGET", "HGETALL", "HEXISTS", "HLEN",
+                "ZCARD", "ZSCORE", "ZRANGE"
+            };
+            return readOnlyCommands.find(command) != readOnlyCommands.end();
+        }
+
+
         void RedisManager::SetUnixConnection(const std::string& fullpath) {
             std::lock_guard<std::mutex> lock(this->_availableConnectionsMut);
             this->_baseConnection = RedisConnectionInfo(fullpath, "", 0);
@@ -125,6 +167,34 @@ namespace darwin {
         }
 
 
+        redisContext* RedisManager::ConnectDedicated() {
+            DARWIN_LOGGER;
+            RedisConnectionInfo connection;
+            redisContext *context = nullptr;
+
+            {
+                std::lock_guard<std::mutex> lock(this->_availableConnectionsMut);
+                connection = this->_activeConnection.isSet() ? this->_activeConnection : this->_baseConnection;
+            }
+
+            if(connection.isSet())
+                context = ConnectTo(connection, this->_connectTimeout);
+
+            if(not context) {
+                std::lock_guard<std::mutex> lock(this->_availableConnectionsMut);
+                if(not this->Discover()) {
+                    DARWIN_LOG_ERROR("RedisManager::ConnectDedicated:: could not find valid connection");
+                    return nullptr;
+                }
+                context = ConnectTo(this->_activeConnection, this->_connectTimeout);
+                if(not context)
+                    DARWIN_LOG_ERROR("RedisManager::ConnectDedicated:: could not connect to redis");
+            }
+
+            return context;
+        }
+
+
         void RedisManager::Disconnect() {
             std::shared_ptr<ThreadData> threadData = this->GetThreadInfo();
             DisconnectContext(&(threadData->_redisContext));
@@ -205,41 +275,30 @@ namespace darwin {
 
 
         int RedisManager::Query(const std::vector<std::string>& arguments, bool reconnectRetry) {
-            int ret;
-            std::any object;
-
-            ret = this->Query(arguments, object, reconnectRetry);
-
-            return ret;
+            return this->Query(arguments, [](const RedisReplyView&){}, reconnectRetry);
         }
 
         int RedisManager::Query(const std::vector<std::string>& arguments, long long int& reply_int, bool reconnectRetry) {
-            int ret;
-            std::any object;
-
-            ret = this->Query(arguments, object, reconnectRetry);
-            try {
-                reply_int = std::any_cast<long long int>(object);
-            }
-            catch(const std::bad_any_cast& error) {}
-
-            return ret;
+            return this->Query(arguments, [&reply_int](const RedisReplyView& reply) {
+                if(reply.IsInteger())
+                    reply_int = reply.Integer();
+            }, reconnectRetry);
         }
 
         int RedisManager::Query(const std::vector<std::string>& arguments, std::string& reply_string, bool reconnectRetry) {
-            int ret;
-            std::any object;
-
-            ret = this->Query(arguments, object, reconnectRetry);
-            try {
-                reply_string.assign(std::any_cast<std::string>(object));
-            }
-            catch(const std::bad_any_cast& error) {}
-
-            return ret;
+            return this->Query(arguments, [&reply_string](const RedisReplyView& reply) {
+                if(not reply.IsInteger() and not reply.IsNil() and not reply.IsArray())
+                    reply_string.assign(reply.String());
+            }, reconnectRetry);
         }
 
         int RedisManager::Query(const std::vector<std::string>& arguments, std::any& reply_object, bool reconnectRetry) {
+            return this->Query(arguments, [&reply_object](const RedisReplyView& reply) {
+                ParseReply(reply, reply_object);
+            }, reconnectRetry);
+        }
+
+        int RedisManager::Query(const std::vector<std::string>& arguments, const RedisReplyVisitor& visitor, bool reconnectRetry) {
             DARWIN_LOGGER;
             std::shared_ptr<ThreadData> threadData = this->GetThreadInfo();
             redisReply *reply = nullptr;
@@ -257,13 +316,23 @@ namespace darwin {
                 c_arguments.push_back(argument.c_str());
             }
 
+            threadData->_lastReplyFromReplica = false;
+            if(this->_replicaReads and not arguments.empty() and IsReadOnlyCommand(arguments[0])) {
+                ret = this->QueryReplica(threadData, c_arguments, visitor);
+                if(ret != REDIS_CONNNECTION_ERROR) {
+                    threadData->_lastReplyFromReplica = true;
+                    return ret;
+                }
+                DARWIN_LOG_DEBUG("RedisManager::Query:: no replica available, querying master");
+            }
+
             if(threadData->_redisContext and not threadData->_redisContext->err) {
 
                 SendArgs(threadData->_redisContext, &reply, &c_arguments[0], c_arguments.size());
 
                 if(reply) {
                     std::time(&(threadData->_redisLastUse));
-                    ParseReply(reply, reply_object);
+                    visitor(RedisReplyView(reply));
                     ret = reply->type;
                     freeReplyObject(reply);
                     reply = nullptr;
@@ -297,7 +366,7 @@ namespace darwin {
                             DARWIN_LOG_INFO("RedisManager::Query:: Connected to Master, querying");
                             SendArgs(threadData->_redisContext, &reply, &c_arguments[0], c_arguments.size());
                             if(reply) {
-                                ParseReply(reply, reply_object);
+                                visitor(RedisReplyView(reply));
                                 ret = reply->type;
                                 freeReplyObject(reply);
                             }
@@ -567,6 +636,7 @@ namespace darwin {
                 //assign new master to valid connection (is master only if searchMaster was true)
                 std::swap(this->_activeConnection, connection);
                 DARWIN_LOG_INFO("RedisManager::Discover:: new active connection: " + to_string(this->_activeConnection));
+                this->UpdateServerStates();
             }
             else {
                 DARWIN_LOG_INFO("RedisManager::Discover:: no valid connection found");
@@ -579,6 +649,132 @@ namespace darwin {
         }
 
 
+        int RedisManager::QueryReplica(std::shared_ptr<ThreadData> threadData, std::vector<const char *>& c_arguments, const RedisReplyVisitor& visitor) {
+            DARWIN_LOGGER;
+            RedisConnectionInfo replica;
+            std::shared_ptr<ServerState> replicaState;
+            redisReply *reply = nullptr;
+            int ret = REDIS_CONNNECTION_ERROR;
+
+            {
+                std::lock_guard<std::mutex> lock(this->_availableConnectionsMut);
+                for(const auto& fallback : this->_fallbackList) {
+                    auto state = this->_serverStates.find(fallback);
+                    if(state == this->_serverStates.end() or not state->second->healthy)
+                        continue;
+                    if(not replicaState or state->second->outstanding < replicaState->outstanding) {
+                        replica = fallback;
+                        replicaState = state->second;
+                    }
+                }
+            }
+
+            if(not replicaState)
+                return REDIS_CONNNECTION_ERROR;
+
+            redisContext *&context = threadData->_replicaContexts[replica];
+            if(not context or context->err) {
+                redisFree(context);
+                context = ConnectTo(replica, this->_connectTimeout);
+                if(not context) {
+                    DARWIN_LOG_WARNING("RedisManager::QueryReplica:: could not connect to replica " + to_string(replica));
+                    replicaState->healthy = false;
+                    return REDIS_CONNNECTION_ERROR;
+                }
+            }
+
+            replicaState->outstanding++;
+            SendArgs(context, &reply, &c_arguments[0], c_arguments.size());
+            replicaState->outstanding--;
+
+            if(reply) {
+                visitor(RedisReplyView(reply));
+                ret = reply->type;
+                freeReplyObject(reply);
+            }
+            else {
+                DARWIN_LOG_WARNING("RedisManager::QueryReplica:: could not query replica " + to_string(replica));
+                replicaState->healthy = false;
+                DisconnectContext(&context);
+            }
+
+            return ret;
+        }
+
+
+        void RedisManager::UpdateServerStates() {
+            std::unordered_map<RedisConnectionInfo, std::shared_ptr<ServerState>, RedisConnectionInfo> newStates;
+
+            auto keepState = [this, &newStates](const RedisConnectionInfo& connection) {
+                auto state = this->_serverStates.find(connection);
+                newStates.emplace(connection, state != this->_serverStates.end() ? state->second : std::make_shared<ServerState>());
+            };
+
+            if(this->_activeConnection.isSet())
+                keepState(this->_activeConnection);
+            for(const auto& fallback : this->_fallbackList)
+                keepState(fallback);
+
+            std::swap(this->_serverStates, newStates);
+        }
+
+
+        void RedisManager::HealthCheckMain() {
+            DARWIN_LOGGER;
+            // the health check thread keeps its own connections to every known server
+            std::unordered_map<RedisConnectionInfo, redisContext*, RedisConnectionInfo> contexts;
+            std::vector<std::pair<RedisConnectionInfo, std::shared_ptr<ServerState>>> servers;
+            std::unique_lock<std::mutex> lock(this->_healthCheckMut);
+
+            DARWIN_LOG_DEBUG("RedisManager::HealthCheckMain:: starting shared health checks");
+            while(not this->_healthCheckStop) {
+                lock.unlock();
+                servers.clear();
+                {
+                    std::lock_guard<std::mutex> connectionsLock(this->_availableConnectionsMut);
+                    servers.assign(this->_serverStates.begin(), this->_serverStates.end());
+                }
+
+                for(auto& server : servers) {
+                    redisContext *&context = contexts[server.first];
+                    if(not context or context->err) {
+                        redisFree(context);
+                        context = ConnectTo(server.first, this->_connectTimeout);
+                    }
+
+                    bool healthy = context and SendPing(context);
+                    if(not healthy)
+                        DisconnectContext(&context);
+
+                    if(server.second->healthy.exchange(healthy) != healthy) {
+                        DARWIN_LOG_INFO("RedisManager::HealthCheckMain:: server " + to_string(server.first) +
+                                        (healthy ? " is back up" : " is down"));
+                    }
+                }
+
+                lock.lock();
+                this->_healthCheckCv.wait_for(lock, std::chrono::seconds(this->_healthCheckInterval),
+                                                [this]() { return this->_healthCheckStop; });
+            }
+
+            for(auto& context : contexts) {
+                redisFree(context.second);
+            }
+            DARWIN_LOG_DEBUG("RedisManager::HealthCheckMain:: stopped shared health checks");
+        }
+
+
+        void RedisManager::StopHealthCheckThread() {
+            {
+                std::lock_guard<std::mutex> lock(this->_healthCheckMut);
+                this->_healthCheckStop = true;
+            }
+            this->_healthCheckCv.notify_all();
+            if(this->_healthCheckThread.joinable())
+                this->_healthCheckThread.join();
+        }
+
+
         bool RedisManager::HealthCheck(std::shared_ptr<ThreadData> threadData) {
             DARWIN_LOGGER;
 
@@ -590,6 +786,14 @@ namespace darwin {
             if(not threadData->_redisContext)
                 return false;
 
+            // the shared health check thread already pings the master regularly
+            if(this->_replicaReads and not threadData->_redisContext->err) {
+                std::lock_guard<std::mutex> lock(this->_availableConnectionsMut);
+                auto state = this->_serverStates.find(this->_activeConnection);
+                if(state != this->_serverStates.end() and state->second->healthy)
+                    return true;
+            }
+
             DARWIN_LOG_DEBUG("RedisManager::HealthCheck:: checking health of current connection");
 
             if(SendPing(threadData->_redisContext)) {
@@ -650,40 +854,28 @@ namespace darwin {
         }
 
 
-        void RedisManager::ParseReply(redisReply *reply, std::any& reply_object) {
-            if(not reply) return;
-            DARWIN_LOGGER;
-
-            switch(reply->type) {
-                case REDIS_REPLY_ERROR:
-                    reply_object = std::string(reply->str, reply->len);
-                    DARWIN_LOG_DEBUG("RedisManager::ParseReply:: [string]: " + std::string(reply->str, reply->len));
-                    return;
+        void RedisManager::ParseReply(const RedisReplyView& reply, std::any& reply_object) {
+            switch(reply.Type()) {
                 case REDIS_REPLY_NIL:
                     return;
-                case REDIS_REPLY_STATUS:
-                    reply_object = std::string(reply->str, reply->len);
-                    DARWIN_LOG_DEBUG("RedisManager::ParseReply:: [string]: " + std::string(reply->str, reply->len));
-                    return;
                 case REDIS_REPLY_INTEGER:
-                    reply_object = reply->integer;
-                    DARWIN_LOG_DEBUG("RedisManager::ParseReply:: [integer]: " + std::to_string(reply->integer));
+                    reply_object = reply.Integer();
                     return;
+                case REDIS_REPLY_ERROR:
+                case REDIS_REPLY_STATUS:
                 case REDIS_REPLY_STRING:
-                    reply_object = std::string(reply->str, reply->len);
-                    DARWIN_LOG_DEBUG("RedisManager::ParseReply:: [string]: " + std::string(reply->str, reply->len));
+                    reply_object = std::string(reply.String());
                     return;
             }
 
-            DARWIN_LOG_DEBUG("RedisManager::ParseReply:: [[array]]");
             std::vector<std::any> sub_array;
-            for(size_t i = 0; i < reply->elements; i++) {
+            sub_array.reserve(reply.Size());
+            for(const auto& element : reply) {
                 std::any sub_object;
-                ParseReply(reply->element[i], sub_object);
-                sub_array.push_back(sub_object);
+                ParseReply(element, sub_object);
+                sub_array.push_back(std::move(sub_object));
             }
-            if(not sub_array.empty()) reply_object = sub_array;
-            return;
+            if(not sub_array.empty()) reply_object = std::move(sub_array);
         }
     }
 }
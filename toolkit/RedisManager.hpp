@@ -5,13 +5,18 @@ extern "C" {
 #include <hiredis/hiredis.h>
 }
 
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <vector>
 #include <condition_variable>
+#include <unordered_map>
 #include <unordered_set>
 #include <set>
 #include <any>
+#include <functional>
+#include <iterator>
+#include <string_view>
 #include <ostream>
 #include <sstream>
 
@@ -33,13 +38,80 @@ namespace darwin {
 
     namespace toolkit {
 
-        class ThreadData {
+        /// Read-only, non-owning view on a reply sent by Redis
+        /// Strings are exposed without copy over the hiredis buffer,
+        /// \warning a view (and the string_views it gives) is only valid while the underlying reply is alive,
+        ///     meaning during the visitor call when obtained through RedisManager::Query
+        class RedisReplyView {
         public:
-            ThreadData(){};
+            /// Iterates on the elements of an array reply, as views
+            class const_iterator {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = RedisReplyView;
+                using difference_type = std::ptrdiff_t;
+                using pointer = void;
+                using reference = RedisReplyView;
+
+                explicit const_iterator(redisReply * const *element) : _element(element) {}
+
+                RedisReplyView operator*() const { return RedisReplyView(*_element); }
+                const_iterator& operator++() { ++_element; return *this; }
+                const_iterator operator++(int) { const_iterator tmp = *this; ++_element; return tmp; }
+                bool operator==(const const_iterator& other) const { return _element == other._element; }
+                bool operator!=(const const_iterator& other) const { return _element != other._element; }
+
+            private:
+                redisReply * const *_element;
+            };
+
         public:
-            redisContext* _redisContext = nullptr;
-            time_t _redisLastUse = 0;
-            time_t _lastDiscovery = 0;
+            explicit RedisReplyView(const redisReply *reply) : _reply(reply) {}
+
+            /// \return The reply type in [REDIS_REPLY_STATUS, REDIS_REPLY_ERROR, REDIS_REPLY_INTEGER, REDIS_REPLY_NIL,
+            ///                             REDIS_REPLY_STRING, REDIS_REPLY_ARRAY]
+            int Type() const { return _reply ? _reply->type : REDIS_REPLY_NIL; }
+
+            bool IsString() const { return Type() == REDIS_REPLY_STRING; }
+            bool IsInteger() const { return Type() == REDIS_REPLY_INTEGER; }
+            bool IsArray() const { return Type() == REDIS_REPLY_ARRAY; }
+            bool IsNil() const { return Type() == REDIS_REPLY_NIL; }
+
+            /// \return the content of a string, status or error reply, an empty view for other types
+            std::string_view String() const {
+                switch(Type()) {
+                    case REDIS_REPLY_STRING:
+                    case REDIS_REPLY_STATUS:
+                    case REDIS_REPLY_ERROR:
+                        return std::string_view(_reply->str, _reply->len);
+                    default:
+                        return std::string_view();
+                }
+            }
+
+            /// \return the value of an integer reply, 0 for other types
+            long long int Integer() const { return IsInteger() ? _reply->integer : 0; }
+
+            /// \return the number of elements of an array reply, 0 for other types
+            size_t Size() const { return IsArray() ? _reply->elements : 0; }
+
+            /// \warning no bound checking is done, index must be lower than Size()
+            RedisReplyView operator[](size_t index) const { return RedisReplyView(_reply->element[index]); }
+
+            const_iterator begin() const { return const_iterator(IsArray() ? _reply->element : nullptr); }
+            const_iterator end() const { return const_iterator(IsArray() ? _reply->element + _reply->elements : nullptr); }
+
+        private:
+            const redisReply *_reply;
+        };
+
+        /// Function called with the reply of a query, see RedisManager::Query
+        using RedisReplyVisitor = std::function<void(const RedisReplyView&)>;
+
+        /// State of a known Redis server, shared between all threads
+        struct ServerState {
+            std::atomic<bool> healthy{true}; // updated by the shared health check thread and on query failures
+            std::atomic<unsigned int> outstanding{0}; // number of queries currently sent to the server
         };
 
         struct RedisConnectionInfo {
@@ -81,6 +153,18 @@ namespace darwin {
             }
         };
 
+        class ThreadData {
+        public:
+            ThreadData(){};
+        public:
+            redisContext* _redisContext = nullptr;
+            time_t _redisLastUse = 0;
+            time_t _lastDiscovery = 0;
+            // thread's own connections to replicas, only used when reading from replicas is enabled
+            std::unordered_map<RedisConnectionInfo, redisContext*, RedisConnectionInfo> _replicaContexts;
+            bool _lastReplyFromReplica = false; // whether the last query of the thread was answered by a replica
+        };
+
         inline std::string to_string(const RedisConnectionInfo& connectionInfo)
         {
             std::ostringstream ss;
@@ -130,6 +214,24 @@ namespace darwin {
             /// Sets the timeout used during connections
             void SetTimeoutConnect(const unsigned int timeoutSec);
 
+            /// Enables or disables sending read-only commands (\see IsReadOnlyCommand) to the replicas of the master
+            /// Replicas are chosen among the healthy ones, by least number of outstanding queries,
+            ///     the master is used if none is available. Write commands are always sent to the master.
+            /// When enabled, health checks are done by a single thread for all servers instead of each thread
+            ///     pinging its own connection.
+            /// \warning replicas may lag behind the master, only enable it if slightly outdated reads are acceptable
+            /// \param enable whether to read from replicas
+            void SetReplicaReads(const bool enable);
+
+            /// Tells whether the last query of the calling thread was answered by a replica
+            /// \return true if the reply came from a replica, false if it came from the master
+            bool LastReplyFromReplica();
+
+            /// Tells whether a command only reads data, and can thus be sent to a replica
+            /// \param command the redis command, in uppercase
+            /// \return true if the command is known to be read-only, false otherwise
+            static bool IsReadOnlyCommand(const std::string& command);
+
             /// Sets the _baseConnection internal attribute to use for initial connection attempts and discoveries
             /// \param fullpath the full system path to the unix socket
             void SetUnixConnection(const std::string& fullpath);
@@ -158,6 +260,14 @@ namespace darwin {
             /// \return true if the manager could connect to a redis server, false otherwise
             bool Connect();
 
+            /// Opens a new connection to the current master, not bound to any thread
+            /// Useful for connections with a dedicated usage, like subscriptions
+            /// Will try to discover a new master if the current one cannot be reached
+            /// \warning may change list of known servers and defined main connection
+            /// \warning the caller owns the returned context, and must free it with redisFree()
+            /// \return the new context, or nullptr if no master could be reached
+            redisContext* ConnectDedicated();
+
             /// Disconnects the calling thread from its connected Redis instance
             /// \warning affects thread data
             void Disconnect();
@@ -245,6 +355,21 @@ namespace darwin {
             ///                             REDIS_REPLY_STRING, REDIS_REPLY_ARRAY, REDIS_CONNNECTION_ERROR]
             int Query(const std::vector<std::string>& arguments, std::any& reply_array, bool reconnectRetry = false);
 
+            /// Execute a query in Redis.
+            /// The reply is given to the visitor as a view, allowing to parse it in place without intermediate copies
+            /// \warning affects thread AND instance data
+            /// \warning can invalidate thread's connection in case of error
+            /// \warning if reconnection is triggered, will affect instance's known hosts and thread current connection
+            /// \warning the view is only valid during the visitor's call,
+            ///     and the visitor may be called again with the new reply if the query is retried
+            /// \param arguments the arguments to send to redis
+            /// \param visitor a function called with each reply received from Redis
+            /// \param reconnectRetry in case of connection/insertion error, tries to discover/reconnect to a valid
+            ///         master and retry call
+            /// \return The reply type in [REDIS_REPLY_STATUS, REDIS_REPLY_ERROR, REDIS_REPLY_INTEGER, REDIS_REPLY_NIL,
+            ///                             REDIS_REPLY_STRING, REDIS_REPLY_ARRAY, REDIS_CONNNECTION_ERROR]
+            int Query(const std::vector<std::string>& arguments, const RedisReplyVisitor& visitor, bool reconnectRetry = false);
+
         private:
             /// Internal function to query for thread related data (active connection, etc...)
             std::shared_ptr<ThreadData> GetThreadInfo();
@@ -305,7 +430,28 @@ namespace darwin {
             /// \return true if at least a valid Redis master was found, false otherwise
             bool Discover();
 
+            /// Sends the query to the healthy replica with the least outstanding queries
+            /// \warning affects thread data
+            /// \warning marks the replica unhealthy and closes the thread's connection to it if it doesn't reply
+            /// \param threadData a valid shared pointer on a ThreadData instance
+            /// \param c_arguments the command with arguments to give to the server
+            /// \param visitor the function to call with the reply
+            /// \return The reply type, or REDIS_CONNNECTION_ERROR if no replica could answer
+            int QueryReplica(std::shared_ptr<ThreadData> threadData, std::vector<const char *>& c_arguments, const RedisReplyVisitor& visitor);
+
+            /// Synchronises _serverStates with the master and its replicas, keeping states of already known servers
+            /// \warning _availableConnectionsMut must be held
+            void UpdateServerStates();
+
+            /// Entry point of the shared health check thread
+            /// Pings the master and every replica every health check interval, and updates their ServerState
+            void HealthCheckMain();
+
+            /// Stops and joins the shared health check thread, if running
+            void StopHealthCheckThread();
+
             /// Runs a connection health check if the health check interval exceeds the one set (default 8 seconds)
+            /// When the shared health check thread is running, the master's shared state is used instead of a ping
             /// \param threadData a valid shared pointer on a ThreadData instance
             /// \warning affect thread's data
             /// \warning might invalidate thread's current connection if server doesn't respond
@@ -324,9 +470,9 @@ namespace darwin {
             static void DisconnectContext(redisContext **context);
 
             /// A helper function to parse the redisReply object given by a Redis server
-            /// \param reply a pointer to a valid redisReply to parse
+            /// \param reply a view on a valid reply to parse
             /// \param reply_object a reference to an any object to store the returned data
-            static void ParseReply(redisReply *reply, std::any& reply_object);
+            static void ParseReply(const RedisReplyView& reply, std::any& reply_object);
 
         private:
             time_t _healthCheckInterval = HEALTH_CHECK_INTERVAL; // will execute a HealthCheck if the connection wasn't used for x seconds
@@ -337,6 +483,12 @@ namespace darwin {
             RedisConnectionInfo _baseConnection; // first connection provided (useful to keep unix sockets)
             std::unordered_set<RedisConnectionInfo, RedisConnectionInfo> _fallbackList; // all other possible connections
             std::mutex _availableConnectionsMut; // connections mutex
+            std::atomic<bool> _replicaReads{false}; // whether read-only commands are sent to replicas
+            std::unordered_map<RedisConnectionInfo, std::shared_ptr<ServerState>, RedisConnectionInfo> _serverStates; // master and replicas states (protected by _availableConnectionsMut)
+            std::thread _healthCheckThread; // shared health check thread, only running when reading from replicas
+            bool _healthCheckStop = false; // tells the shared health check thread to stop (protected by _healthCheckMut)
+            std::mutex _healthCheckMut; // shared health check mutex
+            std::condition_variable _healthCheckCv; // used to wake the shared health check thread up when stopping
         };
     }
 }
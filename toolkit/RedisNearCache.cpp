@@ -0,0 +1,405 @@
+/// \file     RedisNearCache.cpp
+/// \version  1.0
+/// \date     18/10/26
+/// \license  GPLv3
+/// \brief    Copyright (c) 2018 Advens. All rights reserved.
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <cerrno>
+#include <functional>
+
+#include "RedisNearCache.hpp"
+#include "RedisManager.hpp"
+#include "base/Logger.hpp"
+
+namespace darwin {
+
+    namespace toolkit {
+
+        RedisNearCache::RedisNearCache(size_t capacity, unsigned int ttl, const std::string &prefix)
+            : _cache(capacity), _ttl(ttl), _prefix(prefix) {}
+
+
+        RedisNearCache::~RedisNearCache() {
+            this->Stop();
+        }
+
+
+        bool RedisNearCache::Start() {
+            DARWIN_LOGGER;
+
+            if(this->_thread.joinable()) {
+                DARWIN_LOG_WARNING("RedisNearCache::Start:: invalidation thread already started");
+                return false;
+            }
+
+            this->_stop = false;
+            try {
+                this->_thread = std::thread(&RedisNearCache::InvalidationMain, this);
+            }
+            catch(const std::system_error &e) {
+                DARWIN_LOG_ERROR("RedisNearCache::Start:: could not start invalidation thread: " + std::string(e.what()));
+                return false;
+            }
+            return true;
+        }
+
+
+        void RedisNearCache::Stop() {
+            {
+                std::lock_guard<std::mutex> lock(this->_contextMutex);
+                this->_stop = true;
+                // unblock the thread waiting for notifications
+                if(this->_subscribeContext)
+                    shutdown(this->_subscribeContext->fd, SHUT_RDWR);
+            }
+            this->_stopCv.notify_all();
+
+            if(this->_thread.joinable())
+                this->_thread.join();
+        }
+
+
+        bool RedisNearCache::Get(const std::string &key, std::string &value, bool &exists) {
+            if(not this->_active) {
+                this->_misses++;
+                return false;
+            }
+
+            std::lock_guard<std::mutex> lock(this->_cacheMutex);
+            auto entry = this->_cache.get(key);
+
+            if(not entry or entry->expiry < std::chrono::steady_clock::now()) {
+                this->_misses++;
+                return false;
+            }
+
+            this->_hits++;
+            exists = entry->value.is_initialized();
+            if(exists)
+                value = *(entry->value);
+            return true;
+        }
+
+
+        uint64_t RedisNearCache::GetEpoch(const std::string &key) const {
+            const std::size_t bucket = std::hash<std::string>{}(key) % EPOCH_BUCKETS;
+            return this->_clearEpoch.load() + this->_keyEpochs[bucket].load();
+        }
+
+
+        std::atomic_uint_fast64_t &RedisNearCache::KeyEpoch(const std::string &key) {
+            return this->_keyEpochs[std::hash<std::string>{}(key) % EPOCH_BUCKETS];
+        }
+
+
+        void RedisNearCache::Insert(const std::string &key, const boost::optional<std::string> &value, uint64_t epoch) {
+            // invalidations are only received for the keys with the prefix
+            if(not this->_active or key.compare(0, this->_prefix.size(), this->_prefix) != 0)
+                return;
+
+            std::lock_guard<std::mutex> lock(this->_cacheMutex);
+            // the reply may be older than an invalidation received meanwhile
+            if(this->GetEpoch(key) != epoch)
+                return;
+            // lru_cache doesn't replace existing (expired) entries
+            const auto now = std::chrono::steady_clock::now();
+            this->_cache.erase(key);
+            this->_cache.insert(key, Entry{value, now + this->_ttl, now});
+        }
+
+
+        bool RedisNearCache::RefreshDue(const std::string &key, std::chrono::seconds interval) {
+            std::lock_guard<std::mutex> lock(this->_cacheMutex);
+            Entry *entry = this->_cache.peek(key);
+            const auto now = std::chrono::steady_clock::now();
+
+            if(not entry or now - entry->refreshed < interval)
+                return false;
+            entry->refreshed = now;
+            return true;
+        }
+
+
+        void RedisNearCache::Invalidate(const std::string &key) {
+            std::lock_guard<std::mutex> lock(this->_cacheMutex);
+            this->KeyEpoch(key)++;
+            this->_cache.erase(key);
+            this->_invalidations++;
+        }
+
+
+        void RedisNearCache::Clear() {
+            std::lock_guard<std::mutex> lock(this->_cacheMutex);
+            this->_clearEpoch++;
+            this->_cache.clear();
+        }
+
+
+        std::string RedisNearCache::GetStats() {
+            size_t size;
+            {
+                std::lock_guard<std::mutex> lock(this->_cacheMutex);
+                size = this->_cache.size();
+            }
+
+            return "{\"hits\": " + std::to_string(this->_hits)
+                    + ", \"misses\": " + std::to_string(this->_misses)
+                    + ", \"invalidations\": " + std::to_string(this->_invalidations)
+                    + ", \"size\": " + std::to_string(size) + "}";
+        }
+
+
+        void RedisNearCache::InvalidationMain() {
+            DARWIN_LOGGER;
+            RedisManager& redis = RedisManager::GetInstance();
+
+            while(not this->_stop) {
+                bool subscribed = false;
+                redisContext *context = redis.ConnectDedicated();
+
+                if(context) {
+                    // notifications may not come for a long time, wait for them without timeout
+                    redisSetTimeout(context, timeval{0, 0});
+                    {
+                        std::lock_guard<std::mutex> lock(this->_contextMutex);
+                        if(this->_stop) {
+                            redisFree(context);
+                            break;
+                        }
+                        this->_subscribeContext = context;
+                    }
+                    subscribed = this->SubscribeTracking(context) or this->SubscribeKeyspace(context);
+                }
+
+                if(subscribed) {
+                    // notifications may have been missed while disconnected
+                    this->Clear();
+                    this->_active = true;
+
+                    this->ReceiveMessages(context);
+
+                    this->_active = false;
+                    if(not this->_stop)
+                        DARWIN_LOG_WARNING("RedisNearCache::InvalidationMain:: lost connection to redis, "
+                                            "disabling cache until reconnected");
+                }
+                else if(not this->_stop) {
+                    DARWIN_LOG_WARNING("RedisNearCache::InvalidationMain:: could not subscribe to invalidations, "
+                                        "retrying in " + std::to_string(RECONNECT_INTERVAL) + "s");
+                }
+
+                this->Clear();
+                this->CloseContexts();
+
+                std::unique_lock<std::mutex> lock(this->_contextMutex);
+                this->_stopCv.wait_for(lock, std::chrono::seconds(RECONNECT_INTERVAL), [this]{ return this->_stop.load(); });
+            }
+
+            this->CloseContexts();
+        }
+
+
+        void RedisNearCache::ReceiveMessages(redisContext *context) {
+            redisReply *reply = nullptr;
+
+            while(not this->_stop) {
+                if(redisGetReplyFromReader(context, (void **)&reply) != REDIS_OK)
+                    return;
+
+                if(reply) {
+                    this->HandleMessage(reply);
+                    freeReplyObject(reply);
+                    reply = nullptr;
+                    continue;
+                }
+
+                // nothing buffered, wait for the socket (shut down by Stop)
+                pollfd pfd{context->fd, POLLIN, 0};
+                int ready = poll(&pfd, 1, TRACKING_CHECK_INTERVAL * 1000);
+
+                if(ready < 0) {
+                    if(errno == EINTR)
+                        continue;
+                    return;
+                }
+                if(ready == 0) {
+                    if(not this->CheckTracking())
+                        return;
+                    continue;
+                }
+                if(redisBufferRead(context) != REDIS_OK)
+                    return;
+            }
+        }
+
+
+        bool RedisNearCache::CheckTracking() {
+            DARWIN_LOGGER;
+            std::lock_guard<std::mutex> lock(this->_contextMutex);
+
+            // keyspace notifications come on the subscription connection itself
+            if(not this->_trackingContext)
+                return true;
+
+            redisReply *reply = (redisReply *)redisCommand(this->_trackingContext, "PING");
+            bool alive = reply and reply->type == REDIS_REPLY_STATUS;
+
+            freeReplyObject(reply);
+            if(not alive)
+                DARWIN_LOG_WARNING("RedisNearCache::CheckTracking:: lost the connection owning the client tracking");
+            return alive;
+        }
+
+
+        bool RedisNearCache::SubscribeTracking(redisContext *context) {
+            DARWIN_LOGGER;
+            long long int clientId;
+            redisContext *tracking = nullptr;
+            redisReply *reply = nullptr;
+
+            reply = (redisReply *)redisCommand(context, "CLIENT ID");
+            if(not reply or reply->type != REDIS_REPLY_INTEGER) {
+                DARWIN_LOG_INFO("RedisNearCache::SubscribeTracking:: client tracking not supported by server");
+                freeReplyObject(reply);
+                return false;
+            }
+            clientId = reply->integer;
+            freeReplyObject(reply);
+
+            tracking = RedisManager::GetInstance().ConnectDedicated();
+            if(not tracking)
+                return false;
+
+            // BCAST: notified for every key with the prefix modified on the server, no need to track each read key
+            if(this->_prefix.empty())
+                reply = (redisReply *)redisCommand(tracking, "CLIENT TRACKING on REDIRECT %lld BCAST", clientId);
+            else
+                reply = (redisReply *)redisCommand(tracking, "CLIENT TRACKING on REDIRECT %lld BCAST PREFIX %b",
+                                                   clientId, this->_prefix.data(), this->_prefix.size());
+            if(not reply or reply->type != REDIS_REPLY_STATUS) {
+                DARWIN_LOG_INFO("RedisNearCache::SubscribeTracking:: client tracking not supported by server");
+                freeReplyObject(reply);
+                redisFree(tracking);
+                return false;
+            }
+            freeReplyObject(reply);
+
+            {
+                std::lock_guard<std::mutex> lock(this->_contextMutex);
+                this->_trackingContext = tracking;
+            }
+
+            reply = (redisReply *)redisCommand(context, "SUBSCRIBE __redis__:invalidate");
+            if(not reply or reply->type != REDIS_REPLY_ARRAY) {
+                DARWIN_LOG_WARNING("RedisNearCache::SubscribeTracking:: could not subscribe to invalidation channel");
+                freeReplyObject(reply);
+                return false;
+            }
+            freeReplyObject(reply);
+
+            DARWIN_LOG_INFO("RedisNearCache::SubscribeTracking:: receiving invalidations through client tracking");
+            return true;
+        }
+
+
+        bool RedisNearCache::SubscribeKeyspace(redisContext *context) {
+            DARWIN_LOGGER;
+            redisReply *reply = nullptr;
+            std::string events;
+
+            if(context->err)
+                return false;
+
+            // without these notifications, modified or expired keys would be served until their TTL
+            reply = (redisReply *)redisCommand(context, "CONFIG GET notify-keyspace-events");
+            if(not reply or reply->type != REDIS_REPLY_ARRAY or reply->elements != 2
+               or reply->element[1]->type != REDIS_REPLY_STRING) {
+                DARWIN_LOG_WARNING("RedisNearCache::SubscribeKeyspace:: could not get 'notify-keyspace-events' "
+                                   "from the server, cannot check keyspace notifications are enabled");
+                freeReplyObject(reply);
+                return false;
+            }
+            events.assign(reply->element[1]->str, reply->element[1]->len);
+            freeReplyObject(reply);
+
+            auto has = [&events](char event) { return events.find(event) != std::string::npos; };
+            if(not has('K') or not (has('A') or (has('$') and has('g') and has('x')))) {
+                DARWIN_LOG_WARNING("RedisNearCache::SubscribeKeyspace:: 'notify-keyspace-events' is '" + events + "' "
+                                   "on the server, it must contain at least 'K$gx' to enable the near cache");
+                return false;
+            }
+
+            std::string pattern = "__keyspace@*__:";
+            for(const char c : this->_prefix) {
+                if(c == '*' or c == '?' or c == '[' or c == ']' or c == '\\')
+                    pattern += '\\';
+                pattern += c;
+            }
+            pattern += '*';
+
+            reply = (redisReply *)redisCommand(context, "PSUBSCRIBE %b", pattern.data(), pattern.size());
+            if(not reply or reply->type != REDIS_REPLY_ARRAY) {
+                DARWIN_LOG_WARNING("RedisNearCache::SubscribeKeyspace:: could not subscribe to keyspace notifications");
+                freeReplyObject(reply);
+                return false;
+            }
+            freeReplyObject(reply);
+
+            DARWIN_LOG_INFO("RedisNearCache::SubscribeKeyspace:: receiving invalidations through keyspace notifications");
+            return true;
+        }
+
+
+        void RedisNearCache::HandleMessage(const redisReply *reply) {
+            DARWIN_LOGGER;
+
+            if(reply->type != REDIS_REPLY_ARRAY or reply->elements < 3 or reply->element[0]->type != REDIS_REPLY_STRING)
+                return;
+
+            const std::string kind(reply->element[0]->str, reply->element[0]->len);
+
+            // client tracking: ["message", "__redis__:invalidate", [keys...] or nil to flush everything]
+            if(kind == "message") {
+                const redisReply *keys = reply->element[2];
+                if(keys->type == REDIS_REPLY_NIL) {
+                    DARWIN_LOG_DEBUG("RedisNearCache::HandleMessage:: flush notified, clearing cache");
+                    this->Clear();
+                }
+                else if(keys->type == REDIS_REPLY_ARRAY) {
+                    for(size_t i = 0; i < keys->elements; i++) {
+                        if(keys->element[i]->type == REDIS_REPLY_STRING)
+                            this->Invalidate(std::string(keys->element[i]->str, keys->element[i]->len));
+                    }
+                }
+            }
+            // keyspace notifications: ["pmessage", pattern, "__keyspace@<db>__:<key>", event]
+            else if(kind == "pmessage" and reply->elements == 4) {
+                const std::string channel(reply->element[2]->str, reply->element[2]->len);
+                const std::string event(reply->element[3]->str, reply->element[3]->len);
+                std::size_t pos = channel.find("__:");
+
+                // a new expiration doesn't change the value
+                if(pos == std::string::npos or event == "expire" or event == "persist")
+                    return;
+                this->Invalidate(channel.substr(pos + 3));
+            }
+        }
+
+
+        void RedisNearCache::CloseContexts() {
+            std::lock_guard<std::mutex> lock(this->_contextMutex);
+
+            if(this->_subscribeContext) {
+                redisFree(this->_subscribeContext);
+                this->_subscribeContext = nullptr;
+            }
+            if(this->_trackingContext) {
+                redisFree(this->_trackingContext);
+                this->_trackingContext = nullptr;
+            }
+        }
+
+    }
+}
@@ -0,0 +1,163 @@
+/// \file     RedisNearCache.hpp
+/// \version  1.0
+/// \date     18/10/26
+/// \license  GPLv3
+/// \brief    Copyright (c) 2018 Advens. All rights reserved.
+
+#pragma once
+
+extern "C" {
+#include <hiredis/hiredis.h>
+}
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <boost/optional.hpp>
+
+#include "lru_cache.hpp"
+
+namespace darwin {
+
+    namespace toolkit {
+
+        /// Local cache of Redis string keys, shared between all the threads of a filter
+        /// Both existing keys and missing keys (negative entries) are cached, for at most _ttl seconds.
+        /// Only the keys starting with the prefix given at construction are cached, other keys are not invalidated.
+        /// A dedicated thread keeps the cache coherent with the server:
+        ///     - on Redis >= 6, using client side caching in broadcasting mode (CLIENT TRACKING ... BCAST PREFIX),
+        ///         the notifications being redirected to a subscribed connection
+        ///     - on older servers, using keyspace notifications. The cache stays disabled unless
+        ///         'notify-keyspace-events' contains at least 'K$gx' (or 'KA') on the server
+        /// The whole cache is flushed each time the invalidation connection is (re)established,
+        /// as notifications may have been missed in between, and the cache is disabled while it is down.
+        /// The tracking connection is checked regularly, invalidations stop silently if it dies.
+        /// An invalidation received while a key is being queried prevents the reply from being cached,
+        /// see GetEpoch.
+        class RedisNearCache {
+        public:
+            // default values
+            static constexpr unsigned int DEFAULT_TTL = 5; // seconds
+            static constexpr unsigned int RECONNECT_INTERVAL = 5; // seconds between 2 invalidation connection attempts
+            static constexpr unsigned int TRACKING_CHECK_INTERVAL = 1; // seconds without notification before checking tracking
+
+        public:
+            /// \param capacity the maximum number of keys kept, least recently used keys being evicted first
+            /// \param ttl the maximum time in seconds an entry is considered valid
+            /// \param prefix the prefix of the keys to cache and to be notified for, empty for all the keys
+            RedisNearCache(size_t capacity, unsigned int ttl, const std::string &prefix = "");
+            ~RedisNearCache();
+
+            RedisNearCache(const RedisNearCache&) = delete;
+            RedisNearCache& operator=(const RedisNearCache&) = delete;
+
+        public:
+            /// Starts the invalidation thread, uses the RedisManager singleton to find the server
+            /// \return true if the thread was started, false otherwise
+            bool Start();
+
+            /// Stops the invalidation thread
+            void Stop();
+
+            /// Looks for a valid entry in the cache
+            /// \param key the redis key
+            /// \param value will hold the value of the key, if it exists
+            /// \param exists will tell whether the key existed in Redis
+            /// \return true on cache hit, false if key must be queried from Redis
+            bool Get(const std::string &key, std::string &value, bool &exists);
+
+            /// Gets the invalidation epoch of a key, to take before querying it
+            /// \param key the redis key
+            /// \return a value changing each time the key may have been invalidated
+            uint64_t GetEpoch(const std::string &key) const;
+
+            /// Caches the result of a GET query, unless the key was invalidated since the query was sent
+            /// or doesn't start with the prefix
+            /// \param key the redis key
+            /// \param value the value of the key, boost::none if the key doesn't exist
+            /// \param epoch the epoch of the key taken before sending the query
+            void Insert(const std::string &key, const boost::optional<std::string> &value, uint64_t epoch);
+
+            /// Tells whether a key served from the cache is due for a refresh on the server (e.g. its expiration),
+            /// at most once every interval. The insertion counts as a refresh.
+            /// \param key the redis key
+            /// \param interval the minimum time between two refreshes
+            /// \return true if the key is cached and wasn't refreshed for interval, false otherwise
+            bool RefreshDue(const std::string &key, std::chrono::seconds interval);
+
+            /// Removes a key from the cache
+            void Invalidate(const std::string &key);
+
+            /// Removes all keys from the cache
+            void Clear();
+
+            /// Get the statistics of the cache
+            /// \return a JSON object with the hits, misses, invalidations and current size of the cache
+            std::string GetStats();
+
+        private:
+            struct Entry {
+                boost::optional<std::string> value;
+                std::chrono::steady_clock::time_point expiry;
+                std::chrono::steady_clock::time_point refreshed;
+            };
+
+            /// Main loop of the invalidation thread: (re)connects and handles notifications until stopped
+            void InvalidationMain();
+
+            /// Subscribes to invalidation messages using client tracking, sets _trackingContext on success
+            /// \param context the connection to receive the invalidation messages on
+            /// \return true on success, false if the server doesn't support client tracking
+            bool SubscribeTracking(redisContext *context);
+
+            /// Subscribes to keyspace notifications, if they are enabled on the server
+            /// \param context the connection to receive the notifications on
+            /// \return true on success, false otherwise
+            bool SubscribeKeyspace(redisContext *context);
+
+            /// Waits for the messages of the subscription connection, checking the tracking connection meanwhile
+            void ReceiveMessages(redisContext *context);
+
+            /// Checks the connection owning the tracking is still alive
+            /// \return true if it is alive or if keyspace notifications are used, false otherwise
+            bool CheckTracking();
+
+            /// Applies a message received on the subscription connection
+            void HandleMessage(const redisReply *reply);
+
+            /// Gets the bucket of the invalidation epochs of a key
+            std::atomic_uint_fast64_t &KeyEpoch(const std::string &key);
+
+            /// Closes the connections used by the invalidation thread
+            void CloseContexts();
+
+        private:
+            boost::compute::detail::lru_cache<std::string, Entry> _cache;
+            std::mutex _cacheMutex;
+            std::chrono::seconds _ttl;
+            std::string _prefix;
+            // disabled while invalidations can't be received
+            std::atomic<bool> _active{false};
+            // epochs of the keys, hashed in buckets, and of the whole cache: the epoch of a key is the sum of both
+            static constexpr std::size_t EPOCH_BUCKETS = 4096;
+            std::array<std::atomic_uint_fast64_t, EPOCH_BUCKETS> _keyEpochs{};
+            std::atomic_uint_fast64_t _clearEpoch{0};
+
+            std::thread _thread;
+            std::atomic<bool> _stop{false};
+            std::mutex _contextMutex; // protects the contexts and the stop condition
+            std::condition_variable _stopCv;
+            redisContext *_subscribeContext = nullptr; // receives the notifications
+            redisContext *_trackingContext = nullptr; // owns the tracking (Redis >= 6 only)
+
+            std::atomic_uint_fast64_t _hits{0};
+            std::atomic_uint_fast64_t _misses{0};
+            std::atomic_uint_fast64_t _invalidations{0};
+        };
+
+    }
+}
@@ -18,13 +18,12 @@ namespace darwin {
             DARWIN_LOGGER;
 
             // Regex taken from https://validators.readthedocs.io/en/latest/_modules/validators/domain.html#domain
-            std::regex domain_regex = std::regex(
+            // Compiled once, matching against a const regex is thread safe
+            static const std::regex domain_regex = std::regex(
                     R"(^(([a-zA-Z]{1})|([a-zA-Z]{1}[a-zA-Z]{1})|([a-zA-Z]{1}[0-9]{1})|([0-9]{1}[a-zA-Z]{1})|([a-zA-Z0-9][-_.a-zA-Z0-9]{0,61}[a-zA-Z0-9]))\.([a-zA-Z]{2,13}|[a-zA-Z0-9-]{2,30}.[a-zA-Z]{2,3})$)"
             );
 
-            std::smatch match;
-
-            bool is_valid = std::regex_search(domain.begin(), domain.end(), match, domain_regex);
+            bool is_valid = std::regex_search(domain.begin(), domain.end(), domain_regex);
 
             if (is_valid) {
                 DARWIN_LOG_DEBUG("The domain '" + domain + "' is valid");
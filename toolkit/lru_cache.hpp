@@ -119,6 +119,26 @@ public:
         }
     }
 
+    // returns the stored value without updating its place in the most
+    // recently used list, or NULL if not in cache
+    value_type *peek(const key_type &key)
+    {
+        typename map_type::iterator i = m_map.find(key);
+        if(i == m_map.end()){
+            return NULL;
+        }
+        return &i->second.first;
+    }
+
+    void erase(const key_type &key)
+    {
+        typename map_type::iterator i = m_map.find(key);
+        if(i != m_map.end()){
+            m_list.erase(i->second.second);
+            m_map.erase(i);
+        }
+    }
+
     void clear()
     {
         m_map.clear();